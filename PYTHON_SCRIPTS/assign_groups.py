@@ -1,3 +1,4 @@
+#optional tool: the GA deals the training genes into its first generation itself with GM_INIT=groups (see ga_init in gm_routine.c)
 
 #moves the labels column to be the firsts column of the dataframe
 #sorts the dataframe by the labels column
@@ -1,3 +1,4 @@
+#optional tool: the GA splits the dataset itself, stratified and seeded, without writing copies (see init_split in gm_init.c)
 #input is a file path
 #data is split 90% training and 10% testing
 
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_creature.h"
+#include "../gm_bitset.h"
+
+//the creature forms (gm_bitset.h, creature_to_bitset): every popcount kernel is checked against
+//the portable one and timed in GB/s of bitset read, then "is gene g in this creature" is timed for
+//the plain index array (linear scan), the sorted form (binary search) and the bitset
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define MIN_SECONDS 0.2
+#define NUM_GENES 1000000
+#define PROBES 4096
+
+static const int creature_sizes[] = {10, 100, 1000, 10000};
+#define NUM_CREATURE_SIZES ((int)(sizeof(creature_sizes) / sizeof(creature_sizes[0])))
+
+typedef struct kernel_t {
+    const char* name;
+    bitset_count_kernel_t kernel;
+    int supported;
+} kernel_t;
+
+//a linear scan of an unsorted creature
+static int contains_linear(const Creature* creature, int gene) {
+    for (int i = 0; i < creature->num_genes; i++) {
+        if (creature->gene_indices[i] == gene) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    bitset_init();
+    printf("selected popcount kernel: %s\n\n", bitset_kernel_name());
+
+    __builtin_cpu_init();
+    kernel_t kernels[] = {
+        {"scalar", bitset_and_count_scalar, 1},
+        {"popcnt", bitset_and_count_popcnt, __builtin_cpu_supports("popcnt")},
+        {"avx2", bitset_and_count_avx2, __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("avx2")},
+        {"avx512", bitset_and_count_avx512, __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")},
+    };
+    int num_kernels = (int)(sizeof(kernels) / sizeof(kernels[0]));
+
+    int words = bitset_words(NUM_GENES);
+    uint64_t* a = (uint64_t*)malloc(words * sizeof(uint64_t));
+    uint64_t* b = (uint64_t*)malloc(words * sizeof(uint64_t));
+    srand(7);
+    for (int w = 0; w < words; w++) {
+        a[w] = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+        b[w] = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+    }
+
+    printf("%-8s %12s %10s\n", "kernel", "and+count", "GB/s");
+    uint64_t reference = bitset_and_count_scalar(a, b, words);
+    int failed = 0;
+    for (int k = 0; k < num_kernels; k++) {
+        if (!kernels[k].supported) {
+            printf("%-8s %12s %10s\n", kernels[k].name, "n/a", "n/a");
+            continue;
+        }
+        //odd lengths exercise the tails
+        for (int length = 0; length < 40; length++) {
+            if (kernels[k].kernel(a, b, length) != bitset_and_count_scalar(a, b, length)) {
+                failed = 1;
+            }
+        }
+        uint64_t count = 0;
+        int runs = 0;
+        double start = omp_get_wtime();
+        do {
+            count = kernels[k].kernel(a, b, words);
+            runs++;
+        } while (omp_get_wtime() - start < MIN_SECONDS);
+        double seconds = (omp_get_wtime() - start) / runs;
+        failed |= count != reference;
+        printf("%-8s %12llu %10.2f\n", kernels[k].name, (unsigned long long)count, 2.0 * words * sizeof(uint64_t) / seconds / 1e9);
+    }
+
+    printf("\n%-10s %14s %14s %14s\n", "creature", "linear ns", "sorted ns", "bitset ns");
+    int* probes = (int*)malloc(PROBES * sizeof(int));
+    uint64_t* bits = (uint64_t*)malloc(words * sizeof(uint64_t));
+    for (int s = 0; s < NUM_CREATURE_SIZES; s++) {
+        Creature creature = {NULL, 0};
+        creature_set(&creature, creature_sizes[s]);
+        for (int i = 0; i < creature.num_genes; i++) {
+            creature.gene_indices[i] = rand() % NUM_GENES;
+        }
+        //half the probes are members
+        for (int p = 0; p < PROBES; p++) {
+            probes[p] = p % 2 ? creature.gene_indices[rand() % creature.num_genes] : rand() % NUM_GENES;
+        }
+
+        Creature sorted = {NULL, 0};
+        creature_set(&sorted, creature.num_genes);
+        memcpy(sorted.gene_indices, creature.gene_indices, creature.num_genes * sizeof(int));
+        creature_sort(&sorted);
+        creature_to_bitset(&creature, bits, words);
+
+        double times[3];
+        int found[3] = {0, 0, 0};
+        for (int form = 0; form < 3; form++) {
+            int runs = 0;
+            double start = omp_get_wtime();
+            do {
+                int hits = 0;
+                for (int p = 0; p < PROBES; p++) {
+                    hits += form == 0 ? contains_linear(&creature, probes[p]) : form == 1 ? creature_contains_sorted(&sorted, probes[p]) : bitset_test(bits, probes[p]);
+                }
+                found[form] = hits;
+                runs++;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+            times[form] = (omp_get_wtime() - start) * 1e9 / runs / PROBES;
+        }
+        failed |= found[0] != found[1] || found[0] != found[2];
+        printf("%-10d %14.2f %14.2f %14.2f\n", creature.num_genes, times[0], times[1], times[2]);
+
+        free(creature.gene_indices);
+        free(sorted.gene_indices);
+    }
+
+    free(a);
+    free(b);
+    free(bits);
+    free(probes);
+    if (failed) {
+        printf("\nA kernel or a creature form disagrees with the reference\n");
+        return 1;
+    }
+    return 0;
+}
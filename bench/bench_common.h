@@ -0,0 +1,52 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdlib.h>
+#include <omp.h>
+
+#include "../gm_KNN.h"
+#include "../gm_search.h"
+
+//timing loops shared by the benchmarks, their synthetic fixtures come from gm_generate
+
+//a timed loop repeats until at least this long has passed
+#define BENCH_MIN_SECONDS 0.2
+
+
+//O(runs * q * search)
+/**
+ * Runs every query through a search on all threads, over and over for at
+ * least BENCH_MIN_SECONDS.
+ *
+ * @param search The search to time.
+ * @param queries The global indices of the queries.
+ * @param num_queries The number of queries.
+ * @param members The global indices of the genes searched.
+ * @param num_members The number of members.
+ * @param k The number of neighbors per query.
+ * @param neighbors Output, the k neighbors of every query (num_queries * k).
+ * @return The queries per second.
+ */
+static inline double bench_search_qps(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors) {
+    int runs = 0;
+    double start = omp_get_wtime();
+    double elapsed;
+    do {
+        #pragma omp parallel
+        {
+            search_scratch_t scratch;
+            search_scratch_init(&scratch);
+            #pragma omp for schedule(dynamic)
+            for (int first = 0; first < num_queries; first += BATCH_QUERY_BLOCK) {
+                int count = num_queries - first < BATCH_QUERY_BLOCK ? num_queries - first : BATCH_QUERY_BLOCK;
+                search_knn(search, queries + first, count, members, num_members, k, neighbors + (size_t)first * k, &scratch);
+            }
+            search_scratch_free(&scratch);
+        }
+        runs++;
+        elapsed = omp_get_wtime() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return (double)num_queries * runs / elapsed;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../gm_distance.h"
+#include "../gm_dataset.h"
+#include "../gm_half.h"
+
+//microbenchmark for the squared distance kernels, the float ones and those of the reduced precision
+//storage modes. every kernel is first checked against a reference computed in double (on the decoded
+//values for the storage kernels), then timed on one query against a block of rows (about 1MB of
+//features so it sits in L2) and reported in GFLOP/s (3 flops per feature: sub, mul, add). the odd
+//widths leave a tail after the last full vector
+
+#define TOLERANCE 1e-4
+#define MIN_SECONDS 0.2
+
+static const int widths[] = {1, 4, 13, 64, 100, 784, 4096};
+#define NUM_WIDTHS ((int)(sizeof(widths) / sizeof(widths[0])))
+
+//the storage kernels, one of the three kinds of distance_sq_rows
+typedef enum storage_kind_t {
+    KIND_HALF,
+    KIND_U8_WEIGHTED,
+    KIND_U8
+} storage_kind_t;
+
+typedef struct storage_kernel_t {
+    const char* name;
+    storage_kind_t kind;
+    //the rows it reads, 1 for bfloat16 (KIND_HALF only)
+    int bf16;
+    distance_half_kernel_t half;
+    distance_u8_weighted_kernel_t weighted;
+    distance_u8_kernel_t u8;
+    int supported;
+} storage_kernel_t;
+
+
+//O(length)
+//runs a storage kernel on row r of the compact rows against the compact query
+static double storage_distance(const storage_kernel_t* kernel, const uint16_t* halves, const uint16_t* bhalves, const uint8_t* codes, const float* weights, int stride, int r, int length) {
+    switch (kernel->kind) {
+        case KIND_HALF: {
+            const uint16_t* rows = kernel->bf16 ? bhalves : halves;
+            return kernel->half(rows + (size_t)(r + 1) * stride, rows, length);
+        }
+        case KIND_U8_WEIGHTED:
+            return kernel->weighted(codes + (size_t)(r + 1) * stride, codes, weights, length);
+        default:
+            return kernel->u8(codes + (size_t)(r + 1) * stride, codes, length);
+    }
+}
+
+
+//O(length)
+//the distance of a storage kernel computed in double on the decoded values
+static double storage_reference(const storage_kernel_t* kernel, const uint16_t* halves, const uint16_t* bhalves, const uint8_t* codes, const float* weights, int stride, int r, int length) {
+    double reference = 0;
+    for (int i = 0; i < length; i++) {
+        size_t at = (size_t)(r + 1) * stride + i;
+        double diff;
+        if (kernel->kind == KIND_HALF) {
+            diff = kernel->bf16 ? (double)bfloat16_to_float(bhalves[at]) - bfloat16_to_float(bhalves[i]) : (double)half_to_float(halves[at]) - half_to_float(halves[i]);
+        } else {
+            diff = (double)codes[at] - codes[i];
+        }
+        reference += (kernel->kind == KIND_U8_WEIGHTED ? weights[i] : 1.0) * diff * diff;
+    }
+    return reference;
+}
+
+int main() {
+    distance_init();
+    printf("selected kernel: %s\n\n", distance_kernel_name());
+
+    int num_kernels;
+    const distance_kernel_info_t* kernels = distance_kernels(&num_kernels);
+
+    printf("%-8s %6s %12s %12s\n", "kernel", "width", "GFLOP/s", "max rel err");
+    int failed = 0;
+
+    for (int w = 0; w < NUM_WIDTHS; w++) {
+        int width = widths[w];
+        int stride = dataset_padded_width(width);
+        int num_rows = (256 * 1024) / stride;
+        if (num_rows < 16) {
+            num_rows = 16;
+        }
+
+        float* rows = (float*)aligned_alloc(DATASET_ALIGNMENT, (size_t)num_rows * stride * sizeof(float));
+        float* query = (float*)aligned_alloc(DATASET_ALIGNMENT, stride * sizeof(float));
+        if (rows == NULL || query == NULL) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            return 1;
+        }
+
+        srand(width);
+        for (size_t i = 0; i < (size_t)num_rows * stride; i++) {
+            rows[i] = (float)rand() / RAND_MAX;
+        }
+        for (int i = 0; i < stride; i++) {
+            query[i] = (float)rand() / RAND_MAX;
+        }
+
+        for (int k = 0; k < num_kernels; k++) {
+            if (!kernels[k].supported) {
+                printf("%-8s %6d %12s %12s\n", kernels[k].name, width, "n/a", "n/a");
+                continue;
+            }
+
+            //agreement with the scalar reference (computed in double to bound its own error)
+            double max_error = 0;
+            for (int r = 0; r < num_rows; r++) {
+                double reference = 0;
+                for (int i = 0; i < width; i++) {
+                    double diff = (double)query[i] - rows[(size_t)r * stride + i];
+                    reference += diff * diff;
+                }
+                double error = fabs(kernels[k].kernel(query, rows + (size_t)r * stride, width) - reference) / (reference + 1e-12);
+                if (error > max_error) {
+                    max_error = error;
+                }
+            }
+            if (max_error > TOLERANCE) {
+                failed = 1;
+            }
+
+            //timing
+            volatile float sink = 0;
+            long long num_distances = 0;
+            double start = omp_get_wtime();
+            double elapsed = 0;
+            while (elapsed < MIN_SECONDS) {
+                float sum = 0;
+                for (int r = 0; r < num_rows; r++) {
+                    sum += kernels[k].kernel(query, rows + (size_t)r * stride, width);
+                }
+                sink += sum;
+                num_distances += num_rows;
+                elapsed = omp_get_wtime() - start;
+            }
+            (void)sink;
+
+            double gflops = 3.0 * width * num_distances / elapsed / 1e9;
+            printf("%-8s %6d %12.2f %12.2e%s\n", kernels[k].name, width, gflops, max_error, max_error > TOLERANCE ? "  MISMATCH" : "");
+        }
+
+        free(rows);
+        free(query);
+    }
+
+    //the storage kernels, on the same kind of rows stored as halves, bfloat16 and 8 bit codes
+    int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    int avx512 = __builtin_cpu_supports("avx512f");
+    int avx512bw = avx512 && __builtin_cpu_supports("avx512bw");
+    storage_kernel_t storage_kernels[] = {
+        {"f16-scalar", KIND_HALF, 0, distance_sq_f16_scalar, NULL, NULL, 1},
+        {"f16-avx2", KIND_HALF, 0, distance_sq_f16_avx2, NULL, NULL, avx2 && __builtin_cpu_supports("f16c")},
+        {"f16-avx512", KIND_HALF, 0, distance_sq_f16_avx512, NULL, NULL, avx512},
+        {"bf16-scalar", KIND_HALF, 1, distance_sq_bf16_scalar, NULL, NULL, 1},
+        {"bf16-avx2", KIND_HALF, 1, distance_sq_bf16_avx2, NULL, NULL, avx2},
+        {"bf16-avx512", KIND_HALF, 1, distance_sq_bf16_avx512, NULL, NULL, avx512},
+        {"u8w-scalar", KIND_U8_WEIGHTED, 0, NULL, distance_sq_u8_weighted_scalar, NULL, 1},
+        {"u8w-avx2", KIND_U8_WEIGHTED, 0, NULL, distance_sq_u8_weighted_avx2, NULL, avx2},
+        {"u8w-avx512", KIND_U8_WEIGHTED, 0, NULL, distance_sq_u8_weighted_avx512, NULL, avx512},
+        {"u8-scalar", KIND_U8, 0, NULL, NULL, distance_sq_u8_scalar, 1},
+        {"u8-avx2", KIND_U8, 0, NULL, NULL, distance_sq_u8_avx2, __builtin_cpu_supports("avx2")},
+        {"u8-avx512bw", KIND_U8, 0, NULL, NULL, distance_sq_u8_avx512, avx512bw},
+        {"u8-vnni", KIND_U8, 0, NULL, NULL, distance_sq_u8_vnni, avx512bw && __builtin_cpu_supports("avx512vnni")},
+    };
+    int num_storage_kernels = (int)(sizeof(storage_kernels) / sizeof(storage_kernels[0]));
+
+    printf("\n%-12s %6s %12s %12s\n", "kernel", "width", "GFLOP/s", "max rel err");
+    for (int w = 0; w < NUM_WIDTHS; w++) {
+        int width = widths[w];
+        int stride = dataset_padded_width(width);
+        //the query is row 0, the rows it is compared to follow it
+        int num_rows = (256 * 1024) / stride;
+        if (num_rows < 16) {
+            num_rows = 16;
+        }
+
+        size_t size = (size_t)(num_rows + 1) * stride;
+        uint16_t* halves = (uint16_t*)aligned_alloc(DATASET_ALIGNMENT, size * sizeof(uint16_t));
+        uint16_t* bhalves = (uint16_t*)aligned_alloc(DATASET_ALIGNMENT, size * sizeof(uint16_t));
+        uint8_t* codes = (uint8_t*)aligned_alloc(DATASET_ALIGNMENT, (size + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT);
+        float* weights = (float*)aligned_alloc(DATASET_ALIGNMENT, stride * sizeof(float));
+        if (halves == NULL || bhalves == NULL || codes == NULL || weights == NULL) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            return 1;
+        }
+
+        srand(width);
+        for (size_t i = 0; i < size; i++) {
+            float value = (float)rand() / RAND_MAX;
+            halves[i] = float_to_half(value);
+            bhalves[i] = float_to_bfloat16(value);
+            codes[i] = (uint8_t)(rand() % 256);
+        }
+        for (int i = 0; i < stride; i++) {
+            weights[i] = 1e-4f * (1 + rand() % 100);
+        }
+
+        for (int k = 0; k < num_storage_kernels; k++) {
+            const storage_kernel_t* kernel = &storage_kernels[k];
+            if (!kernel->supported) {
+                printf("%-12s %6d %12s %12s\n", kernel->name, width, "n/a", "n/a");
+                continue;
+            }
+
+            double max_error = 0;
+            for (int r = 0; r < num_rows; r++) {
+                double reference = storage_reference(kernel, halves, bhalves, codes, weights, stride, r, width);
+                double error = fabs(storage_distance(kernel, halves, bhalves, codes, weights, stride, r, width) - reference) / (reference + 1e-12);
+                if (error > max_error) {
+                    max_error = error;
+                }
+            }
+            if (max_error > TOLERANCE) {
+                failed = 1;
+            }
+
+            volatile double sink = 0;
+            long long num_distances = 0;
+            double start = omp_get_wtime();
+            double elapsed = 0;
+            while (elapsed < MIN_SECONDS) {
+                double sum = 0;
+                for (int r = 0; r < num_rows; r++) {
+                    sum += storage_distance(kernel, halves, bhalves, codes, weights, stride, r, width);
+                }
+                sink += sum;
+                num_distances += num_rows;
+                elapsed = omp_get_wtime() - start;
+            }
+            (void)sink;
+
+            double gflops = 3.0 * width * num_distances / elapsed / 1e9;
+            printf("%-12s %6d %12.2f %12.2e%s\n", kernel->name, width, gflops, max_error, max_error > TOLERANCE ? "  MISMATCH" : "");
+        }
+
+        free(halves);
+        free(bhalves);
+        free(codes);
+        free(weights);
+    }
+
+    if (failed) {
+        fprintf(stderr, "\nkernel results differ from the scalar reference\n");
+        return 1;
+    }
+    return 0;
+}
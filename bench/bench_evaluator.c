@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_distance.h"
+#include "../gm_evaluator.h"
+#include "../gm_KNN.h"
+#include "../gm_generate.h"
+
+//scaling of the population evaluator (gm_evaluator.h) from 1 to 64 threads on two shapes, a few
+//creatures against a big test set and many creatures against a small one, next to the plain
+//parallel loop over creatures. the fitness must not change with the thread count
+//usage: bench_evaluator.out [max_threads]
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define NUM_GENES 20000
+#define NUM_FEATURES 32
+#define NUM_CLASSES 4
+#define SEPARATION 1.0
+#define K 5
+#define MIN_SECONDS 0.2
+
+typedef struct shape_t {
+    const char* name;
+    int num_creatures;
+    int creature_size;
+    int num_test;
+} shape_t;
+
+static const shape_t shapes[] = {
+    {"small population", 4, 4000, 4000},
+    {"large population", 256, 400, 64},
+};
+#define NUM_SHAPES ((int)(sizeof(shapes) / sizeof(shapes[0])))
+
+int main(int argc, char** argv) {
+    distance_init();
+    int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+    srand(23);
+
+    Dataset* dataset = dataset_init();
+    generate_dataset(dataset, NUM_GENES, NUM_FEATURES, NUM_CLASSES, SEPARATION, 0, 23);
+    dataset_compute_norms(dataset);
+
+    printf("%d cpus available, %d genes of %d features, k = %d\n", omp_get_num_procs(), NUM_GENES, NUM_FEATURES, K);
+    printf("%-18s %8s %12s %9s %8s %14s %9s\n", "shape", "threads", "evaluator ms", "speedup", "steals", "creatures ms", "speedup");
+
+    for (int s = 0; s < NUM_SHAPES; s++) {
+        shape_t shape = shapes[s];
+
+        //the test genes are the last ones, creatures draw from the rest
+        int* test_genes = (int*)malloc(shape.num_test * sizeof(int));
+        for (int i = 0; i < shape.num_test; i++) {
+            test_genes[i] = NUM_GENES - shape.num_test + i;
+        }
+        Creature test_creature = {test_genes, shape.num_test};
+        Creature** creatures = (Creature**)malloc(shape.num_creatures * sizeof(Creature*));
+        for (int c = 0; c < shape.num_creatures; c++) {
+            creatures[c] = creature_init();
+            creature_set(creatures[c], shape.creature_size);
+            for (int i = 0; i < shape.creature_size; i++) {
+                creatures[c]->gene_indices[i] = rand() % (NUM_GENES - shape.num_test);
+            }
+        }
+
+        double* expected = (double*)malloc(shape.num_creatures * sizeof(double));
+        double* fitness = (double*)malloc(shape.num_creatures * sizeof(double));
+        for (int c = 0; c < shape.num_creatures; c++) {
+            expected[c] = KNN(creatures[c], &test_creature, dataset, K);
+        }
+
+        double evaluator_base = 0;
+        double creatures_base = 0;
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            omp_set_num_threads(threads);
+            Evaluator* evaluator = evaluator_init(dataset, test_genes, shape.num_test, K);
+
+            int runs = 0;
+            double start = omp_get_wtime();
+            do {
+                evaluator_run(evaluator, creatures, shape.num_creatures, fitness);
+                runs++;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+            double evaluator_ms = (omp_get_wtime() - start) * 1e3 / runs;
+
+            long long steals = 0;
+            for (int t = 0; t < evaluator->num_threads; t++) {
+                steals += evaluator->threads[t].num_steals;
+            }
+            for (int c = 0; c < shape.num_creatures; c++) {
+                if (fitness[c] != expected[c]) {
+                    fprintf(stderr, "fitness of creature %d differs from KNN with %d threads\n", c, threads);
+                    return 1;
+                }
+            }
+            evaluator_free(evaluator);
+
+            //the plain loop: one creature per iteration, the batch engine inside runs on one thread
+            runs = 0;
+            start = omp_get_wtime();
+            do {
+                #pragma omp parallel for schedule(dynamic)
+                for (int c = 0; c < shape.num_creatures; c++) {
+                    fitness[c] = KNN(creatures[c], &test_creature, dataset, K);
+                }
+                runs++;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+            double creatures_ms = (omp_get_wtime() - start) * 1e3 / runs;
+
+            if (threads == 1) {
+                evaluator_base = evaluator_ms;
+                creatures_base = creatures_ms;
+            }
+            printf("%-18s %8d %12.2f %8.2fx %8lld %14.2f %8.2fx\n", shape.name, threads, evaluator_ms, evaluator_base / evaluator_ms,
+                steals / runs, creatures_ms, creatures_base / creatures_ms);
+        }
+
+        for (int c = 0; c < shape.num_creatures; c++) {
+            creature_free(creatures[c]);
+        }
+        free(creatures);
+        free(test_genes);
+        free(expected);
+        free(fitness);
+    }
+
+    dataset_free(dataset);
+    return 0;
+}
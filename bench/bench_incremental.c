@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_distance.h"
+#include "../gm_creature.h"
+#include "../gm_fitness.h"
+#include "../gm_generate.h"
+
+//generation time against mutation rate, full rescoring (KNN) against incremental updates (gm_fitness.h)
+//every creature of a population breeds one child that differs from it by rate * |creature| genes
+//usage: bench_incremental.out [cache]   (cache scores both paths through a matrix distance cache)
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define NUM_TRAIN 20000
+#define NUM_TEST 1000
+#define NUM_FEATURES 64
+#define NUM_CLASSES 4
+//close classes, so the neighbors of a test gene come from several of them
+#define SEPARATION 1.0
+#define POPULATION 8
+#define CREATURE_SIZE 1000
+#define K 5
+
+static const double rates[] = {0.001, 0.005, 0.01, 0.05, 0.1, 0.25, 0.5};
+#define NUM_RATES ((int)(sizeof(rates) / sizeof(rates[0])))
+
+int main(int argc, char** argv) {
+    distance_init();
+    int use_cache = argc > 1 && strcmp(argv[1], "cache") == 0;
+    srand(11);
+
+    //clustered synthetic data, the first NUM_TRAIN genes train, the rest test
+    Dataset* dataset = dataset_init();
+    generate_dataset(dataset, NUM_TRAIN + NUM_TEST, NUM_FEATURES, NUM_CLASSES, SEPARATION, 0, 11);
+    dataset_compute_norms(dataset);
+
+    int train_genes[NUM_TRAIN];
+    int test_genes[NUM_TEST];
+    for (int i = 0; i < NUM_TRAIN; i++) {
+        train_genes[i] = i;
+    }
+    for (int i = 0; i < NUM_TEST; i++) {
+        test_genes[i] = NUM_TRAIN + i;
+    }
+    Creature test_creature = {test_genes, NUM_TEST};
+
+    DistanceCache* cache = NULL;
+    if (use_cache) {
+        cache = cache_build(dataset, test_genes, NUM_TEST, train_genes, NUM_TRAIN, CACHE_BUDGET, CACHE_MATRIX_F32);
+        cache_print_stats(cache, stdout);
+    }
+
+    //parents: random distinct training genes
+    Creature* parents[POPULATION];
+    Creature* children[POPULATION];
+    FitnessState* parent_states[POPULATION];
+    FitnessState* child_states[POPULATION];
+    int* shuffled = (int*)malloc(NUM_TRAIN * sizeof(int));
+    memcpy(shuffled, train_genes, sizeof(train_genes));
+    for (int p = 0; p < POPULATION; p++) {
+        for (int i = 0; i < CREATURE_SIZE; i++) {
+            int j = i + rand() % (NUM_TRAIN - i);
+            int swap = shuffled[i];
+            shuffled[i] = shuffled[j];
+            shuffled[j] = swap;
+        }
+        parents[p] = creature_init();
+        creature_set(parents[p], CREATURE_SIZE);
+        memcpy(parents[p]->gene_indices, shuffled, CREATURE_SIZE * sizeof(int));
+        children[p] = creature_init();
+        creature_set(children[p], CREATURE_SIZE);
+
+        parent_states[p] = fitness_init(dataset, cache, &test_creature, K);
+        child_states[p] = fitness_init(dataset, cache, &test_creature, K);
+        fitness_evaluate(parent_states[p], parents[p]);
+    }
+
+    printf("%d train, %d test, %d features, population %d of %d genes, k = %d%s\n", NUM_TRAIN, NUM_TEST, NUM_FEATURES, POPULATION, CREATURE_SIZE, K, use_cache ? ", matrix cache" : "");
+    printf("%8s %8s %14s %14s %9s %11s\n", "rate", "genes", "full ms/gen", "incr ms/gen", "speedup", "mismatches");
+
+    for (int r = 0; r < NUM_RATES; r++) {
+        int num_mutations = (int)(rates[r] * CREATURE_SIZE);
+        if (num_mutations < 1) {
+            num_mutations = 1;
+        }
+
+        double full_seconds = 0;
+        double incremental_seconds = 0;
+        int mismatches = 0;
+
+        for (int p = 0; p < POPULATION; p++) {
+            //the mutations, positions may repeat
+            int positions[CREATURE_SIZE];
+            int genes[CREATURE_SIZE];
+            for (int m = 0; m < num_mutations; m++) {
+                positions[m] = rand() % CREATURE_SIZE;
+                genes[m] = rand() % NUM_TRAIN;
+            }
+
+            //incremental: copy the parent's state and apply the mutations
+            double start = omp_get_wtime();
+            memcpy(children[p]->gene_indices, parents[p]->gene_indices, CREATURE_SIZE * sizeof(int));
+            fitness_copy(child_states[p], parent_states[p]);
+            for (int m = 0; m < num_mutations; m++) {
+                fitness_mutate(child_states[p], children[p], positions[m], genes[m]);
+            }
+            double incremental = fitness_value(child_states[p]);
+            incremental_seconds += omp_get_wtime() - start;
+
+            //full: score the child from scratch
+            start = omp_get_wtime();
+            double full = use_cache ? KNN_cached(children[p], cache, dataset, K) : KNN(children[p], &test_creature, dataset, K);
+            full_seconds += omp_get_wtime() - start;
+
+            if (full != incremental) {
+                mismatches++;
+            }
+        }
+
+        printf("%8.3f %8d %14.2f %14.2f %8.1fx %11d\n", rates[r], num_mutations, full_seconds * 1e3, incremental_seconds * 1e3, full_seconds / incremental_seconds, mismatches);
+    }
+
+    for (int p = 0; p < POPULATION; p++) {
+        creature_free(parents[p]);
+        creature_free(children[p]);
+        fitness_free(parent_states[p]);
+        fitness_free(child_states[p]);
+    }
+    if (cache != NULL) {
+        cache_free(cache);
+    }
+    dataset_free(dataset);
+    free(shuffled);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../gm_distance.h"
+#include "../gm_KNN.h"
+#include "../gm_search.h"
+#include "../gm_loader.h"
+#include "../gm_generate.h"
+#include "bench_common.h"
+
+//the exact k-d tree search (gm_kdtree.h) against the batch engine, over the number of features and
+//the size of the creature searched. the queries are the last QUERIES genes, the members every step-th
+//of the others. the tree must find the same neighbor distances, mismatches are counted
+//usage: bench_kdtree.out [file.csv]   (without a file synthetic clustered datasets are used)
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define K 10
+#define QUERIES 2000
+#define SYNTHETIC_GENES 100000
+#define SYNTHETIC_CLUSTERS 50
+//the clusters are tight next to the space between them, which is what the indexes feed on
+#define SYNTHETIC_SEPARATION 8.0
+
+static const int feature_counts[] = {2, 4, 8, 12, 16, 24, 32};
+#define NUM_FEATURE_COUNTS ((int)(sizeof(feature_counts) / sizeof(feature_counts[0])))
+static const int member_steps[] = {1, 10, 100};
+#define NUM_MEMBER_STEPS ((int)(sizeof(member_steps) / sizeof(member_steps[0])))
+
+//neighbors whose distance differs by more than rounding (the batch engine expands the square)
+static int mismatches(const distance_intex_t* exact, const distance_intex_t* tree, int num_queries) {
+    int count = 0;
+    for (int i = 0; i < num_queries * K; i++) {
+        if (fabsf(exact[i].distance - tree[i].distance) > 1e-3f * (1 + exact[i].distance)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void bench_dataset(Dataset* dataset) {
+    dataset_compute_norms(dataset);
+    int num_queries = dataset->num_genes / 10 < QUERIES ? dataset->num_genes / 10 : QUERIES;
+    int num_others = dataset->num_genes - num_queries;
+    int* queries = (int*)malloc(num_queries * sizeof(int));
+    int* members = (int*)malloc(num_others * sizeof(int));
+    distance_intex_t* exact = (distance_intex_t*)malloc((size_t)num_queries * K * sizeof(distance_intex_t));
+    distance_intex_t* tree = (distance_intex_t*)malloc((size_t)num_queries * K * sizeof(distance_intex_t));
+    for (int i = 0; i < num_queries; i++) {
+        queries[i] = num_others + i;
+    }
+
+    double build_start = omp_get_wtime();
+    NeighborSearch* kdtree = search_kdtree_init(dataset);
+    double build_seconds = omp_get_wtime() - build_start;
+    NeighborSearch* brute = search_exact_init(dataset);
+
+    for (int s = 0; s < NUM_MEMBER_STEPS; s++) {
+        int num_members = 0;
+        for (int i = 0; i < num_others; i += member_steps[s]) {
+            members[num_members++] = i;
+        }
+        double exact_qps = bench_search_qps(brute, queries, num_queries, members, num_members, K, exact);
+        double tree_qps = bench_search_qps(kdtree, queries, num_queries, members, num_members, K, tree);
+        printf("%8d %8d %8.2f %12.0f %12.0f %8.2fx %10d\n", dataset->num_features, num_members, build_seconds, exact_qps, tree_qps, tree_qps / exact_qps, mismatches(exact, tree, num_queries));
+    }
+
+    search_free(kdtree);
+    search_free(brute);
+    free(queries);
+    free(members);
+    free(exact);
+    free(tree);
+    return (void)0;
+}
+
+int main(int argc, char* argv[]) {
+    distance_init();
+    printf("k = %d, %d threads\n", K, omp_get_max_threads());
+    printf("%8s %8s %8s %12s %12s %9s %10s\n", "features", "members", "build s", "exact q/s", "kdtree q/s", "speedup", "mismatch");
+    if (argc > 1) {
+        Dataset* dataset = dataset_init();
+        dataset_load_csv(dataset, argv[1], 0);
+        bench_dataset(dataset);
+        dataset_free(dataset);
+        return 0;
+    }
+    for (int i = 0; i < NUM_FEATURE_COUNTS; i++) {
+        Dataset* dataset = dataset_init();
+        generate_dataset(dataset, SYNTHETIC_GENES, feature_counts[i], SYNTHETIC_CLUSTERS, SYNTHETIC_SEPARATION, 0, 31);
+        bench_dataset(dataset);
+        dataset_free(dataset);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_memo.h"
+
+//the fitness memo (gm_memo.h): memo_key is checked to ignore gene order, then threads hammer one
+//memo with lookups and inserts of creatures drawn from a skewed set larger than the memo. every hit
+//must return the fitness inserted for its key, and the run prints operations per second and the hit
+//rate by thread count (usage: bench_memo.out [max_threads])
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define MIN_SECONDS 0.3
+#define MEMO_ENTRIES 65536
+//distinct creatures drawn from, four times what the memo holds
+#define NUM_CREATURES (4 * MEMO_ENTRIES)
+//one operation in this many is an insert
+#define INSERT_EVERY 8
+#define CREATURE_SIZE 16
+
+//O(1)
+//xorshift64*
+static inline uint64_t next_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+//O(1)
+//the fitness a creature's key is always stored with, so a torn or foreign value shows up
+static inline double expected_fitness(uint64_t key) {
+    return (double)(key >> 11) * 0x1p-53;
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : omp_get_max_threads();
+
+    //creature c holds genes c * CREATURE_SIZE + i, shuffled copies must hash alike
+    int failed = 0;
+    int genes[CREATURE_SIZE];
+    int shuffled[CREATURE_SIZE];
+    uint64_t state = 7;
+    for (int c = 0; c < 1000; c++) {
+        for (int i = 0; i < CREATURE_SIZE; i++) {
+            genes[i] = c * CREATURE_SIZE + i;
+            shuffled[i] = genes[i];
+        }
+        for (int i = CREATURE_SIZE - 1; i > 0; i--) {
+            int j = (int)(next_random(&state) % (uint64_t)(i + 1));
+            int swap = shuffled[i];
+            shuffled[i] = shuffled[j];
+            shuffled[j] = swap;
+        }
+        failed |= memo_key(genes, CREATURE_SIZE) != memo_key(shuffled, CREATURE_SIZE);
+        //one gene swapped must not
+        shuffled[0] = -1;
+        failed |= memo_key(genes, CREATURE_SIZE) == memo_key(shuffled, CREATURE_SIZE);
+    }
+    printf("memo_key order independence: %s\n\n", failed ? "FAILED" : "ok");
+
+    uint64_t* keys = (uint64_t*)malloc(NUM_CREATURES * sizeof(uint64_t));
+    if (keys == NULL) {
+        return 1;
+    }
+    for (int c = 0; c < NUM_CREATURES; c++) {
+        for (int i = 0; i < CREATURE_SIZE; i++) {
+            genes[i] = c * CREATURE_SIZE + i;
+        }
+        keys[c] = memo_key(genes, CREATURE_SIZE);
+    }
+
+    printf("%-8s %14s %10s %12s %10s\n", "threads", "Mops/s", "hit rate", "evictions", "dropped");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        FitnessMemo* memo = memo_init(MEMO_ENTRIES);
+        long long operations = 0;
+        int wrong = 0;
+        double start = omp_get_wtime();
+
+        #pragma omp parallel num_threads(threads) reduction(+:operations) reduction(|:wrong)
+        {
+            uint64_t random = 0x9E3779B97F4A7C15ull * (uint64_t)(omp_get_thread_num() + 1);
+            do {
+                for (int i = 0; i < 4096; i++) {
+                    //the minimum of two draws favors low creatures, a few are hot and many are cold
+                    uint64_t first = next_random(&random) % NUM_CREATURES;
+                    uint64_t second = next_random(&random) % NUM_CREATURES;
+                    uint64_t key = keys[first < second ? first : second];
+                    double fitness;
+                    if (i % INSERT_EVERY == 0) {
+                        memo_insert(memo, key, expected_fitness(key));
+                    } else if (memo_lookup(memo, key, &fitness)) {
+                        wrong |= fitness != expected_fitness(key);
+                    }
+                }
+                operations += 4096;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+        }
+
+        double seconds = omp_get_wtime() - start;
+        printf("%-8d %14.2f %9.1f%% %12lld %10lld\n", threads, operations / seconds * 1e-6, 100 * memo_hit_rate(memo), memo->stats.num_evictions, memo->stats.num_dropped);
+        failed |= wrong;
+        memo_free(memo);
+    }
+
+    free(keys);
+    if (failed) {
+        printf("\nThe memo returned a wrong fitness or the key depends on gene order\n");
+        return 1;
+    }
+    return 0;
+}
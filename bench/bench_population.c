@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_population.h"
+
+//generation turnover with a malloc'd creature per child against the population arena (gm_population.h)
+//a child is its parent's genes with a few changed, the arena must not allocate once it is warm
+//usage: bench_population.out [num_creatures] [genes_per_creature]
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define GENERATIONS 200
+#define WARMUP 2
+
+int main(int argc, char** argv) {
+    int num_creatures = argc > 1 ? atoi(argv[1]) : 1000;
+    int num_genes = argc > 2 ? atoi(argv[2]) : 500;
+    srand(5);
+
+    //per creature malloc: every child is a new creature, every parent is freed
+    Creature** parents = (Creature**)malloc(num_creatures * sizeof(Creature*));
+    Creature** children = (Creature**)malloc(num_creatures * sizeof(Creature*));
+    for (int i = 0; i < num_creatures; i++) {
+        parents[i] = creature_init();
+        creature_set(parents[i], num_genes);
+        for (int j = 0; j < num_genes; j++) {
+            parents[i]->gene_indices[j] = rand();
+        }
+    }
+    double start = omp_get_wtime();
+    for (int g = 0; g < GENERATIONS; g++) {
+        for (int i = 0; i < num_creatures; i++) {
+            Creature* parent = parents[(i + g) % num_creatures];
+            children[i] = creature_init();
+            creature_set(children[i], parent->num_genes);
+            memcpy(children[i]->gene_indices, parent->gene_indices, parent->num_genes * sizeof(int));
+            children[i]->gene_indices[i % num_genes] = g;
+        }
+        for (int i = 0; i < num_creatures; i++) {
+            creature_free(parents[i]);
+        }
+        Creature** swap = parents;
+        parents = children;
+        children = swap;
+    }
+    double malloc_seconds = omp_get_wtime() - start;
+    for (int i = 0; i < num_creatures; i++) {
+        creature_free(parents[i]);
+    }
+
+    //the arena, in both layouts (the offset layout with variable sizes, it starts too small to hold them)
+    for (int layout = 0; layout < 2; layout++) {
+        Population* population = population_init(num_creatures, layout == 0 ? num_genes : 0, 1024);
+        int* sizes = (int*)malloc(num_creatures * sizeof(int));
+        for (int i = 0; i < num_creatures; i++) {
+            sizes[i] = layout == 0 ? num_genes : num_genes / 2 + rand() % num_genes;
+        }
+        population_layout(population, sizes);
+        population_swap(population);
+
+        long long allocations = 0;
+        start = omp_get_wtime();
+        for (int g = 0; g < GENERATIONS; g++) {
+            if (g == WARMUP) {
+                allocations = population->stats.num_allocations;
+                start = omp_get_wtime();
+            }
+            population_layout(population, sizes);
+            for (int i = 0; i < num_creatures; i++) {
+                Creature* parent = population->current_list[(i + g) % num_creatures];
+                Creature* child = population->next_list[i];
+                int size = parent->num_genes < child->num_genes ? parent->num_genes : child->num_genes;
+                memcpy(child->gene_indices, parent->gene_indices, size * sizeof(int));
+                child->gene_indices[i % size] = g;
+            }
+            population_swap(population);
+        }
+        double arena_seconds = omp_get_wtime() - start;
+
+        printf("%-8s %d creatures of ~%d genes: malloc %.2f ms/gen, arena %.2f ms/gen, %lld allocations in the steady state (%lld grows, %zu bytes held)\n",
+            layout == 0 ? "fixed" : "offsets", num_creatures, num_genes,
+            malloc_seconds * 1e3 / GENERATIONS, arena_seconds * 1e3 / (GENERATIONS - WARMUP),
+            population->stats.num_allocations - allocations, population->stats.num_grows, population->stats.bytes);
+
+        if (population->stats.num_allocations != allocations) {
+            fprintf(stderr, "the arena allocated in the steady state\n");
+            return 1;
+        }
+        free(sizes);
+        population_free(population);
+    }
+
+    free(parents);
+    free(children);
+    return 0;
+}
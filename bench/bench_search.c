@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../gm_distance.h"
+#include "../gm_KNN.h"
+#include "../gm_search.h"
+#include "../gm_loader.h"
+#include "../gm_generate.h"
+#include "bench_common.h"
+
+//recall against speed of the IVF neighbor search (gm_search.h) against the exact batch engine. the
+//queries are the last QUERIES genes, the members a creature of the other genes (all of them, then a
+//tenth). recall@k is the fraction of the exact k nearest members the search also returns
+//usage: bench_search.out [file.csv]   (without a file a synthetic clustered dataset is used)
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define K 10
+#define QUERIES 2000
+#define SYNTHETIC_GENES 200000
+#define SYNTHETIC_FEATURES 32
+#define SYNTHETIC_CLUSTERS 100
+//the clusters are tight next to the space between them, which is what the indexes feed on
+#define SYNTHETIC_SEPARATION 8.0
+
+static const int probes[] = {1, 2, 4, 8, 16, 32, 64};
+#define NUM_PROBES ((int)(sizeof(probes) / sizeof(probes[0])))
+
+//fraction of the exact neighbors found
+static double recall(const distance_intex_t* exact, const distance_intex_t* approximate, int num_queries) {
+    long long found = 0;
+    for (int q = 0; q < num_queries; q++) {
+        for (int i = 0; i < K; i++) {
+            for (int j = 0; j < K; j++) {
+                if (exact[(size_t)q * K + i].index == approximate[(size_t)q * K + j].index) {
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    return (double)found / ((double)num_queries * K);
+}
+
+int main(int argc, char* argv[]) {
+    distance_init();
+    Dataset* dataset = dataset_init();
+    if (argc > 1) {
+        dataset_load_csv(dataset, argv[1], 0);
+    } else {
+        generate_dataset(dataset, SYNTHETIC_GENES, SYNTHETIC_FEATURES, SYNTHETIC_CLUSTERS, SYNTHETIC_SEPARATION, 0, 29);
+    }
+    dataset_compute_norms(dataset);
+
+    int num_queries = dataset->num_genes / 10 < QUERIES ? dataset->num_genes / 10 : QUERIES;
+    int num_others = dataset->num_genes - num_queries;
+    int* queries = (int*)malloc(num_queries * sizeof(int));
+    int* others = (int*)malloc(num_others * sizeof(int));
+    distance_intex_t* exact = (distance_intex_t*)malloc((size_t)num_queries * K * sizeof(distance_intex_t));
+    distance_intex_t* approximate = (distance_intex_t*)malloc((size_t)num_queries * K * sizeof(distance_intex_t));
+    for (int i = 0; i < num_queries; i++) {
+        queries[i] = num_others + i;
+    }
+    for (int i = 0; i < num_others; i++) {
+        others[i] = i;
+    }
+
+    printf("%d genes, %d features, %d queries, k = %d, %d threads\n", dataset->num_genes, dataset->num_features, num_queries, K, omp_get_max_threads());
+    double build_start = omp_get_wtime();
+    NeighborSearch* ivf = search_ivf_init(dataset, 0, 0);
+    printf("ivf build: %d lists in %.2f s\n\n", ivf->num_lists, omp_get_wtime() - build_start);
+    NeighborSearch* brute = search_exact_init(dataset);
+
+    printf("%-10s %-8s %7s %10s %12s %9s\n", "members", "search", "nprobe", "recall@k", "queries/s", "speedup");
+    int member_counts[2] = {num_others, num_others / 10};
+    for (int m = 0; m < 2; m++) {
+        //every tenth gene for the small creature
+        int num_members = member_counts[m];
+        int* members = others;
+        int* tenth = NULL;
+        if (m == 1) {
+            tenth = (int*)malloc(num_members * sizeof(int));
+            for (int i = 0; i < num_members; i++) {
+                tenth[i] = others[i * 10];
+            }
+            members = tenth;
+        }
+
+        double exact_qps = bench_search_qps(brute, queries, num_queries, members, num_members, K, exact);
+        printf("%-10d %-8s %7s %10.4f %12.0f %8.2fx\n", num_members, "exact", "-", 1.0, exact_qps, 1.0);
+        for (int p = 0; p < NUM_PROBES && probes[p] <= ivf->num_lists; p++) {
+            ivf->num_probes = probes[p];
+            double qps = bench_search_qps(ivf, queries, num_queries, members, num_members, K, approximate);
+            printf("%-10d %-8s %7d %10.4f %12.0f %8.2fx\n", num_members, "ivf", probes[p], recall(exact, approximate, num_queries), qps, qps / exact_qps);
+        }
+        free(tenth);
+    }
+
+    search_free(ivf);
+    search_free(brute);
+    free(queries);
+    free(others);
+    free(exact);
+    free(approximate);
+    dataset_free(dataset);
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../gm_KNN.h"
+#include "../gm_batch.h"
+#include "../gm_loader.h"
+#include "../gm_generate.h"
+
+//accuracy against speed of the feature storage modes (dataset_set_storage). every mode classifies
+//the last fifth of the genes from the rest, both through the batch engine and one pair at a time.
+//agreement is the fraction of test genes whose k neighbor set is the same as with f32
+//usage: bench_storage.out [file.csv ...]   (without files two synthetic datasets are used)
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+#define K 5
+#define MIN_SECONDS 0.2
+#define SYNTHETIC_GENES 12000
+#define SYNTHETIC_FEATURES 256
+#define SYNTHETIC_CLASSES 10
+#define SYNTHETIC_SEPARATION 0.5
+
+static const dataset_storage_t storages[] = {STORAGE_F32, STORAGE_F16, STORAGE_BF16, STORAGE_INT8};
+#define NUM_STORAGES ((int)(sizeof(storages) / sizeof(storages[0])))
+
+//fills a generated dataset, as sparse 8 bit "pixels" (kind 0, a value is 0 or a
+//scaled and clamped copy of the generated one) or as floats of a different scale per feature (kind 1)
+static void make_synthetic(Dataset* dataset, int kind) {
+    generate_dataset(dataset, SYNTHETIC_GENES, SYNTHETIC_FEATURES, SYNTHETIC_CLASSES, SYNTHETIC_SEPARATION, 0, 17);
+    for (int i = 0; i < dataset->num_genes; i++) {
+        float* row = dataset_row(dataset, i);
+        for (int f = 0; f < SYNTHETIC_FEATURES; f++) {
+            if (kind == 0) {
+                float pixel = floorf(64 * row[f]);
+                row[f] = pixel < 32 ? 0 : (pixel > 255 ? 255 : pixel);
+            } else {
+                row[f] *= 1 + f % 7;
+            }
+        }
+    }
+    return (void)0;
+}
+
+//loads a dataset by name
+static void load(Dataset* dataset, const char* name) {
+    if (strcmp(name, "synthetic-pixels") == 0) {
+        make_synthetic(dataset, 0);
+    } else if (strcmp(name, "synthetic-gaussian") == 0) {
+        make_synthetic(dataset, 1);
+    } else {
+        dataset_load_csv(dataset, name, 0);
+    }
+    dataset_compute_norms(dataset);
+    return (void)0;
+}
+
+//1 if both lists hold the same genes
+static int same_neighbors(const distance_intex_t* a, const distance_intex_t* b, int k) {
+    for (int i = 0; i < k; i++) {
+        int found = 0;
+        for (int j = 0; j < k; j++) {
+            found |= a[i].index == b[j].index;
+        }
+        if (!found) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void report(const char* name) {
+    distance_intex_t* reference = NULL;
+
+    for (int s = 0; s < NUM_STORAGES; s++) {
+        Dataset* dataset = dataset_init();
+        load(dataset, name);
+        dataset_set_storage(dataset, storages[s]);
+
+        int num_test = dataset->num_genes / 5;
+        int num_train = dataset->num_genes - num_test;
+        int* test = (int*)malloc(num_test * sizeof(int));
+        int* train = (int*)malloc(num_train * sizeof(int));
+        for (int i = 0; i < num_train; i++) {
+            train[i] = i;
+        }
+        for (int i = 0; i < num_test; i++) {
+            test[i] = num_train + i;
+        }
+        distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)num_test * K * sizeof(distance_intex_t));
+        vote_t vote;
+        vote_init(&vote, dataset->num_classes, K, VOTE_MAJORITY);
+
+        //batch engine
+        int runs = 0;
+        double start = omp_get_wtime();
+        do {
+            batch_knn(dataset, test, num_test, train, num_train, K, neighbors);
+            runs++;
+        } while (omp_get_wtime() - start < MIN_SECONDS);
+        double batch_ms = (omp_get_wtime() - start) * 1e3 / runs;
+
+        //one pair at a time (the incremental fitness and cache path)
+        runs = 0;
+        volatile float sink = 0;
+        start = omp_get_wtime();
+        do {
+            for (int t = 0; t < num_test; t += 8) {
+                for (int r = 0; r < num_train; r++) {
+                    sink += distance_sq_rows(dataset, test[t], train[r]);
+                }
+            }
+            runs++;
+        } while (omp_get_wtime() - start < MIN_SECONDS);
+        double pair_ns = (omp_get_wtime() - start) * 1e9 / runs / ((double)((num_test + 7) / 8) * num_train);
+
+        int correct = 0;
+        int agree = 0;
+        for (int t = 0; t < num_test; t++) {
+            correct += KNN_vote(dataset, neighbors + (size_t)t * K, K, &vote) == dataset->labels[test[t]];
+            if (reference != NULL) {
+                agree += same_neighbors(neighbors + (size_t)t * K, reference + (size_t)t * K, K);
+            }
+        }
+        if (reference == NULL) {
+            reference = neighbors;
+            neighbors = NULL;
+            agree = num_test;
+        }
+
+        size_t row_bytes = storages[s] == STORAGE_F32 ? dataset->padded_features * sizeof(float) : dataset->compact_stride;
+        printf("%-20s %-5s %9zu %8.2f %9.2f %10.2f %10.4f %10.4f\n", name, dataset_storage_name(storages[s]),
+            row_bytes, (double)row_bytes * dataset->num_genes / (1 << 20), batch_ms, pair_ns,
+            (double)correct / num_test, (double)agree / num_test);
+
+        free(neighbors);
+        vote_free(&vote);
+        free(test);
+        free(train);
+        dataset_free(dataset);
+    }
+
+    free(reference);
+    return (void)0;
+}
+
+int main(int argc, char** argv) {
+    distance_init();
+    printf("float kernel %s, int8 kernel %s, k = %d\n", distance_kernel_name(), distance_u8_kernel_name(), K);
+    printf("%-20s %-5s %9s %8s %9s %10s %10s %10s\n", "dataset", "mode", "row bytes", "MB", "batch ms", "pair ns", "accuracy", "agreement");
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            report(argv[i]);
+        }
+    } else {
+        report("synthetic-pixels");
+        report("synthetic-gaussian");
+    }
+    return 0;
+}
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "../gm_loader.h"
+#include "../gm_distance.h"
+#include "../gm_bitset.h"
+#include "../gm_batch.h"
+#include "../gm_topk.h"
+#include "../gm_evaluator.h"
+#include "../gm_routine.h"
+#include "../gm_init.h"
+#include "../gm_rng.h"
+
+//the fixed scenarios of make bench, run on a dataset from tools/generate.c: csv loading, single
+//distances, top k selection, the batch engine, scoring a whole population and whole generations.
+//every result is a rate (higher is better), the best of SUITE_REPEATS timed runs of at least
+//SUITE_MIN_SECONDS each, written as json with the git revision and the cpu. --compare reads two such
+//files and flags every result that dropped by more than a threshold
+//usage: bench_suite.out data.csv results.json
+//       bench_suite.out --compare old.json new.json [threshold_percent]
+
+//gm_creature.c expects this (normally found in gm_main.c)
+int seed = 1;
+
+//set by the Makefile
+#ifndef GM_REVISION
+#define GM_REVISION "unknown"
+#endif
+
+#define SUITE_MIN_SECONDS 0.25
+#define SUITE_REPEATS 3
+#define SUITE_MAX_RESULTS 64
+#define SUITE_DEFAULT_THRESHOLD 5.0
+
+//scenario sizes
+#define SUITE_PAIRS 4096
+#define SUITE_STREAM 65536
+#define SUITE_QUERIES 1024
+#define SUITE_REFERENCES 16384
+#define SUITE_POPULATION 64
+#define SUITE_CREATURE_SIZE 1000
+#define SUITE_K 5
+#define SUITE_GENERATIONS 5
+//the fitness scenarios score on at most this many test genes, so they cost the same on any dataset
+#define SUITE_TEST_GENES 2048
+
+typedef struct suite_result_t {
+    char name[64];
+    double value;
+    char unit[32];
+} suite_result_t;
+
+//what every scenario shares
+typedef struct suite_t {
+    Dataset* dataset;
+    int* train_genes;
+    int num_train_genes;
+    int* test_genes;
+    int num_test_genes;
+    suite_result_t results[SUITE_MAX_RESULTS];
+    int num_results;
+} suite_t;
+
+//one scenario, returns how many units one run did
+typedef double (*scenario_t)(suite_t* suite, void* argument);
+
+//O(runs)
+//the best rate of SUITE_REPEATS timings of a scenario, each repeating it for SUITE_MIN_SECONDS
+static void measure(suite_t* suite, const char* name, const char* unit, double scale, scenario_t scenario, void* argument) {
+    double best = 0;
+    for (int repeat = 0; repeat < SUITE_REPEATS; repeat++) {
+        double units = 0;
+        double start = omp_get_wtime();
+        do {
+            units += scenario(suite, argument);
+        } while (omp_get_wtime() - start < SUITE_MIN_SECONDS);
+        double rate = units / (omp_get_wtime() - start) * scale;
+        best = rate > best ? rate : best;
+    }
+
+    suite_result_t* result = &suite->results[suite->num_results++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    snprintf(result->unit, sizeof(result->unit), "%s", unit);
+    result->value = best;
+    printf("%-24s %14.3f %s\n", name, best, unit);
+    fflush(stdout);
+    return (void)0;
+}
+
+//loads the csv, in bytes
+static double load_csv(suite_t* suite, void* argument) {
+    (void)suite;
+    const char* file_name = (const char*)argument;
+    Dataset* dataset = dataset_init();
+    dataset_load_csv(dataset, file_name, 0);
+    dataset_free(dataset);
+    struct stat status;
+    return stat(file_name, &status) == 0 ? (double)status.st_size : 0;
+}
+
+//SUITE_PAIRS single distances on one thread, in distances
+static volatile float distance_sink;
+static double distances(suite_t* suite, void* argument) {
+    (void)argument;
+    Dataset* dataset = suite->dataset;
+    float sum = 0;
+    for (int p = 0; p < SUITE_PAIRS; p++) {
+        sum += distance_sq_rows(dataset, suite->test_genes[p % suite->num_test_genes], suite->train_genes[(p * 7919) % suite->num_train_genes]);
+    }
+    distance_sink = sum;
+    return SUITE_PAIRS;
+}
+
+//SUITE_STREAM pushes into a top k of the k given as argument, in pushes
+static double topk_stream(suite_t* suite, void* argument) {
+    (void)suite;
+    int k = *(const int*)argument;
+    static float stream[SUITE_STREAM];
+    static int filled = 0;
+    if (!filled) {
+        rng_t rng = rng_stream(1, RNG_GENERATE, 2, 0);
+        for (int i = 0; i < SUITE_STREAM; i++) {
+            stream[i] = (float)rng_uniform(&rng);
+        }
+        filled = 1;
+    }
+
+    float heap_distance[256];
+    int heap_index[256];
+    distance_intex_t out[256];
+    topk_t topk;
+    topk_init(&topk, k, heap_distance, heap_index);
+    for (int i = 0; i < SUITE_STREAM; i++) {
+        topk_push(&topk, stream[i], i);
+    }
+    topk_sorted(&topk, out);
+    distance_sink = out[0].distance;
+    return SUITE_STREAM;
+}
+
+//SUITE_QUERIES queries against SUITE_REFERENCES references on every thread, in distances
+static double batch(suite_t* suite, void* argument) {
+    distance_intex_t* neighbors = (distance_intex_t*)argument;
+    int num_queries = SUITE_QUERIES < suite->num_test_genes ? SUITE_QUERIES : suite->num_test_genes;
+    int num_references = SUITE_REFERENCES < suite->num_train_genes ? SUITE_REFERENCES : suite->num_train_genes;
+    batch_knn(suite->dataset, suite->test_genes, num_queries, suite->train_genes, num_references, SUITE_K, neighbors);
+    return (double)num_queries * num_references;
+}
+
+//scores a fixed population with the evaluator, in creatures
+typedef struct fitness_argument_t {
+    Evaluator* evaluator;
+    Creature** creatures;
+    double* fitness;
+} fitness_argument_t;
+static double fitness(suite_t* suite, void* argument) {
+    (void)suite;
+    fitness_argument_t* fitness_argument = (fitness_argument_t*)argument;
+    evaluator_run(fitness_argument->evaluator, fitness_argument->creatures, SUITE_POPULATION, fitness_argument->fitness);
+    return SUITE_POPULATION;
+}
+
+//a GA from its first generation through SUITE_GENERATIONS steps, in generations
+static double generations(suite_t* suite, void* argument) {
+    (void)argument;
+    ga_config_t config;
+    ga_default_config(&config);
+    config.population_size = SUITE_POPULATION;
+    config.creature_size = SUITE_CREATURE_SIZE;
+    config.k = SUITE_K;
+    GA* ga = ga_init(&config, suite->dataset, suite->train_genes, suite->num_train_genes, suite->test_genes, suite->num_test_genes, 1);
+    ga_evaluate(ga);
+    for (int g = 0; g < SUITE_GENERATIONS; g++) {
+        ga_step(ga);
+    }
+    distance_sink = (float)ga->ranking[0].fitness;
+    ga_free(ga);
+    return SUITE_GENERATIONS;
+}
+
+//O(cpuinfo)
+//the cpu's model name
+static void cpu_name(char* name, size_t capacity) {
+    snprintf(name, capacity, "unknown");
+    FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL) {
+        return (void)0;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+            colon += 2;
+            colon[strcspn(colon, "\n")] = '\0';
+            //quotes and backslashes would break the json
+            for (char* c = colon; *c != '\0'; c++) {
+                *c = (*c == '"' || *c == '\\') ? ' ' : *c;
+            }
+            snprintf(name, capacity, "%s", colon);
+            break;
+        }
+    }
+    fclose(cpuinfo);
+    return (void)0;
+}
+
+//O(results)
+//writes the results, one per line so --compare can read them back without a json parser
+static int write_results(const suite_t* suite, const char* file_name, const char* data_name) {
+    FILE* file = fopen(file_name, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    char cpu[256];
+    cpu_name(cpu, sizeof(cpu));
+    fprintf(file, "{\"revision\":\"%s\",\"cpu\":\"%s\",\"cpus\":%d,\"threads\":%d,\"data\":\"%s\",\"genes\":%d,\"features\":%d,\"results\":[\n", GM_REVISION, cpu, omp_get_num_procs(), omp_get_max_threads(), data_name, suite->dataset->num_genes, suite->dataset->num_features);
+    for (int r = 0; r < suite->num_results; r++) {
+        fprintf(file, "{\"name\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}%s\n", suite->results[r].name, suite->results[r].value, suite->results[r].unit, r + 1 < suite->num_results ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    return 1;
+}
+
+//O(results)
+//reads the results written by write_results, returns how many, -1 if the file can't be read
+static int read_results(const char* file_name, suite_result_t* results, char* revision, size_t revision_capacity) {
+    FILE* file = fopen(file_name, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int num_results = 0;
+    char line[1024];
+    snprintf(revision, revision_capacity, "unknown");
+    while (fgets(line, sizeof(line), file) != NULL && num_results < SUITE_MAX_RESULTS) {
+        suite_result_t* result = &results[num_results];
+        const char* field = strstr(line, "\"revision\":\"");
+        if (field != NULL) {
+            field += strlen("\"revision\":\"");
+            snprintf(revision, revision_capacity, "%.*s", (int)strcspn(field, "\""), field);
+        }
+        if (sscanf(line, "{\"name\":\"%63[^\"]\",\"value\":%lf,\"unit\":\"%31[^\"]\"", result->name, &result->value, result->unit) == 3) {
+            num_results++;
+        }
+    }
+    fclose(file);
+    return num_results;
+}
+
+//O(results^2)
+//prints the change of every result found in both files, returns the number of regressions
+static int compare(const char* old_name, const char* new_name, double threshold) {
+    suite_result_t old_results[SUITE_MAX_RESULTS];
+    suite_result_t new_results[SUITE_MAX_RESULTS];
+    char old_revision[64], new_revision[64];
+    int num_old = read_results(old_name, old_results, old_revision, sizeof(old_revision));
+    int num_new = read_results(new_name, new_results, new_revision, sizeof(new_revision));
+    if (num_old < 0 || num_new < 0) {
+        fprintf(stderr, "Failed to read %s\n", num_old < 0 ? old_name : new_name);
+        return -1;
+    }
+
+    printf("%s (%s) -> %s (%s), regression past %.1f%%\n", old_name, old_revision, new_name, new_revision, threshold);
+    printf("%-24s %14s %14s %9s\n", "result", "old", "new", "change");
+    int regressions = 0;
+    for (int n = 0; n < num_new; n++) {
+        for (int o = 0; o < num_old; o++) {
+            if (strcmp(old_results[o].name, new_results[n].name) != 0) {
+                continue;
+            }
+            double change = old_results[o].value > 0 ? 100 * (new_results[n].value / old_results[o].value - 1) : 0;
+            int regressed = change < -threshold;
+            regressions += regressed;
+            printf("%-24s %14.3f %14.3f %+8.1f%%%s\n", new_results[n].name, old_results[o].value, new_results[n].value, change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3 && strcmp(argv[1], "--compare") == 0) {
+        double threshold = argc > 4 ? atof(argv[4]) : SUITE_DEFAULT_THRESHOLD;
+        return compare(argv[2], argv[3], threshold) != 0;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s data.csv results.json\n       %s --compare old.json new.json [threshold_percent]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    distance_init();
+    bitset_init();
+    suite_t suite;
+    memset(&suite, 0, sizeof(suite));
+    suite.dataset = dataset_init();
+    dataset_load_csv(suite.dataset, argv[1], 0);
+    dataset_compute_norms(suite.dataset);
+    init_split(suite.dataset, 1, &suite.train_genes, &suite.num_train_genes, &suite.test_genes, &suite.num_test_genes);
+    if (suite.num_test_genes > SUITE_TEST_GENES) {
+        suite.num_test_genes = SUITE_TEST_GENES;
+    }
+    if (suite.num_train_genes < SUITE_CREATURE_SIZE || suite.num_test_genes <= 0) {
+        fprintf(stderr, "%s needs at least %d training genes\n", argv[1], SUITE_CREATURE_SIZE);
+        return 1;
+    }
+    printf("%s: %d genes, %d features, %d classes, %d threads, revision %s\n\n", argv[1], suite.dataset->num_genes, suite.dataset->num_features, suite.dataset->num_classes, omp_get_max_threads(), GM_REVISION);
+
+    measure(&suite, "load_csv", "MB/s", 1e-6, load_csv, argv[1]);
+    measure(&suite, "distance", "Mdistances/s", 1e-6, distances, NULL);
+    int small_k = SUITE_K;
+    int large_k = 128;
+    measure(&suite, "topk_k5", "Mpushes/s", 1e-6, topk_stream, &small_k);
+    measure(&suite, "topk_k128", "Mpushes/s", 1e-6, topk_stream, &large_k);
+
+    distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)SUITE_QUERIES * SUITE_K * sizeof(distance_intex_t));
+    measure(&suite, "batch_knn", "Mdistances/s", 1e-6, batch, neighbors);
+    free(neighbors);
+
+    //a fixed population of random training genes
+    fitness_argument_t fitness_argument;
+    fitness_argument.evaluator = evaluator_init(suite.dataset, suite.test_genes, suite.num_test_genes, SUITE_K);
+    fitness_argument.creatures = (Creature**)malloc(SUITE_POPULATION * sizeof(Creature*));
+    fitness_argument.fitness = (double*)malloc(SUITE_POPULATION * sizeof(double));
+    for (int c = 0; c < SUITE_POPULATION; c++) {
+        fitness_argument.creatures[c] = creature_init();
+        creature_set(fitness_argument.creatures[c], SUITE_CREATURE_SIZE);
+        rng_t rng = rng_stream(1, RNG_GENERATE, 3, (uint32_t)c);
+        for (int i = 0; i < SUITE_CREATURE_SIZE; i++) {
+            fitness_argument.creatures[c]->gene_indices[i] = suite.train_genes[rng_below(&rng, (uint32_t)suite.num_train_genes)];
+        }
+    }
+    measure(&suite, "population_fitness", "creatures/s", 1, fitness, &fitness_argument);
+    for (int c = 0; c < SUITE_POPULATION; c++) {
+        creature_free(fitness_argument.creatures[c]);
+    }
+    free(fitness_argument.creatures);
+    free(fitness_argument.fitness);
+    evaluator_free(fitness_argument.evaluator);
+
+    measure(&suite, "generations", "generations/s", 1, generations, NULL);
+
+    if (!write_results(&suite, argv[2], argv[1])) {
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+    printf("\nresults in %s\n", argv[2]);
+
+    free(suite.train_genes);
+    free(suite.test_genes);
+    dataset_free(suite.dataset);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_topk.h"
+
+//benchmark of the streaming top k (gm_topk.h) against filling an array and calling nth_element
+//on random, sorted and heavily duplicated distances. usage: bench_topk.out [num_distances]
+
+#define MIN_SECONDS 0.1
+
+static const int ks[] = {1, 8, 16, 64};
+#define NUM_KS ((int)(sizeof(ks) / sizeof(ks[0])))
+
+static const char* input_names[] = {"random", "sorted", "duplicated"};
+#define NUM_INPUTS 3
+
+//fills the distances for one input kind
+static void make_input(float* distances, int n, int kind) {
+    srand(7);
+    for (int i = 0; i < n; i++) {
+        if (kind == 0) {
+            distances[i] = (float)rand() / RAND_MAX;
+        } else if (kind == 1) {
+            distances[i] = (float)i;
+        } else {
+            //quantized data, only 4 distinct distances
+            distances[i] = (float)(rand() % 4);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+
+    float* distances = (float*)malloc(n * sizeof(float));
+    distance_intex_t* scratch = (distance_intex_t*)malloc(n * sizeof(distance_intex_t));
+    float* heap_distance = (float*)malloc(ks[NUM_KS - 1] * sizeof(float));
+    int* heap_index = (int*)malloc(ks[NUM_KS - 1] * sizeof(int));
+    distance_intex_t* out = (distance_intex_t*)malloc(ks[NUM_KS - 1] * sizeof(distance_intex_t));
+    if (distances == NULL || scratch == NULL || heap_distance == NULL || heap_index == NULL || out == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+
+    printf("n = %d, time per selection in microseconds\n", n);
+    printf("%-11s %4s %14s %14s %14s\n", "input", "k", "nth_element", "topk_small", "topk_heap");
+
+    for (int kind = 0; kind < NUM_INPUTS; kind++) {
+        make_input(distances, n, kind);
+
+        for (int j = 0; j < NUM_KS; j++) {
+            int k = ks[j];
+            double kth[3] = {0, 0, 0};
+            double micros[3] = {-1, -1, -1};
+
+            //nth_element over the full array
+            int reps = 0;
+            double start = omp_get_wtime();
+            do {
+                for (int i = 0; i < n; i++) {
+                    scratch[i].distance = distances[i];
+                    scratch[i].index = i;
+                }
+                nth_element(scratch, n, k - 1);
+                reps++;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+            micros[0] = (omp_get_wtime() - start) / reps * 1e6;
+            kth[0] = scratch[k - 1].distance;
+
+            //streaming small buffer
+            if (k <= TOPK_SMALL) {
+                reps = 0;
+                start = omp_get_wtime();
+                do {
+                    topk_small_t topk;
+                    topk_small_init(&topk, k);
+                    float threshold = topk_small_threshold(&topk);
+                    for (int i = 0; i < n; i++) {
+                        if (distances[i] < threshold) {
+                            topk_small_push(&topk, distances[i], i);
+                            threshold = topk_small_threshold(&topk);
+                        }
+                    }
+                    topk_small_sorted(&topk, out);
+                    reps++;
+                } while (omp_get_wtime() - start < MIN_SECONDS);
+                micros[1] = (omp_get_wtime() - start) / reps * 1e6;
+                kth[1] = out[k - 1].distance;
+            }
+
+            //streaming heap
+            reps = 0;
+            start = omp_get_wtime();
+            do {
+                topk_heap_t topk;
+                topk_heap_init(&topk, k, heap_distance, heap_index);
+                for (int i = 0; i < n; i++) {
+                    topk_heap_push(&topk, distances[i], i);
+                }
+                topk_heap_sorted(&topk, out);
+                reps++;
+            } while (omp_get_wtime() - start < MIN_SECONDS);
+            micros[2] = (omp_get_wtime() - start) / reps * 1e6;
+            kth[2] = out[k - 1].distance;
+
+            if (kth[2] != kth[0] || (k <= TOPK_SMALL && kth[1] != kth[0])) {
+                fprintf(stderr, "k-th distance mismatch for %s k = %d\n", input_names[kind], k);
+                return 1;
+            }
+
+            printf("%-11s %4d %14.2f", input_names[kind], k, micros[0]);
+            if (micros[1] >= 0) {
+                printf(" %14.2f", micros[1]);
+            } else {
+                printf(" %14s", "n/a");
+            }
+            printf(" %14.2f\n", micros[2]);
+        }
+    }
+
+    free(distances);
+    free(scratch);
+    free(heap_distance);
+    free(heap_index);
+    free(out);
+    return 0;
+}
@@ -1,16 +1,34 @@
 #ifndef ERRORS_H
 #define ERRORS_H
 
-//this lets the Make file specify the size of the file reading buffer
-#ifndef BUFF_SIZE
-    #define BUFF_SIZE (32 * 1024) 
-    //32KB (make cool feature to get optimal size based on num features later)
-#endif
-
 #define MALLOC_ERROR "Failed to allocate memory\n"
 #define FILE_ERROR "Failed to open file\n"
 #define EMPTY_FILE_ERROR "File is empty\n"
-#define BUFF_ERROR "Buffer too small to hold line.\n Set BUFF_SIZE to a larger value when compiling using -D BUFF_SIZE=<value>\n"
+#define CSV_FORMAT_ERROR "Malformed row in csv file (every row needs a label and one value per feature)\n"
+#define FEATURE_COUNT_ERROR "File has a different number of features than requested\n"
 #define GENE_CREATURE_ERROR "Not enough creatures to hold all genes\n"
+#define STORAGE_ERROR "Only float32 features can be converted to another storage mode\n"
+#define STORAGE_NAME_ERROR "Unknown storage mode (use f32, f16, bf16 or int8)\n"
+#define POPULATION_SIZE_ERROR "Creature is larger than its slot in the population\n"
+#define GA_CONFIG_ERROR "Population size, creature size, k and the number of training genes must be positive\n"
+#define TOPOLOGY_NAME_ERROR "Unknown island topology (use ring or torus)\n"
+#define SELECTION_NAME_ERROR "Unknown selection (use tournament or rank)\n"
+#define SEARCH_NAME_ERROR "Unknown search backend (use exact, ivf, kdtree or auto)\n"
+#define VOTE_NAME_ERROR "Unknown vote weighting (use majority or distance)\n"
+#define TEST_FRACTION_ERROR "GM_TEST_FRACTION must be in (0, 1)\n"
+#define INITIAL_NAME_ERROR "Unknown first generation (use random or groups)\n"
+#define SHARD_RANKS_ERROR "GM_SHARD_RANKS must divide the number of ranks\n"
+#define STREAM_FILE_ERROR "Out of core runs need the binary dataset file of the csv, up to date (make convert, then convert.out file.csv)\n"
+#define STREAM_READ_ERROR "Failed to read the binary dataset file\n"
+#define STREAM_THREAD_ERROR "Failed to start the prefetch thread\n"
+#define MEMORY_BUDGET_ERROR "GM_MEMORY_BUDGET is too small to hold the test genes, the neighbor lists and one row per buffer\n"
+#define MEMORY_BUDGET_NAME_ERROR "GM_MEMORY_BUDGET and GM_CACHE_BUDGET must be a number of bytes, optionally followed by K, M or G\n"
+#define CACHE_TEST_GENES_ERROR "The distance cache was built over other test genes than the evaluator's\n"
+#define CHECKPOINT_FORMAT_ERROR "Checkpoint file is corrupt or from another version\n"
+#define CHECKPOINT_MISMATCH_ERROR "Checkpoint was written by a run with another seed, dataset or GA settings\n"
+#define CHECKPOINT_RANKS_ERROR "The ranks resumed from checkpoints of different generations\n"
+#define CHECKPOINT_THREAD_ERROR "Failed to start the checkpoint writer thread\n"
+#define CHECKPOINT_WRITE_WARNING "Failed to write a checkpoint, the run goes on\n"
+#define PERF_OPEN_WARNING "Hardware counters unavailable (perf_event_open failed), telemetry reports none\n"
 
 #endif
\ No newline at end of file
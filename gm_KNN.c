@@ -1,42 +1,302 @@
 #include "gm_KNN.h"
 #include "gm_creature.h"
-#include "gm_creature.h"
+#include "gm_batch.h"
+#include "gm_cache.h"
+#include "gm_search.h"
+#include "gm_vote.h"
+#include "gm_telemetry.h"
+#include "errors.h"
 #include <math.h>
 
 /**
  * Calculates the Euclidean distance between two genes.
  *
- * @param gene1 The first gene.
- * @param gene2 The second gene.
+ * @param dataset The dataset holding both genes.
+ * @param gene1 The global index of the first gene.
+ * @param gene2 The global index of the second gene.
  * @return The Euclidean distance between the two genes.
  */
-double get_distance(Gene* gene1, Gene* gene2) {
-    double distance = 0;
-    for(int i = 0; i < gene1->num_features; i++) {
-        distance += pow(gene1->features[i] - gene2->features[i], 2);
+double get_distance(Dataset* dataset, int gene1, int gene2) {
+    return sqrt(get_distance_sq(dataset, gene1, gene2));
+}
+
+
+/**
+ * Calculates the squared Euclidean distance between two genes.
+ *
+ * This is the ranking path, sqrt is monotonic so the nearest neighbors are the
+ * same either way. The selected SIMD kernel runs over the full padded row, the
+ * padding is zero in both rows so it adds nothing to the distance.
+ *
+ * @param dataset The dataset holding both genes.
+ * @param gene1 The global index of the first gene.
+ * @param gene2 The global index of the second gene.
+ * @return The squared Euclidean distance between the two genes.
+ */
+float get_distance_sq(Dataset* dataset, int gene1, int gene2) {
+    return distance_sq_rows(dataset, gene1, gene2);
+}
+
+//O(k)
+/**
+ * Classifies a test gene by the vote of its nearest neighbors (see
+ * vote_classify).
+ *
+ * Ties go to the class that reached the top tally first, which favors nearer
+ * neighbors.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param list The k nearest neighbors sorted by ascending distance (index -1 ends the list early).
+ * @param k The number of neighbors in the list.
+ * @param vote The calling thread's tally, made for dataset->num_classes classes and at least k neighbors.
+ * @return The predicted class id, -1 if the list is empty.
+ */
+int KNN_vote(Dataset* dataset, const distance_intex_t* list, int k, vote_t* vote) {
+    return vote_classify(vote, dataset->labels, list, k);
+}
+
+
+//O(t * k)
+/**
+ * Counts how many test genes the neighbor lists classify correctly.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param test_genes The global indices of the test genes.
+ * @param num_test_genes The number of test genes.
+ * @param neighbors num_test_genes lists of k neighbors sorted by ascending distance.
+ * @param k The number of neighbors per list.
+ * @return The number of correctly classified test genes.
+ */
+static int count_correct(Dataset* dataset, const int* test_genes, int num_test_genes, const distance_intex_t* neighbors, int k) {
+    vote_t vote;
+    vote_init(&vote, dataset->num_classes, k, VOTE_MAJORITY);
+
+    int correct = 0;
+    for (int test_index = 0; test_index < num_test_genes; test_index++) {
+        if (KNN_vote(dataset, neighbors + (size_t)test_index * k, k, &vote) == dataset->labels[test_genes[test_index]]) {
+            correct++;
+        }
     }
 
-    return sqrt(distance);
+    vote_free(&vote);
+    return correct;
 }
 
-double KNN(Creature* creature, Creature* test_creature, Gene* genes, int k) {
-    //index 0 for distance, index 1 for gene index
-    distance_intex_t distance_index[creature->num_genes];
 
-    //find the k nearist neighbors for each point
-    int num_genes = creature->num_genes;
+/**
+ * Scores a creature as a KNN classifier over a set of test genes.
+ *
+ * Every test gene is classified by a majority vote of its k nearest genes in
+ * the creature. The neighbors of all test genes are found in one call to the
+ * batch distance engine, so per test gene only the k best neighbors are ever
+ * stored.
+ *
+ * @param creature The creature whose genes are the training set.
+ * @param test_creature The creature whose genes are the test set.
+ * @param dataset The dataset holding every gene.
+ * @param k The number of neighbors that vote (clamped to the creature size).
+ * @return The fraction of test genes classified correctly.
+ */
+double KNN(Creature* creature, Creature* test_creature, Dataset* dataset, int k) {
+    TELEMETRY_SCOPE(TELEMETRY_KNN);
+    TELEMETRY_PERF_SCOPE();
     int num_test_genes = test_creature->num_genes;
-    for(int creature_index = 0; creature_index < num_genes; creature_index++) {
-        //compute distances to all test genes
-        for(int test_creature_index = 0; test_creature_index < num_test_genes; test_creature_index++) {
-            distance_index[test_creature_index].distance = get_distance(&genes[creature->gene_indices[creature_index]], &genes[test_creature->gene_indices[test_creature_index]]);
-            distance_index[test_creature_index].index = test_creature_index;
+    if (k > creature->num_genes) {
+        k = creature->num_genes;
+    }
+    if (num_test_genes <= 0 || k <= 0) {
+        return 0;
+    }
+
+    //k nearest creature genes of every test gene
+    distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)num_test_genes * k * sizeof(distance_intex_t));
+    if (neighbors == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    batch_knn(dataset, test_creature->gene_indices, num_test_genes, creature->gene_indices, creature->num_genes, k, neighbors);
+
+    //now use the k nearist neighbors to classify each test gene
+    int correct = count_correct(dataset, test_creature->gene_indices, num_test_genes, neighbors, k);
+
+    free(neighbors);
+
+    return (double)correct / num_test_genes;
+}
+
+
+/**
+ * Scores a creature like KNN, reading the distances from a precomputed cache.
+ *
+ * The test genes are the ones the cache was built for. The result is the same
+ * as KNN over those test genes.
+ *
+ * @param creature The creature whose genes are the training set.
+ * @param cache The distance cache of the test genes.
+ * @param dataset The dataset holding every gene.
+ * @param k The number of neighbors that vote (clamped to the creature size).
+ * @return The fraction of test genes classified correctly.
+ */
+double KNN_cached(Creature* creature, DistanceCache* cache, Dataset* dataset, int k) {
+    TELEMETRY_SCOPE(TELEMETRY_KNN);
+    TELEMETRY_PERF_SCOPE();
+    int num_test_genes = cache->num_test_genes;
+    if (k > creature->num_genes) {
+        k = creature->num_genes;
+    }
+    if (num_test_genes <= 0 || k <= 0) {
+        return 0;
+    }
+
+    distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)num_test_genes * k * sizeof(distance_intex_t));
+    if (neighbors == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    cache_knn(cache, dataset, creature, k, neighbors);
+    int correct = count_correct(dataset, cache->test_genes, num_test_genes, neighbors, k);
+
+    free(neighbors);
+
+    return (double)correct / num_test_genes;
+}
+
+
+//O(t * probed members * d / threads)
+/**
+ * Scores a creature like KNN, finding the neighbors through a search backend.
+ *
+ * The test genes are split into blocks of BATCH_QUERY_BLOCK queries that the
+ * threads take in turn, each with its own scratch. With the exact backend the
+ * result is the same as KNN, an approximate backend may miss neighbors.
+ *
+ * @param creature The creature whose genes are the training set.
+ * @param test_creature The creature whose genes are the test set.
+ * @param search The neighbor search backend.
+ * @param k The number of neighbors that vote (clamped to the creature size).
+ * @return The fraction of test genes classified correctly.
+ */
+double KNN_search(Creature* creature, Creature* test_creature, NeighborSearch* search, int k) {
+    TELEMETRY_SCOPE(TELEMETRY_KNN);
+    TELEMETRY_PERF_SCOPE();
+    Dataset* dataset = search->dataset;
+    int num_test_genes = test_creature->num_genes;
+    if (k > creature->num_genes) {
+        k = creature->num_genes;
+    }
+    if (num_test_genes <= 0 || k <= 0) {
+        return 0;
+    }
+
+    distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)num_test_genes * k * sizeof(distance_intex_t));
+    if (neighbors == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        search_scratch_t scratch;
+        search_scratch_init(&scratch);
+
+        #pragma omp for schedule(dynamic)
+        for (int first = 0; first < num_test_genes; first += BATCH_QUERY_BLOCK) {
+            int count = num_test_genes - first < BATCH_QUERY_BLOCK ? num_test_genes - first : BATCH_QUERY_BLOCK;
+            search_knn(search, test_creature->gene_indices + first, count, creature->gene_indices, creature->num_genes, k, neighbors + (size_t)first * k, &scratch);
         }
 
-        //sort distances
-        nth_element(distance_index, num_test_genes, k - 1);
+        search_scratch_free(&scratch);
+    }
+
+    int correct = count_correct(dataset, test_creature->gene_indices, num_test_genes, neighbors, k);
+    free(neighbors);
+
+    return (double)correct / num_test_genes;
+}
+
+
+#ifdef GM_USE_MPI
+
+//test set sharding: every rank of a communicator scores the creatures against its own contiguous
+//slice of the test genes and the per creature counts of correct predictions are summed over the
+//ranks. the counts are integers, so the sum (and the fitness) is exactly what one rank would get
+
+//O(1)
+/**
+ * Finds this rank's slice of a test set split evenly over the ranks of a
+ * communicator.
+ *
+ * @param num_test_genes The number of test genes of the whole set.
+ * @param comm The communicator sharing the test set.
+ * @param begin Set to the first test gene of the slice.
+ * @param end Set to one past the last test gene of the slice.
+ */
+void KNN_shard(int num_test_genes, MPI_Comm comm, int* begin, int* end) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    *begin = (int)((long long)num_test_genes * rank / size);
+    *end = (int)((long long)num_test_genes * (rank + 1) / size);
+    return (void)0;
+}
+
+
+//O(n)
+/**
+ * Sums every creature's count of correct predictions over the ranks sharing a
+ * test set, in place, with a single MPI_Allreduce.
+ *
+ * @param correct The count of every creature on this rank's slice, the total over every rank on return.
+ * @param num_creatures The number of creatures.
+ * @param comm The communicator sharing the test set.
+ */
+void KNN_reduce_correct(int* correct, int num_creatures, MPI_Comm comm) {
+    MPI_Allreduce(MPI_IN_PLACE, correct, num_creatures, MPI_INT, MPI_SUM, comm);
+    return (void)0;
+}
+
 
-        //now use the k nearist neighbors to classify the new point
-        //make a hash map of labels to counts
+//O(t * |creature| * d / ranks)
+/**
+ * Scores a creature like KNN with the test genes sharded over the ranks of a
+ * communicator. Every rank must call it with the same creature and test set,
+ * and every rank gets the same result as KNN.
+ *
+ * @param creature The creature whose genes are the training set.
+ * @param test_creature The creature whose genes are the test set (the whole set).
+ * @param dataset The dataset holding every gene.
+ * @param k The number of neighbors that vote (clamped to the creature size).
+ * @param comm The communicator sharing the test set.
+ * @return The fraction of test genes classified correctly.
+ */
+double KNN_sharded(Creature* creature, Creature* test_creature, Dataset* dataset, int k, MPI_Comm comm) {
+    int num_test_genes = test_creature->num_genes;
+    if (k > creature->num_genes) {
+        k = creature->num_genes;
     }
-}
\ No newline at end of file
+    if (num_test_genes <= 0 || k <= 0) {
+        return 0;
+    }
+
+    int begin, end;
+    KNN_shard(num_test_genes, comm, &begin, &end);
+    int correct = 0;
+
+    if (end > begin) {
+        distance_intex_t* neighbors = (distance_intex_t*)malloc((size_t)(end - begin) * k * sizeof(distance_intex_t));
+        if (neighbors == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        batch_knn(dataset, test_creature->gene_indices + begin, end - begin, creature->gene_indices, creature->num_genes, k, neighbors);
+        correct = count_correct(dataset, test_creature->gene_indices + begin, end - begin, neighbors, k);
+        free(neighbors);
+    }
+
+    KNN_reduce_correct(&correct, 1, comm);
+    return (double)correct / num_test_genes;
+}
+
+#endif
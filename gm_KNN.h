@@ -1,3 +1,29 @@
-double get_distance(Gene* gene1, Gene* gene2);
+#ifndef GM_KNN_H
+#define GM_KNN_H
+#include "gm_creature.h"
+#include "gm_distance.h"
 
-double KNN(Creature* creature, Creature* test_creature, Gene* genes, int k);
\ No newline at end of file
+//defined in gm_cache.h, gm_search.h and gm_vote.h
+typedef struct DistanceCache DistanceCache;
+typedef struct NeighborSearch NeighborSearch;
+typedef struct vote_t vote_t;
+
+double get_distance(Dataset* dataset, int gene1, int gene2);
+float get_distance_sq(Dataset* dataset, int gene1, int gene2);
+
+double KNN(Creature* creature, Creature* test_creature, Dataset* dataset, int k);
+
+double KNN_cached(Creature* creature, DistanceCache* cache, Dataset* dataset, int k);
+
+double KNN_search(Creature* creature, Creature* test_creature, NeighborSearch* search, int k);
+
+int KNN_vote(Dataset* dataset, const distance_intex_t* list, int k, vote_t* vote);
+
+//test set sharded over the ranks of a communicator (MPI build only)
+#ifdef GM_USE_MPI
+void KNN_shard(int num_test_genes, MPI_Comm comm, int* begin, int* end);
+void KNN_reduce_correct(int* correct, int num_creatures, MPI_Comm comm);
+double KNN_sharded(Creature* creature, Creature* test_creature, Dataset* dataset, int k, MPI_Comm comm);
+#endif
+
+#endif
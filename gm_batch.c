@@ -0,0 +1,323 @@
+#include "gm_batch.h"
+#include "gm_topk.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <math.h>
+
+//the batch engine computes the distances between a block of query rows and a block of reference
+//rows at once, using |a - b|^2 = |a|^2 + |b|^2 - 2 a.b with the norms precomputed in the dataset
+//so the inner loop is a small matrix multiply. reference rows are packed NR at a time into panels
+//laid out feature major ([feature][NR]) so the micro kernel is a broadcast and multiply-add over
+//contiguous memory. every tile feeds the per query streaming top k (gm_topk.h) directly, no distance
+//row is stored. a reduced precision dataset (dataset_set_storage) is decoded while packing, so the
+//references are read from memory at 2 or 1 bytes per feature and multiplied as floats
+
+
+//O(MR * NR * d)
+/**
+ * Inner products of MR query rows with one packed panel of NR reference rows.
+ *
+ * The accumulators are a MR x NR tile that stays in vector registers. The
+ * function is cloned for AVX-512, AVX2 and baseline x86-64 and the right clone
+ * is picked at load time.
+ *
+ * @param query The MR query rows.
+ * @param panel The packed panel, num_features rows of NR floats.
+ * @param num_features The number of features to multiply over.
+ * @param dots The output tile, MR rows of NR floats.
+ */
+__attribute__((target_clones("avx512f", "avx2", "default")))
+static void micro_kernel(const float* query[BATCH_MR], const float* panel, int num_features, float dots[BATCH_MR][BATCH_NR]) {
+    float acc[BATCH_MR][BATCH_NR] = {{0}};
+
+    for (int d = 0; d < num_features; d++) {
+        const float* panel_row = panel + (size_t)d * BATCH_NR;
+        for (int m = 0; m < BATCH_MR; m++) {
+            float q = query[m][d];
+            #pragma omp simd
+            for (int r = 0; r < BATCH_NR; r++) {
+                acc[m][r] += q * panel_row[r];
+            }
+        }
+    }
+
+    for (int m = 0; m < BATCH_MR; m++) {
+        for (int r = 0; r < BATCH_NR; r++) {
+            dots[m][r] = acc[m][r];
+        }
+    }
+}
+
+
+//O(1)
+//sizes the reference blocks so their packed panels fit in cache (at least one panel)
+static int plan_panels(const Dataset* dataset) {
+    int panel_size = dataset->num_features * BATCH_NR;
+    int panels_per_block = BATCH_CACHE_BYTES / (panel_size * (int)sizeof(float) + 1);
+    return panels_per_block < 1 ? 1 : panels_per_block;
+}
+
+
+//O(1) unless a buffer has to grow
+//makes sure the scratch buffers are big enough for a batch of this dataset and k
+static void scratch_reserve(batch_scratch_t* scratch, const Dataset* dataset, int k) {
+    size_t packed_size = (size_t)plan_panels(dataset) * dataset->num_features * BATCH_NR;
+    if (packed_size > scratch->packed_capacity) {
+        free(scratch->packed);
+        scratch->packed = (float*)aligned_alloc(DATASET_ALIGNMENT, (packed_size * sizeof(float) + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT);
+        scratch->packed_capacity = packed_size;
+        scratch->num_allocations++;
+    }
+
+    //reduced precision rows are decoded into floats, the queries of a block once per block
+    size_t decoded_size = dataset->storage != STORAGE_F32 ? (size_t)dataset->padded_features : 0;
+    if (decoded_size > scratch->decoded_capacity) {
+        free(scratch->decoded_queries);
+        free(scratch->decoded_row);
+        scratch->decoded_queries = (float*)aligned_alloc(DATASET_ALIGNMENT, (size_t)BATCH_QUERY_BLOCK * decoded_size * sizeof(float));
+        scratch->decoded_row = (float*)aligned_alloc(DATASET_ALIGNMENT, decoded_size * sizeof(float));
+        scratch->decoded_capacity = decoded_size;
+        scratch->num_allocations += 2;
+    }
+
+    //top k heaps of a query block, only needed past the small buffer
+    size_t heap_size = k > TOPK_SMALL ? (size_t)k : 0;
+    if (heap_size > scratch->heap_capacity) {
+        free(scratch->heap_distance);
+        free(scratch->heap_index);
+        scratch->heap_distance = (float*)malloc((size_t)BATCH_QUERY_BLOCK * heap_size * sizeof(float));
+        scratch->heap_index = (int*)malloc((size_t)BATCH_QUERY_BLOCK * heap_size * sizeof(int));
+        scratch->heap_capacity = heap_size;
+        scratch->num_allocations += 2;
+    }
+
+    if (scratch->packed == NULL || (decoded_size > 0 && (scratch->decoded_queries == NULL || scratch->decoded_row == NULL))
+        || (heap_size > 0 && (scratch->heap_distance == NULL || scratch->heap_index == NULL))) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    return (void)0;
+}
+
+
+//O(BATCH_QUERY_BLOCK * r * d)
+//finds the k nearest references of the queries query_start .. query_end - 1 (at most one block)
+static void knn_query_block(Dataset* dataset, const int* queries, int query_start, int query_end, const int* references, int num_references, int k, distance_intex_t* neighbors, batch_scratch_t* scratch) {
+    int num_features = dataset->num_features;
+    const float* norms = dataset->norms;
+    int panel_size = num_features * BATCH_NR;
+    int reference_block = plan_panels(dataset) * BATCH_NR;
+    int decode = dataset->storage != STORAGE_F32;
+    float* packed = scratch->packed;
+
+    //top k state of the block, O(k) per query
+    topk_small_t small[BATCH_QUERY_BLOCK];
+    topk_heap_t heaps[BATCH_QUERY_BLOCK];
+
+    for (int q = 0; q < query_end - query_start; q++) {
+        if (decode) {
+            dataset_decode_row(dataset, queries[query_start + q], scratch->decoded_queries + (size_t)q * dataset->padded_features);
+        }
+        if (k <= TOPK_SMALL) {
+            topk_small_init(&small[q], k);
+        } else {
+            topk_heap_init(&heaps[q], k, scratch->heap_distance + (size_t)q * k, scratch->heap_index + (size_t)q * k);
+        }
+    }
+
+    TELEMETRY_COUNT(TELEMETRY_DISTANCES, (uint64_t)(query_end - query_start) * num_references);
+    for (int reference_start = 0; reference_start < num_references; reference_start += reference_block) {
+        int reference_end = reference_start + reference_block < num_references ? reference_start + reference_block : num_references;
+        int num_panels = (reference_end - reference_start + BATCH_NR - 1) / BATCH_NR;
+
+        //pack the reference block, panel p holds references p * NR .. p * NR + NR - 1 feature major
+        //(a partial last panel is padded with zero columns)
+        for (int p = 0; p < num_panels; p++) {
+            float* panel = packed + (size_t)p * panel_size;
+            for (int r = 0; r < BATCH_NR; r++) {
+                int reference = reference_start + p * BATCH_NR + r;
+                if (reference < reference_end) {
+                    const float* row = scratch->decoded_row;
+                    if (decode) {
+                        dataset_decode_row(dataset, references[reference], scratch->decoded_row);
+                    } else {
+                        row = dataset_row(dataset, references[reference]);
+                    }
+                    for (int d = 0; d < num_features; d++) {
+                        panel[(size_t)d * BATCH_NR + r] = row[d];
+                    }
+                } else {
+                    for (int d = 0; d < num_features; d++) {
+                        panel[(size_t)d * BATCH_NR + r] = 0;
+                    }
+                }
+            }
+        }
+
+        //multiply the query block against the packed block one register tile at a time
+        for (int q = query_start; q < query_end; q += BATCH_MR) {
+            //a partial tile repeats the last query, its extra results are dropped
+            const float* query_rows[BATCH_MR];
+            for (int m = 0; m < BATCH_MR; m++) {
+                int query = q + m < query_end ? q + m : query_end - 1;
+                query_rows[m] = decode ? scratch->decoded_queries + (size_t)(query - query_start) * dataset->padded_features : dataset_row(dataset, queries[query]);
+            }
+
+            for (int p = 0; p < num_panels; p++) {
+                float dots[BATCH_MR][BATCH_NR];
+                micro_kernel(query_rows, packed + (size_t)p * panel_size, num_features, dots);
+
+                //turn the tile into distances and feed the top k lists
+                int panel_end = reference_end - (reference_start + p * BATCH_NR);
+                if (panel_end > BATCH_NR) {
+                    panel_end = BATCH_NR;
+                }
+                const int* panel_genes = references + reference_start + p * BATCH_NR;
+
+                for (int m = 0; m < BATCH_MR && q + m < query_end; m++) {
+                    float query_norm = norms[queries[q + m]];
+
+                    if (k <= TOPK_SMALL) {
+                        //work on a local copy so the buffer stays in registers for the whole panel
+                        topk_small_t local = small[q + m - query_start];
+                        float threshold = topk_small_threshold(&local);
+                        for (int r = 0; r < panel_end; r++) {
+                            float distance = query_norm + norms[panel_genes[r]] - 2 * dots[m][r];
+                            if (distance < 0) {
+                                distance = 0;
+                            }
+                            if (distance < threshold) {
+                                topk_small_push(&local, distance, panel_genes[r]);
+                                threshold = topk_small_threshold(&local);
+                            }
+                        }
+                        small[q + m - query_start] = local;
+                    } else {
+                        topk_heap_t* heap = &heaps[q + m - query_start];
+                        for (int r = 0; r < panel_end; r++) {
+                            float distance = query_norm + norms[panel_genes[r]] - 2 * dots[m][r];
+                            if (distance < 0) {
+                                distance = 0;
+                            }
+                            topk_heap_push(heap, distance, panel_genes[r]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //the block is done, write its lists out sorted
+    for (int q = 0; q < query_end - query_start; q++) {
+        if (k <= TOPK_SMALL) {
+            topk_small_sorted(&small[q], neighbors + (size_t)(query_start + q) * k);
+        } else {
+            topk_heap_sorted(&heaps[q], neighbors + (size_t)(query_start + q) * k);
+        }
+    }
+
+    return (void)0;
+}
+
+
+//O(q * r * d)
+/**
+ * Finds the k nearest reference rows of every query row.
+ *
+ * Queries are processed in blocks of BATCH_QUERY_BLOCK in parallel. For each
+ * query block the references are walked in blocks sized to fit in
+ * BATCH_CACHE_BYTES, each reference block is packed into panels once and then
+ * multiplied against the query block one register tile at a time. Distances use
+ * the squared L2 metric and are clamped at 0 (the expansion can round slightly
+ * below it for near duplicates).
+ *
+ * The dataset norms are computed here if they are missing, callers running
+ * several batches concurrently should call dataset_compute_norms first.
+ *
+ * @param dataset The dataset holding every row.
+ * @param queries The global gene indices of the query rows.
+ * @param num_queries The number of query rows.
+ * @param references The global gene indices of the reference rows.
+ * @param num_references The number of reference rows.
+ * @param k The number of neighbors to find per query.
+ * @param neighbors Output, num_queries lists of k neighbors sorted by ascending squared
+ *                  distance. The index is the global gene index of the reference, lists
+ *                  are padded with (INFINITY, -1) when there are fewer than k references.
+ */
+void batch_knn(Dataset* dataset, const int* queries, int num_queries, const int* references, int num_references, int k, distance_intex_t* neighbors) {
+    if (dataset->norms == NULL) {
+        dataset_compute_norms(dataset);
+    }
+
+    int num_query_blocks = (num_queries + BATCH_QUERY_BLOCK - 1) / BATCH_QUERY_BLOCK;
+
+    #pragma omp parallel
+    {
+        batch_scratch_t scratch;
+        batch_scratch_init(&scratch);
+        scratch_reserve(&scratch, dataset, k);
+
+        #pragma omp for schedule(dynamic)
+        for (int block = 0; block < num_query_blocks; block++) {
+            int query_start = block * BATCH_QUERY_BLOCK;
+            int query_end = query_start + BATCH_QUERY_BLOCK < num_queries ? query_start + BATCH_QUERY_BLOCK : num_queries;
+            knn_query_block(dataset, queries, query_start, query_end, references, num_references, k, neighbors, &scratch);
+        }
+
+        batch_scratch_free(&scratch);
+    }
+
+    return (void)0;
+}
+
+
+//O(q * r * d)
+/**
+ * Same as batch_knn, on the calling thread only and with caller owned scratch.
+ *
+ * Meant for drivers that already run one batch per thread (see gm_evaluator),
+ * the scratch grows on first use and is then reused, so a steady stream of
+ * batches allocates nothing. The dataset norms must already be computed.
+ *
+ * @param scratch The calling thread's scratch buffers.
+ */
+void batch_knn_serial(Dataset* dataset, const int* queries, int num_queries, const int* references, int num_references, int k, distance_intex_t* neighbors, batch_scratch_t* scratch) {
+    scratch_reserve(scratch, dataset, k);
+
+    for (int query_start = 0; query_start < num_queries; query_start += BATCH_QUERY_BLOCK) {
+        int query_end = query_start + BATCH_QUERY_BLOCK < num_queries ? query_start + BATCH_QUERY_BLOCK : num_queries;
+        knn_query_block(dataset, queries, query_start, query_end, references, num_references, k, neighbors, scratch);
+    }
+
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Initializes empty batch scratch buffers.
+ *
+ * @param scratch The scratch to initialize.
+ */
+void batch_scratch_init(batch_scratch_t* scratch) {
+    memset(scratch, 0, sizeof(batch_scratch_t));
+    return (void)0;
+}
+
+
+/**
+ * Frees the buffers of a batch scratch.
+ *
+ * @param scratch The scratch to be freed.
+ */
+void batch_scratch_free(batch_scratch_t* scratch) {
+    free(scratch->packed);
+    free(scratch->decoded_queries);
+    free(scratch->decoded_row);
+    free(scratch->heap_distance);
+    free(scratch->heap_index);
+    memset(scratch, 0, sizeof(batch_scratch_t));
+    return (void)0;
+}
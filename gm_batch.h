@@ -0,0 +1,36 @@
+#ifndef GM_BATCH_H
+#define GM_BATCH_H
+
+#include "gm_dataset.h"
+#include "gm_helper.h"
+
+//register tile of the inner product micro kernel (MR query rows x NR reference rows)
+#define BATCH_MR 4
+#define BATCH_NR 16
+//number of query rows that share one packed reference block
+#define BATCH_QUERY_BLOCK 64
+//a packed reference block is sized to stay in this many bytes of cache
+#ifndef BATCH_CACHE_BYTES
+    #define BATCH_CACHE_BYTES (256 * 1024)
+#endif
+
+//per thread buffers of the batch engine, they only grow and can be reused across batches
+typedef struct batch_scratch_t {
+    float* packed;
+    size_t packed_capacity;
+    float* decoded_queries;
+    float* decoded_row;
+    size_t decoded_capacity;
+    float* heap_distance;
+    int* heap_index;
+    size_t heap_capacity;
+    long long num_allocations;
+} batch_scratch_t;
+
+
+void batch_knn(Dataset* dataset, const int* queries, int num_queries, const int* references, int num_references, int k, distance_intex_t* neighbors);
+void batch_knn_serial(Dataset* dataset, const int* queries, int num_queries, const int* references, int num_references, int k, distance_intex_t* neighbors, batch_scratch_t* scratch);
+void batch_scratch_init(batch_scratch_t* scratch);
+void batch_scratch_free(batch_scratch_t* scratch);
+
+#endif
@@ -0,0 +1,424 @@
+#include "gm_binfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "errors.h"
+
+//the source checksum reads the first and last BINFILE_EDGE_BYTES of the csv and BINFILE_SAMPLES
+//blocks of BINFILE_SAMPLE_BYTES spread evenly in between, a few hundred KB whatever the csv's size
+#define BINFILE_EDGE_BYTES 65536
+#define BINFILE_SAMPLES 32
+#define BINFILE_SAMPLE_BYTES 4096
+
+
+//FNV-1a 64
+static uint64_t checksum_update(uint64_t hash, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#define CHECKSUM_START 14695981039346656037ull
+
+
+//O(1)
+//rounds an offset up to the next section boundary
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT;
+}
+
+
+//O(1)
+//checksum of every header field before header_checksum
+static uint64_t header_checksum(const binfile_header_t* header) {
+    return checksum_update(CHECKSUM_START, (const unsigned char*)header, offsetof(binfile_header_t, header_checksum));
+}
+
+
+//O(1)
+/**
+ * Fills the source fields of a header from the csv file.
+ *
+ * @param header The header to fill.
+ * @param source_name The name of the csv file.
+ * @return 1 if the csv could be read, 0 otherwise.
+ */
+static int source_fingerprint(binfile_header_t* header, const char* source_name) {
+    int file = open(source_name, O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close(file);
+        return 0;
+    }
+    header->source_size = (uint64_t)info.st_size;
+    header->source_mtime_sec = (int64_t)info.st_mtim.tv_sec;
+    header->source_mtime_nsec = (int64_t)info.st_mtim.tv_nsec;
+
+    unsigned char* buffer = (unsigned char*)malloc(BINFILE_EDGE_BYTES);
+    if (buffer == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    uint64_t hash = checksum_update(CHECKSUM_START, (const unsigned char*)&header->source_size, sizeof(header->source_size));
+    uint64_t size = header->source_size;
+
+    //the edges, then the samples in between
+    ssize_t got = pread(file, buffer, BINFILE_EDGE_BYTES, 0);
+    hash = checksum_update(hash, buffer, got > 0 ? (size_t)got : 0);
+    if (size > BINFILE_EDGE_BYTES) {
+        got = pread(file, buffer, BINFILE_EDGE_BYTES, (off_t)(size - BINFILE_EDGE_BYTES));
+        hash = checksum_update(hash, buffer, got > 0 ? (size_t)got : 0);
+    }
+    if (size > 2 * BINFILE_EDGE_BYTES) {
+        uint64_t middle = size - 2 * BINFILE_EDGE_BYTES;
+        for (int i = 0; i < BINFILE_SAMPLES; i++) {
+            uint64_t offset = BINFILE_EDGE_BYTES + middle / BINFILE_SAMPLES * i;
+            got = pread(file, buffer, BINFILE_SAMPLE_BYTES, (off_t)offset);
+            hash = checksum_update(hash, buffer, got > 0 ? (size_t)got : 0);
+        }
+    }
+    header->source_checksum = hash;
+
+    free(buffer);
+    close(file);
+    return 1;
+}
+
+
+/**
+ * Returns the name of the binary file that goes with a csv file.
+ *
+ * @param source_name The name of the csv file.
+ * @return A newly allocated string, source_name followed by BINFILE_EXTENSION.
+ */
+char* binfile_name(const char* source_name) {
+    char* name = (char*)malloc(strlen(source_name) + strlen(BINFILE_EXTENSION) + 1);
+    if (name == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    strcpy(name, source_name);
+    strcat(name, BINFILE_EXTENSION);
+    return name;
+}
+
+
+//writes size bytes and zero padding up to offset, returns 0 on a short write
+static int write_section(FILE* file, const void* data, size_t size, uint64_t* position, uint64_t offset) {
+    static const char zeros[DATASET_ALIGNMENT] = {0};
+    while (*position < offset) {
+        size_t pad = offset - *position < sizeof(zeros) ? (size_t)(offset - *position) : sizeof(zeros);
+        if (fwrite(zeros, 1, pad, file) != pad) {
+            return 0;
+        }
+        *position += pad;
+    }
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return 0;
+    }
+    *position += size;
+    return 1;
+}
+
+
+//O(n * d)
+/**
+ * Writes a dataset to a binary dataset file.
+ *
+ * The file is written under a temporary name and renamed into place, so a
+ * reader never sees half a file. The norms are stored when the dataset has
+ * them. Only STORAGE_F32 datasets are written. Failing to write is not an error, the file is only a cache.
+ *
+ * @param dataset The dataset to write.
+ * @param file_name The name of the binary file.
+ * @param source_name The csv the dataset was loaded from, or NULL if it has none.
+ * @return 1 if the file was written, 0 otherwise.
+ */
+int binfile_write(const Dataset* dataset, const char* file_name, const char* source_name) {
+    //only the float matrix is stored
+    if (dataset->storage != STORAGE_F32) {
+        return 0;
+    }
+
+    binfile_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINFILE_MAGIC, sizeof(header.magic));
+    header.version = BINFILE_VERSION;
+    header.byte_order = BINFILE_BYTE_ORDER;
+    if (source_name != NULL && !source_fingerprint(&header, source_name)) {
+        return 0;
+    }
+
+    header.num_genes = dataset->num_genes;
+    header.num_features = dataset->num_features;
+    header.padded_features = dataset->padded_features;
+    header.num_classes = dataset->num_classes;
+    header.flags = dataset->norms != NULL ? BINFILE_HAS_NORMS : 0;
+
+    //lay out the sections
+    header.class_names_offset = align_offset(sizeof(header));
+    for (int i = 0; i < dataset->num_classes; i++) {
+        header.class_names_size += strlen(dataset->class_names[i]) + 1;
+    }
+    header.features_offset = align_offset(header.class_names_offset + header.class_names_size);
+    uint64_t features_size = (uint64_t)dataset->num_genes * dataset->padded_features * sizeof(float);
+    header.labels_offset = align_offset(header.features_offset + features_size);
+    uint64_t labels_size = (uint64_t)dataset->num_genes * sizeof(int32_t);
+    header.norms_offset = align_offset(header.labels_offset + labels_size);
+    uint64_t norms_size = dataset->norms != NULL ? (uint64_t)dataset->num_genes * sizeof(float) : 0;
+    header.file_size = header.norms_offset + norms_size;
+    header.header_checksum = header_checksum(&header);
+
+    //write under a temporary name, then rename
+    char* temporary_name = (char*)malloc(strlen(file_name) + 32);
+    if (temporary_name == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    sprintf(temporary_name, "%s.%ld.tmp", file_name, (long)getpid());
+
+    FILE* file = fopen(temporary_name, "wb");
+    if (file == NULL) {
+        free(temporary_name);
+        return 0;
+    }
+
+    uint64_t position = 0;
+    int ok = write_section(file, &header, sizeof(header), &position, 0);
+    for (int i = 0; ok && i < dataset->num_classes; i++) {
+        uint64_t offset = i == 0 ? header.class_names_offset : position;
+        ok = write_section(file, dataset->class_names[i], strlen(dataset->class_names[i]) + 1, &position, offset);
+    }
+    ok = ok && write_section(file, dataset->features, features_size, &position, header.features_offset);
+    ok = ok && write_section(file, dataset->labels, labels_size, &position, header.labels_offset);
+    ok = ok && write_section(file, dataset->norms, norms_size, &position, header.norms_offset);
+    ok = fclose(file) == 0 && ok;
+
+    if (ok) {
+        ok = rename(temporary_name, file_name) == 0;
+    }
+    if (!ok) {
+        remove(temporary_name);
+    }
+
+    free(temporary_name);
+    return ok;
+}
+
+
+//O(1)
+//checks a mapped header against the file and the current build, returns 1 if it can be used
+static int header_valid(const binfile_header_t* header, size_t file_size) {
+    if (memcmp(header->magic, BINFILE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != BINFILE_VERSION
+        || header->byte_order != BINFILE_BYTE_ORDER
+        || header->header_checksum != header_checksum(header)
+        || header->file_size != file_size) {
+        return 0;
+    }
+
+    //the row padding is a build setting, a file written with another one can't be used as is
+    if (header->num_genes < 0 || header->num_features <= 0 || header->num_classes < 0
+        || header->padded_features != dataset_padded_width(header->num_features)) {
+        return 0;
+    }
+
+    uint64_t features_size = (uint64_t)header->num_genes * header->padded_features * sizeof(float);
+    uint64_t labels_size = (uint64_t)header->num_genes * sizeof(int32_t);
+    uint64_t norms_size = (header->flags & BINFILE_HAS_NORMS) ? (uint64_t)header->num_genes * sizeof(float) : 0;
+    return header->features_offset % DATASET_ALIGNMENT == 0
+        && header->class_names_offset + header->class_names_size <= header->features_offset
+        && header->features_offset + features_size <= header->labels_offset
+        && header->labels_offset + labels_size <= header->norms_offset
+        && header->norms_offset + norms_size <= file_size;
+}
+
+
+//O(1)
+//checks that a header was made from a csv as it is now, 1 when it was (or there is no csv to check)
+static int source_matches(const binfile_header_t* header, const char* source_name) {
+    if (source_name == NULL) {
+        return 1;
+    }
+
+    //a changed csv invalidates the file, size and mtime first since they cost nothing
+    binfile_header_t source;
+    memset(&source, 0, sizeof(source));
+    struct stat source_info;
+    return stat(source_name, &source_info) == 0
+        && (uint64_t)source_info.st_size == header->source_size
+        && (int64_t)source_info.st_mtim.tv_sec == header->source_mtime_sec
+        && (int64_t)source_info.st_mtim.tv_nsec == header->source_mtime_nsec
+        && source_fingerprint(&source, source_name)
+        && source.source_checksum == header->source_checksum;
+}
+
+
+//O(c)
+//checks that every class name ends inside the class names section
+static int class_names_valid(const char* names, const binfile_header_t* header) {
+    const char* name = names;
+    const char* names_end = names + header->class_names_size;
+    for (int i = 0; i < header->num_classes; i++) {
+        const char* end = (const char*)memchr(name, '\0', names_end - name);
+        if (end == NULL) {
+            return 0;
+        }
+        name = end + 1;
+    }
+    return 1;
+}
+
+
+//O(c), the pages of the matrix are read on first touch
+/**
+ * Maps a binary dataset file into a dataset.
+ *
+ * The file is mapped copy on write, the dataset's features, labels and norms
+ * point straight into the mapping and nothing is parsed. The file is rejected
+ * (and 0 returned, leaving the dataset untouched) if it is missing, corrupt,
+ * from another version or build, or no longer matches its csv. The dataset
+ * must not have any classes yet.
+ *
+ * @param dataset The dataset to fill.
+ * @param file_name The name of the binary file.
+ * @param source_name The csv the file must have been made from, or NULL to skip that check.
+ * @return 1 if the dataset was loaded, 0 otherwise.
+ */
+int binfile_load(Dataset* dataset, const char* file_name, const char* source_name) {
+    int file = open(file_name, O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(binfile_header_t)) {
+        close(file);
+        return 0;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+
+    const binfile_header_t* header = (const binfile_header_t*)mapping;
+    int valid = header_valid(header, size);
+
+    valid = valid && source_matches(header, source_name);
+
+    //every class name must end inside its section
+    char* base = (char*)mapping;
+    valid = valid && class_names_valid(base + header->class_names_offset, header);
+
+    if (!valid) {
+        munmap(mapping, size);
+        return 0;
+    }
+
+    dataset_release(dataset);
+    dataset->mapping = mapping;
+    dataset->mapping_size = size;
+    dataset->num_genes = header->num_genes;
+    dataset->num_features = header->num_features;
+    dataset->padded_features = header->padded_features;
+    dataset->features = (float*)(base + header->features_offset);
+    dataset->labels = (int*)(base + header->labels_offset);
+    dataset->norms = (header->flags & BINFILE_HAS_NORMS) ? (float*)(base + header->norms_offset) : NULL;
+
+    //the class names are interned in order so the ids match the stored labels
+    const char* name = base + header->class_names_offset;
+    for (int i = 0; i < header->num_classes; i++) {
+        dataset_intern_label(dataset, name);
+        name += strlen(name) + 1;
+    }
+
+    //start reading the matrix in before the first distance needs it
+    madvise(dataset->features, (size_t)dataset->num_genes * dataset->padded_features * sizeof(float), MADV_WILLNEED);
+
+    return 1;
+}
+
+
+//O(n + c)
+/**
+ * Loads everything of a binary dataset file but its feature matrix.
+ *
+ * The labels and class names are read into the dataset's own memory, the
+ * features (and norms) are left NULL, so the dataset costs O(n) bytes however
+ * many features it has. The matrix is then read from the file in blocks (see
+ * gm_stream), from header->features_offset on, one row of padded_features
+ * floats after the other. The file is checked as by binfile_load, and 0
+ * returned with the dataset untouched when it can't be used.
+ *
+ * @param dataset The dataset to fill, without any classes yet.
+ * @param file_name The name of the binary file.
+ * @param source_name The csv the file must have been made from, or NULL to skip that check.
+ * @param header Output, the file's header.
+ * @return 1 if the dataset was loaded, 0 otherwise.
+ */
+int binfile_load_meta(Dataset* dataset, const char* file_name, const char* source_name, binfile_header_t* header) {
+    int file = open(file_name, O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+
+    struct stat info;
+    int valid = fstat(file, &info) == 0 && (size_t)info.st_size >= sizeof(binfile_header_t)
+        && pread(file, header, sizeof(binfile_header_t), 0) == (ssize_t)sizeof(binfile_header_t)
+        && header_valid(header, (size_t)info.st_size)
+        && source_matches(header, source_name);
+
+    char* names = NULL;
+    int* labels = NULL;
+    if (valid) {
+        size_t labels_size = (size_t)header->num_genes * sizeof(int32_t);
+        names = (char*)malloc(header->class_names_size + 1);
+        labels = (int*)malloc(labels_size > 0 ? labels_size : 1);
+        if (names == NULL || labels == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        valid = pread(file, names, header->class_names_size, (off_t)header->class_names_offset) == (ssize_t)header->class_names_size
+            && pread(file, labels, labels_size, (off_t)header->labels_offset) == (ssize_t)labels_size
+            && class_names_valid(names, header);
+    }
+    close(file);
+
+    if (!valid) {
+        free(names);
+        free(labels);
+        return 0;
+    }
+
+    dataset_release(dataset);
+    dataset->num_genes = header->num_genes;
+    dataset->num_features = header->num_features;
+    dataset->padded_features = header->padded_features;
+    dataset->labels = labels;
+
+    const char* name = names;
+    for (int i = 0; i < header->num_classes; i++) {
+        dataset_intern_label(dataset, name);
+        name += strlen(name) + 1;
+    }
+
+    free(names);
+    return 1;
+}
\ No newline at end of file
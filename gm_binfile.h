@@ -0,0 +1,60 @@
+#ifndef GM_BINFILE_H
+#define GM_BINFILE_H
+
+#include <stdint.h>
+#include "gm_dataset.h"
+
+//a binary dataset file is a Dataset laid out exactly as it lives in memory, so loading one is a
+//single mmap with no parsing. it is written next to the csv it was made from (file.csv.gmb) and
+//remembers the size, mtime and a sampled checksum of that csv so a changed csv invalidates it
+
+#define BINFILE_MAGIC "GMDSET\0"
+#define BINFILE_VERSION 1
+//lets a file written on a machine of the other endianness be rejected
+#define BINFILE_BYTE_ORDER 0x01020304u
+//appended to the csv's name to get the name of its binary file
+#define BINFILE_EXTENSION ".gmb"
+
+//set in flags when the file holds the squared norm of every row
+#define BINFILE_HAS_NORMS 1u
+
+//the header at the start of the file, every section starts on a DATASET_ALIGNMENT boundary
+//layout: header | class names (num_classes null terminated strings) | features | labels | norms
+typedef struct binfile_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    //what the file was made from
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_checksum;
+
+    int32_t num_genes;
+    int32_t num_features;
+    int32_t padded_features;
+    int32_t num_classes;
+    uint32_t flags;
+    uint32_t reserved;
+
+    //byte offsets of the sections and the size of the whole file
+    uint64_t class_names_offset;
+    uint64_t class_names_size;
+    uint64_t features_offset;
+    uint64_t labels_offset;
+    uint64_t norms_offset;
+    uint64_t file_size;
+
+    //checksum of every field above
+    uint64_t header_checksum;
+} binfile_header_t;
+
+
+//binary dataset file functions
+int binfile_write(const Dataset* dataset, const char* file_name, const char* source_name);
+int binfile_load(Dataset* dataset, const char* file_name, const char* source_name);
+int binfile_load_meta(Dataset* dataset, const char* file_name, const char* source_name, binfile_header_t* header);
+char* binfile_name(const char* source_name);
+
+#endif
@@ -0,0 +1,151 @@
+#include "gm_bitset.h"
+
+#include <immintrin.h>
+
+//the popcount kernels, each compiled for its own instruction set like the distance kernels
+
+//resolves the kernel on first use if bitset_init was never called, a fallback for the tools:
+//GM.out calls bitset_init at startup since two threads resolving at once would race
+static uint64_t bitset_and_count_resolve(const uint64_t* a, const uint64_t* b, int words);
+
+bitset_count_kernel_t bitset_and_count = bitset_and_count_resolve;
+static const char* selected_name = "unselected";
+
+
+//O(words)
+/**
+ * Counts the bits set in a & b, portable reference version.
+ *
+ * @param a The first bitset.
+ * @param b The second bitset (a itself for a plain count).
+ * @param words The number of 64 bit words in each.
+ * @return The number of bits set in both.
+ */
+uint64_t bitset_and_count_scalar(const uint64_t* a, const uint64_t* b, int words) {
+    uint64_t count = 0;
+    for (int i = 0; i < words; i++) {
+        uint64_t v = a[i] & b[i];
+        v = v - ((v >> 1) & 0x5555555555555555ull);
+        v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+        v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        count += (v * 0x0101010101010101ull) >> 56;
+    }
+    return count;
+}
+
+
+//O(words)
+//one popcnt instruction per word, four independent sums so they overlap
+__attribute__((target("popcnt")))
+uint64_t bitset_and_count_popcnt(const uint64_t* a, const uint64_t* b, int words) {
+    uint64_t count[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 4 <= words; i += 4) {
+        count[0] += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+        count[1] += (uint64_t)__builtin_popcountll(a[i + 1] & b[i + 1]);
+        count[2] += (uint64_t)__builtin_popcountll(a[i + 2] & b[i + 2]);
+        count[3] += (uint64_t)__builtin_popcountll(a[i + 3] & b[i + 3]);
+    }
+    for (; i < words; i++) {
+        count[0] += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+    }
+    return count[0] + count[1] + count[2] + count[3];
+}
+
+
+//O(words)
+//nibble lookup popcount (a byte shuffle per 4 bits), the byte counts are summed with sad
+__attribute__((target("avx2,popcnt")))
+uint64_t bitset_and_count_avx2(const uint64_t* a, const uint64_t* b, int words) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_nibbles));
+        __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+
+    uint64_t count = (uint64_t)_mm256_extract_epi64(total, 0) + (uint64_t)_mm256_extract_epi64(total, 1)
+                   + (uint64_t)_mm256_extract_epi64(total, 2) + (uint64_t)_mm256_extract_epi64(total, 3);
+    for (; i < words; i++) {
+        count += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+    }
+    return count;
+}
+
+
+//O(words)
+//a vector popcount per 64 bit lane (AVX-512 VPOPCNTDQ), the tail is masked
+__attribute__((target("avx512f,avx512vpopcntdq")))
+uint64_t bitset_and_count_avx512(const uint64_t* a, const uint64_t* b, int words) {
+    __m512i total = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 8 <= words; i += 8) {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    if (i < words) {
+        __mmask8 mask = (__mmask8)((1u << (words - i)) - 1);
+        __m512i v = _mm512_and_si512(_mm512_maskz_loadu_epi64(mask, a + i), _mm512_maskz_loadu_epi64(mask, b + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(total);
+}
+
+
+//O(1)
+/**
+ * Selects the widest popcount kernel this cpu supports: AVX-512 VPOPCNTDQ,
+ * AVX2, the popcnt instruction or the portable one. GM_KERNEL=scalar (or sse)
+ * forces the portable kernel like it does for the distance kernels, avx2
+ * stops at AVX2.
+ *
+ * This function returns void.
+ */
+void bitset_init() {
+    __builtin_cpu_init();
+    int popcnt = __builtin_cpu_supports("popcnt");
+    int avx2 = popcnt && __builtin_cpu_supports("avx2");
+    int avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+
+    const char* forced = getenv("GM_KERNEL");
+    if (forced != NULL && (strcmp(forced, "scalar") == 0 || strcmp(forced, "sse") == 0)) {
+        popcnt = avx2 = avx512 = 0;
+    } else if (forced != NULL && strcmp(forced, "avx2") == 0) {
+        avx512 = 0;
+    }
+
+    if (avx512) {
+        bitset_and_count = bitset_and_count_avx512;
+        selected_name = "avx512vpopcntdq";
+    } else if (avx2) {
+        bitset_and_count = bitset_and_count_avx2;
+        selected_name = "avx2";
+    } else if (popcnt) {
+        bitset_and_count = bitset_and_count_popcnt;
+        selected_name = "popcnt";
+    } else {
+        bitset_and_count = bitset_and_count_scalar;
+        selected_name = "scalar";
+    }
+    return (void)0;
+}
+
+
+static uint64_t bitset_and_count_resolve(const uint64_t* a, const uint64_t* b, int words) {
+    bitset_init();
+    return bitset_and_count(a, b, words);
+}
+
+
+/**
+ * @return The name of the selected popcount kernel.
+ */
+const char* bitset_kernel_name() {
+    return selected_name;
+}
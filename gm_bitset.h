@@ -0,0 +1,64 @@
+#ifndef GM_BITSET_H
+#define GM_BITSET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//a bitset over the global gene index space, one bit per gene packed into 64 bit words
+//a creature as a bitset answers "is gene g in it" in O(1), and two creatures compare, intersect and
+//count with whole word operations. the counts go through a popcount kernel picked for the cpu
+
+//O(1)
+/**
+ * @return The number of 64 bit words needed for num_bits bits.
+ */
+static inline int bitset_words(int num_bits) {
+    return (num_bits + 63) / 64;
+}
+
+//O(1)
+static inline void bitset_set(uint64_t* bitset, int bit) {
+    bitset[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+//O(1)
+static inline void bitset_clear(uint64_t* bitset, int bit) {
+    bitset[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+}
+
+//O(1)
+static inline int bitset_test(const uint64_t* bitset, int bit) {
+    return (int)((bitset[bit >> 6] >> (bit & 63)) & 1);
+}
+
+//O(words)
+static inline int bitset_equal(const uint64_t* a, const uint64_t* b, int words) {
+    return memcmp(a, b, (size_t)words * sizeof(uint64_t)) == 0;
+}
+
+
+//number of bits set in a & b
+typedef uint64_t (*bitset_count_kernel_t)(const uint64_t* a, const uint64_t* b, int words);
+
+//the kernel selected for this cpu (set by bitset_init)
+extern bitset_count_kernel_t bitset_and_count;
+
+uint64_t bitset_and_count_scalar(const uint64_t* a, const uint64_t* b, int words);
+uint64_t bitset_and_count_popcnt(const uint64_t* a, const uint64_t* b, int words);
+uint64_t bitset_and_count_avx2(const uint64_t* a, const uint64_t* b, int words);
+uint64_t bitset_and_count_avx512(const uint64_t* a, const uint64_t* b, int words);
+
+void bitset_init();
+const char* bitset_kernel_name();
+
+
+//O(words)
+/**
+ * @return The number of bits set in a bitset.
+ */
+static inline uint64_t bitset_count(const uint64_t* bitset, int words) {
+    return bitset_and_count(bitset, bitset, words);
+}
+
+#endif
@@ -0,0 +1,594 @@
+#include "gm_cache.h"
+#include "gm_batch.h"
+#include "gm_bitset.h"
+#include "gm_topk.h"
+#include "gm_half.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <math.h>
+
+//the cache turns fitness evaluation into lookups. a matrix cache reads |creature| distances per
+//test gene instead of computing them, a neighbor cache walks the presorted neighbor list of each
+//test gene and stops at the first k that are members of the creature (a bitset test per entry)
+
+
+//orders (column, gene) pairs by column
+static int compare_columns(const void* a, const void* b) {
+    return ((const int*)a)[0] - ((const int*)b)[0];
+}
+
+
+//O(t * n * d)
+/**
+ * Builds a distance cache between a set of test genes and the training genes.
+ *
+ * With CACHE_AUTO the full squared distance matrix is kept in float32 if it
+ * fits in budget_bytes, then in float16, and otherwise every test gene keeps a
+ * sorted list of its nearest training genes, as deep as the budget allows (at
+ * least 1). The build time and size are recorded in the cache stats.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param test_genes The global indices of the test genes.
+ * @param num_test_genes The number of test genes.
+ * @param train_genes The global indices of the genes creatures are drawn from.
+ * @param num_train_genes The number of training genes.
+ * @param budget_bytes The memory budget of the distances.
+ * @param mode The storage to use, or CACHE_AUTO.
+ * @return A pointer to the newly built cache.
+ */
+DistanceCache* cache_build(Dataset* dataset, const int* test_genes, int num_test_genes, const int* train_genes, int num_train_genes, size_t budget_bytes, cache_mode_t mode) {
+    double start = omp_get_wtime();
+
+    DistanceCache* cache = (DistanceCache*)calloc(1, sizeof(DistanceCache));
+    if (cache == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    size_t num_pairs = (size_t)num_test_genes * num_train_genes;
+    if (mode == CACHE_AUTO) {
+        if (num_pairs * sizeof(float) <= budget_bytes) {
+            mode = CACHE_MATRIX_F32;
+        } else if (num_pairs * sizeof(uint16_t) <= budget_bytes) {
+            mode = CACHE_MATRIX_F16;
+        } else {
+            mode = CACHE_NEIGHBORS;
+        }
+    }
+    cache->mode = mode;
+
+    //copy the gene sets and map global genes to columns
+    cache->num_test_genes = num_test_genes;
+    cache->num_train_genes = num_train_genes;
+    cache->num_genes = dataset->num_genes;
+    cache->test_genes = (int*)malloc((num_test_genes > 0 ? num_test_genes : 1) * sizeof(int));
+    cache->train_genes = (int*)malloc((num_train_genes > 0 ? num_train_genes : 1) * sizeof(int));
+    cache->column_of = (int*)malloc((dataset->num_genes > 0 ? dataset->num_genes : 1) * sizeof(int));
+    if (cache->test_genes == NULL || cache->train_genes == NULL || cache->column_of == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    memcpy(cache->test_genes, test_genes, num_test_genes * sizeof(int));
+    memcpy(cache->train_genes, train_genes, num_train_genes * sizeof(int));
+    for (int i = 0; i < dataset->num_genes; i++) {
+        cache->column_of[i] = -1;
+    }
+    for (int column = 0; column < num_train_genes; column++) {
+        cache->column_of[train_genes[column]] = column;
+    }
+
+
+    if (mode == CACHE_MATRIX_F32 || mode == CACHE_MATRIX_F16) {
+        //the float matrix is always computed, the f16 one is converted from it
+        float* matrix = (float*)malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(float));
+        if (matrix == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        float max_distance = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(max:max_distance)
+        for (int t = 0; t < num_test_genes; t++) {
+            float* matrix_row = matrix + (size_t)t * num_train_genes;
+            for (int column = 0; column < num_train_genes; column++) {
+                matrix_row[column] = distance_sq_rows(dataset, test_genes[t], train_genes[column]);
+                if (matrix_row[column] > max_distance) {
+                    max_distance = matrix_row[column];
+                }
+            }
+        }
+
+        if (mode == CACHE_MATRIX_F32) {
+            cache->matrix_f32 = matrix;
+            cache->stats.bytes = num_pairs * sizeof(float);
+        } else {
+            cache->matrix_f16 = (uint16_t*)malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(uint16_t));
+            if (cache->matrix_f16 == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+            cache->f16_scale = max_distance > 0 ? max_distance : 1;
+            float inverse = 1 / cache->f16_scale;
+
+            #pragma omp parallel for
+            for (size_t i = 0; i < num_pairs; i++) {
+                cache->matrix_f16[i] = float_to_half(matrix[i] * inverse);
+            }
+            free(matrix);
+            cache->stats.bytes = num_pairs * sizeof(uint16_t);
+        }
+    } else {
+        //as many neighbors per test gene as the budget holds (a gene index and a distance each)
+        size_t per_entry = (size_t)num_test_genes * (sizeof(int) + sizeof(float));
+        size_t depth = per_entry > 0 ? budget_bytes / per_entry : (size_t)num_train_genes;
+        if (depth > (size_t)num_train_genes) {
+            depth = num_train_genes;
+        }
+        if (depth < 1) {
+            depth = 1;
+        }
+        cache->depth = (int)depth;
+
+        size_t num_entries = (size_t)num_test_genes * depth;
+        cache->neighbor_genes = (int*)malloc(num_entries * sizeof(int));
+        cache->neighbor_distances = (float*)malloc(num_entries * sizeof(float));
+        if (cache->neighbor_genes == NULL || cache->neighbor_distances == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        #pragma omp parallel
+        {
+            float* heap_distance = (float*)malloc(depth * sizeof(float));
+            int* heap_index = (int*)malloc(depth * sizeof(int));
+            distance_intex_t* sorted = (distance_intex_t*)malloc(depth * sizeof(distance_intex_t));
+            if (heap_distance == NULL || heap_index == NULL || sorted == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+
+            #pragma omp for schedule(dynamic)
+            for (int t = 0; t < num_test_genes; t++) {
+                topk_heap_t heap;
+                topk_heap_init(&heap, (int)depth, heap_distance, heap_index);
+                for (int column = 0; column < num_train_genes; column++) {
+                    topk_heap_push(&heap, distance_sq_rows(dataset, test_genes[t], train_genes[column]), train_genes[column]);
+                }
+                topk_heap_sorted(&heap, sorted);
+
+                for (size_t i = 0; i < depth; i++) {
+                    cache->neighbor_genes[(size_t)t * depth + i] = sorted[i].index;
+                    cache->neighbor_distances[(size_t)t * depth + i] = (float)sorted[i].distance;
+                }
+            }
+
+            free(heap_distance);
+            free(heap_index);
+            free(sorted);
+        }
+
+        cache->stats.bytes = num_entries * (sizeof(int) + sizeof(float));
+    }
+
+    cache->stats.build_seconds = omp_get_wtime() - start;
+    return cache;
+}
+
+
+//O(|creature| log |creature|)
+//readies a scratch for one creature: the sorted columns of its genes in a matrix mode, its membership
+//bitset in neighbor mode. returns 1 when the neighbor lists can't answer for it (a gene twice or a
+//gene outside the training set, which a bitset can't represent)
+static int prepare_creature(DistanceCache* cache, Creature* creature, cache_scratch_t* scratch) {
+    int num_genes = creature->num_genes;
+    int exact_only = 0;
+    scratch->num_outside = 0;
+
+    if (cache->mode == CACHE_MATRIX_F32 || cache->mode == CACHE_MATRIX_F16) {
+        if (num_genes > scratch->columns_capacity) {
+            free(scratch->columns);
+            scratch->columns = (int*)malloc(2 * num_genes * sizeof(int));
+            if (scratch->columns == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+            scratch->columns_capacity = num_genes;
+        }
+        for (int i = 0; i < num_genes; i++) {
+            scratch->columns[2 * i] = cache->column_of[creature->gene_indices[i]];
+            scratch->columns[2 * i + 1] = creature->gene_indices[i];
+            scratch->num_outside += scratch->columns[2 * i] < 0;
+        }
+        qsort(scratch->columns, num_genes, 2 * sizeof(int), compare_columns);
+    } else {
+        int words = bitset_words(cache->num_genes) > 0 ? bitset_words(cache->num_genes) : 1;
+        if (words > scratch->members_words) {
+            free(scratch->members);
+            scratch->members = (uint64_t*)calloc(words, sizeof(uint64_t));
+            if (scratch->members == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+            scratch->members_words = words;
+        }
+        for (int i = 0; i < num_genes; i++) {
+            int gene = creature->gene_indices[i];
+            if (cache->column_of[gene] < 0 || bitset_test(scratch->members, gene)) {
+                exact_only = 1;
+            }
+            bitset_set(scratch->members, gene);
+        }
+    }
+    return exact_only;
+}
+
+
+//O(|creature|)
+//clears the creature's bits, so the bitset is all zero for the next one
+static void release_creature(DistanceCache* cache, Creature* creature, cache_scratch_t* scratch) {
+    if (cache->mode == CACHE_NEIGHBORS) {
+        for (int i = 0; i < creature->num_genes; i++) {
+            bitset_clear(scratch->members, creature->gene_indices[i]);
+        }
+    }
+    return (void)0;
+}
+
+
+//O(|creature|) for the matrix modes, O(scanned) for the neighbor mode
+//pushes the creature genes nearest test gene t into a top k, returns 1 when its neighbor list ran out
+//first and the batch engine has to finish it. every distance read from the matrix is a cache hit and
+//every one computed a miss, in neighbor mode a test gene its list answers is a hit and one it doesn't
+//a miss
+static int knn_test_gene(DistanceCache* cache, Dataset* dataset, const cache_scratch_t* scratch, int num_genes, int exact_only, int t, topk_t* topk, long long* num_scanned) {
+    int k = topk->k;
+    if (cache->mode == CACHE_MATRIX_F32 || cache->mode == CACHE_MATRIX_F16) {
+        size_t row = (size_t)t * cache->num_train_genes;
+        for (int i = 0; i < num_genes; i++) {
+            int column = scratch->columns[2 * i];
+            int gene = scratch->columns[2 * i + 1];
+            float distance;
+            if (column < 0) {
+                distance = distance_sq_rows(dataset, cache->test_genes[t], gene);
+            } else if (cache->mode == CACHE_MATRIX_F32) {
+                distance = cache->matrix_f32[row + column];
+            } else {
+                distance = half_to_float(cache->matrix_f16[row + column]) * cache->f16_scale;
+            }
+            topk_push(topk, distance, gene);
+        }
+        *num_scanned += num_genes;
+        TELEMETRY_COUNT(TELEMETRY_CACHE_HITS, num_genes - scratch->num_outside);
+        TELEMETRY_COUNT(TELEMETRY_CACHE_MISSES, scratch->num_outside);
+        return 0;
+    }
+
+    if (exact_only) {
+        TELEMETRY_COUNT(TELEMETRY_CACHE_MISSES, 1);
+        return 1;
+    }
+    const int* list_genes = cache->neighbor_genes + (size_t)t * cache->depth;
+    const float* list_distances = cache->neighbor_distances + (size_t)t * cache->depth;
+    int found = 0;
+    int i = 0;
+    for (; i < cache->depth && found < k; i++) {
+        if (bitset_test(scratch->members, list_genes[i])) {
+            topk_push(topk, list_distances[i], list_genes[i]);
+            found++;
+        }
+    }
+    *num_scanned += i;
+
+    //the list ran out before k members (and there are more members to find)
+    if (found < k && found < num_genes && cache->depth < cache->num_train_genes) {
+        TELEMETRY_COUNT(TELEMETRY_CACHE_MISSES, 1);
+        return 1;
+    }
+    TELEMETRY_COUNT(TELEMETRY_CACHE_HITS, 1);
+    return 0;
+}
+
+
+//O(1)
+//adds one lookup to the cache stats, creatures may be scored concurrently
+static void record_lookup(DistanceCache* cache, int num_evaluations, int num_queries, long long num_scanned, long long num_fallbacks, double seconds) {
+    #pragma omp atomic
+    cache->stats.num_evaluations += num_evaluations;
+    #pragma omp atomic
+    cache->stats.num_queries += num_queries;
+    #pragma omp atomic
+    cache->stats.num_scanned += num_scanned;
+    #pragma omp atomic
+    cache->stats.num_fallbacks += num_fallbacks;
+    #pragma omp atomic
+    cache->stats.lookup_seconds += seconds;
+    return (void)0;
+}
+
+
+//O(t * |creature|) for the matrix modes, O(t * scanned) for the neighbor mode
+/**
+ * Finds the k nearest creature genes of every cached test gene.
+ *
+ * In a matrix mode the creature's genes are mapped to matrix columns once and
+ * sorted, then every test gene reads those columns of its row in order. In
+ * neighbor mode the creature is turned into a membership bitset and each
+ * neighbor list is scanned until k members are found. The test genes whose list
+ * runs out first are finished together by the batch distance engine, as is
+ * every test gene when the creature holds a gene twice or a gene outside the
+ * training set (a bitset can't represent either), so the result is always
+ * exact.
+ *
+ * @param cache The distance cache.
+ * @param dataset The dataset holding every gene.
+ * @param creature The creature whose genes are the training set.
+ * @param k The number of neighbors to find.
+ * @param neighbors Output, num_test_genes lists of k neighbors in the order of the cache's test genes,
+ *                  sorted by ascending squared distance and padded with (INFINITY, -1).
+ */
+void cache_knn(DistanceCache* cache, Dataset* dataset, Creature* creature, int k, distance_intex_t* neighbors) {
+    double start = omp_get_wtime();
+
+    int num_test_genes = cache->num_test_genes;
+    int num_genes = creature->num_genes;
+
+    cache_scratch_t scratch;
+    cache_scratch_init(&scratch);
+    int exact_only = prepare_creature(cache, creature, &scratch);
+    char* needs_exact = (char*)calloc(num_test_genes > 0 ? num_test_genes : 1, sizeof(char));
+    if (needs_exact == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    long long num_scanned = 0;
+    long long num_fallbacks = 0;
+
+    #pragma omp parallel reduction(+:num_scanned, num_fallbacks)
+    {
+        float* heap_distance = NULL;
+        int* heap_index = NULL;
+        if (k > TOPK_SMALL) {
+            heap_distance = (float*)malloc(k * sizeof(float));
+            heap_index = (int*)malloc(k * sizeof(int));
+            if (heap_distance == NULL || heap_index == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int t = 0; t < num_test_genes; t++) {
+            topk_t topk;
+            topk_init(&topk, k, heap_distance, heap_index);
+            needs_exact[t] = (char)knn_test_gene(cache, dataset, &scratch, num_genes, exact_only, t, &topk, &num_scanned);
+            num_fallbacks += needs_exact[t];
+            topk_sorted(&topk, neighbors + (size_t)t * k);
+        }
+
+        free(heap_distance);
+        free(heap_index);
+    }
+
+    //finish the test genes the lists couldn't answer with the batch engine
+    if (num_fallbacks > 0) {
+        int* fallback_genes = (int*)malloc(num_fallbacks * sizeof(int));
+        distance_intex_t* fallback_neighbors = (distance_intex_t*)malloc((size_t)num_fallbacks * k * sizeof(distance_intex_t));
+        if (fallback_genes == NULL || fallback_neighbors == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        int num_fallback_genes = 0;
+        for (int t = 0; t < num_test_genes; t++) {
+            if (needs_exact[t]) {
+                fallback_genes[num_fallback_genes++] = cache->test_genes[t];
+            }
+        }
+
+        batch_knn(dataset, fallback_genes, num_fallback_genes, creature->gene_indices, num_genes, k, fallback_neighbors);
+
+        int next = 0;
+        for (int t = 0; t < num_test_genes; t++) {
+            if (needs_exact[t]) {
+                memcpy(neighbors + (size_t)t * k, fallback_neighbors + (size_t)next * k, k * sizeof(distance_intex_t));
+                next++;
+            }
+        }
+
+        free(fallback_genes);
+        free(fallback_neighbors);
+    }
+
+    free(needs_exact);
+    cache_scratch_free(&scratch);
+
+    record_lookup(cache, 1, num_test_genes, num_scanned, num_fallbacks, omp_get_wtime() - start);
+    return (void)0;
+}
+
+
+//O(block * |creature|) for the matrix modes, O(block * scanned) for the neighbor mode
+/**
+ * Finds the k nearest creature genes of a block of the cached test genes, like
+ * cache_knn but on the calling thread alone, with its own buffers. The test
+ * genes the neighbor lists can't answer are finished by the serial batch
+ * engine, so the result is exact. This is what an evaluator task runs (see
+ * evaluator_set_cache).
+ *
+ * @param cache The distance cache.
+ * @param dataset The dataset holding every gene.
+ * @param creature The creature whose genes are the training set.
+ * @param first The position of the block's first test gene in the cache's test genes.
+ * @param num_tests The number of test genes in the block.
+ * @param k The number of neighbors to find.
+ * @param neighbors Output, num_tests lists of k neighbors in the order of the block's test genes,
+ *                  sorted by ascending squared distance and padded with (INFINITY, -1).
+ * @param scratch The calling thread's cache scratch.
+ * @param batch The calling thread's batch engine scratch.
+ */
+void cache_knn_block(DistanceCache* cache, Dataset* dataset, Creature* creature, int first, int num_tests, int k, distance_intex_t* neighbors, cache_scratch_t* scratch, batch_scratch_t* batch) {
+    double start = omp_get_wtime();
+    int num_genes = creature->num_genes;
+    int exact_only = prepare_creature(cache, creature, scratch);
+
+    if (k > TOPK_SMALL && k > scratch->heap_capacity) {
+        free(scratch->heap_distance);
+        free(scratch->heap_index);
+        scratch->heap_distance = (float*)malloc(k * sizeof(float));
+        scratch->heap_index = (int*)malloc(k * sizeof(int));
+        if (scratch->heap_distance == NULL || scratch->heap_index == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        scratch->heap_capacity = k;
+    }
+    if ((size_t)num_tests > scratch->fallback_capacity) {
+        free(scratch->fallback_genes);
+        free(scratch->fallback_positions);
+        free(scratch->fallback_neighbors);
+        scratch->fallback_genes = (int*)malloc(num_tests * sizeof(int));
+        scratch->fallback_positions = (int*)malloc(num_tests * sizeof(int));
+        scratch->fallback_neighbors = (distance_intex_t*)malloc((size_t)num_tests * k * sizeof(distance_intex_t));
+        if (scratch->fallback_genes == NULL || scratch->fallback_positions == NULL || scratch->fallback_neighbors == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        scratch->fallback_capacity = num_tests;
+    }
+
+    long long num_scanned = 0;
+    int num_fallbacks = 0;
+    for (int q = 0; q < num_tests; q++) {
+        topk_t topk;
+        topk_init(&topk, k, scratch->heap_distance, scratch->heap_index);
+        if (knn_test_gene(cache, dataset, scratch, num_genes, exact_only, first + q, &topk, &num_scanned)) {
+            scratch->fallback_genes[num_fallbacks] = cache->test_genes[first + q];
+            scratch->fallback_positions[num_fallbacks] = q;
+            num_fallbacks++;
+        }
+        topk_sorted(&topk, neighbors + (size_t)q * k);
+    }
+
+    if (num_fallbacks > 0) {
+        batch_knn_serial(dataset, scratch->fallback_genes, num_fallbacks, creature->gene_indices, num_genes, k, scratch->fallback_neighbors, batch);
+        for (int i = 0; i < num_fallbacks; i++) {
+            memcpy(neighbors + (size_t)scratch->fallback_positions[i] * k, scratch->fallback_neighbors + (size_t)i * k, k * sizeof(distance_intex_t));
+        }
+    }
+    release_creature(cache, creature, scratch);
+
+    //a creature's first block counts it as one evaluation
+    record_lookup(cache, first == 0, num_tests, num_scanned, num_fallbacks, omp_get_wtime() - start);
+    return (void)0;
+}
+
+//O(1)
+/**
+ * Reads one distance out of a matrix cache.
+ *
+ * @param cache The distance cache.
+ * @param test_index The position of the test gene in the cache's test genes.
+ * @param gene The global index of a gene.
+ * @param distance Set to the squared distance when it is cached.
+ * @return 1 if the distance was cached, 0 if it has to be computed (neighbor mode or a gene outside the training set).
+ */
+int cache_lookup(DistanceCache* cache, int test_index, int gene, float* distance) {
+    int column = cache->column_of[gene];
+    if (column < 0) {
+        TELEMETRY_COUNT(TELEMETRY_CACHE_MISSES, 1);
+        return 0;
+    }
+
+    size_t entry = (size_t)test_index * cache->num_train_genes + column;
+    if (cache->mode == CACHE_MATRIX_F32) {
+        TELEMETRY_COUNT(TELEMETRY_CACHE_HITS, 1);
+        *distance = cache->matrix_f32[entry];
+        return 1;
+    }
+    if (cache->mode == CACHE_MATRIX_F16) {
+        TELEMETRY_COUNT(TELEMETRY_CACHE_HITS, 1);
+        *distance = half_to_float(cache->matrix_f16[entry]) * cache->f16_scale;
+        return 1;
+    }
+    TELEMETRY_COUNT(TELEMETRY_CACHE_MISSES, 1);
+    return 0;
+}
+
+
+/**
+ * Prints the build and lookup statistics of a cache.
+ *
+ * @param cache The distance cache.
+ * @param stream Where to print.
+ */
+void cache_print_stats(DistanceCache* cache, FILE* stream) {
+    static const char* mode_names[] = {"auto", "matrix f32", "matrix f16", "neighbors"};
+    cache_stats_t* stats = &cache->stats;
+
+    fprintf(stream, "distance cache: %s", mode_names[cache->mode]);
+    if (cache->mode == CACHE_NEIGHBORS) {
+        fprintf(stream, " (depth %d of %d)", cache->depth, cache->num_train_genes);
+    }
+    fprintf(stream, ", %d test x %d train genes, %.1f MB, built in %.3f s\n", cache->num_test_genes, cache->num_train_genes, stats->bytes / (1024.0 * 1024.0), stats->build_seconds);
+
+    if (stats->num_queries > 0) {
+        fprintf(stream, "  %lld evaluations, %.1f entries scanned per query, %.1f ns per query, %lld fallbacks (%.2f%%)\n",
+                stats->num_evaluations,
+                (double)stats->num_scanned / stats->num_queries,
+                stats->lookup_seconds * 1e9 / stats->num_queries,
+                stats->num_fallbacks,
+                100.0 * stats->num_fallbacks / stats->num_queries);
+    }
+
+    return (void)0;
+}
+
+
+/**
+ * Frees a distance cache and all of its associated memory.
+ *
+ * @param cache The cache to be freed.
+ */
+void cache_free(DistanceCache* cache) {
+    free(cache->test_genes);
+    free(cache->train_genes);
+    free(cache->column_of);
+    free(cache->matrix_f32);
+    free(cache->matrix_f16);
+    free(cache->neighbor_genes);
+    free(cache->neighbor_distances);
+    free(cache);
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Initializes empty cache scratch buffers.
+ *
+ * @param scratch The scratch to initialize.
+ */
+void cache_scratch_init(cache_scratch_t* scratch) {
+    memset(scratch, 0, sizeof(cache_scratch_t));
+    return (void)0;
+}
+
+
+/**
+ * Frees the buffers of a cache scratch.
+ *
+ * @param scratch The scratch to be freed.
+ */
+void cache_scratch_free(cache_scratch_t* scratch) {
+    free(scratch->columns);
+    free(scratch->members);
+    free(scratch->heap_distance);
+    free(scratch->heap_index);
+    free(scratch->fallback_genes);
+    free(scratch->fallback_positions);
+    free(scratch->fallback_neighbors);
+    memset(scratch, 0, sizeof(cache_scratch_t));
+    return (void)0;
+}
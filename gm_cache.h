@@ -0,0 +1,93 @@
+#ifndef GM_CACHE_H
+#define GM_CACHE_H
+
+#include <stdint.h>
+#include "gm_creature.h"
+#include "gm_batch.h"
+
+//default memory budget of the distance cache
+#ifndef CACHE_BUDGET
+    #define CACHE_BUDGET ((size_t)1 << 30)
+    //1GB
+#endif
+
+//how the distances are stored
+//CACHE_AUTO picks the first of f32 matrix, f16 matrix, neighbor lists that fits the budget
+typedef enum cache_mode_t {
+    CACHE_AUTO,
+    CACHE_MATRIX_F32,
+    CACHE_MATRIX_F16,
+    CACHE_NEIGHBORS
+} cache_mode_t;
+
+//build and lookup statistics (lookups are summed over every creature scored)
+typedef struct cache_stats_t {
+    double build_seconds;
+    size_t bytes;
+    long long num_evaluations;
+    long long num_queries;
+    long long num_scanned;
+    long long num_fallbacks;
+    double lookup_seconds;
+} cache_stats_t;
+
+//distances between a fixed set of test genes and every training gene, computed once and shared
+//by every creature of every generation (creatures are only subsets of the training genes)
+typedef struct DistanceCache {
+    cache_mode_t mode;
+
+    int num_test_genes;
+    int* test_genes;
+    int num_train_genes;
+    int* train_genes;
+    //global gene index -> column of the matrix (-1 for genes outside the training set)
+    int num_genes;
+    int* column_of;
+
+    //matrix modes, num_test_genes rows of num_train_genes squared distances
+    //the f16 matrix stores distance / f16_scale so every value is in [0, 1]
+    float* matrix_f32;
+    uint16_t* matrix_f16;
+    float f16_scale;
+
+    //neighbor mode, per test gene the depth nearest training genes in ascending distance
+    int depth;
+    int* neighbor_genes;
+    float* neighbor_distances;
+
+    cache_stats_t stats;
+} DistanceCache;
+
+//one thread's buffers for cache_knn_block, they only grow and are reused across calls
+typedef struct cache_scratch_t {
+    //matrix modes, the creature's (column, gene) pairs sorted by column
+    int* columns;
+    int columns_capacity;
+    //neighbor mode, the creature's membership bitset, all zero between calls
+    uint64_t* members;
+    int members_words;
+    //the top k when k > TOPK_SMALL
+    float* heap_distance;
+    int* heap_index;
+    int heap_capacity;
+    //the test genes the batch engine finishes, their place in the block and their neighbors
+    int* fallback_genes;
+    int* fallback_positions;
+    distance_intex_t* fallback_neighbors;
+    size_t fallback_capacity;
+    //genes of the creature the matrix doesn't hold (computed, cache misses)
+    int num_outside;
+} cache_scratch_t;
+
+
+//DistanceCache functions
+DistanceCache* cache_build(Dataset* dataset, const int* test_genes, int num_test_genes, const int* train_genes, int num_train_genes, size_t budget_bytes, cache_mode_t mode);
+void cache_knn(DistanceCache* cache, Dataset* dataset, Creature* creature, int k, distance_intex_t* neighbors);
+void cache_knn_block(DistanceCache* cache, Dataset* dataset, Creature* creature, int first, int num_tests, int k, distance_intex_t* neighbors, cache_scratch_t* scratch, batch_scratch_t* batch);
+int cache_lookup(DistanceCache* cache, int test_index, int gene, float* distance);
+void cache_print_stats(DistanceCache* cache, FILE* stream);
+void cache_free(DistanceCache* cache);
+void cache_scratch_init(cache_scratch_t* scratch);
+void cache_scratch_free(cache_scratch_t* scratch);
+
+#endif
@@ -0,0 +1,759 @@
+#include "gm_checkpoint.h"
+#include "gm_population.h"
+#include "gm_bitset.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <omp.h>
+
+
+//FNV-1a 64
+static uint64_t checksum_update(uint64_t hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#define CHECKSUM_START 14695981039346656037ull
+
+
+//O(1)
+//checksum of every header field before header_checksum
+static uint64_t header_checksum(const checkpoint_header_t* header) {
+    return checksum_update(CHECKSUM_START, (const uint8_t*)header, offsetof(checkpoint_header_t, header_checksum));
+}
+
+
+//a growing byte buffer being written, or a byte range being read
+typedef struct checkpoint_buffer_t {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+    //reading: the next byte, set when a read ran past the end
+    size_t position;
+    int overrun;
+} checkpoint_buffer_t;
+
+
+//O(size) amortized
+//makes room for size more bytes
+static void reserve_bytes(checkpoint_buffer_t* buffer, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        buffer->bytes = (uint8_t*)realloc(buffer->bytes, capacity);
+        if (buffer->bytes == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        buffer->capacity = capacity;
+    }
+    return (void)0;
+}
+
+
+//O(size) amortized
+static void put_bytes(checkpoint_buffer_t* buffer, const void* data, size_t size) {
+    reserve_bytes(buffer, size);
+    memcpy(buffer->bytes + buffer->size, data, size);
+    buffer->size += size;
+    return (void)0;
+}
+
+
+//O(1)
+//an unsigned LEB128 varint, 7 bits per byte, low bits first
+static void put_varint(checkpoint_buffer_t* buffer, uint64_t value) {
+    uint8_t bytes[10];
+    int length = 0;
+    do {
+        bytes[length] = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        if (value != 0) {
+            bytes[length] |= 0x80;
+        }
+        length++;
+    } while (value != 0);
+    put_bytes(buffer, bytes, length);
+    return (void)0;
+}
+
+
+//O(1)
+static int varint_length(uint64_t value) {
+    int length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+
+//O(size)
+static void get_bytes(checkpoint_buffer_t* buffer, void* data, size_t size) {
+    if (buffer->overrun || size > buffer->size - buffer->position) {
+        buffer->overrun = 1;
+        memset(data, 0, size);
+        return (void)0;
+    }
+    memcpy(data, buffer->bytes + buffer->position, size);
+    buffer->position += size;
+    return (void)0;
+}
+
+
+//O(1)
+static uint64_t get_varint(checkpoint_buffer_t* buffer) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        get_bytes(buffer, &byte, 1);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    buffer->overrun = 1;
+    return 0;
+}
+
+
+//O(1)
+//bits per rank of a creature of num_genes genes
+static int rank_width(int num_genes) {
+    int width = 0;
+    while (((int64_t)1 << width) < num_genes) {
+        width++;
+    }
+    return width;
+}
+
+
+//O(s log s)
+//orders (gene, position) pairs packed as gene << 32 | position
+static int compare_pairs(const void* a, const void* b) {
+    uint64_t first = *(const uint64_t*)a;
+    uint64_t second = *(const uint64_t*)b;
+    return (first > second) - (first < second);
+}
+
+
+//O(s log s + n / 8)
+//appends one creature's record, pairs is scratch for num_genes entries
+static void encode_creature(checkpoint_buffer_t* buffer, const int* genes, int creature_size, int num_genes, uint64_t* pairs) {
+    for (int i = 0; i < creature_size; i++) {
+        pairs[i] = ((uint64_t)(uint32_t)genes[i] << 32) | (uint32_t)i;
+    }
+    qsort(pairs, creature_size, sizeof(uint64_t), compare_pairs);
+
+    //the size of both forms of the sorted genes, a bitset can't hold repeats
+    size_t deltas_size = 0;
+    int sorted = 1;
+    int repeats = 0;
+    uint32_t previous = 0;
+    for (int j = 0; j < creature_size; j++) {
+        uint32_t gene = (uint32_t)(pairs[j] >> 32);
+        deltas_size += varint_length(gene - previous);
+        repeats |= j > 0 && gene == previous;
+        sorted &= (int)(uint32_t)pairs[j] == j;
+        previous = gene;
+    }
+    size_t bitset_size = ((size_t)num_genes + 7) / 8;
+    uint8_t flags = (!repeats && bitset_size < deltas_size ? CHECKPOINT_BITSET : 0) | (sorted ? CHECKPOINT_SORTED : 0);
+    put_bytes(buffer, &flags, 1);
+
+    if (flags & CHECKPOINT_BITSET) {
+        reserve_bytes(buffer, bitset_size);
+        size_t start = buffer->size;
+        memset(buffer->bytes + start, 0, bitset_size);
+        buffer->size += bitset_size;
+        for (int j = 0; j < creature_size; j++) {
+            uint32_t gene = (uint32_t)(pairs[j] >> 32);
+            buffer->bytes[start + gene / 8] |= (uint8_t)(1u << (gene % 8));
+        }
+    } else {
+        previous = 0;
+        for (int j = 0; j < creature_size; j++) {
+            uint32_t gene = (uint32_t)(pairs[j] >> 32);
+            put_varint(buffer, gene - previous);
+            previous = gene;
+        }
+    }
+
+    //the rank of every position's gene in the sorted list, width bits each
+    if (!sorted) {
+        int width = rank_width(creature_size);
+        int* ranks = (int*)malloc(creature_size * sizeof(int));
+        if (ranks == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        for (int j = 0; j < creature_size; j++) {
+            ranks[(uint32_t)pairs[j]] = j;
+        }
+        uint64_t pending = 0;
+        int pending_bits = 0;
+        for (int i = 0; i < creature_size; i++) {
+            pending |= (uint64_t)ranks[i] << pending_bits;
+            pending_bits += width;
+            while (pending_bits >= 8) {
+                uint8_t byte = (uint8_t)pending;
+                put_bytes(buffer, &byte, 1);
+                pending >>= 8;
+                pending_bits -= 8;
+            }
+        }
+        if (pending_bits > 0) {
+            uint8_t byte = (uint8_t)pending;
+            put_bytes(buffer, &byte, 1);
+        }
+        free(ranks);
+    }
+
+    return (void)0;
+}
+
+
+//O(s + n / 8)
+//reads one creature's record into genes, sorted is scratch for creature_size genes. returns 0 when
+//the record doesn't hold creature_size genes in [0, num_genes)
+static int decode_creature(checkpoint_buffer_t* buffer, int* genes, int creature_size, int num_genes, int* sorted) {
+    uint8_t flags;
+    get_bytes(buffer, &flags, 1);
+
+    if (flags & CHECKPOINT_BITSET) {
+        size_t bitset_size = ((size_t)num_genes + 7) / 8;
+        if (buffer->overrun || bitset_size > buffer->size - buffer->position) {
+            return 0;
+        }
+        const uint8_t* bits = buffer->bytes + buffer->position;
+        int count = 0;
+        for (int gene = 0; gene < num_genes; gene++) {
+            if ((bits[gene / 8] >> (gene % 8)) & 1) {
+                if (count == creature_size) {
+                    return 0;
+                }
+                sorted[count++] = gene;
+            }
+        }
+        buffer->position += bitset_size;
+        if (count != creature_size) {
+            return 0;
+        }
+    } else {
+        uint64_t gene = 0;
+        for (int j = 0; j < creature_size; j++) {
+            gene += get_varint(buffer);
+            if (gene >= (uint64_t)num_genes) {
+                return 0;
+            }
+            sorted[j] = (int)gene;
+        }
+    }
+
+    if (flags & CHECKPOINT_SORTED) {
+        memcpy(genes, sorted, creature_size * sizeof(int));
+        return !buffer->overrun;
+    }
+
+    int width = rank_width(creature_size);
+    uint64_t pending = 0;
+    int pending_bits = 0;
+    for (int i = 0; i < creature_size; i++) {
+        while (pending_bits < width) {
+            uint8_t byte;
+            get_bytes(buffer, &byte, 1);
+            pending |= (uint64_t)byte << pending_bits;
+            pending_bits += 8;
+        }
+        uint64_t rank = pending & (((uint64_t)1 << width) - 1);
+        pending >>= width;
+        pending_bits -= width;
+        if (rank >= (uint64_t)creature_size) {
+            return 0;
+        }
+        genes[i] = sorted[rank];
+    }
+    return !buffer->overrun;
+}
+
+
+//O(p * s log s + p * n / 8 + memo)
+//encodes a snapshot's payload
+static void encode_state(const checkpoint_state_t* state, checkpoint_buffer_t* buffer) {
+    const checkpoint_header_t* header = &state->header;
+    int population_size = header->population_size;
+    int creature_size = header->creature_size;
+
+    put_bytes(buffer, state->fitness, population_size * sizeof(double));
+
+    uint64_t* pairs = (uint64_t*)malloc(creature_size * sizeof(uint64_t));
+    if (pairs == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    for (int c = 0; c < population_size; c++) {
+        encode_creature(buffer, state->genes + (size_t)c * creature_size, creature_size, header->num_genes, pairs);
+    }
+    free(pairs);
+
+    //the memo: its stats, the sets whose hand moved, then the filled slots by their distance from the last one
+    uint8_t has_memo = state->memo_slots != NULL;
+    put_bytes(buffer, &has_memo, 1);
+    if (has_memo) {
+        put_varint(buffer, (uint64_t)state->memo_sets);
+        put_varint(buffer, (uint64_t)state->memo_stats.num_hits);
+        put_varint(buffer, (uint64_t)state->memo_stats.num_misses);
+        put_varint(buffer, (uint64_t)state->memo_stats.num_inserts);
+        put_varint(buffer, (uint64_t)state->memo_stats.num_evictions);
+        put_varint(buffer, (uint64_t)state->memo_stats.num_dropped);
+        //only where a hand points in its set matters, and most sets were never written
+        size_t num_turned = 0;
+        for (int s = 0; s < state->memo_sets; s++) {
+            num_turned += state->memo_hands[s] % MEMO_WAYS != 0;
+        }
+        put_varint(buffer, num_turned);
+        int next_set = 0;
+        for (int s = 0; s < state->memo_sets; s++) {
+            uint8_t position = (uint8_t)(state->memo_hands[s] % MEMO_WAYS);
+            if (position != 0) {
+                put_varint(buffer, (uint64_t)(s - next_set));
+                put_bytes(buffer, &position, 1);
+                next_set = s + 1;
+            }
+        }
+        size_t num_slots = (size_t)state->memo_sets * MEMO_WAYS;
+        size_t num_filled = 0;
+        for (size_t i = 0; i < num_slots; i++) {
+            num_filled += state->memo_slots[i].key != 0;
+        }
+        put_varint(buffer, num_filled);
+        size_t next = 0;
+        for (size_t i = 0; i < num_slots; i++) {
+            const memo_slot_t* slot = &state->memo_slots[i];
+            if (slot->key == 0) {
+                continue;
+            }
+            uint8_t referenced = slot->referenced != 0;
+            put_varint(buffer, i - next);
+            put_bytes(buffer, &slot->key, sizeof(slot->key));
+            put_bytes(buffer, &slot->value, sizeof(slot->value));
+            put_bytes(buffer, &referenced, 1);
+            next = i + 1;
+        }
+    }
+
+    return (void)0;
+}
+
+
+//O(size)
+//writes a checkpoint under a temporary name, syncs it and renames it into place, 1 on success
+static int write_file(const char* file_name, const checkpoint_header_t* header, const uint8_t* payload, size_t size) {
+    char* temporary_name = (char*)malloc(strlen(file_name) + 32);
+    if (temporary_name == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    sprintf(temporary_name, "%s.%ld.tmp", file_name, (long)getpid());
+
+    FILE* file = fopen(temporary_name, "wb");
+    if (file == NULL) {
+        free(temporary_name);
+        return 0;
+    }
+    int ok = fwrite(header, sizeof(checkpoint_header_t), 1, file) == 1
+        && (size == 0 || fwrite(payload, 1, size, file) == size)
+        && fflush(file) == 0
+        && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok) {
+        ok = rename(temporary_name, file_name) == 0;
+    }
+    if (!ok) {
+        remove(temporary_name);
+    }
+
+    free(temporary_name);
+    return ok;
+}
+
+
+//O(snapshot)
+//the writer thread, encodes and writes every snapshot handed to it
+static void* writer(void* argument) {
+    Checkpointer* checkpointer = (Checkpointer*)argument;
+    pthread_mutex_lock(&checkpointer->lock);
+    while (1) {
+        while (!checkpointer->busy && !checkpointer->quit) {
+            pthread_cond_wait(&checkpointer->changed, &checkpointer->lock);
+        }
+        //a snapshot handed over before quitting is still written
+        if (!checkpointer->busy) {
+            break;
+        }
+        pthread_mutex_unlock(&checkpointer->lock);
+
+        double start = omp_get_wtime();
+        checkpoint_buffer_t buffer = {checkpointer->bytes, 0, checkpointer->bytes_capacity, 0, 0};
+        checkpoint_header_t* header = &checkpointer->state.header;
+        encode_state(&checkpointer->state, &buffer);
+        header->payload_size = buffer.size;
+        header->payload_checksum = checksum_update(CHECKSUM_START, buffer.bytes, buffer.size);
+        header->header_checksum = header_checksum(header);
+        int ok = write_file(checkpointer->file_name, header, buffer.bytes, buffer.size);
+        checkpointer->bytes = buffer.bytes;
+        checkpointer->bytes_capacity = buffer.capacity;
+        if (!ok) {
+            fprintf(stderr, CHECKPOINT_WRITE_WARNING);
+        }
+
+        //the telemetry blocks are the generation loop's, it picks these up (see checkpoint_telemetry)
+        pthread_mutex_lock(&checkpointer->lock);
+        checkpointer->stats.write_seconds += omp_get_wtime() - start;
+        if (ok) {
+            checkpointer->stats.num_written++;
+            checkpointer->stats.last_bytes = (long long)(sizeof(checkpoint_header_t) + buffer.size);
+            checkpointer->stats.bytes_written += checkpointer->stats.last_bytes;
+        }
+        checkpointer->busy = 0;
+        pthread_cond_broadcast(&checkpointer->changed);
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+    return NULL;
+}
+
+
+//O(1)
+/**
+ * Starts a checkpointer and its writer thread.
+ *
+ * @param file_name Where the checkpoints go, the last one replaces the one before.
+ * @return A pointer to the newly allocated checkpointer.
+ */
+Checkpointer* checkpoint_init(const char* file_name) {
+    Checkpointer* checkpointer = (Checkpointer*)calloc(1, sizeof(Checkpointer));
+    if (checkpointer == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    checkpointer->file_name = strdup(file_name);
+    if (checkpointer->file_name == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    pthread_mutex_init(&checkpointer->lock, NULL);
+    pthread_cond_init(&checkpointer->changed, NULL);
+    if (pthread_create(&checkpointer->thread, NULL, writer, checkpointer) != 0) {
+        fprintf(stderr, CHECKPOINT_THREAD_ERROR);
+        exit(1);
+    }
+    return checkpointer;
+}
+
+
+//O(p * s + memo), the encoding and the write happen on the writer thread
+/**
+ * Snapshots a GA between two generations.
+ *
+ * The state is copied and handed to the writer thread, so the caller only
+ * pays for the copy. When the last snapshot is still being written this one
+ * is dropped (and counted) unless wait is set, then the call waits for the
+ * write to finish first.
+ *
+ * @param checkpointer The checkpointer.
+ * @param ga The GA, between two generations.
+ * @param wait 1 to wait for a write in flight rather than drop the snapshot.
+ * @return 1 if the snapshot was taken, 0 if it was dropped.
+ */
+int checkpoint_save(Checkpointer* checkpointer, const GA* ga, int wait) {
+    pthread_mutex_lock(&checkpointer->lock);
+    if (checkpointer->busy && !wait) {
+        checkpointer->stats.num_skipped++;
+        pthread_mutex_unlock(&checkpointer->lock);
+        return 0;
+    }
+    while (checkpointer->busy) {
+        pthread_cond_wait(&checkpointer->changed, &checkpointer->lock);
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+
+    //the writer is idle, the state is the caller's until it is handed over
+    TELEMETRY_SCOPE(TELEMETRY_SNAPSHOT);
+    double start = omp_get_wtime();
+    const ga_config_t* config = &ga->config;
+    checkpoint_state_t* state = &checkpointer->state;
+    if (state->genes == NULL) {
+        state->genes = (int*)malloc((size_t)config->population_size * config->creature_size * sizeof(int));
+        state->fitness = (double*)malloc(config->population_size * sizeof(double));
+        if (state->genes == NULL || state->fitness == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        if (ga->memo != NULL) {
+            state->memo_sets = ga->memo->num_sets;
+            state->memo_slots = (memo_slot_t*)malloc((size_t)state->memo_sets * MEMO_WAYS * sizeof(memo_slot_t));
+            state->memo_hands = (uint32_t*)malloc(state->memo_sets * sizeof(uint32_t));
+            if (state->memo_slots == NULL || state->memo_hands == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+        }
+    }
+
+    checkpoint_header_t* header = &state->header;
+    memset(header, 0, sizeof(checkpoint_header_t));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->byte_order = CHECKPOINT_BYTE_ORDER;
+    header->seed = ga->seed;
+    header->num_genes = ga->dataset->num_genes;
+    header->num_train_genes = ga->num_train_genes;
+    header->population_size = config->population_size;
+    header->creature_size = config->creature_size;
+    header->k = config->k;
+    header->selection = config->selection;
+    header->mutation_rate = config->mutation_rate;
+    header->tournament_size = config->tournament_size;
+    header->elite = config->elite;
+    header->vote = config->vote;
+    header->memo_entries = config->memo_entries;
+    header->initial = config->initial;
+    header->generation = ga->generation;
+    header->total_reused = ga->total_reused;
+
+    for (int c = 0; c < config->population_size; c++) {
+        memcpy(state->genes + (size_t)c * config->creature_size, ga->population->current_list[c]->gene_indices, config->creature_size * sizeof(int));
+    }
+    memcpy(state->fitness, ga->fitness, config->population_size * sizeof(double));
+    if (ga->memo != NULL) {
+        memcpy(state->memo_slots, ga->memo->slots, (size_t)state->memo_sets * MEMO_WAYS * sizeof(memo_slot_t));
+        memcpy(state->memo_hands, ga->memo->hands, state->memo_sets * sizeof(uint32_t));
+        state->memo_stats = ga->memo->stats;
+    }
+
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->stats.copy_seconds += omp_get_wtime() - start;
+    checkpointer->busy = 1;
+    pthread_cond_broadcast(&checkpointer->changed);
+    pthread_mutex_unlock(&checkpointer->lock);
+    return 1;
+}
+
+
+//O(1), waits for a write in flight
+/**
+ * Waits until the last snapshot is on disk.
+ *
+ * @param checkpointer The checkpointer.
+ */
+void checkpoint_wait(Checkpointer* checkpointer) {
+    pthread_mutex_lock(&checkpointer->lock);
+    while (checkpointer->busy) {
+        pthread_cond_wait(&checkpointer->changed, &checkpointer->lock);
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Adds the writes finished since the last call to the calling thread's
+ * telemetry, the TELEMETRY_CHECKPOINT timer and TELEMETRY_CHECKPOINT_BYTES.
+ * The writer thread only records them in the stats, the generation loop
+ * calls this before its report so the telemetry blocks are never written
+ * concurrently with telemetry_report.
+ *
+ * @param checkpointer The checkpointer.
+ */
+void checkpoint_telemetry(Checkpointer* checkpointer) {
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpoint_stats_t stats = checkpointer->stats;
+    pthread_mutex_unlock(&checkpointer->lock);
+
+    TELEMETRY_TIME(TELEMETRY_CHECKPOINT, (stats.write_seconds - checkpointer->reported.write_seconds) * 1e9, stats.num_written - checkpointer->reported.num_written);
+    TELEMETRY_COUNT(TELEMETRY_CHECKPOINT_BYTES, stats.bytes_written - checkpointer->reported.bytes_written);
+    checkpointer->reported = stats;
+    return (void)0;
+}
+
+
+/**
+ * Writes the snapshot in flight, stops the writer thread and frees the
+ * checkpointer.
+ *
+ * @param checkpointer The checkpointer to be freed.
+ */
+void checkpoint_free(Checkpointer* checkpointer) {
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->quit = 1;
+    pthread_cond_broadcast(&checkpointer->changed);
+    pthread_mutex_unlock(&checkpointer->lock);
+    pthread_join(checkpointer->thread, NULL);
+
+    pthread_mutex_destroy(&checkpointer->lock);
+    pthread_cond_destroy(&checkpointer->changed);
+    free(checkpointer->state.genes);
+    free(checkpointer->state.fitness);
+    free(checkpointer->state.memo_slots);
+    free(checkpointer->state.memo_hands);
+    free(checkpointer->bytes);
+    free(checkpointer->file_name);
+    free(checkpointer);
+    return (void)0;
+}
+
+
+//O(1)
+//checks that a checkpoint belongs to a run with the GA's seed, dataset and settings
+static int header_matches(const checkpoint_header_t* header, const GA* ga) {
+    const ga_config_t* config = &ga->config;
+    return header->seed == ga->seed
+        && header->num_genes == ga->dataset->num_genes
+        && header->num_train_genes == ga->num_train_genes
+        && header->population_size == config->population_size
+        && header->creature_size == config->creature_size
+        && header->k == config->k
+        && header->selection == (int32_t)config->selection
+        && header->mutation_rate == config->mutation_rate
+        && header->tournament_size == config->tournament_size
+        && header->elite == config->elite
+        && header->vote == (int32_t)config->vote
+        && header->memo_entries == config->memo_entries
+        && header->initial == (int32_t)config->initial;
+}
+
+
+//O(p * s + p * n / 8 + memo)
+/**
+ * Restores a GA from a checkpoint file.
+ *
+ * The GA must come from ga_init with the same seed, dataset, split and
+ * settings as the run that wrote the file (the number of generations may
+ * differ), it is then put back in the state that run was in after the
+ * checkpoint's generation: the creatures, their fitness and ranking, the
+ * memo and the generation number. Stepping it from there gives exactly what
+ * the uninterrupted run gave, ga_evaluate must not be called. The run exits
+ * if the file is corrupt or from another run.
+ *
+ * @param ga The GA, fresh from ga_init.
+ * @param file_name The checkpoint file.
+ * @return 1 if the GA was restored, 0 if there is no such file.
+ */
+int checkpoint_restore(GA* ga, const char* file_name) {
+    FILE* file = fopen(file_name, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    checkpoint_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CHECKPOINT_VERSION
+        || header.byte_order != CHECKPOINT_BYTE_ORDER
+        || header.header_checksum != header_checksum(&header)) {
+        fprintf(stderr, CHECKPOINT_FORMAT_ERROR);
+        exit(1);
+    }
+    if (!header_matches(&header, ga)) {
+        fprintf(stderr, CHECKPOINT_MISMATCH_ERROR);
+        exit(1);
+    }
+
+    checkpoint_buffer_t buffer = {NULL, (size_t)header.payload_size, 0, 0, 0};
+    buffer.bytes = (uint8_t*)malloc(buffer.size > 0 ? buffer.size : 1);
+    if (buffer.bytes == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    if (fread(buffer.bytes, 1, buffer.size, file) != buffer.size
+        || checksum_update(CHECKSUM_START, buffer.bytes, buffer.size) != header.payload_checksum) {
+        fprintf(stderr, CHECKPOINT_FORMAT_ERROR);
+        exit(1);
+    }
+    fclose(file);
+
+    const ga_config_t* config = &ga->config;
+    int* sorted = (int*)malloc(config->creature_size * sizeof(int));
+    if (sorted == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    int valid = 1;
+    get_bytes(&buffer, ga->fitness, config->population_size * sizeof(double));
+    for (int c = 0; valid && c < config->population_size; c++) {
+        Creature* creature = ga->population->current_list[c];
+        valid = decode_creature(&buffer, creature->gene_indices, config->creature_size, header.num_genes, sorted);
+        if (valid && ga->bits != NULL) {
+            creature_to_bitset(creature, ga->bits + (size_t)c * ga->bitset_words, ga->bitset_words);
+        }
+    }
+    free(sorted);
+
+    uint8_t has_memo;
+    get_bytes(&buffer, &has_memo, 1);
+    valid = valid && has_memo == (ga->memo != NULL);
+    if (valid && has_memo) {
+        FitnessMemo* memo = ga->memo;
+        valid = get_varint(&buffer) == (uint64_t)memo->num_sets;
+        memo->stats.num_hits = (long long)get_varint(&buffer);
+        memo->stats.num_misses = (long long)get_varint(&buffer);
+        memo->stats.num_inserts = (long long)get_varint(&buffer);
+        memo->stats.num_evictions = (long long)get_varint(&buffer);
+        memo->stats.num_dropped = (long long)get_varint(&buffer);
+        memset(memo->hands, 0, memo->num_sets * sizeof(uint32_t));
+        uint64_t num_turned = valid ? get_varint(&buffer) : 0;
+        uint64_t next_set = 0;
+        for (uint64_t h = 0; valid && h < num_turned; h++) {
+            uint64_t set = next_set + get_varint(&buffer);
+            uint8_t position;
+            get_bytes(&buffer, &position, 1);
+            valid = set < (uint64_t)memo->num_sets && position < MEMO_WAYS;
+            if (valid) {
+                memo->hands[set] = position;
+                next_set = set + 1;
+            }
+        }
+
+        size_t num_slots = (size_t)memo->num_sets * MEMO_WAYS;
+        memset(memo->slots, 0, num_slots * sizeof(memo_slot_t));
+        uint64_t num_filled = valid ? get_varint(&buffer) : 0;
+        size_t next = 0;
+        for (uint64_t f = 0; valid && f < num_filled; f++) {
+            uint64_t index = next + get_varint(&buffer);
+            valid = index < num_slots;
+            if (valid) {
+                memo_slot_t* slot = &memo->slots[index];
+                uint8_t referenced;
+                get_bytes(&buffer, &slot->key, sizeof(slot->key));
+                get_bytes(&buffer, &slot->value, sizeof(slot->value));
+                get_bytes(&buffer, &referenced, 1);
+                slot->referenced = referenced;
+                next = (size_t)index + 1;
+            }
+        }
+    }
+    if (!valid || buffer.overrun || buffer.position != buffer.size) {
+        fprintf(stderr, CHECKPOINT_FORMAT_ERROR);
+        exit(1);
+    }
+    free(buffer.bytes);
+
+    ga->generation = header.generation;
+    ga->total_reused = header.total_reused;
+    ga_rank(ga);
+    return 1;
+}
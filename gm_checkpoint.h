@@ -0,0 +1,117 @@
+#ifndef GM_CHECKPOINT_H
+#define GM_CHECKPOINT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "gm_routine.h"
+#include "gm_memo.h"
+
+//checkpoints of a GA run. every random choice of the GA comes from a counter based stream of its
+//seed and generation (see gm_rng), so the state of a run between two generations is the current
+//generation's creatures, their fitness, the memo and the generation number. a snapshot copies that
+//state on the generation loop (a few memcpys) and a background thread encodes it, writes it under a
+//temporary name, syncs it and renames it over the last checkpoint, so a file on disk is always a
+//whole snapshot. a run resumed from it continues exactly as the uninterrupted run would have.
+//a creature is stored as its genes sorted, as varint deltas or as a bitset over the gene space,
+//whichever is smaller, plus the rank of every position's gene in the sorted list when the creature
+//isn't sorted (crossover is positional, so the order is part of the state)
+
+#define CHECKPOINT_MAGIC "GMCKPT\0"
+#define CHECKPOINT_VERSION 1
+//lets a file written on a machine of the other endianness be rejected
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+//generations between snapshots when GM_CHECKPOINT_INTERVAL is unset
+#define CHECKPOINT_DEFAULT_INTERVAL 10
+
+//how a creature is stored (the first byte of its record)
+//its sorted genes are a bitset over the gene space instead of varint deltas
+#define CHECKPOINT_BITSET 1u
+//its genes are already sorted, no ranks follow
+#define CHECKPOINT_SORTED 2u
+
+//the header at the start of the file, the payload follows it:
+//fitness (population_size doubles) | creatures | memo
+typedef struct checkpoint_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    //the run the state belongs to, a run resuming from it must have the same
+    uint64_t seed;
+    int32_t num_genes;
+    int32_t num_train_genes;
+    int32_t population_size;
+    int32_t creature_size;
+    int32_t k;
+    int32_t selection;
+    double mutation_rate;
+    int32_t tournament_size;
+    int32_t elite;
+    int32_t vote;
+    int32_t memo_entries;
+    int32_t initial;
+
+    //the state
+    int32_t generation;
+    int64_t total_reused;
+
+    uint64_t payload_size;
+    uint64_t payload_checksum;
+    //checksum of every field above
+    uint64_t header_checksum;
+} checkpoint_header_t;
+
+//a copy of the state of a GA between two generations
+typedef struct checkpoint_state_t {
+    checkpoint_header_t header;
+    //population_size rows of creature_size genes
+    int* genes;
+    double* fitness;
+    //a copy of the memo, NULL without one
+    memo_slot_t* memo_slots;
+    uint32_t* memo_hands;
+    int memo_sets;
+    memo_stats_t memo_stats;
+} checkpoint_state_t;
+
+//counts since the checkpointer was made
+typedef struct checkpoint_stats_t {
+    long long num_written;
+    //snapshots dropped because the last one was still being written
+    long long num_skipped;
+    long long last_bytes;
+    long long bytes_written;
+    //time of the copies on the generation loop and of the writes in the background
+    double copy_seconds;
+    double write_seconds;
+} checkpoint_stats_t;
+
+typedef struct Checkpointer {
+    char* file_name;
+    //the snapshot, owned by the writer thread while busy
+    checkpoint_state_t state;
+    int busy;
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    //the encoded snapshot, kept across writes
+    uint8_t* bytes;
+    size_t bytes_capacity;
+    checkpoint_stats_t stats;
+    //the stats already added to the telemetry, only touched by the generation loop
+    checkpoint_stats_t reported;
+} Checkpointer;
+
+
+//Checkpointer functions
+Checkpointer* checkpoint_init(const char* file_name);
+int checkpoint_save(Checkpointer* checkpointer, const GA* ga, int wait);
+void checkpoint_wait(Checkpointer* checkpointer);
+void checkpoint_telemetry(Checkpointer* checkpointer);
+void checkpoint_free(Checkpointer* checkpointer);
+
+//restores a GA from a checkpoint file, 0 when there is none
+int checkpoint_restore(GA* ga, const char* file_name);
+
+#endif
@@ -1,5 +1,10 @@
 #include "gm_creature.h"
+#include "gm_loader.h"
+#include "gm_binfile.h"
+#include "gm_rng.h"
+#include "gm_bitset.h"
 
+#include "gm_telemetry.h"
 #include "errors.h"
 //seed for random number generation (found in gm_main.c)
 extern int seed;
@@ -32,6 +37,7 @@ Gene* gene_init() {
 
     //set the label to NULL (no label yet)
     new_gene->label = NULL;
+    new_gene->class_id = -1;
 
     //return the new gene
     return new_gene;
@@ -81,7 +87,7 @@ void gene_set(Gene* gene, int num_features, char* label) {
 
     //if the label is NULL allocate memory for the label
     if (gene->label == NULL) {
-        gene->label = (char*)malloc(strlen(label) * sizeof(char));   
+        gene->label = (char*)malloc((strlen(label) + 1) * sizeof(char));
     }
 
     //check that the allocation was successful
@@ -98,86 +104,86 @@ void gene_set(Gene* gene, int num_features, char* label) {
 }
 
 
+//O(1)
+/**
+ * Returns a gene that views one row of a dataset.
+ *
+ * The returned gene does not own its memory, its features point into the
+ * dataset's feature matrix (NULL for a reduced precision dataset, see
+ * dataset_decode_row) and its label into the dataset's class table. It must
+ * not be passed to gene_set or gene_free and is only valid while the dataset is.
+ *
+ * @param dataset The dataset that holds the gene.
+ * @param index The global index of the gene.
+ * @return A view of the gene.
+ */
+Gene gene_view(Dataset* dataset, int index) {
+    Gene gene;
+    gene.features = dataset->storage == STORAGE_F32 ? dataset_row(dataset, index) : NULL;
+    gene.num_features = dataset->num_features;
+    gene.class_id = dataset->labels[index];
+    gene.label = dataset->class_names[gene.class_id];
+    return gene;
+}
+
+
 /**
- * Fills an array of genes with data from a file.
+ * Fills a dataset with the genes in a file.
  *
- * This function takes in an array of genes, a file name, the number of genes to fill, and the number of features per gene.
- * It opens the file and reads it in chunks defined by the buffer size. It then parses the buffer and fills in the genes with the data from the buffer.
- * The function will exit if there is an error opening the file or if the buffer is too small to hold a line.
+ * This function takes in a dataset, a file name, the number of genes to fill, and the number of features per gene.
+ * A binary dataset file next to the csv (file_name followed by BINFILE_EXTENSION, see gm_binfile) is memory mapped
+ * when it is still up to date with the csv, so nothing is parsed. Otherwise the file is loaded by the parallel
+ * memory mapped csv loader (see dataset_load_csv), the row norms used by the batch distance engine are computed and
+ * the binary file is written for the next run. Setting the environment variable GM_BINFILE to 0 skips the binary
+ * file. Setting GM_STORAGE to f16, bf16 or int8 then converts the features to that storage mode (see
+ * dataset_set_storage). The function will exit if the file can't be opened, is malformed or has a different number of features
+ * than requested.
  *
- * @param genes The array of genes to fill.
+ * @param dataset The dataset to fill.
  * @param file_name The name of the file to read from.
- * @param num_genes The number of genes to fill.
- * @param num_features The number of features per gene.
+ * @param num_genes The number of genes to fill (0 or less fills every row of the file).
+ * @param num_features The number of features per gene (0 or less takes it from the header).
  *
  * This function returns void.
  */
-void gene_fill(Gene* genes[], char* file_name, int num_genes, int num_features) {
-    FILE* file = fopen(file_name, "r");
+void gene_fill(Dataset* dataset, char* file_name, int num_genes, int num_features) {
+    TELEMETRY_SCOPE(TELEMETRY_LOAD);
+    const char* setting = getenv("GM_BINFILE");
+    int use_binfile = setting == NULL || strcmp(setting, "0") != 0;
+    char* cache_name = binfile_name(file_name);
+
+    if (!use_binfile || !binfile_load(dataset, cache_name, file_name)) {
+        //the binary file holds every row, so a partial load doesn't write one
+        dataset_load_csv(dataset, file_name, use_binfile ? 0 : num_genes);
+        dataset_compute_norms(dataset);
+        if (use_binfile) {
+            binfile_write(dataset, cache_name, file_name);
+        }
+    }
+    free(cache_name);
 
-    //check that the file was opened successfully
-    if (file == NULL) {
-        fprintf(stderr, FILE_ERROR);
+    //check that the file matches what the caller expects
+    if (num_features > 0 && dataset->num_features != num_features) {
+        fprintf(stderr, FEATURE_COUNT_ERROR);
         exit(1);
     }
 
-    char* buffer = (char*)malloc(BUFF_SIZE * sizeof(char));
-    if(buffer == NULL) {
-        fprintf(stderr, MALLOC_ERROR);
-        exit(1);
+    //only keep the genes asked for
+    if (num_genes > 0 && num_genes < dataset->num_genes) {
+        dataset->num_genes = num_genes;
     }
-    int copied_data_index = 0;
-    //index of the current gene being worked on
-    int cur_gene = 0;
-
-    //skip over the attributes line
-    size_t att_size = get_attribute_size(file_name);
-    fseek(file, att_size, SEEK_SET);
-
-    //read until the end of the file
-    while (fread(buffer + copied_data_index, sizeof(char), BUFF_SIZE - copied_data_index, file) != 0 && cur_gene < num_genes) {
-        //parse the buffer and get the index of the start of the incomplete line
-        //if the buffer is too small to hold the line print an error message and exit (issue for a fuck ton of features)
-        int inc_line_start = 0;
-        for(int i = 0; i < BUFF_SIZE; i++) {
-            if (buffer[i] == '\n') {
-                inc_line_start = i + 1;
-            }
-        }
 
-        if(inc_line_start == 0) {
-            fprintf(stderr, BUFF_ERROR);
+    //reduced precision storage, chosen by name
+    const char* storage_name = getenv("GM_STORAGE");
+    dataset_storage_t storage;
+    if (storage_name != NULL) {
+        if (!dataset_storage_from_name(storage_name, &storage)) {
+            fprintf(stderr, STORAGE_NAME_ERROR);
             exit(1);
         }
-
-        //use the content of the buffer up until the start of the incomplete line
-        int buff_index = 0;
-
-        //fill the genes with the content from the buffer
-        while(buff_index < inc_line_start) {
-            buff_index += tokfill(buffer + buff_index, genes[cur_gene], num_features);
-            //move to the next gene
-            ++cur_gene;
-        }
-
-        //move the incomplete line to the start of the buffer
-        memmove(buffer, buffer + inc_line_start, BUFF_SIZE - inc_line_start);
-
-        //keep track of the copied data index
-        copied_data_index = BUFF_SIZE - inc_line_start;
+        dataset_set_storage(dataset, storage);
     }
 
-    //sometimes there is still data in the buffer that needs to be processed
-    if (cur_gene < num_genes) {
-        tokfill(buffer, genes[cur_gene], num_features);
-    }
-
-    //close the file
-    fclose(file);
-
-    //free the buffer
-    free(buffer);
-
     return (void)0;
 }
 
@@ -257,76 +263,183 @@ void creature_set(Creature* creature, int num_genes) {
 
 
 
+//O(total)
 /**
- * Fills the creatures with all the genes in an even distribution, then scrambles them.
+ * Deals a list of genes out to creatures in an even distribution.
  *
- * This function takes an array of creatures, the number of creatures, an array of genes, and the
- * number of features as input. It first checks if there are enough creatures to cover every gene,
- * and if not, it exits with an error message. Then it fills the creatures with all the genes in an
- * even distribution using OpenMP parallel for loops. Finally, it scrambles the creatures using unique
- * seeds for each core, also using OpenMP parallel for loops.
+ * The creatures are laid end to end and slot j of the whole sequence gets
+ * gene j % num_genes of the list. The sequence is scrambled as one with the
+ * counter based shuffle (see rng_shuffle) of the RNG_FILL stream before it
+ * is dealt out, so the result only depends on the seed, not on the number of
+ * threads. When the creatures have fewer slots than there are genes, the
+ * list is scrambled instead and its first genes fill the slots, a random
+ * subset without repeats.
  *
  * @param creatures An array of creatures to be filled.
  * @param num_creatures The number of creatures.
- * @param num_genes The number of genes in the global genes array.
+ * @param genes The global indices of the genes to deal, NULL for 0 to num_genes - 1.
+ * @param num_genes The number of genes, positive.
+ * @param fill_seed The seed of the shuffle.
  */
-void creature_fill(Creature* creatures[], int num_creatures, int num_genes) {
-    #pragma omp parallel
-    {
-        //check if there are enough creatures to cover every gene
-        int total_space = 0;
-
-        #pragma omp parallel for reduction(+:total_space)
-        for (int i = 0; i < num_creatures; i++) {
-            total_space += creatures[i]->num_genes;
-        }
+void creature_deal(Creature* creatures[], int num_creatures, const int* genes, int num_genes, uint64_t fill_seed) {
+    if (num_genes <= 0) {
+        fprintf(stderr, GA_CONFIG_ERROR);
+        exit(1);
+    }
 
-        // Only one thread checks and prints
-        #pragma omp single
-        {
-            if (total_space < num_genes) {
-                fprintf(stderr, GENE_CREATURE_ERROR);
-                exit(1);
-            }
-        }
+    //where each creature starts in the sequence of all their genes
+    long long* starts = (long long*)malloc((num_creatures + 1) * sizeof(long long));
+    if (starts == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    starts[0] = 0;
+    for (int i = 0; i < num_creatures; i++) {
+        starts[i + 1] = starts[i] + creatures[i]->num_genes;
+    }
+
+    //first we lay the genes end to end in an even distribution (the whole list when it is longer)
+    int total = (int)starts[num_creatures];
+    int length = total > num_genes ? total : num_genes;
+    int* sequence = (int*)malloc((length > 0 ? length : 1) * sizeof(int));
+    if (sequence == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < length; j++) {
+        sequence[j] = genes != NULL ? genes[j % num_genes] : j % num_genes;
+    }
 
-        #pragma omp barrier
+    //now we scramble them as one sequence, which only depends on the seed
+    rng_t rng = rng_stream(fill_seed, RNG_FILL, 0, 0);
+    rng_shuffle(sequence, length, &rng);
 
-        //first we fill the creatures with all the genes in an even distribution
-        int local_count = (num_genes / omp_get_num_threads()) * omp_get_thread_num();
-        #pragma omp for
-        for (int i = 0; i < num_creatures; i++) {
-            int local_num_genes = creatures[i]->num_genes;
-            for (int j = 0; j < local_num_genes; j++) {
-                creatures[i]->gene_indices[j] = (local_count++) % num_genes;
-            }
-        }
+    //and deal the sequence out to the creatures
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_creatures; i++) {
+        memcpy(creatures[i]->gene_indices, sequence + starts[i], creatures[i]->num_genes * sizeof(int));
+    }
+
+    free(sequence);
+    free(starts);
+    return (void)0;
+}
+
+
+/**
+ * Fills the creatures with all the genes in an even distribution, then scrambles them.
+ *
+ * This function takes an array of creatures, the number of creatures and the dataset as input. It first
+ * checks if there are enough creatures to cover every gene, and if not, it exits with an error message.
+ * Then it deals every gene of the dataset out to the creatures (see creature_deal), so every gene lands
+ * in at least one place and the result only depends on the seed, not on the number of threads.
+ *
+ * @param creatures An array of creatures to be filled.
+ * @param num_creatures The number of creatures.
+ * @param dataset The dataset holding the global genes, creatures index into its rows.
+ */
+void creature_fill(Creature* creatures[], int num_creatures, Dataset* dataset) {
+    TELEMETRY_SCOPE(TELEMETRY_FILL);
 
-        //the first loop must finish before the second loop
-        #pragma omp barrier
+    //check if there are enough creatures to cover every gene
+    long long total = 0;
+    for (int i = 0; i < num_creatures; i++) {
+        total += creatures[i]->num_genes;
+    }
+    if (total < dataset->num_genes) {
+        fprintf(stderr, GENE_CREATURE_ERROR);
+        exit(1);
+    }
 
-        //now we scramble the creatures
-        #pragma omp for
-        for (int i = 0; i < num_creatures; i++) {
-            unsigned int unique_seed = seed + i;
-            int local_num_genes = creatures[i]->num_genes;
+    creature_deal(creatures, num_creatures, NULL, dataset->num_genes, (uint64_t)seed);
+    return (void)0;
+}
 
-            for (int j = 0; j < local_num_genes; j++) {
-                int random_creature = rand_r(&unique_seed) % num_creatures;
-                int random_index = rand_r(&unique_seed) % creatures[random_creature]->num_genes;
 
-                //swap
-                creatures[i]->gene_indices[j] ^= creatures[random_creature]->gene_indices[random_index];
-                creatures[random_creature]->gene_indices[random_index] ^= creatures[i]->gene_indices[j];
-                creatures[i]->gene_indices[j] ^= creatures[random_creature]->gene_indices[random_index];
-            }
+//O(words + |creature|)
+/**
+ * Writes a creature as a bitset over the gene space, bit g is set when the
+ * creature holds gene g. Repeated genes only set their bit once, so the
+ * creature has repeats exactly when bitset_count is below num_genes.
+ *
+ * @param creature The creature.
+ * @param bitset Output, words 64 bit words.
+ * @param words The words of the gene space (bitset_words of the number of genes).
+ */
+void creature_to_bitset(const Creature* creature, uint64_t* bitset, int words) {
+    memset(bitset, 0, (size_t)words * sizeof(uint64_t));
+    for (int i = 0; i < creature->num_genes; i++) {
+        bitset_set(bitset, creature->gene_indices[i]);
+    }
+    return (void)0;
+}
+
+
+//O(words + |creature|)
+/**
+ * Makes a creature from a bitset, its genes come out sorted ascending.
+ *
+ * @param creature The creature, its gene_indices must have room for every bit set.
+ * @param bitset The bitset.
+ * @param words The number of 64 bit words in the bitset.
+ * @return The number of genes, also stored in num_genes.
+ */
+int creature_from_bitset(Creature* creature, const uint64_t* bitset, int words) {
+    int num_genes = 0;
+    for (int w = 0; w < words; w++) {
+        uint64_t bits = bitset[w];
+        while (bits != 0) {
+            creature->gene_indices[num_genes++] = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
         }
     }
+    creature->num_genes = num_genes;
+    return num_genes;
+}
 
+
+//orders genes ascending
+static int compare_genes(const void* a, const void* b) {
+    int first = *(const int*)a;
+    int second = *(const int*)b;
+    return (first > second) - (first < second);
+}
+
+
+//O(|creature| log |creature|)
+/**
+ * Sorts a creature's genes ascending (its sorted index form). A sorted
+ * creature answers membership by binary search and its rows are read in
+ * memory order.
+ *
+ * @param creature The creature to sort.
+ */
+void creature_sort(Creature* creature) {
+    qsort(creature->gene_indices, creature->num_genes, sizeof(int), compare_genes);
     return (void)0;
 }
 
 
+//O(log |creature|)
+/**
+ * @return 1 if a sorted creature holds a gene, 0 otherwise.
+ */
+int creature_contains_sorted(const Creature* creature, int gene) {
+    int low = 0;
+    int high = creature->num_genes;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (creature->gene_indices[middle] < gene) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < creature->num_genes && creature->gene_indices[low] == gene;
+}
+
+
 /**
  * Frees the memory associated with a creature.
  *
@@ -344,37 +457,3 @@ void creature_free(Creature* creature) {
     free(creature);
     return (void)0;
 }
-
-
-
-/**
- * Tokenizes the buffer and fills the gene with the tokenized values.
- *
- * This function tokenizes the input buffer and fills the gene with the
- * tokenized values. It first tokenizes the label, then fills the features
- * array with the remaining tokens. The function returns the index of the
- * buffer after the last tokenized value.
- *
- * @param buffer The buffer to tokenize.
- * @param gene The gene to fill with the tokenized values.
- * @param num_features The number of features of the gene.
- * @return The index of the buffer after the last tokenized value.
- */
-int tokfill(char* buffer, Gene* gene, int num_features) {
-    //tokenize the buffer
-    char* token = strtok(buffer, ",\n");
-    //set the new gene (this token is the label)
-    gene_set(gene, num_features, token);
-    //keep track of the buff index (+1 for the comma)
-    int buff_index = strlen(token) + 1;
-
-    //fill the features of this gene
-    for(int i = 0; i < num_features; i++) {
-        token = strtok(NULL, ",\n");
-        gene->features[i] = (float)atof(token);
-
-        //keep track of the buff index (+1 for the comma)
-        buff_index += strlen(token) + 1;
-    }
-    return buff_index;
-}
\ No newline at end of file
@@ -1,17 +1,15 @@
 #ifndef GM_CREATURE_H
 #define GM_CREATURE_H
 
-#include "gm_helper.h"
-#include "gm_init.h"
-#include "gm_KNN.h"
-#include "gm_main.h"
-#include "gm_routine.h"
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <omp.h>
-//#include <mpi.h>
+#ifdef GM_USE_MPI
+#include <mpi.h>
+#endif
+
+#include "gm_dataset.h"
 
 //a "creature" has 2 levels, the gene level and the creature level
 //the gene level are the genes of the creatures (I.E for MNIST, individual digits)
@@ -19,10 +17,12 @@
 
 
 //a gene contains a float array of features, and int for the number of features, and a string label
+//genes loaded from a file live in a Dataset, a Gene is then only a view of one row (see gene_view)
 typedef struct Gene {
     float* features;
     int num_features;
     char* label;
+    int class_id;
 } Gene;
 
 //a creature is a collection of genes
@@ -32,12 +32,19 @@ typedef struct Creature {
     int num_genes;
 } Creature;
 
+//the other modules use the types above
+#include "gm_helper.h"
+#include "gm_init.h"
+#include "gm_KNN.h"
+#include "gm_main.h"
+#include "gm_routine.h"
 
 //Gene functions
 Gene* gene_init();
 void gene_set(Gene* gene, int num_features, char* label);
+Gene gene_view(Dataset* dataset, int index);
 //uses omp for large datasets
-void gene_fill(Gene* genes[], char* file_name, int num_genes, int num_features);
+void gene_fill(Dataset* dataset, char* file_name, int num_genes, int num_features);
 void gene_free(Gene* gene);
 
 
@@ -46,10 +53,14 @@ void gene_free(Gene* gene);
 Creature* creature_init();
 void creature_set(Creature* creature, int num_genes);
 //uses mpi and omp
-void creature_fill(Creature* creatures[], int num_creatures, int num_genes);
+void creature_fill(Creature* creatures[], int num_creatures, Dataset* dataset);
+void creature_deal(Creature* creatures[], int num_creatures, const int* genes, int num_genes, uint64_t fill_seed);
 void creature_free(Creature* creature);
 
-//helper function
-int tokfill(char* buffer, Gene* gene, int num_features);
+//the other forms of a creature: a bitset over the gene space (see gm_bitset.h) and sorted indices
+void creature_to_bitset(const Creature* creature, uint64_t* bitset, int words);
+int creature_from_bitset(Creature* creature, const uint64_t* bitset, int words);
+void creature_sort(Creature* creature);
+int creature_contains_sorted(const Creature* creature, int gene);
 
 #endif
\ No newline at end of file
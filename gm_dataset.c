@@ -0,0 +1,566 @@
+#include "gm_dataset.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <immintrin.h>
+
+#include "gm_half.h"
+#include "errors.h"
+
+//initial number of class slots (grows by doubling)
+#define DATASET_CLASS_START 16
+
+int dataset_f16c = 0;
+
+//O(1)
+/**
+ * Rounds a feature count up to the padded row width.
+ *
+ * @param num_features The number of real features in a row.
+ * @return The row stride in floats, a multiple of DATASET_ROW_PAD.
+ */
+int dataset_padded_width(int num_features) {
+    return ((num_features + DATASET_ROW_PAD - 1) / DATASET_ROW_PAD) * DATASET_ROW_PAD;
+}
+
+
+static const char* storage_names[] = {"f32", "f16", "bf16", "int8"};
+#define NUM_STORAGES ((int)(sizeof(storage_names) / sizeof(storage_names[0])))
+
+
+//O(1)
+/**
+ * @return The name of a storage mode.
+ */
+const char* dataset_storage_name(dataset_storage_t storage) {
+    return storage_names[storage];
+}
+
+
+//O(1)
+/**
+ * Looks up a storage mode by name.
+ *
+ * @param name The name (f32, f16, bf16 or int8).
+ * @param storage Set to the storage mode when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int dataset_storage_from_name(const char* name, dataset_storage_t* storage) {
+    for (int i = 0; i < NUM_STORAGES; i++) {
+        if (strcmp(name, storage_names[i]) == 0) {
+            *storage = (dataset_storage_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//O(1)
+/**
+ * Allocates memory for a new dataset and initializes its fields.
+ *
+ * This function allocates memory for a new dataset using malloc and checks if the
+ * allocation was successful. If the allocation fails, an error message is
+ * printed and the program exits. The dataset starts out empty with no classes.
+ *
+ * @return A pointer to the newly allocated dataset.
+ */
+Dataset* dataset_init() {
+    //allocate memory for the dataset
+    Dataset* new_dataset = (Dataset*)calloc(1, sizeof(Dataset));
+
+    //check that the allocation was successful
+    if (new_dataset == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    return new_dataset;
+}
+
+
+//O(1)
+/**
+ * Releases the feature matrix, labels and norms of a dataset, whether they
+ * were allocated or memory mapped. Shared arrays are left alone. The class
+ * table is kept.
+ *
+ * @param dataset The dataset to empty.
+ */
+void dataset_release(Dataset* dataset) {
+    if (dataset->shared) {
+        //the owner of the shared memory frees it
+        dataset->shared = 0;
+    } else {
+        if (dataset->mapping != NULL) {
+            //norms computed after mapping are a separate allocation
+            const char* start = (const char*)dataset->mapping;
+            const char* norms = (const char*)dataset->norms;
+            if (norms != NULL && (norms < start || norms >= start + dataset->mapping_size)) {
+                free(dataset->norms);
+            }
+            munmap(dataset->mapping, dataset->mapping_size);
+            dataset->mapping = NULL;
+            dataset->mapping_size = 0;
+        } else {
+            free(dataset->features);
+            free(dataset->labels);
+            free(dataset->norms);
+        }
+        free(dataset->compact);
+        free(dataset->scales);
+        free(dataset->offsets);
+        free(dataset->weights);
+    }
+    dataset->features = NULL;
+    dataset->labels = NULL;
+    dataset->norms = NULL;
+    dataset->compact = NULL;
+    dataset->scales = NULL;
+    dataset->offsets = NULL;
+    dataset->weights = NULL;
+    dataset->storage = STORAGE_F32;
+    dataset->num_genes = 0;
+    return (void)0;
+}
+
+
+//O(n * d)
+/**
+ * Sizes the feature matrix and label array of a dataset.
+ *
+ * The feature matrix is allocated as a single 64 byte aligned block holding
+ * num_genes rows of padded_features floats. The padding is zeroed so distance
+ * kernels can run over the full padded width without a remainder loop. Any
+ * previous matrix is released (or unmapped), the class table is kept.
+ *
+ * @param dataset The dataset to size.
+ * @param num_genes The number of genes (rows).
+ * @param num_features The number of features per gene (columns).
+ */
+void dataset_set(Dataset* dataset, int num_genes, int num_features) {
+    dataset_release(dataset);
+
+    dataset->num_genes = num_genes;
+    dataset->num_features = num_features;
+    dataset->padded_features = dataset_padded_width(num_features);
+
+    //aligned_alloc needs the size to be a multiple of the alignment, padded rows guarantee that
+    size_t matrix_size = (size_t)num_genes * dataset->padded_features * sizeof(float);
+    if (matrix_size == 0) {
+        matrix_size = DATASET_ALIGNMENT;
+    }
+
+    dataset->features = (float*)aligned_alloc(DATASET_ALIGNMENT, matrix_size);
+    dataset->labels = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+
+    //check that the allocation was successful
+    if (dataset->features == NULL || dataset->labels == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    memset(dataset->features, 0, matrix_size);
+
+    return (void)0;
+}
+
+
+//FNV-1a, only used to place labels in the class table
+static unsigned int label_hash(const char* label) {
+    unsigned int hash = 2166136261u;
+    while (*label) {
+        hash ^= (unsigned char)*label++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+//rebuilds the class table at a new size
+static void class_table_resize(Dataset* dataset, int new_size) {
+    free(dataset->class_table);
+    dataset->class_table = (int*)malloc(new_size * sizeof(int));
+    if (dataset->class_table == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    dataset->class_table_size = new_size;
+
+    for (int i = 0; i < new_size; i++) {
+        dataset->class_table[i] = -1;
+    }
+
+    //reinsert every known class (the table size is a power of 2)
+    for (int id = 0; id < dataset->num_classes; id++) {
+        unsigned int slot = label_hash(dataset->class_names[id]) & (new_size - 1);
+        while (dataset->class_table[slot] != -1) {
+            slot = (slot + 1) & (new_size - 1);
+        }
+        dataset->class_table[slot] = id;
+    }
+}
+
+
+//O(1) amortized
+/**
+ * Interns a label string and returns its dense class id.
+ *
+ * Labels are looked up in an open addressing table. A label seen for the first
+ * time is copied into the class name table and given the next free id, so ids
+ * are 0 .. num_classes - 1 in order of first appearance.
+ *
+ * @param dataset The dataset that owns the class table.
+ * @param label The label string to intern.
+ * @return The class id of the label.
+ */
+int dataset_intern_label(Dataset* dataset, const char* label) {
+    //keep the table at most half full
+    if (2 * (dataset->num_classes + 1) > dataset->class_table_size) {
+        class_table_resize(dataset, dataset->class_table_size > 0 ? 2 * dataset->class_table_size : 2 * DATASET_CLASS_START);
+    }
+
+    int mask = dataset->class_table_size - 1;
+    unsigned int slot = label_hash(label) & mask;
+    while (dataset->class_table[slot] != -1) {
+        int id = dataset->class_table[slot];
+        if (strcmp(dataset->class_names[id], label) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    //new class, grow the name table if needed
+    if (dataset->num_classes == dataset->class_capacity) {
+        dataset->class_capacity = dataset->class_capacity > 0 ? 2 * dataset->class_capacity : DATASET_CLASS_START;
+        dataset->class_names = (char**)realloc(dataset->class_names, dataset->class_capacity * sizeof(char*));
+        if (dataset->class_names == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+    }
+
+    int id = dataset->num_classes++;
+    dataset->class_names[id] = (char*)malloc((strlen(label) + 1) * sizeof(char));
+    if (dataset->class_names[id] == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    strcpy(dataset->class_names[id], label);
+    dataset->class_table[slot] = id;
+
+    return id;
+}
+
+
+//O(n + c log c)
+/**
+ * Renumbers the classes in order of their first appearance in the labels.
+ *
+ * Loaders that intern labels from several threads at once get ids in whatever
+ * order the threads got there, this makes the ids (and class_names) the same
+ * as a serial load would give.
+ *
+ * @param dataset The dataset to renumber.
+ */
+void dataset_order_classes(Dataset* dataset) {
+    int num_classes = dataset->num_classes;
+    int* first_seen = (int*)malloc((num_classes > 0 ? num_classes : 1) * sizeof(int));
+    int* new_id = (int*)malloc((num_classes > 0 ? num_classes : 1) * sizeof(int));
+    char** names = (char**)malloc((num_classes > 0 ? num_classes : 1) * sizeof(char*));
+    if (first_seen == NULL || new_id == NULL || names == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    for (int id = 0; id < num_classes; id++) {
+        first_seen[id] = dataset->num_genes;
+    }
+    for (int i = dataset->num_genes - 1; i >= 0; i--) {
+        first_seen[dataset->labels[i]] = i;
+    }
+
+    //classes that were interned but never used keep their relative order at the end
+    int next = 0;
+    for (int row = 0; row < dataset->num_genes; row++) {
+        int id = dataset->labels[row];
+        if (first_seen[id] == row) {
+            new_id[id] = next++;
+        }
+    }
+    for (int id = 0; id < num_classes; id++) {
+        if (first_seen[id] == dataset->num_genes) {
+            new_id[id] = next++;
+        }
+    }
+
+    for (int id = 0; id < num_classes; id++) {
+        names[new_id[id]] = dataset->class_names[id];
+    }
+    memcpy(dataset->class_names, names, num_classes * sizeof(char*));
+
+    #pragma omp parallel for
+    for (int i = 0; i < dataset->num_genes; i++) {
+        dataset->labels[i] = new_id[dataset->labels[i]];
+    }
+
+    class_table_resize(dataset, dataset->class_table_size);
+
+    free(first_seen);
+    free(new_id);
+    free(names);
+    return (void)0;
+}
+
+
+//O(d)
+//allocates one float per padded feature
+static float* feature_array(const Dataset* dataset) {
+    float* array = (float*)calloc(dataset->padded_features > 0 ? dataset->padded_features : 1, sizeof(float));
+    if (array == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    return array;
+}
+
+
+//O(n * d)
+//picks the per feature affine map of the int8 storage from each feature's range
+static void choose_int8_scales(Dataset* dataset) {
+    int num_features = dataset->num_features;
+    dataset->scales = feature_array(dataset);
+    dataset->offsets = feature_array(dataset);
+    dataset->weights = feature_array(dataset);
+
+    #pragma omp parallel for
+    for (int f = 0; f < num_features; f++) {
+        float low = 0;
+        float high = 0;
+        for (int i = 0; i < dataset->num_genes; i++) {
+            float value = dataset_row(dataset, i)[f];
+            if (i == 0 || value < low) {
+                low = value;
+            }
+            if (i == 0 || value > high) {
+                high = value;
+            }
+        }
+        dataset->offsets[f] = low;
+        dataset->scales[f] = (high - low) / 255;
+    }
+
+    //pixel, one hot and count data usually give every varying feature the same scale, the integer
+    //kernels can then skip the weights
+    float shared = 0;
+    int uniform = 1;
+    for (int f = 0; f < num_features; f++) {
+        float scale = dataset->scales[f];
+        if (scale > 0) {
+            if (shared == 0) {
+                shared = scale;
+            } else if (scale != shared) {
+                uniform = 0;
+            }
+        }
+        dataset->weights[f] = scale * scale;
+    }
+    dataset->uniform_weight = uniform ? shared * shared : 0;
+
+    return (void)0;
+}
+
+
+//O(n * d)
+/**
+ * Converts the feature matrix to a reduced precision storage mode.
+ *
+ * The float matrix is replaced by a matrix of 16 bit floats (f16 or bf16) or
+ * of 8 bit codes (int8, each feature mapped affinely from its own range onto
+ * 0 .. 255), and released. The norms are recomputed from the stored values so
+ * the batch engine and the direct kernels agree. Only a STORAGE_F32 dataset
+ * can be converted.
+ *
+ * @param dataset The dataset to convert.
+ * @param storage The storage mode to convert to.
+ */
+void dataset_set_storage(Dataset* dataset, dataset_storage_t storage) {
+    if (storage == dataset->storage) {
+        return (void)0;
+    }
+    if (dataset->storage != STORAGE_F32) {
+        fprintf(stderr, STORAGE_ERROR);
+        exit(1);
+    }
+
+    size_t element_size = storage == STORAGE_INT8 ? sizeof(uint8_t) : sizeof(uint16_t);
+    dataset->compact_stride = (size_t)dataset->padded_features * element_size;
+    size_t compact_size = (size_t)dataset->num_genes * dataset->compact_stride;
+    compact_size = (compact_size + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT;
+    dataset->compact = aligned_alloc(DATASET_ALIGNMENT, compact_size > 0 ? compact_size : DATASET_ALIGNMENT);
+    if (dataset->compact == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    if (storage == STORAGE_INT8) {
+        choose_int8_scales(dataset);
+    }
+
+    //the padding stays zero in every format (code 0 in both rows adds nothing to a distance)
+    #pragma omp parallel for
+    for (int i = 0; i < dataset->num_genes; i++) {
+        const float* row = dataset_row(dataset, i);
+        void* compact_row = (char*)dataset->compact + (size_t)i * dataset->compact_stride;
+        for (int f = 0; f < dataset->padded_features; f++) {
+            float value = f < dataset->num_features ? row[f] : 0;
+            if (storage == STORAGE_F16) {
+                ((uint16_t*)compact_row)[f] = float_to_half(value);
+            } else if (storage == STORAGE_BF16) {
+                ((uint16_t*)compact_row)[f] = float_to_bfloat16(value);
+            } else if (f >= dataset->num_features || dataset->scales[f] == 0) {
+                ((uint8_t*)compact_row)[f] = 0;
+            } else {
+                float code = (value - dataset->offsets[f]) / dataset->scales[f] + 0.5f;
+                ((uint8_t*)compact_row)[f] = (uint8_t)(code < 0 ? 0 : code > 255 ? 255 : code);
+            }
+        }
+    }
+
+    //drop the float matrix, a mapped one is given back to the page cache
+    if (dataset->mapping == NULL) {
+        free(dataset->features);
+    } else {
+        size_t page = 4096;
+        uintptr_t start = ((uintptr_t)dataset->features + page - 1) / page * page;
+        uintptr_t end = ((uintptr_t)(dataset->features + (size_t)dataset->num_genes * dataset->padded_features)) / page * page;
+        if (end > start) {
+            madvise((void*)start, end - start, MADV_DONTNEED);
+        }
+    }
+    dataset->features = NULL;
+    dataset->storage = storage;
+
+    if (dataset->norms != NULL) {
+        dataset_compute_norms(dataset);
+    }
+
+    return (void)0;
+}
+
+
+//O(d)
+//decodes a row of IEEE halves with F16C, 8 at a time
+__attribute__((target("avx,f16c")))
+static void decode_f16_f16c(const uint16_t* compact_row, float* row, int length) {
+    int f = 0;
+    for (; f + 8 <= length; f += 8) {
+        _mm256_storeu_ps(row + f, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(compact_row + f))));
+    }
+    for (; f < length; f++) {
+        row[f] = half_to_float(compact_row[f]);
+    }
+    return (void)0;
+}
+
+
+//O(d)
+/**
+ * Decodes a row into floats, whatever the storage mode.
+ *
+ * @param dataset The dataset to read from.
+ * @param index The global index of the gene.
+ * @param row Output, padded_features floats (the padding is written as zeros).
+ */
+void dataset_decode_row(const Dataset* dataset, int index, float* row) {
+    int length = dataset->padded_features;
+    if (dataset->storage == STORAGE_F32) {
+        memcpy(row, dataset_row(dataset, index), length * sizeof(float));
+    } else if (dataset->storage == STORAGE_F16) {
+        const uint16_t* compact_row = (const uint16_t*)dataset_compact_row(dataset, index);
+        if (dataset_f16c) {
+            decode_f16_f16c(compact_row, row, length);
+        } else {
+            for (int f = 0; f < length; f++) {
+                row[f] = half_to_float(compact_row[f]);
+            }
+        }
+    } else if (dataset->storage == STORAGE_BF16) {
+        const uint16_t* compact_row = (const uint16_t*)dataset_compact_row(dataset, index);
+        for (int f = 0; f < length; f++) {
+            row[f] = bfloat16_to_float(compact_row[f]);
+        }
+    } else {
+        const uint8_t* compact_row = (const uint8_t*)dataset_compact_row(dataset, index);
+        for (int f = 0; f < length; f++) {
+            row[f] = dataset->offsets[f] + dataset->scales[f] * compact_row[f];
+        }
+    }
+    return (void)0;
+}
+
+
+//O(n * d)
+/**
+ * Computes the squared L2 norm of every row of the feature matrix.
+ *
+ * The norms are used by the batch distance engine, which expands
+ * |a - b|^2 into |a|^2 + |b|^2 - 2 a.b. They must be recomputed if the
+ * features change.
+ *
+ * @param dataset The dataset to compute the norms of.
+ */
+void dataset_compute_norms(Dataset* dataset) {
+    if (dataset->norms == NULL) {
+        dataset->norms = (float*)malloc((dataset->num_genes > 0 ? dataset->num_genes : 1) * sizeof(float));
+        if (dataset->norms == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+    }
+
+    #pragma omp parallel
+    {
+        //reduced precision rows are decoded first, the norms are of the stored values
+        float* decoded = dataset->storage != STORAGE_F32 ? feature_array(dataset) : NULL;
+
+        #pragma omp for
+        for (int i = 0; i < dataset->num_genes; i++) {
+            const float* row = decoded;
+            if (decoded != NULL) {
+                dataset_decode_row(dataset, i, decoded);
+            } else {
+                row = dataset_row(dataset, i);
+            }
+            float norm = 0;
+            for (int j = 0; j < dataset->num_features; j++) {
+                norm += row[j] * row[j];
+            }
+            dataset->norms[i] = norm;
+        }
+
+        free(decoded);
+    }
+
+    return (void)0;
+}
+
+
+/**
+ * Frees a dataset and all of its associated memory.
+ *
+ * @param dataset The dataset to be freed.
+ */
+void dataset_free(Dataset* dataset) {
+    dataset_release(dataset);
+    for (int i = 0; i < dataset->num_classes; i++) {
+        free(dataset->class_names[i]);
+    }
+    free(dataset->class_names);
+    free(dataset->class_table);
+    free(dataset);
+    return (void)0;
+}
@@ -0,0 +1,113 @@
+#ifndef GM_DATASET_H
+#define GM_DATASET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//every row of the feature matrix starts on a 64 byte boundary (one cache line)
+#define DATASET_ALIGNMENT 64
+//rows are padded with zeros up to a multiple of this many floats
+#define DATASET_ROW_PAD ((int)(DATASET_ALIGNMENT / sizeof(float)))
+
+//how the feature matrix is stored, chosen at load time (see dataset_set_storage)
+//f16 and bf16 halve the bytes read per distance, int8 quarters them (per feature affine, 8 bit codes)
+typedef enum dataset_storage_t {
+    STORAGE_F32,
+    STORAGE_F16,
+    STORAGE_BF16,
+    STORAGE_INT8
+} dataset_storage_t;
+
+//a dataset holds every gene in a single structure-of-arrays store
+//the features are one contiguous, 64 byte aligned, row padded matrix (num_genes x padded_features)
+//the labels are interned into dense integer class ids, class_names maps an id back to its string
+typedef struct Dataset {
+    float* features;
+    int* labels;
+    int num_genes;
+    int num_features;
+    int padded_features;
+
+    //squared L2 norm of every row, NULL until dataset_compute_norms is called
+    float* norms;
+
+    char** class_names;
+    int num_classes;
+    int class_capacity;
+
+    //open addressing table from label string to class id (-1 is an empty slot)
+    int* class_table;
+    int class_table_size;
+
+    //reduced precision storage, features is NULL and the rows live in compact instead
+    //num_genes rows of padded_features 16 bit or 8 bit values, compact_stride bytes apart
+    dataset_storage_t storage;
+    void* compact;
+    size_t compact_stride;
+    //int8 only: feature f of a row is offsets[f] + scales[f] * code, weights[f] = scales[f]^2
+    float* scales;
+    float* offsets;
+    float* weights;
+    //int8 only: the weight every varying feature shares when they all have the same scale, 0 otherwise
+    float uniform_weight;
+
+    //set when features, labels and norms live in a memory mapped binary dataset file (see gm_binfile)
+    //instead of their own allocations
+    void* mapping;
+    size_t mapping_size;
+
+    //set when the arrays live in memory the dataset doesn't own (a node's MPI shared window, see
+    //gm_island), releasing the dataset then only forgets them
+    int shared;
+} Dataset;
+
+
+//Dataset functions
+Dataset* dataset_init();
+void dataset_set(Dataset* dataset, int num_genes, int num_features);
+void dataset_release(Dataset* dataset);
+int dataset_intern_label(Dataset* dataset, const char* label);
+void dataset_order_classes(Dataset* dataset);
+void dataset_set_storage(Dataset* dataset, dataset_storage_t storage);
+void dataset_decode_row(const Dataset* dataset, int index, float* row);
+void dataset_compute_norms(Dataset* dataset);
+void dataset_free(Dataset* dataset);
+
+//rounds a feature count up to the padded row width
+int dataset_padded_width(int num_features);
+
+//storage mode names (f32, f16, bf16, int8)
+const char* dataset_storage_name(dataset_storage_t storage);
+int dataset_storage_from_name(const char* name, dataset_storage_t* storage);
+
+//whether dataset_decode_row decodes halves with F16C, set once by distance_init with the f16 kernels
+//(the portable decode until then)
+extern int dataset_f16c;
+
+//O(1)
+/**
+ * Returns a pointer to the start of a row of the feature matrix.
+ * Only valid while the dataset is stored as STORAGE_F32.
+ *
+ * @param dataset The dataset to read from.
+ * @param index The global index of the gene.
+ * @return A pointer to the padded_features floats of the gene.
+ */
+static inline float* dataset_row(const Dataset* dataset, int index) {
+    return dataset->features + (size_t)index * dataset->padded_features;
+}
+
+
+//O(1)
+/**
+ * Returns a pointer to the start of a row of the reduced precision matrix.
+ *
+ * @param dataset The dataset to read from (not STORAGE_F32).
+ * @param index The global index of the gene.
+ * @return A pointer to the padded_features codes of the gene.
+ */
+static inline const void* dataset_compact_row(const Dataset* dataset, int index) {
+    return (const char*)dataset->compact + (size_t)index * dataset->compact_stride;
+}
+
+#endif
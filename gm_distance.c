@@ -0,0 +1,633 @@
+#include "gm_distance.h"
+#include "gm_half.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+//the kernels live in one file, each one is compiled for its own instruction set with a target
+//attribute so the rest of the program keeps the default flags and still runs on any x86-64 cpu
+
+//resolves the kernel on first use if distance_init was never called, a fallback for the tools:
+//GM.out calls distance_init at startup since two threads resolving at once would race
+static float distance_sq_resolve(const float* a, const float* b, int length);
+
+distance_kernel_t distance_sq = distance_sq_resolve;
+static const char* selected_name = "unselected";
+
+//the reduced precision kernels resolve the same way
+static float distance_sq_f16_resolve(const uint16_t* a, const uint16_t* b, int length);
+static float distance_sq_bf16_resolve(const uint16_t* a, const uint16_t* b, int length);
+static float distance_sq_u8_weighted_resolve(const uint8_t* a, const uint8_t* b, const float* weights, int length);
+static uint32_t distance_sq_u8_resolve(const uint8_t* a, const uint8_t* b, int length);
+
+distance_half_kernel_t distance_sq_f16 = distance_sq_f16_resolve;
+distance_half_kernel_t distance_sq_bf16 = distance_sq_bf16_resolve;
+distance_u8_weighted_kernel_t distance_sq_u8_weighted = distance_sq_u8_weighted_resolve;
+distance_u8_kernel_t distance_sq_u8 = distance_sq_u8_resolve;
+static const char* selected_u8_name = "unselected";
+
+static distance_kernel_info_t kernel_list[] = {
+    {"scalar", distance_sq_scalar, 1},
+    {"sse", distance_sq_sse, 0},
+    {"avx2", distance_sq_avx2, 0},
+    {"avx512", distance_sq_avx512, 0},
+};
+#define NUM_KERNELS ((int)(sizeof(kernel_list) / sizeof(kernel_list[0])))
+
+
+//O(n)
+/**
+ * Squared euclidean distance, portable reference version.
+ *
+ * @param a The first row.
+ * @param b The second row.
+ * @param length The number of features in each row.
+ * @return The squared distance between a and b.
+ */
+float distance_sq_scalar(const float* a, const float* b, int length) {
+    float distance = 0;
+    for (int i = 0; i < length; i++) {
+        float diff = a[i] - b[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance using SSE (4 floats per step, 2 accumulators).
+ */
+__attribute__((target("sse2")))
+float distance_sq_sse(const float* a, const float* b, int length) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 diff0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 diff1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff0, diff0));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(diff1, diff1));
+    }
+    for (; i + 4 <= length; i += 4) {
+        __m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff, diff));
+    }
+
+    //horizontal sum
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float distance = _mm_cvtss_f32(sum);
+
+    for (; i < length; i++) {
+        float diff = a[i] - b[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance using AVX2 and FMA (8 floats per step, 4 accumulators).
+ */
+__attribute__((target("avx2,fma")))
+float distance_sq_avx2(const float* a, const float* b, int length) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps();
+    __m256 sum3 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 diff2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 diff3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+        sum2 = _mm256_fmadd_ps(diff2, diff2, sum2);
+        sum3 = _mm256_fmadd_ps(diff3, diff3, sum3);
+    }
+    for (; i + 8 <= length; i += 8) {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        sum0 = _mm256_fmadd_ps(diff, diff, sum0);
+    }
+
+    //horizontal sum
+    __m256 sum8 = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float distance = _mm_cvtss_f32(sum);
+
+    for (; i < length; i++) {
+        float diff = a[i] - b[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance using AVX-512 (16 floats per step, 2 accumulators).
+ * The tail is handled with a masked load instead of a scalar loop.
+ */
+__attribute__((target("avx512f")))
+float distance_sq_avx512(const float* a, const float* b, int length) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        sum0 = _mm512_fmadd_ps(diff, diff, sum0);
+    }
+    if (i < length) {
+        __mmask16 mask = (__mmask16)((1u << (length - i)) - 1);
+        __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        sum1 = _mm512_fmadd_ps(diff, diff, sum1);
+    }
+
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+}
+
+
+//------------------------------reduced precision kernels-------------------------------
+//the 16 bit kernels widen to float and reuse the float arithmetic, the 8 bit kernels widen the
+//codes to 16 bits and square the differences with integer multiply-adds (vpdpwssd with VNNI)
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of IEEE halves, portable version.
+ */
+float distance_sq_f16_scalar(const uint16_t* a, const uint16_t* b, int length) {
+    float distance = 0;
+    for (int i = 0; i < length; i++) {
+        float diff = half_to_float(a[i]) - half_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of IEEE halves using F16C and AVX2.
+ */
+__attribute__((target("avx2,fma,f16c")))
+float distance_sq_f16_avx2(const uint16_t* a, const uint16_t* b, int length) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256 diff0 = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(a + i))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(b + i))));
+        __m256 diff1 = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(a + i + 8))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(b + i + 8))));
+        sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+    }
+
+    //horizontal sum
+    __m256 sum8 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float distance = _mm_cvtss_f32(sum);
+
+    for (; i < length; i++) {
+        float diff = half_to_float(a[i]) - half_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of IEEE halves using AVX-512.
+ */
+__attribute__((target("avx512f")))
+float distance_sq_f16_avx512(const uint16_t* a, const uint16_t* b, int length) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m512 diff0 = _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(a + i))), _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(b + i))));
+        __m512 diff1 = _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(a + i + 16))), _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(b + i + 16))));
+        sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m512 diff = _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(a + i))), _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(b + i))));
+        sum0 = _mm512_fmadd_ps(diff, diff, sum0);
+    }
+
+    float distance = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+    for (; i < length; i++) {
+        float diff = half_to_float(a[i]) - half_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of bfloat16, portable version.
+ */
+float distance_sq_bf16_scalar(const uint16_t* a, const uint16_t* b, int length) {
+    float distance = 0;
+    for (int i = 0; i < length; i++) {
+        float diff = bfloat16_to_float(a[i]) - bfloat16_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of bfloat16 using AVX2 (a
+ * bfloat16 widens to a float with a 16 bit shift).
+ */
+__attribute__((target("avx2,fma")))
+float distance_sq_bf16_avx2(const uint16_t* a, const uint16_t* b, int length) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256i a16 = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i b16 = _mm256_loadu_si256((const __m256i*)(b + i));
+        //the low halves of each 32 bit lane hold the even elements, the high halves the odd ones
+        __m256 a_even = _mm256_castsi256_ps(_mm256_slli_epi32(a16, 16));
+        __m256 b_even = _mm256_castsi256_ps(_mm256_slli_epi32(b16, 16));
+        __m256 a_odd = _mm256_castsi256_ps(_mm256_and_si256(a16, _mm256_set1_epi32((int)0xffff0000)));
+        __m256 b_odd = _mm256_castsi256_ps(_mm256_and_si256(b16, _mm256_set1_epi32((int)0xffff0000)));
+        __m256 diff0 = _mm256_sub_ps(a_even, b_even);
+        __m256 diff1 = _mm256_sub_ps(a_odd, b_odd);
+        sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+    }
+
+    //horizontal sum
+    __m256 sum8 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float distance = _mm_cvtss_f32(sum);
+
+    for (; i < length; i++) {
+        float diff = bfloat16_to_float(a[i]) - bfloat16_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Squared euclidean distance between two rows of bfloat16 using AVX-512.
+ */
+__attribute__((target("avx512f")))
+float distance_sq_bf16_avx512(const uint16_t* a, const uint16_t* b, int length) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    __m512i high = _mm512_set1_epi32((int)0xffff0000);
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m512i a16 = _mm512_loadu_si512((const void*)(a + i));
+        __m512i b16 = _mm512_loadu_si512((const void*)(b + i));
+        __m512 diff0 = _mm512_sub_ps(_mm512_castsi512_ps(_mm512_slli_epi32(a16, 16)), _mm512_castsi512_ps(_mm512_slli_epi32(b16, 16)));
+        __m512 diff1 = _mm512_sub_ps(_mm512_castsi512_ps(_mm512_and_si512(a16, high)), _mm512_castsi512_ps(_mm512_and_si512(b16, high)));
+        sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m512 a32 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(a + i))), 16));
+        __m512 b32 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(b + i))), 16));
+        __m512 diff = _mm512_sub_ps(a32, b32);
+        sum0 = _mm512_fmadd_ps(diff, diff, sum0);
+    }
+
+    float distance = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+    for (; i < length; i++) {
+        float diff = bfloat16_to_float(a[i]) - bfloat16_to_float(b[i]);
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Weighted squared distance between two rows of 8 bit codes, portable version.
+ */
+float distance_sq_u8_weighted_scalar(const uint8_t* a, const uint8_t* b, const float* weights, int length) {
+    float distance = 0;
+    for (int i = 0; i < length; i++) {
+        float diff = (float)((int)a[i] - (int)b[i]);
+        distance += weights[i] * diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Weighted squared distance between two rows of 8 bit codes using AVX2.
+ */
+__attribute__((target("avx2,fma")))
+float distance_sq_u8_weighted_avx2(const uint8_t* a, const uint8_t* b, const float* weights, int length) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i a8 = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i b8 = _mm_loadu_si128((const __m128i*)(b + i));
+        __m256 diff0 = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(a8), _mm256_cvtepu8_epi32(b8)));
+        __m256 diff1 = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(a8, 8)), _mm256_cvtepu8_epi32(_mm_srli_si128(b8, 8))));
+        sum0 = _mm256_fmadd_ps(_mm256_mul_ps(diff0, diff0), _mm256_loadu_ps(weights + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_mul_ps(diff1, diff1), _mm256_loadu_ps(weights + i + 8), sum1);
+    }
+
+    //horizontal sum
+    __m256 sum8 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float distance = _mm_cvtss_f32(sum);
+
+    for (; i < length; i++) {
+        float diff = (float)((int)a[i] - (int)b[i]);
+        distance += weights[i] * diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Weighted squared distance between two rows of 8 bit codes using AVX-512.
+ */
+__attribute__((target("avx512f")))
+float distance_sq_u8_weighted_avx512(const uint8_t* a, const uint8_t* b, const float* weights, int length) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m512 diff0 = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(a + i))), _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(b + i)))));
+        __m512 diff1 = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(a + i + 16))), _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(b + i + 16)))));
+        sum0 = _mm512_fmadd_ps(_mm512_mul_ps(diff0, diff0), _mm512_loadu_ps(weights + i), sum0);
+        sum1 = _mm512_fmadd_ps(_mm512_mul_ps(diff1, diff1), _mm512_loadu_ps(weights + i + 16), sum1);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m512 diff = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(a + i))), _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(b + i)))));
+        sum0 = _mm512_fmadd_ps(_mm512_mul_ps(diff, diff), _mm512_loadu_ps(weights + i), sum0);
+    }
+
+    float distance = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+    for (; i < length; i++) {
+        float diff = (float)((int)a[i] - (int)b[i]);
+        distance += weights[i] * diff * diff;
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Integer squared distance between two rows of 8 bit codes, portable version.
+ */
+uint32_t distance_sq_u8_scalar(const uint8_t* a, const uint8_t* b, int length) {
+    uint32_t distance = 0;
+    for (int i = 0; i < length; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        distance += (uint32_t)(diff * diff);
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Integer squared distance between two rows of 8 bit codes using AVX2
+ * (16 bit differences, pairs of squares summed by vpmaddwd).
+ */
+__attribute__((target("avx2")))
+uint32_t distance_sq_u8_avx2(const uint8_t* a, const uint8_t* b, int length) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256i diff = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i))), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i))));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+    }
+
+    //horizontal sum
+    __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0x4e));
+    sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0xb1));
+    uint32_t distance = (uint32_t)_mm_cvtsi128_si32(sum4);
+
+    for (; i < length; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        distance += (uint32_t)(diff * diff);
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Integer squared distance between two rows of 8 bit codes using AVX-512BW.
+ */
+__attribute__((target("avx512f,avx512bw")))
+uint32_t distance_sq_u8_avx512(const uint8_t* a, const uint8_t* b, int length) {
+    __m512i sum = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m512i diff = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i))), _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i))));
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(diff, diff));
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m256i diff = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i))), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i))));
+        sum = _mm512_add_epi32(sum, _mm512_zextsi256_si512(_mm256_madd_epi16(diff, diff)));
+    }
+
+    uint32_t distance = (uint32_t)_mm512_reduce_add_epi32(sum);
+    for (; i < length; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        distance += (uint32_t)(diff * diff);
+    }
+    return distance;
+}
+
+
+//O(n)
+/**
+ * Integer squared distance between two rows of 8 bit codes using AVX-512 VNNI
+ * (vpdpwssd squares and accumulates in one instruction, 2 accumulators).
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+uint32_t distance_sq_u8_vnni(const uint8_t* a, const uint8_t* b, int length) {
+    __m512i sum0 = _mm512_setzero_si512();
+    __m512i sum1 = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m512i diff0 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i))), _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i))));
+        __m512i diff1 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i + 32))), _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i + 32))));
+        sum0 = _mm512_dpwssd_epi32(sum0, diff0, diff0);
+        sum1 = _mm512_dpwssd_epi32(sum1, diff1, diff1);
+    }
+    for (; i + 32 <= length; i += 32) {
+        __m512i diff = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i))), _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i))));
+        sum0 = _mm512_dpwssd_epi32(sum0, diff, diff);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m256i diff = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i))), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i))));
+        sum1 = _mm512_add_epi32(sum1, _mm512_zextsi256_si512(_mm256_madd_epi16(diff, diff)));
+    }
+
+    uint32_t distance = (uint32_t)_mm512_reduce_add_epi32(_mm512_add_epi32(sum0, sum1));
+    for (; i < length; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        distance += (uint32_t)(diff * diff);
+    }
+    return distance;
+}
+
+
+//O(1)
+/**
+ * Selects the widest distance kernel this cpu supports.
+ *
+ * The choice is made once from cpuid. Setting the environment variable
+ * GM_KERNEL to a kernel name (scalar, sse, avx2, avx512) forces that kernel
+ * if the cpu can run it. The kernels of the reduced precision storage modes
+ * follow the same instruction set (the int8 one uses VNNI when present),
+ * and rows of halves are decoded with F16C when the cpu has it.
+ *
+ * This function returns void.
+ */
+void distance_init() {
+    __builtin_cpu_init();
+    kernel_list[1].supported = __builtin_cpu_supports("sse2");
+    kernel_list[2].supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    kernel_list[3].supported = __builtin_cpu_supports("avx512f");
+
+    //widest supported kernel wins
+    int selected = 0;
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (kernel_list[i].supported) {
+            selected = i;
+        }
+    }
+
+    //let the user force a kernel
+    char* forced = getenv("GM_KERNEL");
+    if (forced != NULL) {
+        for (int i = 0; i < NUM_KERNELS; i++) {
+            if (strcmp(forced, kernel_list[i].name) == 0 && kernel_list[i].supported) {
+                selected = i;
+            }
+        }
+    }
+
+    selected_name = kernel_list[selected].name;
+    distance_sq = kernel_list[selected].kernel;
+
+    //the reduced precision kernels follow the float kernel's instruction set
+    int avx512 = strcmp(selected_name, "avx512") == 0;
+    int avx2 = strcmp(selected_name, "avx2") == 0;
+    int f16c = __builtin_cpu_supports("f16c");
+    dataset_f16c = f16c;
+    int avx512bw = __builtin_cpu_supports("avx512bw");
+    int vnni = avx512bw && __builtin_cpu_supports("avx512vnni");
+
+    distance_sq_f16 = avx512 ? distance_sq_f16_avx512 : (avx2 && f16c) ? distance_sq_f16_avx2 : distance_sq_f16_scalar;
+    distance_sq_bf16 = avx512 ? distance_sq_bf16_avx512 : avx2 ? distance_sq_bf16_avx2 : distance_sq_bf16_scalar;
+    distance_sq_u8_weighted = avx512 ? distance_sq_u8_weighted_avx512 : avx2 ? distance_sq_u8_weighted_avx2 : distance_sq_u8_weighted_scalar;
+    if (avx512 && vnni) {
+        distance_sq_u8 = distance_sq_u8_vnni;
+        selected_u8_name = "avx512vnni";
+    } else if (avx512 && avx512bw) {
+        distance_sq_u8 = distance_sq_u8_avx512;
+        selected_u8_name = "avx512bw";
+    } else if (avx512 || avx2) {
+        distance_sq_u8 = distance_sq_u8_avx2;
+        selected_u8_name = "avx2";
+    } else {
+        distance_sq_u8 = distance_sq_u8_scalar;
+        selected_u8_name = "scalar";
+    }
+
+    return (void)0;
+}
+
+
+static float distance_sq_resolve(const float* a, const float* b, int length) {
+    distance_init();
+    return distance_sq(a, b, length);
+}
+
+
+static float distance_sq_f16_resolve(const uint16_t* a, const uint16_t* b, int length) {
+    distance_init();
+    return distance_sq_f16(a, b, length);
+}
+
+
+static float distance_sq_bf16_resolve(const uint16_t* a, const uint16_t* b, int length) {
+    distance_init();
+    return distance_sq_bf16(a, b, length);
+}
+
+
+static float distance_sq_u8_weighted_resolve(const uint8_t* a, const uint8_t* b, const float* weights, int length) {
+    distance_init();
+    return distance_sq_u8_weighted(a, b, weights, length);
+}
+
+
+static uint32_t distance_sq_u8_resolve(const uint8_t* a, const uint8_t* b, int length) {
+    distance_init();
+    return distance_sq_u8(a, b, length);
+}
+
+
+/**
+ * @return The name of the selected distance kernel.
+ */
+const char* distance_kernel_name() {
+    return selected_name;
+}
+
+
+/**
+ * @return The name of the selected integer kernel of the int8 storage.
+ */
+const char* distance_u8_kernel_name() {
+    return selected_u8_name;
+}
+
+
+/**
+ * Returns every kernel compiled into the program, with its cpu support flag.
+ *
+ * @param num_kernels Set to the number of kernels in the returned list.
+ * @return The kernel list (owned by this module).
+ */
+const distance_kernel_info_t* distance_kernels(int* num_kernels) {
+    if (distance_sq == distance_sq_resolve) {
+        distance_init();
+    }
+    *num_kernels = NUM_KERNELS;
+    return kernel_list;
+}
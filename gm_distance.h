@@ -0,0 +1,86 @@
+#ifndef GM_DISTANCE_H
+#define GM_DISTANCE_H
+
+#include <stdint.h>
+#include "gm_dataset.h"
+
+//squared euclidean distance between two float rows of a given length
+typedef float (*distance_kernel_t)(const float* a, const float* b, int length);
+
+//a kernel together with its name and whether this cpu can run it
+typedef struct distance_kernel_info_t {
+    const char* name;
+    distance_kernel_t kernel;
+    int supported;
+} distance_kernel_info_t;
+
+//the squared distance kernel selected for this cpu (set by distance_init)
+extern distance_kernel_t distance_sq;
+
+float distance_sq_scalar(const float* a, const float* b, int length);
+float distance_sq_sse(const float* a, const float* b, int length);
+float distance_sq_avx2(const float* a, const float* b, int length);
+float distance_sq_avx512(const float* a, const float* b, int length);
+
+//kernels of the reduced precision storage modes (see dataset_set_storage), picked with the float one
+//squared distance between two rows of 16 bit floats
+typedef float (*distance_half_kernel_t)(const uint16_t* a, const uint16_t* b, int length);
+//sum of weights[i] * (a[i] - b[i])^2 over two rows of 8 bit codes
+typedef float (*distance_u8_weighted_kernel_t)(const uint8_t* a, const uint8_t* b, const float* weights, int length);
+//exact integer sum of (a[i] - b[i])^2 over two rows of 8 bit codes (exact up to 66000 features)
+typedef uint32_t (*distance_u8_kernel_t)(const uint8_t* a, const uint8_t* b, int length);
+
+extern distance_half_kernel_t distance_sq_f16;
+extern distance_half_kernel_t distance_sq_bf16;
+extern distance_u8_weighted_kernel_t distance_sq_u8_weighted;
+extern distance_u8_kernel_t distance_sq_u8;
+
+float distance_sq_f16_scalar(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_f16_avx2(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_f16_avx512(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_bf16_scalar(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_bf16_avx2(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_bf16_avx512(const uint16_t* a, const uint16_t* b, int length);
+float distance_sq_u8_weighted_scalar(const uint8_t* a, const uint8_t* b, const float* weights, int length);
+float distance_sq_u8_weighted_avx2(const uint8_t* a, const uint8_t* b, const float* weights, int length);
+float distance_sq_u8_weighted_avx512(const uint8_t* a, const uint8_t* b, const float* weights, int length);
+uint32_t distance_sq_u8_scalar(const uint8_t* a, const uint8_t* b, int length);
+uint32_t distance_sq_u8_avx2(const uint8_t* a, const uint8_t* b, int length);
+uint32_t distance_sq_u8_avx512(const uint8_t* a, const uint8_t* b, int length);
+uint32_t distance_sq_u8_vnni(const uint8_t* a, const uint8_t* b, int length);
+
+void distance_init();
+const char* distance_kernel_name();
+const char* distance_u8_kernel_name();
+const distance_kernel_info_t* distance_kernels(int* num_kernels);
+
+
+//O(d)
+/**
+ * Squared euclidean distance between two genes of a dataset, in whatever
+ * storage mode the dataset uses. The padding is zero (code 0) in every row so
+ * the kernels run over the full padded width.
+ *
+ * @param dataset The dataset holding both genes.
+ * @param a The global index of the first gene.
+ * @param b The global index of the second gene.
+ * @return The squared distance between the stored values of the two genes.
+ */
+static inline float distance_sq_rows(const Dataset* dataset, int a, int b) {
+    int length = dataset->padded_features;
+    switch (dataset->storage) {
+        case STORAGE_F16:
+            return distance_sq_f16((const uint16_t*)dataset_compact_row(dataset, a), (const uint16_t*)dataset_compact_row(dataset, b), length);
+        case STORAGE_BF16:
+            return distance_sq_bf16((const uint16_t*)dataset_compact_row(dataset, a), (const uint16_t*)dataset_compact_row(dataset, b), length);
+        case STORAGE_INT8:
+            if (dataset->uniform_weight > 0) {
+                return dataset->uniform_weight * (float)distance_sq_u8((const uint8_t*)dataset_compact_row(dataset, a), (const uint8_t*)dataset_compact_row(dataset, b), length);
+            }
+            return distance_sq_u8_weighted((const uint8_t*)dataset_compact_row(dataset, a), (const uint8_t*)dataset_compact_row(dataset, b), dataset->weights, length);
+        default:
+            return distance_sq(dataset_row(dataset, a), dataset_row(dataset, b), length);
+    }
+}
+
+#endif
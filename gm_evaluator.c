@@ -0,0 +1,802 @@
+#include "gm_evaluator.h"
+#include "gm_KNN.h"
+#include "gm_distance.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <immintrin.h>
+#include <math.h>
+
+
+//O(1)
+//a task range packed as end << 32 | begin
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return ((uint64_t)end << 32) | begin;
+}
+
+static inline uint32_t range_begin(uint64_t range) {
+    return (uint32_t)range;
+}
+
+static inline uint32_t range_end(uint64_t range) {
+    return (uint32_t)(range >> 32);
+}
+
+
+//O(1) amortized
+//takes the first task of a thread's own range, -1 when the range is empty
+static int take_task(evaluator_range_t* own) {
+    uint64_t range = __atomic_load_n(&own->range, __ATOMIC_ACQUIRE);
+    while (range_begin(range) < range_end(range)) {
+        uint64_t taken = pack_range(range_begin(range) + 1, range_end(range));
+        if (__atomic_compare_exchange_n(&own->range, &range, taken, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return (int)range_begin(range);
+        }
+    }
+    return -1;
+}
+
+
+//O(threads)
+//steals the back half of the first non empty range after the thread's own, the first stolen task is
+//returned and the rest becomes the thread's range. -1 when every range is empty (no task is ever
+//added during a run, so then the run is over)
+static int steal_task(Evaluator* evaluator, int self, int num_ranges) {
+    for (int offset = 1; offset < num_ranges; offset++) {
+        evaluator_range_t* victim = &evaluator->ranges[(self + offset) % num_ranges];
+        uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        while (range_begin(range) < range_end(range)) {
+            uint32_t begin = range_begin(range);
+            uint32_t end = range_end(range);
+            uint32_t middle = begin + (end - begin) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &range, pack_range(begin, middle), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&evaluator->ranges[self].range, pack_range(middle + 1, end), __ATOMIC_RELEASE);
+                evaluator->threads[self].num_steals++;
+                return (int)middle;
+            }
+        }
+    }
+    return -1;
+}
+
+
+//O(n)
+//makes room for num_threads threads (the thread count may grow between runs)
+static void threads_reserve(Evaluator* evaluator, int num_threads) {
+    if (num_threads <= evaluator->num_threads) {
+        return (void)0;
+    }
+
+    evaluator->threads = (evaluator_thread_t*)realloc(evaluator->threads, num_threads * sizeof(evaluator_thread_t));
+    free(evaluator->ranges);
+    evaluator->ranges = (evaluator_range_t*)aligned_alloc(64, num_threads * sizeof(evaluator_range_t));
+    if (evaluator->threads == NULL || evaluator->ranges == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    for (int t = evaluator->num_threads; t < num_threads; t++) {
+        evaluator_thread_t* thread = &evaluator->threads[t];
+        memset(thread, 0, sizeof(evaluator_thread_t));
+        batch_scratch_init(&thread->batch);
+        search_scratch_init(&thread->search);
+        cache_scratch_init(&thread->cache);
+        vote_init(&thread->vote, evaluator->dataset->num_classes, evaluator->k, evaluator->weighting);
+    }
+    evaluator->num_threads = num_threads;
+
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Allocates a population evaluator for a fixed test set.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param test_genes The global indices of the test genes (borrowed, must outlive the evaluator).
+ * @param num_test_genes The number of test genes.
+ * @param k The number of neighbors that vote.
+ * @return A pointer to the newly allocated evaluator.
+ */
+Evaluator* evaluator_init(Dataset* dataset, const int* test_genes, int num_test_genes, int k) {
+    Evaluator* evaluator = (Evaluator*)calloc(1, sizeof(Evaluator));
+    if (evaluator == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    evaluator->dataset = dataset;
+    evaluator->test_genes = test_genes;
+    evaluator->num_test_genes = num_test_genes;
+    evaluator->total_test_genes = num_test_genes;
+    evaluator->k = k;
+    threads_reserve(evaluator, omp_get_max_threads());
+
+    return evaluator;
+}
+
+
+#ifdef GM_USE_MPI
+//O(1)
+/**
+ * Shards an evaluator's test set over the ranks of a communicator.
+ *
+ * From then on the evaluator only scores this rank's slice of the test genes
+ * (see KNN_shard) and evaluator_run sums the counts of every rank with one
+ * MPI_Allreduce, so every rank must call evaluator_run with the same
+ * population. The fitness is exactly the unsharded one.
+ *
+ * @param evaluator The evaluator, with the whole test set.
+ * @param comm The communicator sharing the test set (must outlive the evaluator).
+ */
+void evaluator_shard(Evaluator* evaluator, MPI_Comm comm) {
+    int begin, end;
+    KNN_shard(evaluator->total_test_genes, comm, &begin, &end);
+    evaluator->test_genes += begin;
+    evaluator->num_test_genes = end - begin;
+    evaluator->sharded = 1;
+    evaluator->shard_comm = comm;
+    return (void)0;
+}
+#endif
+
+
+//O(prepare)
+//makes sure a creature has been prepared, preparing it when no other thread has started to, and
+//returns its final state (2 to score it, 3 when it is already scored)
+static int prepare_creature(Evaluator* evaluator, evaluator_thread_t* thread, int self, int creature) {
+    int state = __atomic_load_n(&evaluator->prepared[creature], __ATOMIC_ACQUIRE);
+    if (state >= 2) {
+        return state;
+    }
+
+    int expected = 0;
+    if (state == 0 && __atomic_compare_exchange_n(&evaluator->prepared[creature], &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        double start = omp_get_wtime();
+        state = evaluator->prepare(evaluator->prepare_context, creature, self) ? 2 : 3;
+        thread->prepare_seconds += omp_get_wtime() - start;
+        __atomic_store_n(&evaluator->prepared[creature], state, __ATOMIC_RELEASE);
+        return state;
+    }
+
+    //another thread is building it, that takes O(|creature|)
+    while ((state = __atomic_load_n(&evaluator->prepared[creature], __ATOMIC_ACQUIRE)) < 2) {
+        _mm_pause();
+    }
+    return state;
+}
+
+
+//O(|creature| * block * d)
+//scores one (creature, test block) task and stores its number of correct predictions
+static void run_task(Evaluator* evaluator, evaluator_thread_t* thread, int self, Creature* creatures[], int task) {
+    int k = evaluator->k;
+    if (evaluator->prepare != NULL && prepare_creature(evaluator, thread, self, task / evaluator->num_blocks) == 3) {
+        evaluator->correct[task] = 0;
+        return (void)0;
+    }
+
+    double start = omp_get_wtime();
+    Creature* creature = creatures[task / evaluator->num_blocks];
+    int first = (task % evaluator->num_blocks) * evaluator->block_size;
+    int num_queries = evaluator->num_test_genes - first < evaluator->block_size ? evaluator->num_test_genes - first : evaluator->block_size;
+    const int* queries = evaluator->test_genes + first;
+
+    //a kept state takes the block's lists and predictions in place
+    distance_intex_t* neighbors = thread->neighbors;
+    int* predictions = NULL;
+    if (evaluator->states != NULL) {
+        FitnessState* state = evaluator->states[task / evaluator->num_blocks];
+        neighbors = state->neighbors + (size_t)first * k;
+        predictions = state->predictions + first;
+    }
+
+    //the telemetry scopes end with these blocks
+    {
+        TELEMETRY_SCOPE(TELEMETRY_KNN);
+        TELEMETRY_PERF_SCOPE();
+        if (evaluator->cache != NULL) {
+            cache_knn_block(evaluator->cache, evaluator->dataset, creature, first, num_queries, k, neighbors, &thread->cache, &thread->batch);
+        } else if (evaluator->search != NULL) {
+            search_knn(evaluator->search, queries, num_queries, creature->gene_indices, creature->num_genes, k, neighbors, &thread->search);
+        } else {
+            batch_knn_serial(evaluator->dataset, queries, num_queries, creature->gene_indices, creature->num_genes, k, neighbors, &thread->batch);
+        }
+    }
+
+    int correct = 0;
+    {
+        TELEMETRY_SCOPE(TELEMETRY_VOTE);
+        for (int q = 0; q < num_queries; q++) {
+            int prediction = KNN_vote(evaluator->dataset, neighbors + (size_t)q * k, k, &thread->vote);
+            if (predictions != NULL) {
+                predictions[q] = prediction;
+            }
+            correct += prediction == evaluator->dataset->labels[queries[q]];
+        }
+    }
+    evaluator->correct[task] = correct;
+    thread->num_tasks++;
+    thread->task_seconds += omp_get_wtime() - start;
+
+    return (void)0;
+}
+
+
+//O(p * t * |creature| * d / threads)
+//cuts this rank's test genes into blocks and runs every (creature, block) task on the team
+static void run_tasks(Evaluator* evaluator, Creature* creatures[], int num_creatures) {
+    int num_threads = omp_get_max_threads();
+    threads_reserve(evaluator, num_threads);
+
+    //cut the test set so there are enough tasks, but not into blocks too small to pay for themselves
+    int num_test_genes = evaluator->num_test_genes;
+    int target_tasks = num_threads * EVALUATOR_TASKS_PER_THREAD;
+    int num_blocks = (target_tasks + num_creatures - 1) / num_creatures;
+    int max_blocks = num_test_genes / EVALUATOR_MIN_BLOCK > 1 ? num_test_genes / EVALUATOR_MIN_BLOCK : 1;
+    if (num_blocks > max_blocks) {
+        num_blocks = max_blocks;
+    }
+    evaluator->block_size = (num_test_genes + num_blocks - 1) / num_blocks;
+    evaluator->num_blocks = (num_test_genes + evaluator->block_size - 1) / evaluator->block_size;
+
+    size_t num_tasks = (size_t)num_creatures * evaluator->num_blocks;
+    if (num_tasks > evaluator->correct_capacity) {
+        free(evaluator->correct);
+        evaluator->correct = (int*)malloc(num_tasks * sizeof(int));
+        if (evaluator->correct == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        evaluator->correct_capacity = num_tasks;
+    }
+
+    //even contiguous ranges, a creature's blocks mostly stay on one thread
+    for (int t = 0; t < evaluator->num_threads; t++) {
+        uint32_t begin = t < num_threads ? (uint32_t)(num_tasks * t / num_threads) : 0;
+        uint32_t end = t < num_threads ? (uint32_t)(num_tasks * (t + 1) / num_threads) : 0;
+        evaluator->ranges[t].range = pack_range(begin, end);
+    }
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int self = omp_get_thread_num();
+        evaluator_thread_t* thread = &evaluator->threads[self];
+
+        size_t neighbors_size = (size_t)evaluator->block_size * evaluator->k;
+        if (neighbors_size > thread->neighbors_capacity) {
+            free(thread->neighbors);
+            thread->neighbors = (distance_intex_t*)malloc(neighbors_size * sizeof(distance_intex_t));
+            if (thread->neighbors == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+            thread->neighbors_capacity = neighbors_size;
+        }
+
+        //a smaller team than asked for (nested regions) leaves ranges without an owner, they get stolen
+        int num_ranges = num_threads;
+        int task = take_task(&evaluator->ranges[self]);
+        while (task >= 0 || (task = steal_task(evaluator, self, num_ranges)) >= 0) {
+            run_task(evaluator, thread, self, creatures, task);
+            task = take_task(&evaluator->ranges[self]);
+        }
+    }
+
+    return (void)0;
+}
+
+
+//O(n)
+//grows an int array to hold at least size entries
+static int* reserve_ints(int* array, size_t* capacity, size_t size) {
+    if (size <= *capacity) {
+        return array;
+    }
+    free(array);
+    array = (int*)malloc(size * sizeof(int));
+    if (array == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    *capacity = size;
+    return array;
+}
+
+
+//O(log |block|)
+//the first gene of a block's bucket at or after position whose slot is at least slot
+static size_t slot_start(const int* gene_slots, size_t begin, size_t end, int slot) {
+    while (begin < end) {
+        size_t middle = begin + (end - begin) / 2;
+        if (gene_slots[middle] < slot) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+
+//O(m * chunk * d)
+//pushes m genes of a block into the neighbor lists of a chunk of test genes, a gene only goes in
+//when it is strictly nearer than a list's k-th neighbor (as in fitness_add_gene)
+static void apply_genes(const Evaluator* evaluator, const float* rows, int first_row, const int* genes, size_t num_genes, distance_intex_t* lists, int first_test, int num_tests) {
+    int k = evaluator->k;
+    int padded = evaluator->dataset->padded_features;
+    const float* test_rows = evaluator->streamed.test_rows;
+    TELEMETRY_COUNT(TELEMETRY_DISTANCES, num_genes * num_tests);
+
+    for (size_t m = 0; m < num_genes; m++) {
+        const float* row = rows + (size_t)(genes[m] - first_row) * padded;
+        for (int q = first_test; q < first_test + num_tests; q++) {
+            distance_intex_t* list = lists + (size_t)q * k;
+            float distance = distance_sq(test_rows + (size_t)q * padded, row, padded);
+            if (distance >= list[k - 1].distance) {
+                continue;
+            }
+            int i = k - 1;
+            while (i > 0 && list[i - 1].distance > distance) {
+                list[i] = list[i - 1];
+                i--;
+            }
+            list[i].distance = distance;
+            list[i].index = genes[m];
+        }
+    }
+    return (void)0;
+}
+
+
+//O(p * |creature| + blocks)
+//buckets the scored creatures' genes by block and lists the blocks to read, returns how many
+static int bucket_genes(Evaluator* evaluator, Creature* creatures[], int num_creatures) {
+    evaluator_stream_t* streamed = &evaluator->streamed;
+    int block_rows = streamed->stream->block_rows;
+    int num_blocks = streamed->stream->num_blocks;
+    int* starts = streamed->starts;
+
+    //count every block's genes one slot ahead, so the sums end up as the starts
+    memset(starts, 0, (num_blocks + 1) * sizeof(int));
+    for (int c = 0; c < num_creatures; c++) {
+        if (streamed->slots[c] < 0) {
+            continue;
+        }
+        for (int i = 0; i < creatures[c]->num_genes; i++) {
+            starts[creatures[c]->gene_indices[i] / block_rows + 1]++;
+        }
+    }
+    for (int b = 0; b < num_blocks; b++) {
+        starts[b + 1] += starts[b];
+    }
+
+    //place them, creature order is kept inside a block so its slots ascend
+    for (int c = 0; c < num_creatures; c++) {
+        if (streamed->slots[c] < 0) {
+            continue;
+        }
+        for (int i = 0; i < creatures[c]->num_genes; i++) {
+            int gene = creatures[c]->gene_indices[i];
+            int position = starts[gene / block_rows]++;
+            streamed->genes[position] = gene;
+            streamed->gene_slots[position] = streamed->slots[c];
+        }
+    }
+    for (int b = num_blocks; b > 0; b--) {
+        starts[b] = starts[b - 1];
+    }
+    starts[0] = 0;
+
+    int num_needed = 0;
+    for (int b = 0; b < num_blocks; b++) {
+        if (starts[b] < starts[b + 1]) {
+            streamed->blocks[num_needed++] = b;
+        }
+    }
+    return num_needed;
+}
+
+
+//O(p * t * |creature| * d / threads), every needed row of the matrix read once
+//scores the population gene major: every block of the file is applied to the neighbor lists of
+//every creature before the next one is read (see evaluator_set_stream)
+static void run_streamed(Evaluator* evaluator, Creature* creatures[], int num_creatures) {
+    evaluator_stream_t* streamed = &evaluator->streamed;
+    GeneStream* stream = streamed->stream;
+    int k = evaluator->k;
+    int num_test_genes = evaluator->num_test_genes;
+    int padded = evaluator->dataset->padded_features;
+    int num_threads = omp_get_max_threads();
+    threads_reserve(evaluator, num_threads);
+
+    //the test genes stay resident, read once (after any sharding has picked this rank's slice)
+    size_t test_bytes = (size_t)num_test_genes * padded * sizeof(float);
+    if (streamed->test_rows == NULL) {
+        streamed->test_rows = (float*)aligned_alloc(DATASET_ALIGNMENT, test_bytes);
+        if (streamed->test_rows == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        stream_read_rows(stream, evaluator->test_genes, num_test_genes, streamed->test_rows);
+    }
+
+    //every block touches every creature, so they are all built first
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int self = omp_get_thread_num();
+        #pragma omp for schedule(dynamic)
+        for (int c = 0; c < num_creatures; c++) {
+            if (evaluator->prepare != NULL) {
+                prepare_creature(evaluator, &evaluator->threads[self], self, c);
+            } else {
+                evaluator->prepared[c] = 2;
+            }
+        }
+    }
+
+    if (num_creatures > streamed->slots_capacity) {
+        free(streamed->slots);
+        streamed->slots = (int*)malloc(num_creatures * sizeof(int));
+        if (streamed->slots == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        streamed->slots_capacity = num_creatures;
+    }
+    int num_scored = 0;
+    size_t num_genes = 0;
+    for (int c = 0; c < num_creatures; c++) {
+        streamed->slots[c] = evaluator->prepared[c] == 3 ? -1 : num_scored++;
+        num_genes += streamed->slots[c] >= 0 ? (size_t)creatures[c]->num_genes : 0;
+        evaluator->creature_correct[c] = 0;
+    }
+    if (num_scored == 0) {
+        return (void)0;
+    }
+
+    //lists for the whole population, so the blocks keep their size from one generation to the next
+    size_t lists_size = (size_t)num_creatures * num_test_genes * k;
+    if (lists_size > streamed->lists_capacity) {
+        free(streamed->lists);
+        streamed->lists = (distance_intex_t*)malloc(lists_size * sizeof(distance_intex_t));
+        if (streamed->lists == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        streamed->lists_capacity = lists_size;
+    }
+    size_t genes_capacity = streamed->genes_capacity;
+    streamed->genes = reserve_ints(streamed->genes, &genes_capacity, num_genes);
+    streamed->gene_slots = reserve_ints(streamed->gene_slots, &streamed->genes_capacity, num_genes);
+    stream_reserve(stream, test_bytes + streamed->lists_capacity * sizeof(distance_intex_t) + 2 * streamed->genes_capacity * sizeof(int));
+
+    streamed->starts = reserve_ints(streamed->starts, &streamed->starts_capacity, (size_t)stream->num_blocks + 1);
+    streamed->blocks = reserve_ints(streamed->blocks, &streamed->blocks_capacity, (size_t)stream->num_blocks);
+    int num_needed = bucket_genes(evaluator, creatures, num_creatures);
+
+    //the test set is cut into chunks so a block has work for every thread even with few creatures
+    int num_chunks = (num_test_genes + EVALUATOR_MIN_BLOCK - 1) / EVALUATOR_MIN_BLOCK;
+    evaluator->block_size = EVALUATOR_MIN_BLOCK;
+    evaluator->num_blocks = num_chunks;
+
+    size_t num_lists = (size_t)num_scored * num_test_genes * k;
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (size_t i = 0; i < num_lists; i++) {
+        streamed->lists[i].distance = INFINITY;
+        streamed->lists[i].index = -1;
+    }
+
+    stream_begin(stream, streamed->blocks, num_needed);
+    for (int n = 0; n < num_needed; n++) {
+        int block = streamed->blocks[n];
+        const float* rows = stream_next(stream);
+        int first_row = block * stream->block_rows;
+        size_t block_begin = (size_t)streamed->starts[block];
+        size_t block_end = (size_t)streamed->starts[block + 1];
+
+        #pragma omp parallel num_threads(num_threads)
+        {
+            evaluator_thread_t* thread = &evaluator->threads[omp_get_thread_num()];
+            double start = omp_get_wtime();
+
+            #pragma omp for collapse(2) schedule(dynamic)
+            for (int slot = 0; slot < num_scored; slot++) {
+                for (int chunk = 0; chunk < num_chunks; chunk++) {
+                    TELEMETRY_SCOPE(TELEMETRY_KNN);
+                    size_t begin = slot_start(streamed->gene_slots, block_begin, block_end, slot);
+                    size_t end = slot_start(streamed->gene_slots, begin, block_end, slot + 1);
+                    int first_test = chunk * EVALUATOR_MIN_BLOCK;
+                    int num_tests = num_test_genes - first_test < EVALUATOR_MIN_BLOCK ? num_test_genes - first_test : EVALUATOR_MIN_BLOCK;
+                    apply_genes(evaluator, rows, first_row, streamed->genes + begin, end - begin, streamed->lists + (size_t)slot * num_test_genes * k, first_test, num_tests);
+                    thread->num_tasks++;
+                }
+            }
+
+            thread->task_seconds += omp_get_wtime() - start;
+        }
+    }
+    stream_end(stream);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        evaluator_thread_t* thread = &evaluator->threads[omp_get_thread_num()];
+        TELEMETRY_SCOPE(TELEMETRY_VOTE);
+
+        #pragma omp for schedule(dynamic)
+        for (int c = 0; c < num_creatures; c++) {
+            int slot = streamed->slots[c];
+            if (slot < 0) {
+                continue;
+            }
+            const distance_intex_t* lists = streamed->lists + (size_t)slot * num_test_genes * k;
+            int correct = 0;
+            for (int q = 0; q < num_test_genes; q++) {
+                correct += KNN_vote(evaluator->dataset, lists + (size_t)q * k, k, &thread->vote) == evaluator->dataset->labels[evaluator->test_genes[q]];
+            }
+            evaluator->creature_correct[c] = correct;
+        }
+    }
+
+    return (void)0;
+}
+
+
+//O(p * t * |creature| * d / threads)
+/**
+ * Scores every creature of a population against the test set.
+ *
+ * The test set is cut into blocks so that there are about
+ * EVALUATOR_TASKS_PER_THREAD (creature, block) tasks per thread. Every thread
+ * runs its own range of tasks with its own scratch and steals from the others
+ * when it runs out. Each task's count lands in its own slot and the fitness of
+ * a creature is summed over its blocks in order, so the results are the same
+ * whatever the thread count or steal order, and equal to what KNN returns. The
+ * batch engine runs single threaded inside a task, the tasks are the
+ * parallelism (over creatures and over the test set). A sharded evaluator
+ * scores its rank's slice and sums the counts over the ranks.
+ *
+ * @param evaluator The evaluator.
+ * @param creatures The population.
+ * @param num_creatures The number of creatures.
+ * @param fitness Output, the fraction of test genes each creature classifies correctly.
+ */
+void evaluator_run(Evaluator* evaluator, Creature* creatures[], int num_creatures, double* fitness) {
+    evaluator_run_fused(evaluator, creatures, num_creatures, fitness, NULL, NULL);
+    return (void)0;
+}
+
+
+//O(p * t * |creature| * d / threads)
+/**
+ * Builds and scores every creature of a population in one parallel pass.
+ *
+ * Like evaluator_run, but creature c is only built (by prepare) right before
+ * its first task runs, on the thread that runs it. So the threads start
+ * scoring the first creatures while the others are still being built and no
+ * barrier separates the two, and a creature is built in the cache it is
+ * scored from. A thread that needs a creature another thread is building
+ * waits for it. Every creature is prepared exactly once, even one with no
+ * task. When prepare reports that it already knows a creature's fitness (an
+ * unchanged copy of a scored creature) its tasks are skipped and fitness[c]
+ * is left as prepare set it.
+ *
+ * @param evaluator The evaluator.
+ * @param creatures The population, filled in by prepare.
+ * @param num_creatures The number of creatures.
+ * @param fitness Output, the fraction of test genes each creature classifies correctly.
+ * @param prepare Builds a creature, NULL when they are already built.
+ * @param context Passed to prepare.
+ */
+void evaluator_run_fused(Evaluator* evaluator, Creature* creatures[], int num_creatures, double* fitness, evaluator_prepare_t prepare, void* context) {
+    if (num_creatures <= 0) {
+        return (void)0;
+    }
+    double start = omp_get_wtime();
+    if (evaluator->dataset->norms == NULL && evaluator->streamed.stream == NULL) {
+        dataset_compute_norms(evaluator->dataset);
+    }
+
+    if (num_creatures > evaluator->creature_correct_capacity) {
+        free(evaluator->creature_correct);
+        free(evaluator->prepared);
+        evaluator->creature_correct = (int*)malloc(num_creatures * sizeof(int));
+        evaluator->prepared = (int*)malloc(num_creatures * sizeof(int));
+        if (evaluator->creature_correct == NULL || evaluator->prepared == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        evaluator->creature_correct_capacity = num_creatures;
+    }
+    evaluator->prepare = prepare;
+    evaluator->prepare_context = context;
+    memset(evaluator->prepared, 0, num_creatures * sizeof(int));
+    for (int t = 0; t < evaluator->num_threads; t++) {
+        evaluator->threads[t].prepare_seconds = 0;
+        evaluator->threads[t].task_seconds = 0;
+    }
+
+    //a rank of a sharded test set may have no test genes, it still takes part in the sum
+    if (evaluator->num_test_genes > 0 && evaluator->streamed.stream != NULL) {
+        run_streamed(evaluator, creatures, num_creatures);
+    } else if (evaluator->num_test_genes > 0) {
+        run_tasks(evaluator, creatures, num_creatures);
+
+        //sum each creature's blocks in order
+        for (int c = 0; c < num_creatures; c++) {
+            int correct = 0;
+            for (int b = 0; b < evaluator->num_blocks; b++) {
+                correct += evaluator->correct[(size_t)c * evaluator->num_blocks + b];
+            }
+            evaluator->creature_correct[c] = correct;
+            if (evaluator->states != NULL && !(prepare != NULL && evaluator->prepared[c] == 3)) {
+                evaluator->states[c]->num_correct = correct;
+            }
+        }
+    } else {
+        memset(evaluator->creature_correct, 0, num_creatures * sizeof(int));
+    }
+
+#ifdef GM_USE_MPI
+    if (evaluator->sharded) {
+        KNN_reduce_correct(evaluator->creature_correct, num_creatures, evaluator->shard_comm);
+    }
+#endif
+
+    //creatures without a task (no test genes here) still have to be built
+    if (prepare != NULL) {
+        for (int c = 0; c < num_creatures; c++) {
+            prepare_creature(evaluator, &evaluator->threads[0], 0, c);
+        }
+    }
+
+    evaluator->num_skipped = 0;
+    for (int c = 0; c < num_creatures; c++) {
+        if (prepare != NULL && evaluator->prepared[c] == 3) {
+            evaluator->num_skipped++;
+            continue;
+        }
+        fitness[c] = evaluator->total_test_genes > 0 ? (double)evaluator->creature_correct[c] / evaluator->total_test_genes : 0;
+    }
+
+    evaluator->prepare = NULL;
+    evaluator->prepare_seconds = 0;
+    evaluator->task_seconds = 0;
+    for (int t = 0; t < evaluator->num_threads; t++) {
+        evaluator->prepare_seconds += evaluator->threads[t].prepare_seconds;
+        evaluator->task_seconds += evaluator->threads[t].task_seconds;
+    }
+    evaluator->wall_seconds = omp_get_wtime() - start;
+
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Makes an evaluator find neighbors through a search backend (an approximate
+ * one trades fitness accuracy for speed).
+ *
+ * @param evaluator The evaluator.
+ * @param search The backend (borrowed), NULL for the batch engine.
+ */
+void evaluator_set_search(Evaluator* evaluator, NeighborSearch* search) {
+    evaluator->search = search;
+    return (void)0;
+}
+
+
+//O(t)
+/**
+ * Makes an evaluator read the distances of its tasks out of a distance cache
+ * (see cache_knn_block) instead of computing them, ahead of any search
+ * backend. The neighbors are exact either way, but the cache's distances come
+ * from distance_sq_rows rather than the norms of the batch engine, so a near
+ * tie may break differently. Streamed runs don't use it.
+ *
+ * @param evaluator The evaluator, sharded already when it is going to be.
+ * @param cache The cache (borrowed), built over the evaluator's test genes in their order, NULL for none.
+ */
+void evaluator_set_cache(Evaluator* evaluator, DistanceCache* cache) {
+    if (cache != NULL && (cache->num_test_genes != evaluator->num_test_genes
+        || memcmp(cache->test_genes, evaluator->test_genes, evaluator->num_test_genes * sizeof(int)) != 0)) {
+        fprintf(stderr, CACHE_TEST_GENES_ERROR);
+        exit(1);
+    }
+    evaluator->cache = cache;
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Makes an evaluator keep the KNN state of every creature it scores: the
+ * tasks write their neighbor lists and predictions straight into the
+ * creature's state instead of the thread's scratch, and the state's count of
+ * correct predictions is set once the creature is scored. So a state can be
+ * updated afterwards (see fitness_mutate) without scoring the creature again.
+ * The states of creatures the prepare hook skips are left alone. Only for
+ * majority votes, in memory and unsharded test sets (the states hold the
+ * whole test set), and streamed runs don't fill them.
+ *
+ * @param evaluator The evaluator.
+ * @param states The state of every creature of the next runs (borrowed, for the evaluator's test genes and k), NULL for none.
+ */
+void evaluator_set_states(Evaluator* evaluator, FitnessState** states) {
+    evaluator->states = states;
+    return (void)0;
+}
+
+
+//O(threads)
+/**
+ * Sets how an evaluator's neighbors vote, majority (the default) or distance
+ * weighted.
+ *
+ * @param evaluator The evaluator.
+ * @param weighting The vote weighting.
+ */
+void evaluator_set_vote(Evaluator* evaluator, vote_weighting_t weighting) {
+    evaluator->weighting = weighting;
+    for (int t = 0; t < evaluator->num_threads; t++) {
+        evaluator->threads[t].vote.weighting = weighting;
+    }
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Makes an evaluator read the genes from an out of core stream instead of the
+ * dataset's features (which are then NULL, see stream_open).
+ *
+ * A streamed run is gene major: every creature is built first, then the
+ * blocks of the file holding any of their genes are read once each, in file
+ * order, and every block is applied to the neighbor lists of every creature
+ * (in parallel over creatures and chunks of the test set) while the next one
+ * is read. So a generation reads each needed byte of the matrix once, not
+ * once per creature. The test genes' rows, a list of k neighbors per creature
+ * and test gene, and the creatures' genes bucketed by block stay resident, the
+ * stream sizes its blocks so they and its buffers fit its budget. Distances
+ * are computed directly (distance_sq) rather than through the norms of the
+ * batch engine, so a near tie may break differently than in memory.
+ * The search backend is not used.
+ *
+ * @param evaluator The evaluator.
+ * @param stream The stream over the evaluator's dataset (borrowed).
+ */
+void evaluator_set_stream(Evaluator* evaluator, GeneStream* stream) {
+    evaluator->streamed.stream = stream;
+    return (void)0;
+}
+
+
+/**
+ * Frees an evaluator and all of its scratch.
+ *
+ * @param evaluator The evaluator to be freed.
+ */
+void evaluator_free(Evaluator* evaluator) {
+    for (int t = 0; t < evaluator->num_threads; t++) {
+        batch_scratch_free(&evaluator->threads[t].batch);
+        search_scratch_free(&evaluator->threads[t].search);
+        cache_scratch_free(&evaluator->threads[t].cache);
+        free(evaluator->threads[t].neighbors);
+        vote_free(&evaluator->threads[t].vote);
+    }
+    free(evaluator->threads);
+    free(evaluator->ranges);
+    free(evaluator->correct);
+    free(evaluator->creature_correct);
+    free(evaluator->prepared);
+    free(evaluator->streamed.test_rows);
+    free(evaluator->streamed.lists);
+    free(evaluator->streamed.slots);
+    free(evaluator->streamed.genes);
+    free(evaluator->streamed.gene_slots);
+    free(evaluator->streamed.starts);
+    free(evaluator->streamed.blocks);
+    free(evaluator);
+    return (void)0;
+}
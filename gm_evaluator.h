@@ -0,0 +1,141 @@
+#ifndef GM_EVALUATOR_H
+#define GM_EVALUATOR_H
+
+#include <stdint.h>
+#include "gm_creature.h"
+#include "gm_batch.h"
+#include "gm_search.h"
+#include "gm_vote.h"
+#include "gm_stream.h"
+#include "gm_cache.h"
+#include "gm_fitness.h"
+
+//the evaluator scores a whole population at once. the work is cut into (creature, test block) tasks
+//so there are enough of them whether the population is small and the test set big or the other way
+//around. every thread starts with an even, contiguous range of tasks and steals half of another
+//thread's remaining range once its own runs dry
+
+//fewest test genes per task, smaller blocks cost more packing than they win in balance
+#define EVALUATOR_MIN_BLOCK 32
+//tasks per thread the blocks are sized for
+#define EVALUATOR_TASKS_PER_THREAD 8
+
+//one thread's task range [begin, end) packed into a single word so it can be taken from or split
+//with one compare and swap, alone on its cache line
+typedef struct evaluator_range_t {
+    uint64_t range;
+    char pad[64 - sizeof(uint64_t)];
+} evaluator_range_t;
+
+//builds creature number creature right before its first task runs, on the thread that runs it
+//(see evaluator_run_fused), thread is that thread's number in the team. returns 1 when the creature
+//has to be scored, 0 when its fitness is already known (the hook stored it) and its tasks are skipped
+typedef int (*evaluator_prepare_t)(void* context, int creature, int thread);
+
+//one thread's scratch, kept across generations
+typedef struct evaluator_thread_t {
+    batch_scratch_t batch;
+    search_scratch_t search;
+    cache_scratch_t cache;
+    distance_intex_t* neighbors;
+    size_t neighbors_capacity;
+    vote_t vote;
+    long long num_tasks;
+    long long num_steals;
+    //time spent preparing creatures and running tasks in the last run
+    double prepare_seconds;
+    double task_seconds;
+} evaluator_thread_t;
+
+//what a streamed run keeps between generations (see evaluator_set_stream)
+typedef struct evaluator_stream_t {
+    GeneStream* stream;
+    //the rows of the test genes, read from the file on the first run
+    float* test_rows;
+    //num_test_genes lists of k neighbors for every scored creature
+    distance_intex_t* lists;
+    size_t lists_capacity;
+    //every creature's place among the scored ones, -1 when its fitness is already known
+    int* slots;
+    int slots_capacity;
+    //the scored creatures' genes bucketed by block, in creature order inside a block: block b holds
+    //genes[starts[b], starts[b + 1]), slots says whose each one is
+    int* genes;
+    int* gene_slots;
+    size_t genes_capacity;
+    int* starts;
+    size_t starts_capacity;
+    //the blocks holding at least one gene, in file order
+    int* blocks;
+    size_t blocks_capacity;
+} evaluator_stream_t;
+
+typedef struct Evaluator {
+    Dataset* dataset;
+    const int* test_genes;
+    int num_test_genes;
+    int k;
+    //the neighbor search backend, NULL for the batch engine (see evaluator_set_search)
+    NeighborSearch* search;
+    //the distances between the test and training genes, NULL to compute them (see evaluator_set_cache)
+    DistanceCache* cache;
+    //every creature's KNN state, the lists and predictions of a scored creature land in it, NULL to
+    //keep none (see evaluator_set_states)
+    FitnessState** states;
+    //how the neighbors vote (see evaluator_set_vote)
+    vote_weighting_t weighting;
+    //the out of core gene matrix, the stream is NULL when the dataset holds its features
+    evaluator_stream_t streamed;
+
+    int num_threads;
+    evaluator_thread_t* threads;
+    evaluator_range_t* ranges;
+
+    //number of test genes over every rank sharing the test set (num_test_genes when not sharded)
+    int total_test_genes;
+#ifdef GM_USE_MPI
+    //set by evaluator_shard, test_genes is then this rank's slice
+    int sharded;
+    MPI_Comm shard_comm;
+#endif
+
+    //number of correct predictions of every task, creature major
+    int* correct;
+    size_t correct_capacity;
+    //number of correct predictions of every creature
+    int* creature_correct;
+    int creature_correct_capacity;
+
+    //the fused run's hook and every creature's state (0 waiting, 1 being prepared, 2 ready, 3 ready
+    //and already scored)
+    evaluator_prepare_t prepare;
+    void* prepare_context;
+    int* prepared;
+
+    //time of the last run, prepare and task times summed over the threads
+    double prepare_seconds;
+    double task_seconds;
+    double wall_seconds;
+    //test genes per block and blocks per creature of the last run
+    int block_size;
+    int num_blocks;
+    //creatures of the last run whose fitness the hook already knew
+    int num_skipped;
+} Evaluator;
+
+
+//Evaluator functions
+Evaluator* evaluator_init(Dataset* dataset, const int* test_genes, int num_test_genes, int k);
+void evaluator_run(Evaluator* evaluator, Creature* creatures[], int num_creatures, double* fitness);
+void evaluator_run_fused(Evaluator* evaluator, Creature* creatures[], int num_creatures, double* fitness, evaluator_prepare_t prepare, void* context);
+void evaluator_set_search(Evaluator* evaluator, NeighborSearch* search);
+void evaluator_set_cache(Evaluator* evaluator, DistanceCache* cache);
+void evaluator_set_states(Evaluator* evaluator, FitnessState** states);
+void evaluator_set_vote(Evaluator* evaluator, vote_weighting_t weighting);
+void evaluator_set_stream(Evaluator* evaluator, GeneStream* stream);
+void evaluator_free(Evaluator* evaluator);
+#ifdef GM_USE_MPI
+void evaluator_shard(Evaluator* evaluator, MPI_Comm comm);
+#endif
+
+#endif
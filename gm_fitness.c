@@ -0,0 +1,313 @@
+#include "gm_fitness.h"
+#include "gm_batch.h"
+#include "gm_topk.h"
+#include "gm_vote.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <math.h>
+
+//incremental fitness. adding a gene can only change the test genes it is nearer to than their
+//current k-th neighbor, removing a gene only the test genes that have it as a neighbor. so a child
+//that differs from its parent by m genes costs O(m * t * d) (O(m * t) with a matrix cache) plus a
+//rescore of the few test genes that lost a neighbor, instead of O(|creature| * t * d)
+
+
+//O(d), O(1) with a matrix cache
+//squared distance between the t-th test gene and a gene
+static inline float pair_distance(FitnessState* state, int test_index, int gene) {
+    float distance;
+    if (state->cache != NULL && cache_lookup(state->cache, test_index, gene, &distance)) {
+        return distance;
+    }
+    TELEMETRY_COUNT(TELEMETRY_DISTANCES, 1);
+    return distance_sq_rows(state->dataset, state->test_genes[test_index], gene);
+}
+
+
+//O(k)
+//votes again for the t-th test gene and returns the change in the number of correct predictions
+static inline int revote(FitnessState* state, int test_index, vote_t* vote) {
+    int label = state->dataset->labels[state->test_genes[test_index]];
+    int old_prediction = state->predictions[test_index];
+    int new_prediction = KNN_vote(state->dataset, state->neighbors + (size_t)test_index * state->k, state->k, vote);
+    state->predictions[test_index] = new_prediction;
+    return (new_prediction == label) - (old_prediction == label);
+}
+
+
+//O(t * k)
+/**
+ * Allocates the KNN state of a creature.
+ *
+ * The state is empty until fitness_evaluate or fitness_copy fills it.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param cache An optional distance cache, when given its test genes are used and test_creature may be NULL.
+ * @param test_creature The creature whose genes are the test set.
+ * @param k The number of neighbors that vote.
+ * @return A pointer to the newly allocated state.
+ */
+FitnessState* fitness_init(Dataset* dataset, DistanceCache* cache, Creature* test_creature, int k) {
+    FitnessState* state = (FitnessState*)calloc(1, sizeof(FitnessState));
+    if (state == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    state->k = k;
+    state->dataset = dataset;
+    state->cache = cache;
+    if (cache != NULL) {
+        state->num_test_genes = cache->num_test_genes;
+        state->test_genes = cache->test_genes;
+    } else {
+        state->num_test_genes = test_creature->num_genes;
+        state->test_genes = test_creature->gene_indices;
+    }
+
+    int num_test_genes = state->num_test_genes > 0 ? state->num_test_genes : 1;
+    state->neighbors = (distance_intex_t*)malloc((size_t)num_test_genes * k * sizeof(distance_intex_t));
+    state->predictions = (int*)malloc(num_test_genes * sizeof(int));
+    state->affected = (int*)malloc(num_test_genes * sizeof(int));
+    if (state->neighbors == NULL || state->predictions == NULL || state->affected == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    return state;
+}
+
+
+//O(t * |creature| * d)
+/**
+ * Scores a creature from scratch and stores its KNN state.
+ *
+ * @param state The state to fill.
+ * @param creature The creature to score.
+ */
+void fitness_evaluate(FitnessState* state, Creature* creature) {
+    if (state->cache != NULL) {
+        cache_knn(state->cache, state->dataset, creature, state->k, state->neighbors);
+    } else {
+        batch_knn(state->dataset, state->test_genes, state->num_test_genes, creature->gene_indices, creature->num_genes, state->k, state->neighbors);
+    }
+
+    vote_t vote;
+    vote_init(&vote, state->dataset->num_classes, state->k, VOTE_MAJORITY);
+    state->num_correct = 0;
+    for (int t = 0; t < state->num_test_genes; t++) {
+        state->predictions[t] = -1;
+        state->num_correct += revote(state, t, &vote);
+    }
+    vote_free(&vote);
+
+    return (void)0;
+}
+
+
+//O(t * k)
+/**
+ * Copies a parent's KNN state into a child's (both for the same test genes and k).
+ *
+ * @param destination The child's state.
+ * @param source The parent's state.
+ */
+void fitness_copy(FitnessState* destination, const FitnessState* source) {
+    memcpy(destination->neighbors, source->neighbors, (size_t)source->num_test_genes * source->k * sizeof(distance_intex_t));
+    memcpy(destination->predictions, source->predictions, source->num_test_genes * sizeof(int));
+    destination->num_correct = source->num_correct;
+    return (void)0;
+}
+
+
+//O(t * d)
+/**
+ * Updates a state for a gene added to its creature.
+ *
+ * Only the test genes the new gene is strictly nearer to than their current
+ * k-th neighbor change, their lists take the gene and they vote again.
+ *
+ * @param state The state of the creature.
+ * @param gene The global index of the added gene.
+ */
+void fitness_add_gene(FitnessState* state, int gene) {
+    int k = state->k;
+    int delta = 0;
+
+    #pragma omp parallel reduction(+:delta)
+    {
+        vote_t vote;
+        vote_init(&vote, state->dataset->num_classes, k, VOTE_MAJORITY);
+
+        #pragma omp for schedule(static)
+        for (int t = 0; t < state->num_test_genes; t++) {
+            distance_intex_t* list = state->neighbors + (size_t)t * k;
+            float distance = pair_distance(state, t, gene);
+            if (distance >= list[k - 1].distance) {
+                continue;
+            }
+
+            //insert it, the k-th neighbor falls off the end
+            int i = k - 1;
+            while (i > 0 && list[i - 1].distance > distance) {
+                list[i] = list[i - 1];
+                i--;
+            }
+            list[i].distance = distance;
+            list[i].index = gene;
+
+            delta += revote(state, t, &vote);
+        }
+
+        vote_free(&vote);
+    }
+
+    state->num_correct += delta;
+    return (void)0;
+}
+
+
+//O(t * k + affected * |creature| * d)
+/**
+ * Updates a state for a gene removed from its creature.
+ *
+ * Only the test genes that have the gene as one of their k neighbors change.
+ * Their lists are rebuilt from the creature (which must no longer hold the
+ * gene), through the cache when it has a matrix and by the batch engine
+ * otherwise, and they vote again.
+ *
+ * @param state The state of the creature.
+ * @param creature The creature after the removal.
+ * @param gene The global index of the removed gene.
+ */
+void fitness_remove_gene(FitnessState* state, Creature* creature, int gene) {
+    int k = state->k;
+    Dataset* dataset = state->dataset;
+
+    //find the test genes that lose a neighbor
+    int num_affected = 0;
+    for (int t = 0; t < state->num_test_genes; t++) {
+        const distance_intex_t* list = state->neighbors + (size_t)t * k;
+        for (int j = 0; j < k && list[j].index >= 0; j++) {
+            if (list[j].index == gene) {
+                state->affected[num_affected++] = t;
+                break;
+            }
+        }
+    }
+    if (num_affected == 0) {
+        return (void)0;
+    }
+
+    int delta = 0;
+    int cached = state->cache != NULL && (state->cache->mode == CACHE_MATRIX_F32 || state->cache->mode == CACHE_MATRIX_F16);
+
+    if (cached) {
+        //rebuild each affected list from matrix lookups
+        #pragma omp parallel reduction(+:delta)
+        {
+            vote_t vote;
+            vote_init(&vote, dataset->num_classes, k, VOTE_MAJORITY);
+            float* heap_distance = (float*)malloc(k * sizeof(float));
+            int* heap_index = (int*)malloc(k * sizeof(int));
+            if (heap_distance == NULL || heap_index == NULL) {
+                fprintf(stderr, MALLOC_ERROR);
+                exit(1);
+            }
+
+            #pragma omp for schedule(dynamic)
+            for (int a = 0; a < num_affected; a++) {
+                int t = state->affected[a];
+                topk_t topk;
+                topk_init(&topk, k, heap_distance, heap_index);
+                for (int i = 0; i < creature->num_genes; i++) {
+                    topk_push(&topk, pair_distance(state, t, creature->gene_indices[i]), creature->gene_indices[i]);
+                }
+                topk_sorted(&topk, state->neighbors + (size_t)t * k);
+                delta += revote(state, t, &vote);
+            }
+
+            vote_free(&vote);
+            free(heap_distance);
+            free(heap_index);
+        }
+    } else {
+        //rebuild every affected list in one batch
+        int* affected_genes = (int*)malloc(num_affected * sizeof(int));
+        distance_intex_t* lists = (distance_intex_t*)malloc((size_t)num_affected * k * sizeof(distance_intex_t));
+        vote_t vote;
+        vote_init(&vote, dataset->num_classes, k, VOTE_MAJORITY);
+        if (affected_genes == NULL || lists == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        for (int a = 0; a < num_affected; a++) {
+            affected_genes[a] = state->test_genes[state->affected[a]];
+        }
+        batch_knn(dataset, affected_genes, num_affected, creature->gene_indices, creature->num_genes, k, lists);
+
+        for (int a = 0; a < num_affected; a++) {
+            int t = state->affected[a];
+            memcpy(state->neighbors + (size_t)t * k, lists + (size_t)a * k, k * sizeof(distance_intex_t));
+            delta += revote(state, t, &vote);
+        }
+
+        free(affected_genes);
+        free(lists);
+        vote_free(&vote);
+    }
+
+    state->num_correct += delta;
+    return (void)0;
+}
+
+
+/**
+ * Replaces one gene of a creature and updates its state (a point mutation).
+ *
+ * @param state The state of the creature.
+ * @param creature The creature to mutate.
+ * @param position The position in gene_indices to replace.
+ * @param new_gene The global index of the new gene.
+ */
+void fitness_mutate(FitnessState* state, Creature* creature, int position, int new_gene) {
+    int old_gene = creature->gene_indices[position];
+    if (old_gene == new_gene) {
+        return (void)0;
+    }
+
+    //add first, so the lists rebuilt by the removal already see the new gene
+    fitness_add_gene(state, new_gene);
+    creature->gene_indices[position] = new_gene;
+    fitness_remove_gene(state, creature, old_gene);
+
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * @return The fraction of test genes the state classifies correctly (what KNN returns).
+ */
+double fitness_value(const FitnessState* state) {
+    if (state->num_test_genes <= 0) {
+        return 0;
+    }
+    return (double)state->num_correct / state->num_test_genes;
+}
+
+
+/**
+ * Frees a KNN state and all of its associated memory.
+ *
+ * @param state The state to be freed.
+ */
+void fitness_free(FitnessState* state) {
+    free(state->neighbors);
+    free(state->predictions);
+    free(state->affected);
+    free(state);
+    return (void)0;
+}
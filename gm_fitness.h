@@ -0,0 +1,38 @@
+#ifndef GM_FITNESS_H
+#define GM_FITNESS_H
+
+#include "gm_creature.h"
+#include "gm_cache.h"
+
+//the KNN state of one creature: the k nearest creature genes of every test gene and the vote they
+//give. a creature that changes by a few genes updates its state instead of being scored again
+typedef struct FitnessState {
+    int k;
+    int num_test_genes;
+    //borrowed, the test creature's genes or the cache's
+    const int* test_genes;
+    //num_test_genes lists of k neighbors sorted by ascending squared distance, padded with (INFINITY, -1)
+    distance_intex_t* neighbors;
+    int* predictions;
+    int num_correct;
+
+    Dataset* dataset;
+    //optional, distances are read from it when it holds a matrix
+    DistanceCache* cache;
+
+    //scratch for the test genes a removal touches
+    int* affected;
+} FitnessState;
+
+
+//FitnessState functions
+FitnessState* fitness_init(Dataset* dataset, DistanceCache* cache, Creature* test_creature, int k);
+void fitness_evaluate(FitnessState* state, Creature* creature);
+void fitness_copy(FitnessState* destination, const FitnessState* source);
+void fitness_add_gene(FitnessState* state, int gene);
+void fitness_remove_gene(FitnessState* state, Creature* creature, int gene);
+void fitness_mutate(FitnessState* state, Creature* creature, int position, int new_gene);
+double fitness_value(const FitnessState* state);
+void fitness_free(FitnessState* state);
+
+#endif
@@ -0,0 +1,161 @@
+#include "gm_generate.h"
+#include "gm_rng.h"
+#include "errors.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//O(1)
+//a standard normal draw (Box-Muller)
+static double normal(rng_t* rng) {
+    double u = 1.0 - rng_uniform(rng);
+    double v = rng_uniform(rng);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+
+//O(c * d)
+/**
+ * Initializes a generator and draws its class centers.
+ *
+ * @param num_features The number of features of a row, positive.
+ * @param num_classes The number of classes, positive.
+ * @param separation The half width of the range the centers are drawn from.
+ * @param duplicate_rate The fraction of rows that copy an earlier row, in [0, 1).
+ * @param seed The seed of every stream.
+ * @return A pointer to the newly allocated generator.
+ */
+Generator* generator_init(int num_features, int num_classes, double separation, double duplicate_rate, uint64_t seed) {
+    Generator* generator = (Generator*)malloc(sizeof(Generator));
+    double* centers = (double*)malloc((size_t)num_classes * num_features * sizeof(double));
+    if (generator == NULL || centers == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    for (int c = 0; c < num_classes; c++) {
+        rng_t rng = rng_stream(seed, RNG_GENERATE, GENERATE_CENTERS, (uint32_t)c);
+        for (int f = 0; f < num_features; f++) {
+            centers[(size_t)c * num_features + f] = (2.0 * rng_uniform(&rng) - 1.0) * separation;
+        }
+    }
+
+    generator->seed = seed;
+    generator->num_features = num_features;
+    generator->num_classes = num_classes;
+    generator->separation = separation;
+    generator->duplicate_rate = duplicate_rate;
+    generator->centers = centers;
+    return generator;
+}
+
+
+//O(chain)
+/**
+ * The row a row's values come from: itself, unless it copies an earlier row
+ * (which may copy another).
+ *
+ * @param generator The generator.
+ * @param row The index of the row.
+ * @return The index of the row whose values it holds.
+ */
+int generator_source(const Generator* generator, int row) {
+    while (row > 0) {
+        rng_t rng = rng_stream(generator->seed, RNG_GENERATE, GENERATE_ROWS, (uint32_t)row);
+        if (rng_uniform(&rng) >= generator->duplicate_rate) {
+            break;
+        }
+        row = (int)rng_below(&rng, (uint32_t)row);
+    }
+    return row;
+}
+
+
+//O(d)
+/**
+ * Draws the class and values of a source row (see generator_source), from
+ * the row's stream past its duplicate draw.
+ *
+ * @param generator The generator.
+ * @param source The index of a row that copies no other.
+ * @param values Output, num_features values.
+ * @return The class of the row.
+ */
+int generator_values(const Generator* generator, int source, double* values) {
+    rng_t rng = rng_stream(generator->seed, RNG_GENERATE, GENERATE_ROWS, (uint32_t)source);
+    rng.draw = 1;
+    int label = (int)rng_below(&rng, (uint32_t)generator->num_classes);
+    const double* center = generator->centers + (size_t)label * generator->num_features;
+    for (int f = 0; f < generator->num_features; f++) {
+        values[f] = center[f] + normal(&rng);
+    }
+    return label;
+}
+
+
+/**
+ * Frees a generator.
+ *
+ * @param generator The generator to be freed.
+ */
+void generator_free(Generator* generator) {
+    free(generator->centers);
+    free(generator);
+    return (void)0;
+}
+
+
+//O(n * d / threads)
+/**
+ * Fills a dataset with generated rows, the rows generate.out writes for the
+ * same arguments (before they are printed to 5 digits). Class c is named
+ * classc and the class ids are in order of first appearance, as a load of
+ * the csv would give.
+ *
+ * @param dataset The dataset to fill, without any genes or classes yet.
+ * @param num_rows The number of rows.
+ * @param num_features The number of features, positive.
+ * @param num_classes The number of classes, positive.
+ * @param separation The half width of the range the class centers are drawn from.
+ * @param duplicate_rate The fraction of rows that copy an earlier row, in [0, 1).
+ * @param seed The seed.
+ * @return The number of rows that copy an earlier row.
+ */
+long long generate_dataset(Dataset* dataset, int num_rows, int num_features, int num_classes, double separation, double duplicate_rate, uint64_t seed) {
+    Generator* generator = generator_init(num_features, num_classes, separation, duplicate_rate, seed);
+    dataset_set(dataset, num_rows, num_features);
+
+    //interned up front so class c gets id c, the ids are put in order once every row is labeled
+    char name[32];
+    for (int c = 0; c < num_classes; c++) {
+        snprintf(name, sizeof(name), "class%d", c);
+        dataset_intern_label(dataset, name);
+    }
+
+    long long num_duplicates = 0;
+    #pragma omp parallel reduction(+:num_duplicates)
+    {
+        double* values = (double*)malloc(num_features * sizeof(double));
+        if (values == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        #pragma omp for schedule(static)
+        for (int row = 0; row < num_rows; row++) {
+            int source = generator_source(generator, row);
+            num_duplicates += source != row;
+            dataset->labels[row] = generator_values(generator, source, values);
+            float* features = dataset_row(dataset, row);
+            for (int f = 0; f < num_features; f++) {
+                features[f] = (float)values[f];
+            }
+        }
+        free(values);
+    }
+    dataset_order_classes(dataset);
+
+    generator_free(generator);
+    return num_duplicates;
+}
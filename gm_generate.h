@@ -0,0 +1,37 @@
+#ifndef GM_GENERATE_H
+#define GM_GENERATE_H
+
+#include <stdint.h>
+#include "gm_dataset.h"
+
+//synthetic datasets. every class is a gaussian cluster (unit variance per feature) around a center
+//drawn uniformly from [-separation, separation] per feature, so a larger separation makes the classes
+//easier to tell apart. a duplicate_rate fraction of the rows copies an earlier row. every row is drawn
+//from its own counter based stream (see gm_rng), so a row only depends on the arguments and its index:
+//generate.out writes a dataset row by row and generate_dataset fills one in parallel, with the same rows
+
+//what the streams of a dataset are for, the generation field of the stream
+#define GENERATE_ROWS 0
+#define GENERATE_CENTERS 1
+
+typedef struct Generator {
+    uint64_t seed;
+    int num_features;
+    int num_classes;
+    double separation;
+    double duplicate_rate;
+    //num_classes rows of num_features
+    double* centers;
+} Generator;
+
+
+//Generator functions
+Generator* generator_init(int num_features, int num_classes, double separation, double duplicate_rate, uint64_t seed);
+int generator_source(const Generator* generator, int row);
+int generator_values(const Generator* generator, int source, double* values);
+void generator_free(Generator* generator);
+
+//fills a dataset with generated rows, returns how many are duplicates
+long long generate_dataset(Dataset* dataset, int num_rows, int num_features, int num_classes, double separation, double duplicate_rate, uint64_t seed);
+
+#endif
@@ -1,4 +1,5 @@
 #include "gm_helper.h"
+#include "gm_telemetry.h"
 #include "errors.h"
 
 
@@ -13,13 +14,14 @@
  */
 size_t get_attribute_size(char* filename) {
     FILE* file = fopen(filename, "r");
-    if (file = NULL) {
+    if (file == NULL) {
         fprintf(stderr, FILE_ERROR);
         exit(1);
     }
 
     //skip to the end of the first line
-    while(fgetc(file) != "\n");
+    int c;
+    while((c = fgetc(file)) != '\n' && c != EOF);
 
     size_t size = ftell(file);
     fclose(file);
@@ -37,7 +39,7 @@ size_t get_attribute_size(char* filename) {
  */
 int get_num_attributes(char* filename) {
     FILE* file = fopen(filename, "r");
-    if (file = NULL) {
+    if (file == NULL) {
         fprintf(stderr, FILE_ERROR);
         exit(1);
     }
@@ -65,8 +67,8 @@ int get_num_attributes(char* filename) {
 /**
  * @brief Gets the attributes of a file and stores them in the attributes_t struct.
  *
- * Opens the file and reads the first line into a buffer. It then tokenizes the buffer
- * and stores the tokens in the attributes_t struct.
+ * Opens the file and reads the first line into a buffer once. It then counts and
+ * tokenizes the buffer and stores the tokens in the attributes_t struct.
  *
  * @param filename The name of the file to get the attributes of.
  * @param attributes A pointer to an attributes_t struct to store the attributes in.
@@ -75,28 +77,44 @@ int get_num_attributes(char* filename) {
  */
 void get_attributes(char* filename, attributes_t* attributes) {
     FILE* file = fopen(filename, "r");
-    if (file = NULL) {
+    if (file == NULL) {
         fprintf(stderr, FILE_ERROR);
         exit(1);
     }
 
-    size_t size = get_attribute_size(filename);
-    char* buffer = (char*)malloc(size * sizeof(char));
-    if(buffer == NULL) {
-        fprintf(stderr, MALLOC_ERROR);
+    //the header line can be any length
+    char* buffer = NULL;
+    size_t capacity = 0;
+    if (getline(&buffer, &capacity, file) <= 0) {
+        fprintf(stderr, EMPTY_FILE_ERROR);
         exit(1);
     }
-
-    fread(buffer, size, 1, file);
     fclose(file);
 
-    char* token = strtok(buffer, ",\n");
-    attributes->num_attributes = get_num_attributes(filename);
+    //one attribute per comma plus the last one
+    attributes->num_attributes = 1;
+    for (char* c = buffer; *c != '\0'; c++) {
+        if (*c == ',') {
+            attributes->num_attributes++;
+        }
+    }
+
     attributes->attributes = (char**)malloc(attributes->num_attributes * sizeof(char*));
+    if (attributes->attributes == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    char* token = strtok(buffer, ",\r\n");
     for(int i = 0; i < attributes->num_attributes; i++) {
-        attributes->attributes[i] = (char*)malloc(strlen(token) * sizeof(char));
-        strcpy(attributes->attributes[i], token);
-        token = strtok(NULL, ",\n");
+        const char* name = token != NULL ? token : "";
+        attributes->attributes[i] = (char*)malloc((strlen(name) + 1) * sizeof(char));
+        if (attributes->attributes[i] == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        strcpy(attributes->attributes[i], name);
+        token = strtok(NULL, ",\r\n");
     }
 
     free(buffer);
@@ -181,6 +199,8 @@ int partition(distance_intex_t* distance_index, int low, int high) {
  * @param n The index of the nth element.
  */
 void nth_element(distance_intex_t* distance_index, int length, int n) {
+    TELEMETRY_SCOPE(TELEMETRY_NTH_ELEMENT);
+    TELEMETRY_COUNT(TELEMETRY_PARTITIONED, length);
     int low = 0;
     int high = length - 1;
     while (low <= high) {
@@ -4,7 +4,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <omp.h>
-#include "gm_creature.h"
 
 typedef struct attributes_t {
     int num_attributes;
@@ -16,6 +15,9 @@ typedef struct distance_intex_t {
     int index;
 } distance_intex_t;
 
+//the rest of the declarations use the creature types
+#include "gm_creature.h"
+
 size_t get_attribute_size(char* filename);
 
 int get_num_attributes(char* filename);
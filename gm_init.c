@@ -0,0 +1,211 @@
+#include "gm_init.h"
+#include "gm_creature.h"
+#include "gm_routine.h"
+#include "gm_evaluator.h"
+#include "gm_cache.h"
+#include "gm_rng.h"
+#include "errors.h"
+
+#include <omp.h>
+
+
+/**
+ * Fills the GA settings of a run.
+ *
+ * Starts from the defaults (see ga_default_config), then takes the command
+ * line (file.csv [generations] [population_size] [creature_size] [k]) and the
+ * environment variables GM_SELECTION (tournament or rank), GM_MUTATION_RATE,
+ * GM_TOURNAMENT_SIZE, GM_ELITE, GM_VOTE (majority or distance),
+ * GM_MEMO_ENTRIES (fitnesses remembered across generations, 0 turns it off),
+ * GM_INIT (random or groups, how the first generation is drawn) and
+ * GM_INCREMENTAL (0 scores every child from scratch, not from its parent's state).
+ *
+ * @param config The config to fill.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ */
+void init_config(ga_config_t* config, int argc, char* argv[]) {
+    ga_default_config(config);
+    if (argc > 2) config->generations = atoi(argv[2]);
+    if (argc > 3) config->population_size = atoi(argv[3]);
+    if (argc > 4) config->creature_size = atoi(argv[4]);
+    if (argc > 5) config->k = atoi(argv[5]);
+
+    const char* value;
+    if ((value = getenv("GM_SELECTION")) != NULL && !ga_selection_from_name(value, &config->selection)) {
+        fprintf(stderr, SELECTION_NAME_ERROR);
+        exit(1);
+    }
+    if ((value = getenv("GM_MUTATION_RATE")) != NULL) config->mutation_rate = atof(value);
+    if ((value = getenv("GM_TOURNAMENT_SIZE")) != NULL) config->tournament_size = atoi(value);
+    if ((value = getenv("GM_ELITE")) != NULL) config->elite = atoi(value);
+    if ((value = getenv("GM_VOTE")) != NULL && !vote_weighting_from_name(value, &config->vote)) {
+        fprintf(stderr, VOTE_NAME_ERROR);
+        exit(1);
+    }
+    if ((value = getenv("GM_MEMO_ENTRIES")) != NULL) config->memo_entries = atoi(value);
+    if ((value = getenv("GM_INIT")) != NULL && !ga_initial_from_name(value, &config->initial)) {
+        fprintf(stderr, INITIAL_NAME_ERROR);
+        exit(1);
+    }
+    if ((value = getenv("GM_INCREMENTAL")) != NULL) config->incremental = atoi(value) != 0;
+
+    return (void)0;
+}
+
+
+//O(n / threads + classes)
+/**
+ * Splits a dataset into training and test genes, stratified by class.
+ *
+ * The genes of every class are shuffled with their own stream of the seed
+ * (see rng_shuffle) and the first round(GM_TEST_FRACTION * class size) of
+ * them become test genes (INIT_TEST_FRACTION by default), a class keeps at
+ * least one training gene. Both lists come out in ascending gene order. The
+ * bucketing by class and the final compaction run in parallel, and the
+ * result only depends on the seed and the labels, not on the thread count.
+ *
+ * @param dataset The dataset to split.
+ * @param seed The seed of the split, the same on every rank.
+ * @param train_genes Set to a newly allocated array of the training genes.
+ * @param num_train_genes Set to the number of training genes.
+ * @param test_genes Set to a newly allocated array of the test genes.
+ * @param num_test_genes Set to the number of test genes.
+ */
+void init_split(const Dataset* dataset, uint64_t seed, int** train_genes, int* num_train_genes, int** test_genes, int* num_test_genes) {
+    int num_genes = dataset->num_genes;
+    int num_classes = dataset->num_classes > 0 ? dataset->num_classes : 1;
+    double test_fraction = INIT_TEST_FRACTION;
+    const char* value = getenv("GM_TEST_FRACTION");
+    if (value != NULL) {
+        test_fraction = atof(value);
+    }
+    if (!(test_fraction > 0 && test_fraction < 1)) {
+        fprintf(stderr, TEST_FRACTION_ERROR);
+        exit(1);
+    }
+
+    //chunks of genes, each counted and written by one thread
+    int num_chunks = omp_get_max_threads();
+    *train_genes = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    *test_genes = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    int* members = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    uint8_t* is_test = (uint8_t*)calloc(num_genes > 0 ? num_genes : 1, sizeof(uint8_t));
+    int* class_starts = (int*)malloc((num_classes + 1) * sizeof(int));
+    int* counts = (int*)calloc((size_t)num_chunks * num_classes, sizeof(int));
+    int* chunk_starts = (int*)malloc(2 * (num_chunks + 1) * sizeof(int));
+    if (*train_genes == NULL || *test_genes == NULL || members == NULL || is_test == NULL || class_starts == NULL || counts == NULL || chunk_starts == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    //bucket the genes by class (a stable counting sort), every chunk counts its own genes
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < num_chunks; c++) {
+        int* chunk_counts = counts + (size_t)c * num_classes;
+        for (int i = (int)((long long)num_genes * c / num_chunks); i < (int)((long long)num_genes * (c + 1) / num_chunks); i++) {
+            chunk_counts[dataset->labels[i]]++;
+        }
+    }
+    int position = 0;
+    for (int label = 0; label < num_classes; label++) {
+        class_starts[label] = position;
+        for (int c = 0; c < num_chunks; c++) {
+            int count = counts[(size_t)c * num_classes + label];
+            counts[(size_t)c * num_classes + label] = position;
+            position += count;
+        }
+    }
+    class_starts[num_classes] = position;
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < num_chunks; c++) {
+        int* chunk_positions = counts + (size_t)c * num_classes;
+        for (int i = (int)((long long)num_genes * c / num_chunks); i < (int)((long long)num_genes * (c + 1) / num_chunks); i++) {
+            members[chunk_positions[dataset->labels[i]]++] = i;
+        }
+    }
+
+    //every class draws its test genes from its own stream (rng_shuffle runs large classes in parallel)
+    for (int label = 0; label < num_classes; label++) {
+        int size = class_starts[label + 1] - class_starts[label];
+        int num_test = (int)(size * test_fraction + 0.5);
+        if (num_test >= size && size > 1) {
+            num_test = size - 1;
+        }
+        if (num_test <= 0) {
+            continue;
+        }
+        rng_t rng = rng_stream(seed, RNG_SPLIT, 0, (uint32_t)label);
+        rng_shuffle(members + class_starts[label], size, &rng);
+        for (int i = 0; i < num_test; i++) {
+            is_test[members[class_starts[label] + i]] = 1;
+        }
+    }
+
+    //compact both lists in gene order, every chunk counts then writes its share
+    int* train_starts = chunk_starts;
+    int* test_starts = chunk_starts + num_chunks + 1;
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < num_chunks; c++) {
+        int tests = 0;
+        int end = (int)((long long)num_genes * (c + 1) / num_chunks);
+        for (int i = (int)((long long)num_genes * c / num_chunks); i < end; i++) {
+            tests += is_test[i];
+        }
+        test_starts[c + 1] = tests;
+        train_starts[c + 1] = end - (int)((long long)num_genes * c / num_chunks) - tests;
+    }
+    train_starts[0] = 0;
+    test_starts[0] = 0;
+    for (int c = 0; c < num_chunks; c++) {
+        train_starts[c + 1] += train_starts[c];
+        test_starts[c + 1] += test_starts[c];
+    }
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < num_chunks; c++) {
+        int train = train_starts[c];
+        int test = test_starts[c];
+        for (int i = (int)((long long)num_genes * c / num_chunks); i < (int)((long long)num_genes * (c + 1) / num_chunks); i++) {
+            if (is_test[i]) {
+                (*test_genes)[test++] = i;
+            } else {
+                (*train_genes)[train++] = i;
+            }
+        }
+    }
+    *num_train_genes = train_starts[num_chunks];
+    *num_test_genes = test_starts[num_chunks];
+
+    free(members);
+    free(is_test);
+    free(class_starts);
+    free(counts);
+    free(chunk_starts);
+    return (void)0;
+}
+
+
+//O(t * n * d / threads)
+/**
+ * Builds the distance cache of a run when GM_CACHE_BUDGET gives it a size
+ * (a number of bytes, optionally followed by K, M or G) and hands it to the
+ * evaluator (see evaluator_set_cache). The cache holds the distances between
+ * the evaluator's test genes, this rank's slice when sharded, and every
+ * training gene, as a float32 matrix, a float16 one or neighbor lists,
+ * whichever fits the budget first (see cache_build).
+ *
+ * @param evaluator The evaluator, sharded already when it is going to be.
+ * @param train_genes The genes creatures are made of.
+ * @param num_train_genes The number of training genes.
+ * @return The cache, NULL when GM_CACHE_BUDGET is unset or 0.
+ */
+DistanceCache* init_cache(Evaluator* evaluator, const int* train_genes, int num_train_genes) {
+    size_t budget = stream_budget_from_env("GM_CACHE_BUDGET", 0);
+    if (budget == 0) {
+        return NULL;
+    }
+
+    DistanceCache* cache = cache_build(evaluator->dataset, evaluator->test_genes, evaluator->num_test_genes, train_genes, num_train_genes, budget, CACHE_AUTO);
+    evaluator_set_cache(evaluator, cache);
+    return cache;
+}
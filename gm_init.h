@@ -0,0 +1,25 @@
+#ifndef GM_INIT_H
+#define GM_INIT_H
+
+//setting up a run: the GA settings from the command line and the environment, the split of the
+//dataset into training genes (what creatures are made of) and test genes (what they are scored on)
+//and the distance cache between the two.
+//the split is stratified (every class keeps its share of the test set) and seeded, so it replaces
+//PYTHON_SCRIPTS/split_file.py without writing the data out again
+
+#include <stdint.h>
+#include "gm_dataset.h"
+
+//share of every class that becomes test genes when GM_TEST_FRACTION doesn't say
+#define INIT_TEST_FRACTION 0.1
+
+//defined in gm_routine.h, gm_evaluator.h and gm_cache.h
+typedef struct ga_config_t ga_config_t;
+typedef struct Evaluator Evaluator;
+typedef struct DistanceCache DistanceCache;
+
+void init_config(ga_config_t* config, int argc, char* argv[]);
+void init_split(const Dataset* dataset, uint64_t seed, int** train_genes, int* num_train_genes, int** test_genes, int* num_test_genes);
+DistanceCache* init_cache(Evaluator* evaluator, const int* train_genes, int num_train_genes);
+
+#endif
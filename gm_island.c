@@ -0,0 +1,352 @@
+#include "gm_island.h"
+
+#ifdef GM_USE_MPI
+
+#include "gm_creature.h"
+#include "gm_population.h"
+#include "errors.h"
+
+//message tags, the genes and the fitness of the emigrants travel separately
+#define ISLAND_TAG_GENES 1
+#define ISLAND_TAG_FITNESS 2
+
+static const char* topology_names[] = {"ring", "torus"};
+#define NUM_TOPOLOGIES ((int)(sizeof(topology_names) / sizeof(topology_names[0])))
+
+
+//O(1)
+/**
+ * Looks up a topology by name.
+ *
+ * @param name The name (ring or torus).
+ * @param topology Set to the topology when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int island_topology_from_name(const char* name, island_topology_t* topology) {
+    for (int i = 0; i < NUM_TOPOLOGIES; i++) {
+        if (strcmp(name, topology_names[i]) == 0) {
+            *topology = (island_topology_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//O(ranks)
+/**
+ * Allocates the migration state of this rank's island and finds its neighbors.
+ *
+ * The neighbors come from a periodic cartesian grid of the ranks, one
+ * dimension for a ring and two (as square as MPI_Dims_create makes them) for a
+ * torus. A direction in which a rank is its own neighbor is dropped.
+ *
+ * @param comm The communicator of the islands (one island per rank).
+ * @param topology Which islands send to which.
+ * @param migration_size The number of creatures sent to each neighbor per migration.
+ * @param creature_size The number of genes of every creature.
+ * @return A pointer to the newly allocated island.
+ */
+Island* island_init(MPI_Comm comm, island_topology_t topology, int migration_size, int creature_size) {
+    Island* island = (Island*)calloc(1, sizeof(Island));
+    if (island == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    MPI_Comm_rank(comm, &island->rank);
+    MPI_Comm_size(comm, &island->num_ranks);
+    island->migration_size = migration_size;
+    island->creature_size = creature_size;
+
+    //the grid keeps the ranks of comm (no reordering), it is only used to find neighbors
+    int num_dims = topology == ISLAND_TORUS ? 2 : 1;
+    int dims[2] = {0, 0};
+    int periods[2] = {1, 1};
+    MPI_Dims_create(island->num_ranks, num_dims, dims);
+    MPI_Cart_create(comm, num_dims, dims, periods, 0, &island->comm);
+
+    for (int d = 0; d < num_dims; d++) {
+        int source, destination;
+        MPI_Cart_shift(island->comm, d, 1, &source, &destination);
+        if (destination != island->rank) {
+            island->sources[island->num_links] = source;
+            island->destinations[island->num_links] = destination;
+            island->num_links++;
+        }
+    }
+
+    size_t genes = (size_t)migration_size * creature_size;
+    int links = island->num_links > 0 ? island->num_links : 1;
+    island->send_genes = (int*)malloc((genes > 0 ? genes : 1) * sizeof(int));
+    island->send_fitness = (double*)malloc((migration_size > 0 ? migration_size : 1) * sizeof(double));
+    island->receive_genes = (int*)malloc((genes > 0 ? genes : 1) * links * sizeof(int));
+    island->receive_fitness = (double*)malloc((migration_size > 0 ? migration_size : 1) * links * sizeof(double));
+    if (island->send_genes == NULL || island->send_fitness == NULL || island->receive_genes == NULL || island->receive_fitness == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    return island;
+}
+
+
+//O(m * |creature|)
+/**
+ * Starts a migration: copies the island's best creatures and posts the
+ * non-blocking sends to every destination and receives from every source.
+ *
+ * The GA may go on to the next generation right away, island_complete finishes
+ * the migration.
+ *
+ * @param island The island.
+ * @param ga The island's GA, ranked.
+ */
+void island_post(Island* island, GA* ga) {
+    int migration_size = island->migration_size < ga->config.population_size ? island->migration_size : ga->config.population_size;
+    if (island->num_links == 0 || migration_size <= 0) {
+        return (void)0;
+    }
+
+    //the emigrants are copied, the GA overwrites its generation while they travel
+    int creature_size = island->creature_size;
+    for (int i = 0; i < migration_size; i++) {
+        Creature* creature = ga->population->current_list[ga->ranking[i].index];
+        memcpy(island->send_genes + (size_t)i * creature_size, creature->gene_indices, creature_size * sizeof(int));
+        island->send_fitness[i] = ga->ranking[i].fitness;
+    }
+
+    int count = migration_size * creature_size;
+    island->num_requests = 0;
+    for (int l = 0; l < island->num_links; l++) {
+        MPI_Irecv(island->receive_genes + (size_t)l * count, count, MPI_INT, island->sources[l], ISLAND_TAG_GENES, island->comm, &island->requests[island->num_requests++]);
+        MPI_Irecv(island->receive_fitness + (size_t)l * migration_size, migration_size, MPI_DOUBLE, island->sources[l], ISLAND_TAG_FITNESS, island->comm, &island->requests[island->num_requests++]);
+        MPI_Isend(island->send_genes, count, MPI_INT, island->destinations[l], ISLAND_TAG_GENES, island->comm, &island->requests[island->num_requests++]);
+        MPI_Isend(island->send_fitness, migration_size, MPI_DOUBLE, island->destinations[l], ISLAND_TAG_FITNESS, island->comm, &island->requests[island->num_requests++]);
+    }
+
+    return (void)0;
+}
+
+
+//O(m * |creature| + p log p)
+/**
+ * Finishes a migration: waits for the messages posted by island_post and lets
+ * the immigrants replace the island's worst creatures they are fitter than.
+ *
+ * Every island scores on the same test genes, so an immigrant keeps the
+ * fitness it was sent with. The elite are never replaced. The GA is ranked
+ * again afterwards.
+ *
+ * @param island The island.
+ * @param ga The island's GA, ranked.
+ */
+void island_complete(Island* island, GA* ga) {
+    if (island->num_requests == 0) {
+        return (void)0;
+    }
+    MPI_Waitall(island->num_requests, island->requests, MPI_STATUSES_IGNORE);
+    island->num_requests = 0;
+    island->num_migrations++;
+
+    int population_size = ga->config.population_size;
+    int migration_size = island->migration_size < population_size ? island->migration_size : population_size;
+    int creature_size = island->creature_size;
+
+    //the worst creature still open to replacement, the elite are not
+    int worst = population_size - 1;
+    int last = ga->config.elite;
+    for (int i = 0; i < migration_size * island->num_links && worst >= last; i++) {
+        double fitness = island->receive_fitness[i];
+        if (fitness > ga->ranking[worst].fitness) {
+            ga_replace(ga, ga->ranking[worst].index, island->receive_genes + (size_t)i * creature_size, fitness);
+            worst--;
+        }
+    }
+    ga_rank(ga);
+
+    return (void)0;
+}
+
+
+/**
+ * Frees an island and all of its associated memory, after finishing any
+ * migration still in flight.
+ *
+ * @param island The island to be freed.
+ */
+void island_free(Island* island) {
+    if (island->num_requests > 0) {
+        MPI_Waitall(island->num_requests, island->requests, MPI_STATUSES_IGNORE);
+    }
+    MPI_Comm_free(&island->comm);
+    free(island->send_genes);
+    free(island->send_fitness);
+    free(island->receive_genes);
+    free(island->receive_fitness);
+    free(island);
+    return (void)0;
+}
+
+
+//O(1)
+//rounds a byte offset up to the dataset alignment
+static size_t align_offset(size_t offset) {
+    return (offset + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT;
+}
+
+
+//what the first rank of a node tells the others about the dataset it loaded
+enum {
+    SHARE_NUM_GENES,
+    SHARE_NUM_FEATURES,
+    SHARE_PADDED_FEATURES,
+    SHARE_STORAGE,
+    SHARE_STRIDE,
+    SHARE_NUM_CLASSES,
+    SHARE_NAMES_SIZE,
+    SHARE_UNIFORM_WEIGHT,
+    SHARE_FIELDS
+};
+
+
+//O(n * d / ranks per node)
+/**
+ * Loads a dataset once per node and shares it between the node's ranks.
+ *
+ * The first rank of every node fills the dataset with gene_fill (so the
+ * binary dataset file and GM_STORAGE apply) and copies its labels, norms,
+ * feature matrix and int8 scales into an MPI shared memory window. Every rank
+ * of the node then points its dataset into that window, read only, and interns
+ * the class names in the same order. The dataset is marked shared, so freeing
+ * it leaves the window alone: free the window (MPI_Win_free) after the dataset.
+ *
+ * @param dataset The dataset to fill (empty).
+ * @param file_name The name of the file to read from.
+ * @param comm The communicator of the ranks sharing the file.
+ * @return The shared memory window holding the dataset.
+ */
+MPI_Win dataset_share(Dataset* dataset, char* file_name, MPI_Comm comm) {
+    MPI_Comm node;
+    int node_rank;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &node_rank);
+
+    Dataset* loaded = NULL;
+    long long header[SHARE_FIELDS] = {0};
+    char* names = NULL;
+    size_t names_size = 0;
+
+    if (node_rank == 0) {
+        loaded = dataset_init();
+        gene_fill(loaded, file_name, 0, 0);
+        if (loaded->norms == NULL) {
+            dataset_compute_norms(loaded);
+        }
+
+        for (int c = 0; c < loaded->num_classes; c++) {
+            names_size += strlen(loaded->class_names[c]) + 1;
+        }
+        header[SHARE_NUM_GENES] = loaded->num_genes;
+        header[SHARE_NUM_FEATURES] = loaded->num_features;
+        header[SHARE_PADDED_FEATURES] = loaded->padded_features;
+        header[SHARE_STORAGE] = loaded->storage;
+        header[SHARE_STRIDE] = loaded->storage == STORAGE_F32 ? (long long)(loaded->padded_features * sizeof(float)) : (long long)loaded->compact_stride;
+        header[SHARE_NUM_CLASSES] = loaded->num_classes;
+        header[SHARE_NAMES_SIZE] = (long long)names_size;
+        memcpy(&header[SHARE_UNIFORM_WEIGHT], &loaded->uniform_weight, sizeof(float));
+    }
+    MPI_Bcast(header, SHARE_FIELDS, MPI_LONG_LONG, 0, node);
+
+    int num_genes = (int)header[SHARE_NUM_GENES];
+    int padded_features = (int)header[SHARE_PADDED_FEATURES];
+    dataset_storage_t storage = (dataset_storage_t)header[SHARE_STORAGE];
+    size_t stride = (size_t)header[SHARE_STRIDE];
+    names_size = (size_t)header[SHARE_NAMES_SIZE];
+
+    //the class names travel as one block of terminated strings
+    names = (char*)malloc(names_size > 0 ? names_size : 1);
+    if (names == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    if (node_rank == 0) {
+        size_t position = 0;
+        for (int c = 0; c < loaded->num_classes; c++) {
+            size_t length = strlen(loaded->class_names[c]) + 1;
+            memcpy(names + position, loaded->class_names[c], length);
+            position += length;
+        }
+    }
+    MPI_Bcast(names, (int)names_size, MPI_CHAR, 0, node);
+
+    //layout of the window, every array starts on a cache line
+    size_t labels_offset = 0;
+    size_t norms_offset = align_offset(labels_offset + (size_t)num_genes * sizeof(int));
+    size_t matrix_offset = align_offset(norms_offset + (size_t)num_genes * sizeof(float));
+    size_t scales_offset = align_offset(matrix_offset + (size_t)num_genes * stride);
+    size_t window_size = scales_offset;
+    if (storage == STORAGE_INT8) {
+        window_size += 3 * align_offset((size_t)padded_features * sizeof(float));
+    }
+
+    char* base;
+    MPI_Win window;
+    MPI_Win_allocate_shared(node_rank == 0 ? (MPI_Aint)window_size : 0, 1, MPI_INFO_NULL, node, &base, &window);
+    MPI_Aint size;
+    int unit;
+    MPI_Win_shared_query(window, 0, &size, &unit, &base);
+
+    MPI_Win_fence(0, window);
+    if (node_rank == 0) {
+        memcpy(base + labels_offset, loaded->labels, (size_t)num_genes * sizeof(int));
+        memcpy(base + norms_offset, loaded->norms, (size_t)num_genes * sizeof(float));
+        const void* matrix = storage == STORAGE_F32 ? (const void*)loaded->features : loaded->compact;
+        memcpy(base + matrix_offset, matrix, (size_t)num_genes * stride);
+        if (storage == STORAGE_INT8) {
+            size_t vector = align_offset((size_t)padded_features * sizeof(float));
+            memcpy(base + scales_offset, loaded->scales, padded_features * sizeof(float));
+            memcpy(base + scales_offset + vector, loaded->offsets, padded_features * sizeof(float));
+            memcpy(base + scales_offset + 2 * vector, loaded->weights, padded_features * sizeof(float));
+        }
+        dataset_free(loaded);
+    }
+    MPI_Win_fence(0, window);
+
+    //every rank points its dataset into the window
+    dataset_release(dataset);
+    dataset->num_genes = num_genes;
+    dataset->num_features = (int)header[SHARE_NUM_FEATURES];
+    dataset->padded_features = padded_features;
+    dataset->labels = (int*)(base + labels_offset);
+    dataset->norms = (float*)(base + norms_offset);
+    dataset->storage = storage;
+    if (storage == STORAGE_F32) {
+        dataset->features = (float*)(base + matrix_offset);
+    } else {
+        dataset->compact = base + matrix_offset;
+        dataset->compact_stride = stride;
+    }
+    if (storage == STORAGE_INT8) {
+        size_t vector = align_offset((size_t)padded_features * sizeof(float));
+        dataset->scales = (float*)(base + scales_offset);
+        dataset->offsets = (float*)(base + scales_offset + vector);
+        dataset->weights = (float*)(base + scales_offset + 2 * vector);
+        memcpy(&dataset->uniform_weight, &header[SHARE_UNIFORM_WEIGHT], sizeof(float));
+    }
+    dataset->shared = 1;
+
+    //interning in the loader's order gives the same class ids
+    size_t position = 0;
+    for (int c = 0; c < (int)header[SHARE_NUM_CLASSES]; c++) {
+        dataset_intern_label(dataset, names + position);
+        position += strlen(names + position) + 1;
+    }
+
+    free(names);
+    MPI_Comm_free(&node);
+
+    return window;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef GM_ISLAND_H
+#define GM_ISLAND_H
+
+//the island model: every MPI rank evolves its own population (an island) over the same dataset,
+//which each node loads once into shared memory. every few generations the islands send copies of
+//their best creatures to their neighbors, where they replace the worst ones. the messages are
+//non-blocking, they travel while the next generation is evaluated
+//only built with -DGM_USE_MPI (make mpi)
+
+#ifdef GM_USE_MPI
+
+#include <mpi.h>
+#include "gm_routine.h"
+
+//which islands send to which
+typedef enum island_topology_t {
+    //rank r sends to r + 1 and receives from r - 1
+    ISLAND_RING,
+    //the ranks form a periodic 2D grid, each sends east and south and receives from west and north
+    ISLAND_TORUS
+} island_topology_t;
+
+typedef struct Island {
+    MPI_Comm comm;
+    int rank;
+    int num_ranks;
+
+    //neighbors in the topology, a rank that would talk to itself has none in that direction
+    int num_links;
+    int destinations[2];
+    int sources[2];
+
+    int migration_size;
+    int creature_size;
+    //the emigrants (sent to every destination) and the immigrants of every source
+    int* send_genes;
+    double* send_fitness;
+    int* receive_genes;
+    double* receive_fitness;
+
+    MPI_Request requests[8];
+    int num_requests;
+    long long num_migrations;
+} Island;
+
+
+//Island functions
+Island* island_init(MPI_Comm comm, island_topology_t topology, int migration_size, int creature_size);
+void island_post(Island* island, GA* ga);
+void island_complete(Island* island, GA* ga);
+void island_free(Island* island);
+int island_topology_from_name(const char* name, island_topology_t* topology);
+
+MPI_Win dataset_share(Dataset* dataset, char* file_name, MPI_Comm comm);
+
+#endif
+
+#endif
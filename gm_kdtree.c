@@ -0,0 +1,292 @@
+#include "gm_kdtree.h"
+#include "gm_distance.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <math.h>
+
+
+//what the recursive build shares
+typedef struct kdtree_build_t {
+    KdTree* tree;
+    //every gene decoded, num_features floats apart
+    const float* points;
+    //the genes, the build reorders them so every node owns a contiguous range
+    int* order;
+    int nodes_capacity;
+} kdtree_build_t;
+
+
+//O(n) expected
+//reorders order[start, end) so order[middle] holds the gene whose feature f is the median
+static void select_median(const kdtree_build_t* build, int start, int end, int middle, int f) {
+    int d = build->tree->num_features;
+    int* order = build->order;
+    int low = start;
+    int high = end - 1;
+    while (low < high) {
+        float pivot = build->points[(size_t)order[(low + high) / 2] * d + f];
+        int i = low;
+        int j = high;
+        while (i <= j) {
+            while (build->points[(size_t)order[i] * d + f] < pivot) {
+                i++;
+            }
+            while (build->points[(size_t)order[j] * d + f] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                int swap = order[i];
+                order[i] = order[j];
+                order[j] = swap;
+                i++;
+                j--;
+            }
+        }
+        if (middle <= j) {
+            high = j;
+        } else if (middle >= i) {
+            low = i;
+        } else {
+            break;
+        }
+    }
+    return (void)0;
+}
+
+
+//O(n log n * d)
+//builds the subtree of order[start, end) and returns its node
+static int build_node(kdtree_build_t* build, int start, int end) {
+    KdTree* tree = build->tree;
+    int d = tree->num_features;
+    int node = tree->num_nodes++;
+    if (node >= build->nodes_capacity) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    //the box of the node's genes
+    float* lower = tree->lower + (size_t)node * d;
+    float* upper = tree->upper + (size_t)node * d;
+    for (int f = 0; f < d; f++) {
+        lower[f] = INFINITY;
+        upper[f] = -INFINITY;
+    }
+    for (int i = start; i < end; i++) {
+        const float* point = build->points + (size_t)build->order[i] * d;
+        for (int f = 0; f < d; f++) {
+            lower[f] = point[f] < lower[f] ? point[f] : lower[f];
+            upper[f] = point[f] > upper[f] ? point[f] : upper[f];
+        }
+    }
+
+    //split on the widest feature, a node whose genes are all equal stays a leaf
+    int split_feature = 0;
+    for (int f = 1; f < d; f++) {
+        if (upper[f] - lower[f] > upper[split_feature] - lower[split_feature]) {
+            split_feature = f;
+        }
+    }
+    kdtree_node_t* record = &tree->nodes[node];
+    if (end - start <= KDTREE_LEAF_SIZE || d == 0 || !(upper[split_feature] > lower[split_feature])) {
+        record->left = -1;
+        record->right = -1;
+        record->leaf = tree->num_leaves++;
+        record->split_feature = 0;
+        record->split_value = 0;
+        for (int i = start; i < end; i++) {
+            tree->gene_leaf[build->order[i]] = record->leaf;
+        }
+        return node;
+    }
+
+    int middle = start + (end - start) / 2;
+    select_median(build, start, end, middle, split_feature);
+    record->leaf = -1;
+    record->split_feature = split_feature;
+    record->split_value = build->points[(size_t)build->order[middle] * d + split_feature];
+
+    //nodes never moves (its capacity is an upper bound), so the record stays valid
+    record->left = build_node(build, start, middle);
+    record->right = build_node(build, middle, end);
+    return node;
+}
+
+
+//O(n log n * d)
+/**
+ * Builds a k-d tree over every gene of a dataset.
+ *
+ * Nodes split at the median of their widest feature until they hold at most
+ * KDTREE_LEAF_SIZE genes, every node records the bounding box of its genes.
+ * Compact storage is decoded for the build, so the boxes are in the decoded
+ * values the distance kernels approximate.
+ *
+ * @param dataset The dataset holding every gene.
+ * @return A pointer to the newly allocated tree.
+ */
+KdTree* kdtree_init(Dataset* dataset) {
+    int num_genes = dataset->num_genes;
+    int d = dataset->num_features;
+
+    KdTree* tree = (KdTree*)calloc(1, sizeof(KdTree));
+    if (tree == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    tree->dataset = dataset;
+    tree->num_features = d;
+
+    //median splits leave at least KDTREE_LEAF_SIZE / 2 genes per leaf, so this is an upper bound
+    kdtree_build_t build;
+    build.tree = tree;
+    build.nodes_capacity = 4 * (num_genes / KDTREE_LEAF_SIZE + 1);
+    tree->nodes = (kdtree_node_t*)malloc(build.nodes_capacity * sizeof(kdtree_node_t));
+    tree->lower = (float*)malloc(((size_t)build.nodes_capacity * d + 1) * sizeof(float));
+    tree->upper = (float*)malloc(((size_t)build.nodes_capacity * d + 1) * sizeof(float));
+    tree->gene_leaf = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    build.order = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    float* points = (float*)malloc(((size_t)num_genes * d + 1) * sizeof(float));
+    if (tree->nodes == NULL || tree->lower == NULL || tree->upper == NULL || tree->gene_leaf == NULL || build.order == NULL || points == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        float* decoded = (float*)aligned_alloc(DATASET_ALIGNMENT, dataset->padded_features * sizeof(float));
+        if (decoded == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < num_genes; i++) {
+            const float* row = decoded;
+            if (dataset->storage == STORAGE_F32) {
+                row = dataset_row(dataset, i);
+            } else {
+                dataset_decode_row(dataset, i, decoded);
+            }
+            memcpy(points + (size_t)i * d, row, d * sizeof(float));
+            build.order[i] = i;
+        }
+
+        free(decoded);
+    }
+    build.points = points;
+
+    if (num_genes > 0) {
+        build_node(&build, 0, num_genes);
+    }
+
+    free(build.order);
+    free(points);
+    return tree;
+}
+
+
+//O(nodes)
+/**
+ * Counts a creature's members under every node of a tree.
+ *
+ * @param tree The tree.
+ * @param member_starts num_leaves + 1 offsets, the members of leaf l are [member_starts[l], member_starts[l + 1]).
+ * @param node_counts Output, num_nodes counts.
+ */
+void kdtree_count(const KdTree* tree, const int* member_starts, int* node_counts) {
+    //children come after their parent, so a reverse sweep sees them first
+    for (int node = tree->num_nodes - 1; node >= 0; node--) {
+        const kdtree_node_t* record = &tree->nodes[node];
+        if (record->leaf >= 0) {
+            node_counts[node] = member_starts[record->leaf + 1] - member_starts[record->leaf];
+        } else {
+            node_counts[node] = node_counts[record->left] + node_counts[record->right];
+        }
+    }
+    return (void)0;
+}
+
+
+//O(d)
+//squared distance from a query to the nearest point of a node's box
+static inline float box_distance(const KdTree* tree, int node, const float* query) {
+    int d = tree->num_features;
+    const float* lower = tree->lower + (size_t)node * d;
+    const float* upper = tree->upper + (size_t)node * d;
+    float distance = 0;
+    for (int f = 0; f < d; f++) {
+        float below = lower[f] - query[f];
+        float above = query[f] - upper[f];
+        float gap = below > 0 ? below : (above > 0 ? above : 0);
+        distance += gap * gap;
+    }
+    return distance;
+}
+
+
+//O(log n) typical
+//branch and bound descent, the nearer child first
+static void visit(const KdTree* tree, int node, const float* query, int query_gene, const int* node_counts, const int* member_starts, const int* member_genes, topk_t* topk) {
+    if (node_counts[node] == 0 || box_distance(tree, node, query) > topk_threshold(topk)) {
+        return (void)0;
+    }
+
+    const kdtree_node_t* record = &tree->nodes[node];
+    if (record->leaf >= 0) {
+        TELEMETRY_COUNT(TELEMETRY_DISTANCES, member_starts[record->leaf + 1] - member_starts[record->leaf]);
+        for (int m = member_starts[record->leaf]; m < member_starts[record->leaf + 1]; m++) {
+            int gene = member_genes[m];
+            topk_push(topk, distance_sq_rows(tree->dataset, query_gene, gene), gene);
+        }
+        return (void)0;
+    }
+
+    int near = query[record->split_feature] < record->split_value ? record->left : record->right;
+    int far = near == record->left ? record->right : record->left;
+    visit(tree, near, query, query_gene, node_counts, member_starts, member_genes, topk);
+    visit(tree, far, query, query_gene, node_counts, member_starts, member_genes, topk);
+    return (void)0;
+}
+
+
+//O(log n) typical, O(n) worst
+/**
+ * Finds the k nearest members of a query gene.
+ *
+ * The members are the genes bucketed by leaf in member_starts and
+ * member_genes, node_counts comes from kdtree_count. A node is skipped when
+ * it has no members or its box is farther than the current k-th neighbor (a
+ * box exactly that far is still visited), so the result is exact. Distances
+ * are the dataset's own (distance_sq_rows).
+ *
+ * @param tree The tree.
+ * @param query The query's decoded features.
+ * @param query_gene The global index of the query.
+ * @param node_counts The members under every node.
+ * @param member_starts num_leaves + 1 offsets into member_genes.
+ * @param member_genes The members grouped by leaf.
+ * @param topk An empty top k, filled with the neighbors.
+ */
+void kdtree_query(const KdTree* tree, const float* query, int query_gene, const int* node_counts, const int* member_starts, const int* member_genes, topk_t* topk) {
+    if (tree->num_nodes > 0) {
+        visit(tree, 0, query, query_gene, node_counts, member_starts, member_genes, topk);
+    }
+    return (void)0;
+}
+
+
+/**
+ * Frees a k-d tree.
+ *
+ * @param tree The tree to be freed.
+ */
+void kdtree_free(KdTree* tree) {
+    free(tree->nodes);
+    free(tree->lower);
+    free(tree->upper);
+    free(tree->gene_leaf);
+    free(tree);
+    return (void)0;
+}
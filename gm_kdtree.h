@@ -0,0 +1,48 @@
+#ifndef GM_KDTREE_H
+#define GM_KDTREE_H
+
+#include "gm_dataset.h"
+#include "gm_topk.h"
+
+//exact k-d tree over the whole gene matrix, for datasets with few features. every node keeps the
+//bounding box of its genes, a query descends to the nearer child first and skips any node whose box
+//is farther than its current k-th neighbor. a query restricted to a creature also skips the nodes
+//that hold none of its members, the counts come from bucketing the members by leaf
+
+//most genes in a leaf
+#define KDTREE_LEAF_SIZE 16
+
+typedef struct kdtree_node_t {
+    //children, -1 for a leaf
+    int left;
+    int right;
+    //leaf id of a leaf, -1 for an inner node
+    int leaf;
+    //the dimension an inner node splits on and where
+    int split_feature;
+    float split_value;
+} kdtree_node_t;
+
+typedef struct KdTree {
+    Dataset* dataset;
+    int num_features;
+
+    //the root is node 0, a child always comes after its parent
+    kdtree_node_t* nodes;
+    int num_nodes;
+    int num_leaves;
+    //num_nodes boxes of num_features floats
+    float* lower;
+    float* upper;
+    //the leaf every gene fell in
+    int* gene_leaf;
+} KdTree;
+
+
+//KdTree functions
+KdTree* kdtree_init(Dataset* dataset);
+void kdtree_count(const KdTree* tree, const int* member_starts, int* node_counts);
+void kdtree_query(const KdTree* tree, const float* query, int query_gene, const int* node_counts, const int* member_starts, const int* member_genes, topk_t* topk);
+void kdtree_free(KdTree* tree);
+
+#endif
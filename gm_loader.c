@@ -0,0 +1,400 @@
+#include "gm_loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "gm_telemetry.h"
+#include "errors.h"
+
+//the csv loader maps the file and parses it in parallel straight into the dataset's feature matrix
+//the body is cut into chunks that start right after a newline, a first parallel pass counts the
+//rows of every chunk so each chunk knows the matrix row it starts at, a second pass parses them
+//there is no line length limit and nothing is reallocated
+
+//chunks per thread, more chunks balance uneven lines better
+#define LOADER_CHUNKS_PER_THREAD 8
+//labels each thread remembers before it has to take the lock to intern one
+#define LOADER_LABEL_CACHE 64
+
+//exact powers of ten for the float parser
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/**
+ * Maps a csv file into memory and reads its header.
+ *
+ * @param csv The mapping to fill.
+ * @param file_name The name of the file to map.
+ *
+ * This function returns void.
+ */
+void csv_open(csv_file_t* csv, const char* file_name) {
+    int file = open(file_name, O_RDONLY);
+    if (file < 0) {
+        fprintf(stderr, FILE_ERROR);
+        exit(1);
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        fprintf(stderr, EMPTY_FILE_ERROR);
+        exit(1);
+    }
+
+    csv->size = (size_t)info.st_size;
+    csv->data = (const char*)mmap(NULL, csv->size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (csv->data == MAP_FAILED) {
+        fprintf(stderr, FILE_ERROR);
+        exit(1);
+    }
+    madvise((void*)csv->data, csv->size, MADV_SEQUENTIAL);
+
+    //the header is read once, its columns are counted from the commas
+    const char* newline = (const char*)memchr(csv->data, '\n', csv->size);
+    size_t header_end = newline != NULL ? (size_t)(newline - csv->data) : csv->size;
+    csv->num_columns = 1;
+    for (size_t i = 0; i < header_end; i++) {
+        if (csv->data[i] == ',') {
+            csv->num_columns++;
+        }
+    }
+    csv->body_start = newline != NULL ? header_end + 1 : csv->size;
+
+    return (void)0;
+}
+
+
+/**
+ * Unmaps a csv file.
+ *
+ * @param csv The mapping to release.
+ */
+void csv_close(csv_file_t* csv) {
+    munmap((void*)csv->data, csv->size);
+    csv->data = NULL;
+    csv->size = 0;
+    return (void)0;
+}
+
+
+//O(1)
+//returns the first offset >= offset that starts a line
+static size_t line_start(const csv_file_t* csv, size_t offset) {
+    if (offset <= csv->body_start) {
+        return csv->body_start;
+    }
+    if (offset >= csv->size) {
+        return csv->size;
+    }
+    //offset starts a line if the byte before it is a newline
+    if (csv->data[offset - 1] == '\n') {
+        return offset;
+    }
+    const char* newline = (const char*)memchr(csv->data + offset, '\n', csv->size - offset);
+    return newline != NULL ? (size_t)(newline - csv->data) + 1 : csv->size;
+}
+
+
+//O(chunk)
+//counts the non blank lines of [start, end)
+static int count_rows(const char* data, size_t start, size_t end) {
+    int rows = 0;
+    size_t line = start;
+    while (line < end) {
+        const char* newline = (const char*)memchr(data + line, '\n', end - line);
+        size_t line_end = newline != NULL ? (size_t)(newline - data) : end;
+        //blank lines (or a lone \r) are not rows
+        if (line_end > line && !(line_end == line + 1 && data[line] == '\r')) {
+            rows++;
+        }
+        line = line_end + 1;
+    }
+    return rows;
+}
+
+
+//O(token)
+/**
+ * Parses a decimal float without going through the locale.
+ *
+ * Handles an optional sign, digits, a fraction and an exponent. The first 19
+ * significant digits are kept in an integer and scaled by an exact power of
+ * ten in double precision, well inside a float's rounding error. Tokens it
+ * doesn't understand (nan, inf, hex) go to strtof. An empty field is 0.
+ *
+ * @param p The start of the token.
+ * @param end The end of the line.
+ * @param out Set to the parsed value.
+ * @return A pointer to the first byte after the token.
+ */
+static const char* parse_float(const char* p, const char* end, float* out) {
+    const char* start = p;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int significant = 0;
+    int seen_digit = 0;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        seen_digit = 1;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            significant += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            seen_digit = 1;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (seen_digit && p < end && (*p == 'e' || *p == 'E')) {
+        const char* exponent_start = p;
+        p++;
+        int exponent_negative = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_negative = *p == '-';
+            p++;
+        }
+        int value = 0;
+        int exponent_digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (value < 10000) {
+                value = value * 10 + (*p - '0');
+            }
+            exponent_digits++;
+        }
+        if (exponent_digits == 0) {
+            p = exponent_start;
+        } else {
+            exponent += exponent_negative ? -value : value;
+        }
+    }
+
+    int at_delimiter = p == end || *p == ',' || *p == '\r';
+
+    if (!seen_digit || !at_delimiter) {
+        //empty field
+        if (p == start && at_delimiter) {
+            *out = 0;
+            return p;
+        }
+
+        //anything else goes through strtof on a terminated copy of the token
+        const char* token_end = p;
+        while (token_end < end && *token_end != ',' && *token_end != '\r') {
+            token_end++;
+        }
+        char token[64];
+        size_t length = (size_t)(token_end - start) < sizeof(token) - 1 ? (size_t)(token_end - start) : sizeof(token) - 1;
+        memcpy(token, start, length);
+        token[length] = '\0';
+        char* parsed_end;
+        *out = strtof(token, &parsed_end);
+        if (parsed_end == token) {
+            fprintf(stderr, CSV_FORMAT_ERROR);
+            exit(1);
+        }
+        return token_end;
+    }
+
+    double value = (double)mantissa;
+    while (exponent > 22) {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        value /= 1e22;
+        exponent += 22;
+    }
+    value = exponent >= 0 ? value * powers_of_ten[exponent] : value / powers_of_ten[-exponent];
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+
+//a label a thread has already interned
+typedef struct label_cache_t {
+    const char* text;
+    int length;
+    int id;
+} label_cache_t;
+
+
+//O(1) amortized
+//interns the label [text, text + length), through the thread's cache when it has seen it before
+static int intern_label(Dataset* dataset, label_cache_t* cache, int* cache_size, const char* text, int length) {
+    for (int i = 0; i < *cache_size; i++) {
+        if (cache[i].length == length && memcmp(cache[i].text, text, length) == 0) {
+            return cache[i].id;
+        }
+    }
+
+    char small[128];
+    char* label = length < (int)sizeof(small) ? small : (char*)malloc(length + 1);
+    if (label == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    memcpy(label, text, length);
+    label[length] = '\0';
+
+    int id;
+    #pragma omp critical(gm_loader_labels)
+    id = dataset_intern_label(dataset, label);
+
+    if (label != small) {
+        free(label);
+    }
+
+    if (*cache_size < LOADER_LABEL_CACHE) {
+        cache[*cache_size].text = text;
+        cache[*cache_size].length = length;
+        cache[*cache_size].id = id;
+        (*cache_size)++;
+    }
+    return id;
+}
+
+
+//O(file size / threads)
+/**
+ * Loads a csv file into a dataset.
+ *
+ * The file is memory mapped and its body is split into chunks at line
+ * boundaries. The chunks' rows are counted in parallel, the dataset is sized
+ * once from the total, then the chunks are parsed in parallel, each straight
+ * into its rows of the feature matrix. The header gives the number of features
+ * (every column after the label), lines may be any length, blank lines are
+ * skipped and a row with too few features is an error.
+ *
+ * @param dataset The dataset to fill.
+ * @param file_name The name of the csv file.
+ * @param max_genes The most rows to load, 0 or less loads every row.
+ * @return The number of genes loaded.
+ */
+int dataset_load_csv(Dataset* dataset, const char* file_name, int max_genes) {
+    csv_file_t csv;
+    csv_open(&csv, file_name);
+
+    int num_features = csv.num_columns - 1;
+    if (num_features <= 0) {
+        fprintf(stderr, EMPTY_FILE_ERROR);
+        exit(1);
+    }
+
+    //cut the body into chunks that each start a line
+    int num_chunks = omp_get_max_threads() * LOADER_CHUNKS_PER_THREAD;
+    size_t body_size = csv.size - csv.body_start;
+    if ((size_t)num_chunks > body_size / 4096 + 1) {
+        num_chunks = (int)(body_size / 4096 + 1);
+    }
+
+    size_t* bounds = (size_t*)malloc((num_chunks + 1) * sizeof(size_t));
+    int* first_row = (int*)malloc((num_chunks + 1) * sizeof(int));
+    if (bounds == NULL || first_row == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    for (int c = 0; c <= num_chunks; c++) {
+        bounds[c] = line_start(&csv, csv.body_start + body_size / num_chunks * c);
+    }
+    bounds[num_chunks] = csv.size;
+
+    //first pass: count the rows of each chunk
+    #pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < num_chunks; c++) {
+        first_row[c + 1] = count_rows(csv.data, bounds[c], bounds[c + 1]);
+    }
+    first_row[0] = 0;
+    for (int c = 0; c < num_chunks; c++) {
+        first_row[c + 1] += first_row[c];
+    }
+
+    int num_genes = first_row[num_chunks];
+    if (max_genes > 0 && max_genes < num_genes) {
+        num_genes = max_genes;
+    }
+    dataset_set(dataset, num_genes, num_features);
+
+    //second pass: parse every chunk into its rows
+    #pragma omp parallel
+    {
+        label_cache_t label_cache[LOADER_LABEL_CACHE];
+        int label_cache_size = 0;
+
+        #pragma omp for schedule(dynamic)
+        for (int c = 0; c < num_chunks; c++) {
+            int row = first_row[c];
+            size_t line = bounds[c];
+            TELEMETRY_COUNT(TELEMETRY_BYTES_PARSED, bounds[c + 1] - bounds[c]);
+
+            while (line < bounds[c + 1] && row < num_genes) {
+                const char* p = csv.data + line;
+                const char* newline = (const char*)memchr(p, '\n', bounds[c + 1] - line);
+                const char* end = newline != NULL ? newline : csv.data + bounds[c + 1];
+                line = (size_t)(end - csv.data) + 1;
+
+                if (end > p && end[-1] == '\r') {
+                    end--;
+                }
+                if (end == p) {
+                    continue;
+                }
+
+                //the label is the first column
+                const char* comma = (const char*)memchr(p, ',', end - p);
+                if (comma == NULL) {
+                    fprintf(stderr, CSV_FORMAT_ERROR);
+                    exit(1);
+                }
+                dataset->labels[row] = intern_label(dataset, label_cache, &label_cache_size, p, (int)(comma - p));
+                p = comma + 1;
+
+                float* features = dataset_row(dataset, row);
+                for (int f = 0; f < num_features; f++) {
+                    if (p > end) {
+                        fprintf(stderr, CSV_FORMAT_ERROR);
+                        exit(1);
+                    }
+                    p = parse_float(p, end, &features[f]) + 1;
+                }
+
+                row++;
+            }
+        }
+    }
+
+    //the threads interned the labels in no particular order
+    dataset_order_classes(dataset);
+
+    free(bounds);
+    free(first_row);
+    csv_close(&csv);
+
+    return num_genes;
+}
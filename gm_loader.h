@@ -0,0 +1,25 @@
+#ifndef GM_LOADER_H
+#define GM_LOADER_H
+
+#include <stddef.h>
+#include "gm_dataset.h"
+
+//a csv file mapped into memory
+//the first line is the header, every other line is a label followed by the features
+typedef struct csv_file_t {
+    const char* data;
+    size_t size;
+    //offset of the first byte after the header line
+    size_t body_start;
+    //number of comma separated columns in the header (label included)
+    int num_columns;
+} csv_file_t;
+
+
+//csv_file_t functions
+void csv_open(csv_file_t* csv, const char* file_name);
+void csv_close(csv_file_t* csv);
+
+int dataset_load_csv(Dataset* dataset, const char* file_name, int max_genes);
+
+#endif
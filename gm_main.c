@@ -0,0 +1,327 @@
+#include "gm_creature.h"
+#include "gm_distance.h"
+#include "gm_bitset.h"
+#include "gm_routine.h"
+#include "gm_evaluator.h"
+#include "gm_search.h"
+#include "gm_stream.h"
+#include "gm_checkpoint.h"
+#include "gm_island.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+//seed for random number generation, every rank of the MPI build adds its rank
+int seed = 1;
+
+
+//O(1)
+//prints the best fitness of the generation the GA just finished, with where its time went when timing
+static void print_generation(const GA* ga, int timing) {
+    printf("generation %d best fitness %f", ga->generation, ga->ranking[0].fitness);
+    if (timing) {
+        const ga_timing_t* t = &ga->timing;
+        printf(" | breed %.3f ms evaluate %.3f ms rank %.3f ms wall %.3f ms", t->breed * 1e3, t->evaluate * 1e3, t->rank * 1e3, t->wall * 1e3);
+    }
+    printf("\n");
+    return (void)0;
+}
+
+
+//O(1)
+//prints the time of every phase over the whole run
+static void print_timing(const GA* ga) {
+    const ga_timing_t* t = &ga->total_timing;
+    double threads = t->breed + t->evaluate;
+    printf("total: breed %.3f s evaluate %.3f s (%.1f%% breeding, thread seconds) rank %.3f s wall %.3f s, %lld copies not scored, %lld children scored from a parent's state\n", t->breed, t->evaluate, threads > 0 ? 100 * t->breed / threads : 0, t->rank, t->wall, ga->total_reused, ga->total_incremental);
+    if (ga->memo != NULL) {
+        const memo_stats_t* stats = &ga->memo->stats;
+        printf("memo: %lld hits %lld misses (%.1f%% hit rate), %lld inserts %lld evictions %lld dropped\n", stats->num_hits, stats->num_misses, 100 * memo_hit_rate(ga->memo), stats->num_inserts, stats->num_evictions, stats->num_dropped);
+    }
+    return (void)0;
+}
+
+
+//O(1)
+//prints what the out of core stream read over the whole run
+static void print_stream(const GeneStream* stream) {
+    const stream_stats_t* stats = &stream->stats;
+    printf("stream: %lld passes %lld blocks of %d rows, %.1f MB read, %.3f s waiting for reads\n", stats->num_passes, stats->num_blocks, stream->block_rows, stats->bytes_read / 1e6, stats->wait_seconds);
+    return (void)0;
+}
+
+
+//O(1)
+//prints what checkpointing cost over the whole run
+static void print_checkpoint(const Checkpointer* checkpointer) {
+    const checkpoint_stats_t* stats = &checkpointer->stats;
+    printf("checkpoint: %lld written %lld skipped (%.1f KB each), %.3f s copying in the loop, %.3f s writing in the background\n", stats->num_written, stats->num_skipped, stats->last_bytes / 1e3, stats->copy_seconds, stats->write_seconds);
+    return (void)0;
+}
+
+
+//O(1)
+//an integer from the environment, or a default when it is unset
+static int env_int(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return value != NULL ? atoi(value) : fallback;
+}
+
+
+/**
+ * Runs the genetic algorithm on a csv dataset and prints the best creature's
+ * fitness every generation (and the island model's best over every rank at
+ * the end when built with MPI). Setting GM_TIMING to 1 adds where the time of
+ * every generation and of the whole run went. Setting GM_OUT_OF_CORE to 1
+ * leaves the features in the csv's binary dataset file and streams them in
+ * blocks every generation, within GM_MEMORY_BUDGET bytes (see gm_stream.h).
+ * Setting GM_CACHE_BUDGET to a number of bytes keeps the distances between
+ * the test and training genes in a cache of that size (see init_cache).
+ * Setting GM_CHECKPOINT to a file name snapshots the run there every
+ * GM_CHECKPOINT_INTERVAL generations and after the last one, and with
+ * GM_RESUME set to 1 a run picks up from that file when it exists (see
+ * gm_checkpoint.h).
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.csv [generations] [population_size] [creature_size] [k]\n", argv[0]);
+        return 1;
+    }
+
+    //the kernels are picked once here, before any thread can call one
+    distance_init();
+    bitset_init();
+
+    ga_config_t config;
+    init_config(&config, argc, argv);
+    //every island splits the dataset the same way, so migrants' fitness means the same everywhere
+    uint64_t split_seed = (uint64_t)seed;
+    const char* timing_setting = getenv("GM_TIMING");
+    int timing = timing_setting != NULL && strcmp(timing_setting, "0") != 0;
+    const char* out_of_core_setting = getenv("GM_OUT_OF_CORE");
+    int out_of_core = out_of_core_setting != NULL && strcmp(out_of_core_setting, "0") != 0;
+    GeneStream* stream = NULL;
+
+#ifdef GM_USE_MPI
+    //the threads of a rank never call MPI
+    int rank, num_ranks;
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+
+    //the ranks of an island shard its test set, they run the same GA (same seed) and see the same
+    //fitness, so the rank of every island with the same place in it can migrate for the whole island
+    int shard_ranks = env_int("GM_SHARD_RANKS", 1);
+    if (shard_ranks < 1 || num_ranks % shard_ranks != 0) {
+        fprintf(stderr, SHARD_RANKS_ERROR);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int island_index = rank / shard_ranks;
+    MPI_Comm shard_comm, migration_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, island_index, rank, &shard_comm);
+    MPI_Comm_split(MPI_COMM_WORLD, rank % shard_ranks, rank, &migration_comm);
+    seed += island_index;
+
+    TELEMETRY_OPEN(rank);
+
+    island_topology_t topology = ISLAND_RING;
+    const char* topology_name = getenv("GM_TOPOLOGY");
+    if (topology_name != NULL && !island_topology_from_name(topology_name, &topology)) {
+        fprintf(stderr, TOPOLOGY_NAME_ERROR);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int migration_interval = env_int("GM_MIGRATION_INTERVAL", MAIN_MIGRATION_INTERVAL);
+    int migration_size = env_int("GM_MIGRATION_SIZE", MAIN_MIGRATION_SIZE);
+
+    //one copy of the dataset per node, or every rank streams its own
+    Dataset* dataset = dataset_init();
+    MPI_Win window = MPI_WIN_NULL;
+    if (out_of_core) {
+        stream = stream_open(dataset, argv[1], stream_budget_from_env("GM_MEMORY_BUDGET", STREAM_DEFAULT_BUDGET));
+    } else {
+        window = dataset_share(dataset, argv[1], MPI_COMM_WORLD);
+    }
+#else
+    TELEMETRY_OPEN(-1);
+    Dataset* dataset = dataset_init();
+    if (out_of_core) {
+        stream = stream_open(dataset, argv[1], stream_budget_from_env("GM_MEMORY_BUDGET", STREAM_DEFAULT_BUDGET));
+    } else {
+        gene_fill(dataset, argv[1], 0, 0);
+    }
+#endif
+
+    int* train_genes;
+    int* test_genes;
+    int num_train_genes, num_test_genes;
+    init_split(dataset, split_seed, &train_genes, &num_train_genes, &test_genes, &num_test_genes);
+
+    GA* ga = ga_init(&config, dataset, train_genes, num_train_genes, test_genes, num_test_genes, (uint64_t)seed);
+    //the search backends index the whole matrix, a streamed run reads it block by block instead
+    NeighborSearch* search = NULL;
+    if (stream != NULL) {
+        evaluator_set_stream(ga->evaluator, stream);
+    } else {
+        search = search_from_env(dataset);
+        evaluator_set_search(ga->evaluator, search);
+    }
+
+    //every rank snapshots its own GA (an island, or its copy of a sharded one)
+    Checkpointer* checkpointer = NULL;
+    int resumed = 0;
+    int checkpoint_interval = env_int("GM_CHECKPOINT_INTERVAL", CHECKPOINT_DEFAULT_INTERVAL);
+    const char* checkpoint_setting = getenv("GM_CHECKPOINT");
+    if (checkpoint_setting != NULL) {
+        char* checkpoint_name = (char*)malloc(strlen(checkpoint_setting) + 16);
+        if (checkpoint_name == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+#ifdef GM_USE_MPI
+        sprintf(checkpoint_name, "%s.%d", checkpoint_setting, rank);
+#else
+        strcpy(checkpoint_name, checkpoint_setting);
+#endif
+        const char* resume_setting = getenv("GM_RESUME");
+        if (resume_setting != NULL && strcmp(resume_setting, "0") != 0) {
+            resumed = checkpoint_restore(ga, checkpoint_name);
+        }
+        checkpointer = checkpoint_init(checkpoint_name);
+        free(checkpoint_name);
+    }
+
+#ifdef GM_USE_MPI
+    if (shard_ranks > 1) {
+        evaluator_shard(ga->evaluator, shard_comm);
+    }
+    DistanceCache* cache = stream == NULL ? init_cache(ga->evaluator, train_genes, num_train_genes) : NULL;
+
+    //the islands only migrate in step when every rank picked up from the same generation
+    if (checkpointer != NULL) {
+        int generations[2] = {ga->generation, -ga->generation};
+        MPI_Allreduce(MPI_IN_PLACE, generations, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if (generations[0] != -generations[1]) {
+            if (rank == 0) {
+                fprintf(stderr, CHECKPOINT_RANKS_ERROR);
+            }
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    if (!resumed) {
+        ga_evaluate(ga);
+        TELEMETRY_REPORT(0);
+    }
+
+    Island* island = island_init(migration_comm, topology, migration_size, config.creature_size);
+    for (int g = ga->generation + 1; g <= config.generations; g++) {
+        //emigrants leave before the step and arrive after it, the messages overlap the evaluation
+        int migrate = migration_interval > 0 && g % migration_interval == 0;
+        if (migrate) {
+            island_post(island, ga);
+        }
+        ga_step(ga);
+        if (migrate) {
+            island_complete(island, ga);
+        }
+        if (checkpointer != NULL && ((checkpoint_interval > 0 && g % checkpoint_interval == 0) || g == config.generations)) {
+            checkpoint_save(checkpointer, ga, g == config.generations);
+            //the last one is on disk before the generation is reported
+            if (g == config.generations) {
+                checkpoint_wait(checkpointer);
+            }
+        }
+        if (checkpointer != NULL) {
+            checkpoint_telemetry(checkpointer);
+        }
+        TELEMETRY_REPORT(g);
+        if (rank == 0) {
+            print_generation(ga, timing);
+        }
+    }
+    if (rank == 0 && timing) {
+        print_timing(ga);
+        if (stream != NULL) {
+            print_stream(stream);
+        }
+        if (checkpointer != NULL) {
+            print_checkpoint(checkpointer);
+        }
+        if (cache != NULL) {
+            cache_print_stats(cache, stdout);
+        }
+    }
+
+    //the best creature over every island
+    struct {
+        double fitness;
+        int rank;
+    } local = {ga->ranking[0].fitness, island_index}, best;
+    MPI_Reduce(&local, &best, 1, MPI_DOUBLE_INT, MPI_MAXLOC, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("best fitness %f (island %d) after %d generations, %lld migrations per island\n", best.fitness, best.rank, config.generations, island->num_migrations);
+    }
+    island_free(island);
+#else
+    DistanceCache* cache = stream == NULL ? init_cache(ga->evaluator, train_genes, num_train_genes) : NULL;
+    if (!resumed) {
+        ga_evaluate(ga);
+        TELEMETRY_REPORT(0);
+    }
+    for (int g = ga->generation + 1; g <= config.generations; g++) {
+        ga_step(ga);
+        if (checkpointer != NULL && ((checkpoint_interval > 0 && g % checkpoint_interval == 0) || g == config.generations)) {
+            checkpoint_save(checkpointer, ga, g == config.generations);
+            //the last one is on disk before the generation is reported
+            if (g == config.generations) {
+                checkpoint_wait(checkpointer);
+            }
+        }
+        if (checkpointer != NULL) {
+            checkpoint_telemetry(checkpointer);
+        }
+        TELEMETRY_REPORT(g);
+        print_generation(ga, timing);
+    }
+    if (timing) {
+        print_timing(ga);
+        if (stream != NULL) {
+            print_stream(stream);
+        }
+        if (checkpointer != NULL) {
+            print_checkpoint(checkpointer);
+        }
+        if (cache != NULL) {
+            cache_print_stats(cache, stdout);
+        }
+    }
+#endif
+
+    if (checkpointer != NULL) {
+        checkpoint_free(checkpointer);
+    }
+    ga_free(ga);
+    if (search != NULL) {
+        search_free(search);
+    }
+    if (cache != NULL) {
+        cache_free(cache);
+    }
+    if (stream != NULL) {
+        stream_close(stream);
+    }
+    free(train_genes);
+    free(test_genes);
+    dataset_free(dataset);
+    TELEMETRY_CLOSE();
+
+#ifdef GM_USE_MPI
+    MPI_Comm_free(&shard_comm);
+    MPI_Comm_free(&migration_comm);
+    if (window != MPI_WIN_NULL) {
+        MPI_Win_free(&window);
+    }
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
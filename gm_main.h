@@ -0,0 +1,24 @@
+#ifndef GM_MAIN_H
+#define GM_MAIN_H
+
+//usage: GM.out file.csv [generations] [population_size] [creature_size] [k]
+//GM_SELECTION, GM_MUTATION_RATE, GM_TOURNAMENT_SIZE, GM_ELITE and GM_INIT tune the GA (see init_config),
+//GM_TEST_FRACTION is the share of every class held out as test genes (see init_split), GM_TIMING=1
+//prints the time of every phase, GM_SEARCH=ivf (with GM_IVF_LISTS and GM_IVF_PROBES) finds neighbors
+//approximately (see search_from_env), GM_OUT_OF_CORE=1 streams the features from the csv's binary dataset file
+//(make it with convert.out) instead of loading them, holding at most GM_MEMORY_BUDGET bytes (1G by default,
+//K, M and G suffixes) for the stream and the evaluator (see gm_stream.h), GM_CHECKPOINT=file snapshots the run
+//every GM_CHECKPOINT_INTERVAL generations (10 by default) from a background thread and GM_RESUME=1 continues
+//from that file when it exists, exactly as the run would have gone on (see gm_checkpoint.h)
+//built with make TELEMETRY=1, every generation also writes a json line of hot path timers and counters to
+//stderr or GM_TELEMETRY_FILE, GM_PERF=1 adds hardware counters around the distance kernels (see gm_telemetry.h)
+//the MPI build (GM_MPI.out) also reads GM_MIGRATION_INTERVAL, GM_MIGRATION_SIZE, GM_TOPOLOGY (ring or torus)
+//and GM_SHARD_RANKS, the number of ranks that evolve one island together, each scoring a slice of the
+//test set (1 by default, every rank is its own island; the number of ranks for a single sharded GA), and
+//every rank checkpoints to GM_CHECKPOINT.<rank>
+
+//island model defaults
+#define MAIN_MIGRATION_INTERVAL 5
+#define MAIN_MIGRATION_SIZE 2
+
+#endif
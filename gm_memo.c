@@ -0,0 +1,188 @@
+#include "gm_memo.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//O(1)
+//splitmix64 finalizer, a bijection that spreads every input bit over the output
+static inline uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+
+//O(entries)
+/**
+ * Allocates an empty fitness memo.
+ *
+ * @param num_entries The most fitnesses it holds, rounded up to a power of two number of sets.
+ * @return A pointer to the newly allocated memo.
+ */
+FitnessMemo* memo_init(int num_entries) {
+    FitnessMemo* memo = (FitnessMemo*)calloc(1, sizeof(FitnessMemo));
+    if (memo == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    memo->num_sets = 1;
+    while (memo->num_sets * MEMO_WAYS < num_entries) {
+        memo->num_sets *= 2;
+    }
+    memo->slots = (memo_slot_t*)aligned_alloc(64, (size_t)memo->num_sets * MEMO_WAYS * sizeof(memo_slot_t));
+    memo->hands = (uint32_t*)calloc(memo->num_sets, sizeof(uint32_t));
+    if (memo->slots == NULL || memo->hands == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    memset(memo->slots, 0, (size_t)memo->num_sets * MEMO_WAYS * sizeof(memo_slot_t));
+
+    return memo;
+}
+
+
+//O(|creature|)
+/**
+ * Hashes a creature's genes independently of their order: the sum of the
+ * mixed gene indices, so a gene held twice counts twice. 0 is never
+ * returned (it marks an empty slot).
+ *
+ * @param gene_indices The creature's genes.
+ * @param num_genes The number of genes.
+ * @return The creature's key.
+ */
+uint64_t memo_key(const int* gene_indices, int num_genes) {
+    uint64_t sum = 0;
+    for (int i = 0; i < num_genes; i++) {
+        sum += mix((uint64_t)(uint32_t)gene_indices[i]);
+    }
+    //mixing the sum once more keeps sums of few genes apart
+    uint64_t key = mix(sum ^ (uint64_t)num_genes);
+    return key != 0 ? key : 1;
+}
+
+
+//O(MEMO_WAYS)
+/**
+ * Looks a fitness up, safe to call from any thread at any time.
+ *
+ * A slot a writer is filling is skipped (its sequence number is odd or
+ * changed while it was read), so a lookup never waits. A hit marks the slot
+ * referenced so CLOCK keeps it.
+ *
+ * @param memo The memo.
+ * @param key The creature's key (see memo_key).
+ * @param fitness Set to the cached fitness on a hit.
+ * @return 1 on a hit, 0 on a miss.
+ */
+int memo_lookup(FitnessMemo* memo, uint64_t key, double* fitness) {
+    memo_slot_t* set = memo->slots + (size_t)(key & (uint64_t)(memo->num_sets - 1)) * MEMO_WAYS;
+    for (int w = 0; w < MEMO_WAYS; w++) {
+        memo_slot_t* slot = &set[w];
+        uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        uint64_t slot_key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+        uint64_t value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (slot_key != key || __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != before) {
+            continue;
+        }
+
+        if (__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED) == 0) {
+            __atomic_store_n(&slot->referenced, 1, __ATOMIC_RELAXED);
+        }
+        memcpy(fitness, &value, sizeof(double));
+        __atomic_fetch_add(&memo->stats.num_hits, 1, __ATOMIC_RELAXED);
+        TELEMETRY_COUNT(TELEMETRY_MEMO_HITS, 1);
+        return 1;
+    }
+    __atomic_fetch_add(&memo->stats.num_misses, 1, __ATOMIC_RELAXED);
+    TELEMETRY_COUNT(TELEMETRY_MEMO_MISSES, 1);
+    return 0;
+}
+
+
+//O(MEMO_WAYS)
+/**
+ * Caches a fitness, safe to call from any thread at any time.
+ *
+ * The key's set runs CLOCK: its hand moves over the slots, clearing the
+ * referenced mark of each one it passes, and the first unmarked slot (an
+ * empty one or the least recently hit) is claimed with a compare and swap on
+ * its sequence number, filled and released. A key that is already cached is
+ * left as it is. When every claim fails (other threads are writing the set)
+ * the fitness is dropped.
+ *
+ * @param memo The memo.
+ * @param key The creature's key (see memo_key).
+ * @param fitness The creature's fitness.
+ */
+void memo_insert(FitnessMemo* memo, uint64_t key, double fitness) {
+    size_t set_index = (size_t)(key & (uint64_t)(memo->num_sets - 1));
+    memo_slot_t* set = memo->slots + set_index * MEMO_WAYS;
+    for (int w = 0; w < MEMO_WAYS; w++) {
+        if (__atomic_load_n(&set[w].key, __ATOMIC_RELAXED) == key) {
+            return (void)0;
+        }
+    }
+
+    //two turns of the hand clear every mark, so an unmarked slot turns up unless writers hold them
+    for (int step = 0; step < 2 * MEMO_WAYS; step++) {
+        uint32_t hand = __atomic_fetch_add(&memo->hands[set_index], 1, __ATOMIC_RELAXED);
+        memo_slot_t* slot = &set[hand % MEMO_WAYS];
+        if (__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&slot->referenced, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+        if ((sequence & 1) || !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) != 0) {
+            __atomic_fetch_add(&memo->stats.num_evictions, 1, __ATOMIC_RELAXED);
+        }
+        uint64_t value;
+        memcpy(&value, &fitness, sizeof(double));
+        __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->referenced, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&memo->stats.num_inserts, 1, __ATOMIC_RELAXED);
+        return (void)0;
+    }
+
+    __atomic_fetch_add(&memo->stats.num_dropped, 1, __ATOMIC_RELAXED);
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * @return The fraction of lookups that hit, 0 before the first lookup.
+ */
+double memo_hit_rate(const FitnessMemo* memo) {
+    long long lookups = memo->stats.num_hits + memo->stats.num_misses;
+    return lookups > 0 ? (double)memo->stats.num_hits / lookups : 0;
+}
+
+
+/**
+ * Frees a fitness memo.
+ *
+ * @param memo The memo to be freed.
+ */
+void memo_free(FitnessMemo* memo) {
+    free(memo->slots);
+    free(memo->hands);
+    free(memo);
+    return (void)0;
+}
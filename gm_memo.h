@@ -0,0 +1,56 @@
+#ifndef GM_MEMO_H
+#define GM_MEMO_H
+
+#include <stdint.h>
+
+//fitness memoization. a creature's fitness only depends on which genes it holds, so it is cached
+//under an order independent hash of its genes (a sum of mixed gene indices, which also counts
+//repeats). the table is split into sets of MEMO_WAYS slots, a key can only live in its own set and
+//a set evicts with CLOCK: every hit marks its slot referenced, the set's hand clears marks as it
+//passes and evicts the first slot left unmarked. every slot has a sequence number so lookups never
+//take a lock (they retry around a concurrent write) and inserts claim a slot with one compare and
+//swap (an insert that loses the race is dropped, it is a cache)
+
+//slots per set, a set is four cache lines
+#define MEMO_WAYS 8
+//entries of the memo when the run doesn't say
+#define MEMO_DEFAULT_ENTRIES 65536
+
+//one cached fitness, key 0 is an empty slot
+typedef struct memo_slot_t {
+    //odd while a writer fills the slot
+    uint32_t sequence;
+    uint32_t referenced;
+    uint64_t key;
+    //the fitness' bits
+    uint64_t value;
+    uint64_t pad;
+} memo_slot_t;
+
+//counts since the memo was made, updated with relaxed atomics
+typedef struct memo_stats_t {
+    long long num_hits;
+    long long num_misses;
+    long long num_inserts;
+    long long num_evictions;
+    long long num_dropped;
+} memo_stats_t;
+
+typedef struct FitnessMemo {
+    memo_slot_t* slots;
+    //num_sets is a power of two, each set's CLOCK hand
+    int num_sets;
+    uint32_t* hands;
+    memo_stats_t stats;
+} FitnessMemo;
+
+
+//FitnessMemo functions
+FitnessMemo* memo_init(int num_entries);
+uint64_t memo_key(const int* gene_indices, int num_genes);
+int memo_lookup(FitnessMemo* memo, uint64_t key, double* fitness);
+void memo_insert(FitnessMemo* memo, uint64_t key, double fitness);
+double memo_hit_rate(const FitnessMemo* memo);
+void memo_free(FitnessMemo* memo);
+
+#endif
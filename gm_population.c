@@ -0,0 +1,197 @@
+#include "gm_population.h"
+
+#include "errors.h"
+
+
+//O(1)
+//allocates through the arena so the allocation is counted
+static void* arena_alloc(Population* population, size_t size) {
+    void* block = malloc(size > 0 ? size : 1);
+    if (block == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    population->stats.num_allocations++;
+    population->stats.bytes += size;
+    return block;
+}
+
+
+//O(n)
+//allocates one generation's headers, pointer list, slab and offset table
+static void generation_init(Population* population, Creature** headers, Creature*** list, int** slab, size_t** offsets, size_t capacity) {
+    int num_creatures = population->num_creatures;
+    *headers = (Creature*)arena_alloc(population, num_creatures * sizeof(Creature));
+    *list = (Creature**)arena_alloc(population, num_creatures * sizeof(Creature*));
+    *slab = (int*)arena_alloc(population, capacity * sizeof(int));
+    *offsets = (size_t*)arena_alloc(population, (num_creatures + 1) * sizeof(size_t));
+
+    for (int i = 0; i < num_creatures; i++) {
+        (*list)[i] = &(*headers)[i];
+        if (population->layout == POPULATION_FIXED) {
+            (*offsets)[i] = (size_t)i * population->genes_per_creature;
+            (*headers)[i].num_genes = population->genes_per_creature;
+        } else {
+            (*offsets)[i] = 0;
+            (*headers)[i].num_genes = 0;
+        }
+        (*headers)[i].gene_indices = *slab + (*offsets)[i];
+    }
+    (*offsets)[num_creatures] = population->layout == POPULATION_FIXED ? capacity : 0;
+
+    return (void)0;
+}
+
+
+//O(n)
+/**
+ * Allocates a population and both of its generations.
+ *
+ * With genes_per_creature > 0 the layout is fixed: every creature owns that
+ * many slots and starts out that size. Otherwise the creatures are packed
+ * through an offset table into slabs of slab_capacity genes and start out
+ * empty, population_layout sizes them.
+ *
+ * @param num_creatures The number of creatures per generation.
+ * @param genes_per_creature The slot size of the fixed layout, 0 or less for the offset layout.
+ * @param slab_capacity The initial number of genes per slab for the offset layout (the slabs grow if needed).
+ * @return A pointer to the newly allocated population.
+ */
+Population* population_init(int num_creatures, int genes_per_creature, size_t slab_capacity) {
+    Population* population = (Population*)calloc(1, sizeof(Population));
+    if (population == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    population->num_creatures = num_creatures;
+    if (genes_per_creature > 0) {
+        population->layout = POPULATION_FIXED;
+        population->genes_per_creature = genes_per_creature;
+        slab_capacity = (size_t)num_creatures * genes_per_creature;
+    } else {
+        population->layout = POPULATION_OFFSETS;
+        population->genes_per_creature = 0;
+    }
+
+    population->current_capacity = slab_capacity;
+    population->next_capacity = slab_capacity;
+    generation_init(population, &population->current, &population->current_list, &population->current_slab, &population->current_offsets, slab_capacity);
+    generation_init(population, &population->next, &population->next_list, &population->next_slab, &population->next_offsets, slab_capacity);
+
+    return population;
+}
+
+
+//O(n)
+/**
+ * Sizes the creatures of the next generation.
+ *
+ * In the fixed layout a creature may be given any size up to its slot. In the
+ * offset layout the creatures are packed back to back and the next slab only
+ * grows (and allocates) when the generation needs more genes than it has ever
+ * held. The gene indices themselves are left for the caller to fill.
+ *
+ * @param population The population to lay out.
+ * @param num_genes The size of each creature of the next generation, NULL for full slots (fixed layout only).
+ */
+void population_layout(Population* population, const int* num_genes) {
+    int num_creatures = population->num_creatures;
+
+    if (population->layout == POPULATION_FIXED) {
+        for (int i = 0; i < num_creatures; i++) {
+            int size = num_genes != NULL ? num_genes[i] : population->genes_per_creature;
+            if (size < 0 || size > population->genes_per_creature) {
+                fprintf(stderr, POPULATION_SIZE_ERROR);
+                exit(1);
+            }
+            population->next[i].num_genes = size;
+        }
+        return (void)0;
+    }
+
+    if (num_genes == NULL) {
+        fprintf(stderr, POPULATION_SIZE_ERROR);
+        exit(1);
+    }
+
+    //prefix sum of the sizes
+    size_t* offsets = population->next_offsets;
+    offsets[0] = 0;
+    for (int i = 0; i < num_creatures; i++) {
+        offsets[i + 1] = offsets[i] + (size_t)num_genes[i];
+    }
+
+    //grow the slab (at least doubling so growth stops quickly)
+    if (offsets[num_creatures] > population->next_capacity) {
+        size_t capacity = 2 * population->next_capacity;
+        if (capacity < offsets[num_creatures]) {
+            capacity = offsets[num_creatures];
+        }
+        free(population->next_slab);
+        population->stats.bytes -= population->next_capacity * sizeof(int);
+        population->next_slab = (int*)arena_alloc(population, capacity * sizeof(int));
+        population->next_capacity = capacity;
+        population->stats.num_grows++;
+    }
+
+    for (int i = 0; i < num_creatures; i++) {
+        population->next[i].gene_indices = population->next_slab + offsets[i];
+        population->next[i].num_genes = num_genes[i];
+    }
+
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Makes the next generation the current one. The old current generation's
+ * memory becomes the next generation to build.
+ *
+ * @param population The population to advance.
+ */
+void population_swap(Population* population) {
+    Creature* headers = population->current;
+    population->current = population->next;
+    population->next = headers;
+
+    Creature** list = population->current_list;
+    population->current_list = population->next_list;
+    population->next_list = list;
+
+    int* slab = population->current_slab;
+    population->current_slab = population->next_slab;
+    population->next_slab = slab;
+
+    size_t* offsets = population->current_offsets;
+    population->current_offsets = population->next_offsets;
+    population->next_offsets = offsets;
+
+    size_t capacity = population->current_capacity;
+    population->current_capacity = population->next_capacity;
+    population->next_capacity = capacity;
+
+    population->stats.num_swaps++;
+    return (void)0;
+}
+
+
+/**
+ * Frees a population and both of its generations. The creatures must not be
+ * passed to creature_free, they are owned by the population.
+ *
+ * @param population The population to be freed.
+ */
+void population_free(Population* population) {
+    free(population->current);
+    free(population->current_list);
+    free(population->current_slab);
+    free(population->current_offsets);
+    free(population->next);
+    free(population->next_list);
+    free(population->next_slab);
+    free(population->next_offsets);
+    free(population);
+    return (void)0;
+}
@@ -0,0 +1,57 @@
+#ifndef GM_POPULATION_H
+#define GM_POPULATION_H
+
+#include <stddef.h>
+#include "gm_creature.h"
+
+//a population keeps every creature of a generation in one contiguous slab of gene indices, the
+//next generation is built in a second slab and the two are swapped by pointer. after the first
+//generations have sized the slabs a generation costs no heap allocation at all
+
+//how the creatures sit in a slab
+//fixed: creature i always owns genes_per_creature slots starting at i * genes_per_creature
+//offsets: the creatures are packed back to back, an offset table records where each one starts
+typedef enum population_layout_t {
+    POPULATION_FIXED,
+    POPULATION_OFFSETS
+} population_layout_t;
+
+//heap activity of the arena, a steady state loop must leave num_allocations unchanged
+typedef struct population_stats_t {
+    long long num_allocations;
+    long long num_grows;
+    long long num_swaps;
+    //bytes currently held by the arena
+    size_t bytes;
+} population_stats_t;
+
+typedef struct Population {
+    population_layout_t layout;
+    int num_creatures;
+    int genes_per_creature;
+
+    //the current generation, read by the GA
+    Creature* current;
+    Creature** current_list;
+    int* current_slab;
+    size_t* current_offsets;
+    size_t current_capacity;
+
+    //the generation being built, swapped with the current one by population_swap
+    Creature* next;
+    Creature** next_list;
+    int* next_slab;
+    size_t* next_offsets;
+    size_t next_capacity;
+
+    population_stats_t stats;
+} Population;
+
+
+//Population functions
+Population* population_init(int num_creatures, int genes_per_creature, size_t slab_capacity);
+void population_layout(Population* population, const int* num_genes);
+void population_swap(Population* population);
+void population_free(Population* population);
+
+#endif
@@ -0,0 +1,121 @@
+#include "gm_rng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "errors.h"
+
+
+//O(n)
+//Fisher-Yates over values[0, n), draw first + i picks the slot swapped into position n - 1 - i
+static void shuffle_serial(int* values, int n, const rng_t* rng, uint32_t first) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(((rng_at(rng, first + (uint32_t)(n - 1 - i)) >> 32) * (uint64_t)(i + 1)) >> 32);
+        int swap = values[i];
+        values[i] = values[j];
+        values[j] = swap;
+    }
+    return (void)0;
+}
+
+
+//O(n / threads)
+/**
+ * Shuffles an array into a uniformly random order, in parallel.
+ *
+ * The result only depends on the stream, never on the thread count. Short
+ * arrays get a serial Fisher-Yates. Longer ones send every element to a
+ * random bucket (one draw each, computed in parallel), gather the buckets in
+ * order through per chunk counts and then Fisher-Yates every bucket in
+ * parallel. Uniform buckets followed by uniform orders within them give a
+ * uniform permutation. Only the stream's draws [0, 2n) are used, and the
+ * stream itself is left unchanged.
+ *
+ * @param values The array to shuffle.
+ * @param n The length of the array.
+ * @param rng The stream to draw from.
+ */
+void rng_shuffle(int* values, int n, const rng_t* rng) {
+    if (n < RNG_SHUFFLE_SERIAL) {
+        shuffle_serial(values, n, rng, 0);
+        return (void)0;
+    }
+
+    uint8_t* buckets = (uint8_t*)malloc(n);
+    int* scattered = (int*)malloc((size_t)n * sizeof(int));
+    int* counts = (int*)calloc((size_t)RNG_SHUFFLE_CHUNKS * RNG_SHUFFLE_BUCKETS, sizeof(int));
+    int starts[RNG_SHUFFLE_BUCKETS + 1];
+    if (buckets == NULL || scattered == NULL || counts == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    //draw every element's bucket and count the buckets of every chunk
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < RNG_SHUFFLE_CHUNKS; c++) {
+        int begin = (int)((long long)n * c / RNG_SHUFFLE_CHUNKS);
+        int end = (int)((long long)n * (c + 1) / RNG_SHUFFLE_CHUNKS);
+        int* chunk_counts = counts + (size_t)c * RNG_SHUFFLE_BUCKETS;
+        for (int i = begin; i < end; i++) {
+            buckets[i] = (uint8_t)(rng_at(rng, (uint32_t)i) >> 56);
+            chunk_counts[buckets[i]]++;
+        }
+    }
+
+    //where every chunk writes into every bucket
+    int position = 0;
+    for (int b = 0; b < RNG_SHUFFLE_BUCKETS; b++) {
+        starts[b] = position;
+        for (int c = 0; c < RNG_SHUFFLE_CHUNKS; c++) {
+            int count = counts[(size_t)c * RNG_SHUFFLE_BUCKETS + b];
+            counts[(size_t)c * RNG_SHUFFLE_BUCKETS + b] = position;
+            position += count;
+        }
+    }
+    starts[RNG_SHUFFLE_BUCKETS] = position;
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (int c = 0; c < RNG_SHUFFLE_CHUNKS; c++) {
+            int begin = (int)((long long)n * c / RNG_SHUFFLE_CHUNKS);
+            int end = (int)((long long)n * (c + 1) / RNG_SHUFFLE_CHUNKS);
+            int* chunk_positions = counts + (size_t)c * RNG_SHUFFLE_BUCKETS;
+            for (int i = begin; i < end; i++) {
+                scattered[chunk_positions[buckets[i]]++] = values[i];
+            }
+        }
+
+        //every bucket draws from [n + start, n + end) so no two buckets share a draw
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < RNG_SHUFFLE_BUCKETS; b++) {
+            shuffle_serial(scattered + starts[b], starts[b + 1] - starts[b], rng, (uint32_t)n + (uint32_t)starts[b]);
+        }
+    }
+
+    memcpy(values, scattered, (size_t)n * sizeof(int));
+    free(buckets);
+    free(scattered);
+    free(counts);
+    return (void)0;
+}
+
+
+//O(n / threads)
+/**
+ * Fills an array with a uniformly random permutation of 0 .. n - 1.
+ *
+ * @param permutation The array to fill.
+ * @param n The length of the array.
+ * @param rng The stream to draw from (see rng_shuffle).
+ */
+void rng_permutation(int* permutation, int n, const rng_t* rng) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+        permutation[i] = i;
+    }
+    rng_shuffle(permutation, n, rng);
+    return (void)0;
+}
@@ -0,0 +1,122 @@
+#ifndef GM_RNG_H
+#define GM_RNG_H
+
+#include <stdint.h>
+
+//a counter based random number generator (Philox4x32-10). a random number is a pure function of its
+//key (the seed) and its counter (purpose, generation, stream, draw), there is no shared state to
+//update, so any thread or rank can compute any draw in any order and get the same value. each
+//creature of each generation gets its own stream, which makes the GA the same for a given seed
+//whatever the thread or rank count
+
+//what a stream is used for, streams of different purposes never overlap
+typedef enum rng_purpose_t {
+    RNG_FILL,
+    RNG_INIT,
+    RNG_BREED,
+    RNG_SHUFFLE,
+    RNG_SEARCH,
+    RNG_GENERATE,
+    RNG_SPLIT
+} rng_purpose_t;
+
+//one stream of draws, draw counts how many have been taken
+typedef struct rng_t {
+    uint64_t seed;
+    uint32_t purpose;
+    uint32_t generation;
+    uint32_t stream;
+    uint32_t draw;
+} rng_t;
+
+//arrays shorter than this are shuffled serially
+#define RNG_SHUFFLE_SERIAL 16384
+//buckets and chunks of the parallel shuffle, fixed so the result doesn't depend on the thread count
+#define RNG_SHUFFLE_BUCKETS 256
+#define RNG_SHUFFLE_CHUNKS 64
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+
+//O(1)
+/**
+ * Philox4x32-10: encrypts a 128 bit counter under a 64 bit key.
+ *
+ * @param counter The counter, replaced by the 128 random bits.
+ * @param key The key.
+ */
+static inline void philox4x32(uint32_t counter[4], const uint32_t key[2]) {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t product0 = (uint64_t)PHILOX_M0 * counter[0];
+        uint64_t product1 = (uint64_t)PHILOX_M1 * counter[2];
+        uint32_t c0 = (uint32_t)(product1 >> 32) ^ counter[1] ^ k0;
+        uint32_t c1 = (uint32_t)product1;
+        uint32_t c2 = (uint32_t)(product0 >> 32) ^ counter[3] ^ k1;
+        uint32_t c3 = (uint32_t)product0;
+        counter[0] = c0;
+        counter[1] = c1;
+        counter[2] = c2;
+        counter[3] = c3;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+
+//O(1)
+/**
+ * Starts a stream.
+ *
+ * @param seed The seed of the run.
+ * @param purpose What the stream is used for.
+ * @param generation The generation it is used in.
+ * @param stream Which stream of that generation (a creature index for instance).
+ * @return The stream, at its first draw.
+ */
+static inline rng_t rng_stream(uint64_t seed, rng_purpose_t purpose, uint32_t generation, uint32_t stream) {
+    rng_t rng = {seed, (uint32_t)purpose, generation, stream, 0};
+    return rng;
+}
+
+
+//O(1)
+//64 random bits, draw number draw of the stream (the stream's position is not used or changed)
+static inline uint64_t rng_at(const rng_t* rng, uint32_t draw) {
+    uint32_t counter[4] = {draw, rng->stream, rng->generation, rng->purpose};
+    uint32_t key[2] = {(uint32_t)rng->seed, (uint32_t)(rng->seed >> 32)};
+    philox4x32(counter, key);
+    return ((uint64_t)counter[1] << 32) | counter[0];
+}
+
+
+//O(1)
+//the next 64 random bits of a stream
+static inline uint64_t rng_next(rng_t* rng) {
+    return rng_at(rng, rng->draw++);
+}
+
+
+//O(1)
+//a random integer in [0, bound), by the high half of a 64 x 32 bit product (bias below 2^-32)
+static inline uint32_t rng_below(rng_t* rng, uint32_t bound) {
+    return (uint32_t)(((rng_next(rng) >> 32) * bound) >> 32);
+}
+
+
+//O(1)
+//a random double in [0, 1)
+static inline double rng_uniform(rng_t* rng) {
+    return (double)(rng_next(rng) >> 11) * 0x1p-53;
+}
+
+
+//rng functions
+void rng_shuffle(int* values, int n, const rng_t* rng);
+void rng_permutation(int* permutation, int n, const rng_t* rng);
+
+#endif
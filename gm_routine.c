@@ -0,0 +1,820 @@
+#include "gm_routine.h"
+#include "gm_population.h"
+#include "gm_evaluator.h"
+#include "gm_fitness.h"
+#include "gm_search.h"
+#include "gm_cache.h"
+#include "gm_rng.h"
+#include "gm_bitset.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+
+//O(1)
+/**
+ * Fills a config with the default settings.
+ *
+ * @param config The config to fill.
+ */
+void ga_default_config(ga_config_t* config) {
+    config->population_size = 64;
+    config->creature_size = 100;
+    config->k = 5;
+    config->generations = 100;
+    config->selection = SELECTION_TOURNAMENT;
+    config->mutation_rate = 0.01;
+    config->tournament_size = 3;
+    config->elite = 2;
+    config->vote = VOTE_MAJORITY;
+    config->memo_entries = MEMO_DEFAULT_ENTRIES;
+    config->initial = INITIAL_RANDOM;
+    config->incremental = 1;
+    return (void)0;
+}
+
+
+static const char* selection_names[] = {"tournament", "rank"};
+#define NUM_SELECTIONS ((int)(sizeof(selection_names) / sizeof(selection_names[0])))
+
+
+//O(1)
+/**
+ * Looks up a selection by name.
+ *
+ * @param name The name (tournament or rank).
+ * @param selection Set to the selection when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int ga_selection_from_name(const char* name, ga_selection_t* selection) {
+    for (int i = 0; i < NUM_SELECTIONS; i++) {
+        if (strcmp(name, selection_names[i]) == 0) {
+            *selection = (ga_selection_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static const char* initial_names[] = {"random", "groups"};
+#define NUM_INITIALS ((int)(sizeof(initial_names) / sizeof(initial_names[0])))
+
+
+//O(1)
+/**
+ * Looks up how to draw the first generation by name.
+ *
+ * @param name The name (random or groups).
+ * @param initial Set to the kind when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int ga_initial_from_name(const char* name, ga_initial_t* initial) {
+    for (int i = 0; i < NUM_INITIALS; i++) {
+        if (strcmp(name, initial_names[i]) == 0) {
+            *initial = (ga_initial_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//orders ranks by descending fitness, ties by index so the ranking is deterministic
+static int compare_ranks(const void* a, const void* b) {
+    const ga_rank_t* first = (const ga_rank_t*)a;
+    const ga_rank_t* second = (const ga_rank_t*)b;
+    if (first->fitness != second->fitness) {
+        return first->fitness < second->fitness ? 1 : -1;
+    }
+    return first->index - second->index;
+}
+
+
+//O(1)
+//a uniformly random training gene
+static inline int random_gene(GA* ga, rng_t* rng) {
+    return ga->train_genes[rng_below(rng, (uint32_t)ga->num_train_genes)];
+}
+
+
+//O(p * |creature|)
+/**
+ * Allocates a GA and draws its first generation.
+ *
+ * Every creature of the first generation is a random subset of the training
+ * genes (without repeats when there are enough of them), drawn in parallel
+ * from the creature's own stream so it only depends on the seed. With
+ * INITIAL_GROUPS the training genes are laid end to end as many times as the
+ * creatures need, shuffled as one sequence (see rng_shuffle) and dealt out in
+ * order, so every training gene is in some creature before any gene is in
+ * two (when the training genes outnumber the slots, the ones dealt are a
+ * random subset). The
+ * generation is not scored yet so the evaluator can still be set up (sharded
+ * for instance), ga_evaluate must be called before the first ga_step.
+ *
+ * @param config The settings of the run.
+ * @param dataset The dataset holding every gene.
+ * @param train_genes The genes creatures are made of (borrowed).
+ * @param num_train_genes The number of training genes.
+ * @param test_genes The genes creatures are scored on (borrowed).
+ * @param num_test_genes The number of test genes.
+ * @param seed The seed of the GA's random numbers.
+ * @return A pointer to the newly allocated GA.
+ */
+GA* ga_init(const ga_config_t* config, Dataset* dataset, const int* train_genes, int num_train_genes, const int* test_genes, int num_test_genes, uint64_t seed) {
+    GA* ga = (GA*)calloc(1, sizeof(GA));
+    if (ga == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    if (num_train_genes <= 0 || config->population_size <= 0 || config->creature_size <= 0 || config->k <= 0) {
+        fprintf(stderr, GA_CONFIG_ERROR);
+        exit(1);
+    }
+
+    ga->config = *config;
+    ga->dataset = dataset;
+    ga->train_genes = train_genes;
+    ga->num_train_genes = num_train_genes;
+    ga->seed = seed;
+
+    ga->population = population_init(config->population_size, config->creature_size, 0);
+    ga->evaluator = evaluator_init(dataset, test_genes, num_test_genes, config->k);
+    evaluator_set_vote(ga->evaluator, config->vote);
+    ga->fitness = (double*)malloc(config->population_size * sizeof(double));
+    ga->next_fitness = (double*)malloc(config->population_size * sizeof(double));
+    ga->ranking = (ga_rank_t*)malloc(config->population_size * sizeof(ga_rank_t));
+    ga->rank_weights = (double*)malloc(config->population_size * sizeof(double));
+    if (ga->fitness == NULL || ga->next_fitness == NULL || ga->ranking == NULL || ga->rank_weights == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    //room for the bitsets of both generations when they are small enough
+    ga->bitset_words = bitset_words(dataset->num_genes);
+    if (2 * (size_t)config->population_size * ga->bitset_words * sizeof(uint64_t) <= GA_BITSET_BYTES) {
+        ga->bits = (uint64_t*)malloc((size_t)config->population_size * ga->bitset_words * sizeof(uint64_t));
+        ga->next_bits = (uint64_t*)malloc((size_t)config->population_size * ga->bitset_words * sizeof(uint64_t));
+        if (ga->bits == NULL || ga->next_bits == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+    }
+    //room for the KNN states of both generations, the bitsets tell how far a child is from its parents
+    size_t state_bytes = (size_t)num_test_genes * (config->k * sizeof(distance_intex_t) + 2 * sizeof(int));
+    if (config->incremental && ga->bits != NULL && config->vote == VOTE_MAJORITY && 2 * (size_t)config->population_size * state_bytes <= GA_STATE_BYTES) {
+        Creature test_creature = {(int*)test_genes, num_test_genes};
+        ga->states = (FitnessState**)malloc(config->population_size * sizeof(FitnessState*));
+        ga->next_states = (FitnessState**)malloc(config->population_size * sizeof(FitnessState*));
+        ga->state_valid = (uint8_t*)calloc(config->population_size, sizeof(uint8_t));
+        ga->next_state_valid = (uint8_t*)calloc(config->population_size, sizeof(uint8_t));
+        if (ga->states == NULL || ga->next_states == NULL || ga->state_valid == NULL || ga->next_state_valid == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        for (int c = 0; c < config->population_size; c++) {
+            ga->states[c] = fitness_init(dataset, NULL, &test_creature, config->k);
+            ga->next_states[c] = fitness_init(dataset, NULL, &test_creature, config->k);
+        }
+    }
+    if (config->memo_entries > 0) {
+        ga->memo = memo_init(config->memo_entries);
+    }
+    ga->duplicate_of = (int*)malloc(config->population_size * sizeof(int));
+    ga->memo_keys = (uint64_t*)calloc(config->population_size, sizeof(uint64_t));
+    if (ga->duplicate_of == NULL || ga->memo_keys == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    double weight = 0;
+    for (int i = 0; i < config->population_size; i++) {
+        weight += config->population_size - i;
+        ga->rank_weights[i] = weight;
+    }
+
+    //the training genes dealt out over the whole generation, as creature_fill deals the dataset
+    int groups = config->initial == INITIAL_GROUPS;
+    if (groups) {
+        TELEMETRY_SCOPE(TELEMETRY_FILL);
+        creature_deal(ga->population->current_list, config->population_size, train_genes, num_train_genes, seed);
+    }
+
+    #pragma omp parallel
+    {
+        TELEMETRY_SCOPE(TELEMETRY_FILL);
+        //partial shuffles of a private copy of the training genes, undone after every creature
+        int* shuffled = (int*)malloc(num_train_genes * sizeof(int));
+        int* picks = (int*)malloc(config->creature_size * sizeof(int));
+        if (shuffled == NULL || picks == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        memcpy(shuffled, train_genes, num_train_genes * sizeof(int));
+
+        #pragma omp for schedule(static)
+        for (int c = 0; c < config->population_size; c++) {
+            Creature* creature = ga->population->current_list[c];
+            if (groups) {
+                if (ga->bits != NULL) {
+                    creature_to_bitset(creature, ga->bits + (size_t)c * ga->bitset_words, ga->bitset_words);
+                }
+                continue;
+            }
+            rng_t rng = rng_stream(seed, RNG_INIT, 0, (uint32_t)c);
+            int used = creature->num_genes < num_train_genes ? creature->num_genes : num_train_genes;
+
+            for (int i = 0; i < used; i++) {
+                int j = i + (int)rng_below(&rng, (uint32_t)(num_train_genes - i));
+                picks[i] = j;
+                int swap = shuffled[i];
+                shuffled[i] = shuffled[j];
+                shuffled[j] = swap;
+            }
+            memcpy(creature->gene_indices, shuffled, used * sizeof(int));
+            //more genes than training genes, the rest repeat
+            for (int i = used; i < creature->num_genes; i++) {
+                creature->gene_indices[i] = random_gene(ga, &rng);
+            }
+
+            for (int i = used - 1; i >= 0; i--) {
+                int swap = shuffled[i];
+                shuffled[i] = shuffled[picks[i]];
+                shuffled[picks[i]] = swap;
+            }
+
+            if (ga->bits != NULL) {
+                creature_to_bitset(creature, ga->bits + (size_t)c * ga->bitset_words, ga->bitset_words);
+            }
+        }
+
+        free(shuffled);
+        free(picks);
+    }
+
+    return ga;
+}
+
+
+//orders (hash, creature) pairs by hash, then creature
+static int compare_hashes(const void* a, const void* b) {
+    const uint64_t* first = (const uint64_t*)a;
+    const uint64_t* second = (const uint64_t*)b;
+    if (first[0] != second[0]) {
+        return first[0] < second[0] ? -1 : 1;
+    }
+    return (first[1] > second[1]) - (first[1] < second[1]);
+}
+
+
+//O(p * words + p log p)
+//points every creature of the current generation at the first one with the same genes, -1 for none
+static void find_duplicates(GA* ga) {
+    int population_size = ga->config.population_size;
+    int words = ga->bitset_words;
+    for (int c = 0; c < population_size; c++) {
+        ga->duplicate_of[c] = -1;
+    }
+    if (ga->bits == NULL) {
+        return (void)0;
+    }
+
+    //hash every bitset, only creatures without repeated genes are identical to one with the same bits
+    uint64_t* hashes = (uint64_t*)malloc(2 * population_size * sizeof(uint64_t));
+    if (hashes == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    int num_hashes = 0;
+    for (int c = 0; c < population_size; c++) {
+        const uint64_t* bits = ga->bits + (size_t)c * words;
+        if (bitset_count(bits, words) != (uint64_t)ga->population->current_list[c]->num_genes) {
+            continue;
+        }
+        uint64_t hash = 0x9E3779B97F4A7C15ull;
+        for (int w = 0; w < words; w++) {
+            hash = (hash ^ bits[w]) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 29;
+        }
+        hashes[2 * num_hashes] = hash;
+        hashes[2 * num_hashes + 1] = (uint64_t)c;
+        num_hashes++;
+    }
+    qsort(hashes, num_hashes, 2 * sizeof(uint64_t), compare_hashes);
+
+    //within a run of equal hashes every creature looks for an earlier one with the same bits, two
+    //creatures of n distinct genes hold the same genes when their bitsets share n of them
+    for (int i = 1; i < num_hashes; i++) {
+        int c = (int)hashes[2 * i + 1];
+        int num_genes = ga->population->current_list[c]->num_genes;
+        for (int j = i - 1; j >= 0 && hashes[2 * j] == hashes[2 * i]; j--) {
+            int other = (int)hashes[2 * j + 1];
+            if (ga->duplicate_of[other] < 0 && ga->population->current_list[other]->num_genes == num_genes
+                && bitset_and_count(ga->bits + (size_t)c * words, ga->bits + (size_t)other * words, words) == (uint64_t)num_genes) {
+                ga->duplicate_of[c] = other;
+            }
+        }
+    }
+
+    free(hashes);
+    return (void)0;
+}
+
+
+//O(1)
+//whether the evaluator can keep the KNN states this run: they hold the whole test set and exact lists,
+//so not for a sharded test set, a streamed run, the IVF search (which may miss neighbors) or a float16
+//distance cache (whose rounded distances the updates would mix with exact ones)
+static int states_usable(const GA* ga) {
+    const Evaluator* evaluator = ga->evaluator;
+    return ga->states != NULL && evaluator->streamed.stream == NULL && evaluator->num_test_genes == evaluator->total_test_genes
+        && (evaluator->search == NULL || evaluator->search->centroids == NULL)
+        && (evaluator->cache == NULL || evaluator->cache->mode != CACHE_MATRIX_F16);
+}
+
+
+//O(1)
+//skips the creatures ga_evaluate found a duplicate of (an evaluator_prepare_t)
+static int score_unique(void* context, int c, int thread) {
+    (void)thread;
+    GA* ga = (GA*)context;
+    return ga->duplicate_of[c] < 0;
+}
+
+
+//O(p * MEMO_WAYS)
+//adds the creatures a run scored to the memo, in creature order so every run (and every shard rank) fills it the same
+static void memo_remember(GA* ga, const double* fitness) {
+    if (ga->memo == NULL) {
+        return (void)0;
+    }
+    for (int c = 0; c < ga->config.population_size; c++) {
+        if (ga->memo_keys[c] != 0) {
+            memo_insert(ga->memo, ga->memo_keys[c], fitness[c]);
+        }
+    }
+    return (void)0;
+}
+
+
+//O(p * t * |creature| * d / threads)
+/**
+ * Scores and ranks the current generation. Creatures with the same genes as
+ * another one are scored once, and the scored ones are remembered by the memo.
+ *
+ * @param ga The GA to score.
+ */
+void ga_evaluate(GA* ga) {
+    find_duplicates(ga);
+    int keep_states = states_usable(ga);
+    evaluator_set_states(ga->evaluator, keep_states ? ga->states : NULL);
+    evaluator_run_fused(ga->evaluator, ga->population->current_list, ga->config.population_size, ga->fitness, score_unique, ga);
+    evaluator_set_states(ga->evaluator, NULL);
+
+    ga->num_reused = 0;
+    for (int c = 0; c < ga->config.population_size; c++) {
+        if (ga->duplicate_of[c] >= 0) {
+            ga->fitness[c] = ga->fitness[ga->duplicate_of[c]];
+            if (keep_states) {
+                fitness_copy(ga->states[c], ga->states[ga->duplicate_of[c]]);
+            }
+            ga->num_reused++;
+        }
+    }
+    if (ga->states != NULL) {
+        memset(ga->state_valid, keep_states, ga->config.population_size * sizeof(uint8_t));
+    }
+    ga->total_reused += ga->num_reused;
+
+    if (ga->memo != NULL) {
+        for (int c = 0; c < ga->config.population_size; c++) {
+            const Creature* creature = ga->population->current_list[c];
+            ga->memo_keys[c] = ga->duplicate_of[c] < 0 ? memo_key(creature->gene_indices, creature->num_genes) : 0;
+        }
+        memo_remember(ga, ga->fitness);
+    }
+
+    ga_rank(ga);
+    return (void)0;
+}
+
+
+//O(p log p)
+/**
+ * Ranks the current generation by fitness, best first.
+ *
+ * @param ga The GA to rank.
+ */
+void ga_rank(GA* ga) {
+    for (int c = 0; c < ga->config.population_size; c++) {
+        ga->ranking[c].fitness = ga->fitness[c];
+        ga->ranking[c].index = c;
+    }
+    qsort(ga->ranking, ga->config.population_size, sizeof(ga_rank_t), compare_ranks);
+    return (void)0;
+}
+
+
+//O(n)
+//makes room for the breeding scratch of num_threads threads
+static void threads_reserve(GA* ga, int num_threads) {
+    if (num_threads <= ga->num_threads) {
+        return (void)0;
+    }
+
+    ga->threads = (ga_thread_t*)realloc(ga->threads, num_threads * sizeof(ga_thread_t));
+    if (ga->threads == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    //a power of two at least twice the creature size keeps the probes short
+    int set_size = 16;
+    while (set_size < 2 * ga->config.creature_size) {
+        set_size *= 2;
+    }
+    for (int t = ga->num_threads; t < num_threads; t++) {
+        ga->threads[t].set = (int*)malloc(set_size * sizeof(int));
+        ga->threads[t].set_size = set_size;
+        ga->threads[t].genes = (int*)malloc(ga->config.creature_size * sizeof(int));
+        ga->threads[t].positions = (int*)malloc(ga->config.creature_size * sizeof(int));
+        ga->threads[t].added = (int*)malloc(ga->config.creature_size * sizeof(int));
+        if (ga->threads[t].set == NULL || ga->threads[t].genes == NULL || ga->threads[t].positions == NULL || ga->threads[t].added == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+    }
+    ga->num_threads = num_threads;
+
+    return (void)0;
+}
+
+
+//O(1) expected
+//adds a gene to a thread's set, returns 0 if it was already there
+static inline int set_insert(ga_thread_t* scratch, int gene) {
+    int mask = scratch->set_size - 1;
+    int slot = (int)(((uint32_t)gene * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (scratch->set[slot] >= 0) {
+        if (scratch->set[slot] == gene) {
+            return 0;
+        }
+        slot = (slot + 1) & mask;
+    }
+    scratch->set[slot] = gene;
+    return 1;
+}
+
+
+//O(tournament_size) or O(log p)
+//picks a parent from the current generation and returns its index
+static int select_parent(GA* ga, rng_t* rng) {
+    int population_size = ga->config.population_size;
+    TELEMETRY_COUNT(TELEMETRY_SELECTIONS, 1);
+
+    if (ga->config.selection == SELECTION_RANK) {
+        //the first rank whose cumulative weight passes a uniform draw
+        double target = rng_uniform(rng) * ga->rank_weights[population_size - 1];
+        int low = 0;
+        int high = population_size - 1;
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (ga->rank_weights[middle] > target) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return ga->ranking[low].index;
+    }
+
+    int best = (int)rng_below(rng, (uint32_t)population_size);
+    for (int i = 1; i < ga->config.tournament_size; i++) {
+        int challenger = (int)rng_below(rng, (uint32_t)population_size);
+        if (ga->fitness[challenger] > ga->fitness[best]) {
+            best = challenger;
+        }
+    }
+    return best;
+}
+
+
+//tries at a random training gene before a child searches the training genes for one it lacks
+#define GA_REPAIR_TRIES 8
+
+
+//O(m * t * d + affected * |creature| * d)
+//scores child c from the state of a parent it shares all but m of its genes with: a copy of the
+//parent's state takes the m swaps (see fitness_mutate). returns 0 without touching the child's state
+//when the genes the parent loses and those the child gains don't pair up (a parent with repeats)
+static int score_from_parent(GA* ga, ga_thread_t* scratch, int c, int parent_index) {
+    Creature* child = ga->population->next_list[c];
+    Creature* parent = ga->population->current_list[parent_index];
+    int words = ga->bitset_words;
+    const uint64_t* child_bits = ga->next_bits + (size_t)c * words;
+    const uint64_t* parent_bits = ga->bits + (size_t)parent_index * words;
+
+    int num_removed = 0;
+    for (int i = 0; i < parent->num_genes; i++) {
+        if (!bitset_test(child_bits, parent->gene_indices[i])) {
+            scratch->positions[num_removed++] = i;
+        }
+    }
+    int num_added = 0;
+    for (int i = 0; i < child->num_genes && num_added < parent->num_genes; i++) {
+        if (!bitset_test(parent_bits, child->gene_indices[i])) {
+            scratch->added[num_added++] = child->gene_indices[i];
+        }
+    }
+    if (num_added != num_removed) {
+        return 0;
+    }
+
+    FitnessState* state = ga->next_states[c];
+    fitness_copy(state, ga->states[parent_index]);
+    memcpy(scratch->genes, parent->gene_indices, parent->num_genes * sizeof(int));
+    Creature working = {scratch->genes, parent->num_genes};
+    for (int i = 0; i < num_added; i++) {
+        fitness_mutate(state, &working, scratch->positions[i], scratch->added[i]);
+    }
+    ga->next_fitness[c] = fitness_value(state);
+    ga->next_state_valid[c] = 1;
+    __atomic_fetch_add(&ga->num_incremental, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+
+//O(|creature|)
+/**
+ * Breeds child number c of the next generation (an evaluator_prepare_t).
+ *
+ * The first elite children copy the best creatures. Every other child picks
+ * two parents and takes each gene from one of them, then mutates it. A gene
+ * the child already holds is swapped for the other parent's gene at that
+ * position or a training gene it lacks, so a child keeps its whole budget of
+ * distinct genes (unless it is larger than the training set). The child draws
+ * from its own stream, so it is the same whichever thread breeds it and
+ * whenever.
+ *
+ * An elite child is a copy of a scored creature and so is a child that ends
+ * up with exactly the genes of one of its parents (its bitset equals the
+ * parent's), their fitness is copied instead of scored. So is a child whose
+ * genes the memo has seen in an earlier generation (same genes and repeats,
+ * any order). A child with a creature's genes in another order scores the
+ * same unless two neighbors are at exactly the same distance.
+ *
+ * @return 1 when the child has to be scored, 0 when its fitness was copied.
+ */
+static int breed_child(void* context, int c, int thread) {
+    TELEMETRY_SCOPE(TELEMETRY_BREED);
+    GA* ga = (GA*)context;
+    ga_config_t* config = &ga->config;
+    Population* population = ga->population;
+    Creature* child = population->next_list[c];
+    int words = ga->bitset_words;
+    int elite = config->elite < config->population_size ? config->elite : config->population_size;
+
+    int keep_states = ga->evaluator->states != NULL;
+
+    if (c < elite) {
+        int parent = ga->ranking[c].index;
+        memcpy(child->gene_indices, population->current_list[parent]->gene_indices, child->num_genes * sizeof(int));
+        if (ga->bits != NULL) {
+            memcpy(ga->next_bits + (size_t)c * words, ga->bits + (size_t)parent * words, words * sizeof(uint64_t));
+        }
+        if (keep_states && ga->state_valid[parent]) {
+            fitness_copy(ga->next_states[c], ga->states[parent]);
+            ga->next_state_valid[c] = 1;
+        }
+        ga->next_fitness[c] = ga->fitness[parent];
+        ga->memo_keys[c] = 0;
+        return 0;
+    }
+
+    ga_thread_t* scratch = &ga->threads[thread];
+    memset(scratch->set, 0xff, scratch->set_size * sizeof(int));
+
+    rng_t rng = rng_stream(ga->seed, RNG_BREED, (uint32_t)ga->generation + 1, (uint32_t)c);
+    int mother_index = select_parent(ga, &rng);
+    int father_index = select_parent(ga, &rng);
+    Creature* mother = population->current_list[mother_index];
+    Creature* father = population->current_list[father_index];
+
+    for (int i = 0; i < child->num_genes; i++) {
+        //one draw gives the parent (top bit) and the mutation roll (the rest)
+        uint64_t bits = rng_next(&rng);
+        int gene = (bits >> 63) ? mother->gene_indices[i] : father->gene_indices[i];
+        if ((double)(bits & ((1ull << 53) - 1)) * 0x1p-53 < config->mutation_rate) {
+            gene = random_gene(ga, &rng);
+        }
+
+        if (!set_insert(scratch, gene)) {
+            int other = (bits >> 63) ? father->gene_indices[i] : mother->gene_indices[i];
+            if (set_insert(scratch, other)) {
+                gene = other;
+            } else {
+                int repaired = 0;
+                for (int attempt = 0; attempt < GA_REPAIR_TRIES && !repaired; attempt++) {
+                    int candidate = random_gene(ga, &rng);
+                    if (set_insert(scratch, candidate)) {
+                        gene = candidate;
+                        repaired = 1;
+                    }
+                }
+                //a nearly full child walks the training genes from a random one
+                int first = (int)rng_below(&rng, (uint32_t)ga->num_train_genes);
+                for (int j = 0; j < ga->num_train_genes && !repaired; j++) {
+                    int candidate = ga->train_genes[(first + j) % ga->num_train_genes];
+                    if (set_insert(scratch, candidate)) {
+                        gene = candidate;
+                        repaired = 1;
+                    }
+                }
+            }
+        }
+        child->gene_indices[i] = gene;
+    }
+    ga->memo_keys[c] = 0;
+
+    //the parent the child shares the most genes with, and how many
+    int nearest = -1;
+    uint64_t nearest_overlap = 0;
+    if (ga->bits != NULL) {
+        uint64_t* child_bits = ga->next_bits + (size_t)c * words;
+        creature_to_bitset(child, child_bits, words);
+        //a child sharing all its genes with a parent of as many genes is that parent
+        if (bitset_count(child_bits, words) == (uint64_t)child->num_genes) {
+            int parents[2] = {mother_index, father_index};
+            for (int p = 0; p < 2; p++) {
+                Creature* parent = population->current_list[parents[p]];
+                if (parent->num_genes != child->num_genes) {
+                    continue;
+                }
+                uint64_t overlap = bitset_and_count(child_bits, ga->bits + (size_t)parents[p] * words, words);
+                if (overlap == (uint64_t)child->num_genes) {
+                    if (keep_states && ga->state_valid[parents[p]]) {
+                        fitness_copy(ga->next_states[c], ga->states[parents[p]]);
+                        ga->next_state_valid[c] = 1;
+                    }
+                    ga->next_fitness[c] = ga->fitness[parents[p]];
+                    return 0;
+                }
+                if (overlap > nearest_overlap) {
+                    nearest = parents[p];
+                    nearest_overlap = overlap;
+                }
+            }
+        }
+    }
+
+    if (ga->memo != NULL) {
+        uint64_t key = memo_key(child->gene_indices, child->num_genes);
+        if (memo_lookup(ga->memo, key, &ga->next_fitness[c])) {
+            return 0;
+        }
+        ga->memo_keys[c] = key;
+    }
+
+    //a child a few genes away from a parent (mostly one that only mutated) updates the parent's state
+    if (keep_states && nearest >= 0 && ga->state_valid[nearest]
+        && (child->num_genes - nearest_overlap) * GA_INCREMENTAL_SHARE <= (uint64_t)child->num_genes
+        && score_from_parent(ga, &ga->threads[thread], c, nearest)) {
+        return 0;
+    }
+    if (keep_states) {
+        ga->next_state_valid[c] = 1;
+    }
+    return 1;
+}
+
+
+//O(p * t * |creature| * d / threads)
+/**
+ * Breeds the next generation, scores it and makes it the current one.
+ *
+ * Breeding and scoring are one parallel pass (see evaluator_run_fused): a
+ * child is bred by the thread that scores it, right before, so threads score
+ * the first children while the last are still being bred. Selection only
+ * reads the current generation, which is fully scored, so a generation only
+ * depends on the seed. The time of every phase lands in ga->timing. Nothing
+ * is allocated once the thread count is stable.
+ *
+ * @param ga The GA to advance.
+ */
+void ga_step(GA* ga) {
+    Population* population = ga->population;
+    double start = omp_get_wtime();
+
+    threads_reserve(ga, omp_get_max_threads());
+    if (ga->states != NULL) {
+        memset(ga->next_state_valid, 0, ga->config.population_size * sizeof(uint8_t));
+    }
+    evaluator_set_states(ga->evaluator, states_usable(ga) ? ga->next_states : NULL);
+    ga->num_incremental = 0;
+    evaluator_run_fused(ga->evaluator, population->next_list, ga->config.population_size, ga->next_fitness, breed_child, ga);
+    evaluator_set_states(ga->evaluator, NULL);
+    memo_remember(ga, ga->next_fitness);
+
+    population_swap(population);
+    double* fitness = ga->fitness;
+    ga->fitness = ga->next_fitness;
+    ga->next_fitness = fitness;
+    uint64_t* bits = ga->bits;
+    ga->bits = ga->next_bits;
+    ga->next_bits = bits;
+    FitnessState** states = ga->states;
+    ga->states = ga->next_states;
+    ga->next_states = states;
+    uint8_t* state_valid = ga->state_valid;
+    ga->state_valid = ga->next_state_valid;
+    ga->next_state_valid = state_valid;
+    //the children scored from a parent's state are skipped by the evaluator too
+    ga->num_reused = ga->evaluator->num_skipped - ga->num_incremental;
+    ga->total_reused += ga->num_reused;
+    ga->total_incremental += ga->num_incremental;
+
+    double rank_start = omp_get_wtime();
+    ga_rank(ga);
+    ga->generation++;
+
+    double end = omp_get_wtime();
+    ga->timing.breed = ga->evaluator->prepare_seconds;
+    ga->timing.evaluate = ga->evaluator->task_seconds;
+    ga->timing.rank = end - rank_start;
+    ga->timing.wall = end - start;
+    ga->total_timing.breed += ga->timing.breed;
+    ga->total_timing.evaluate += ga->timing.evaluate;
+    ga->total_timing.rank += ga->timing.rank;
+    ga->total_timing.wall += ga->timing.wall;
+
+    return (void)0;
+}
+
+
+//O(|creature|)
+/**
+ * Overwrites a creature of the current generation (an immigrant from another
+ * island) whose fitness is already known. The ranking is not updated, the
+ * memo remembers the creature.
+ *
+ * @param ga The GA.
+ * @param index The creature to overwrite.
+ * @param gene_indices The new creature's genes (creature_size of them).
+ * @param fitness The new creature's fitness.
+ */
+void ga_replace(GA* ga, int index, const int* gene_indices, double fitness) {
+    Creature* creature = ga->population->current_list[index];
+    memcpy(creature->gene_indices, gene_indices, creature->num_genes * sizeof(int));
+    if (ga->bits != NULL) {
+        creature_to_bitset(creature, ga->bits + (size_t)index * ga->bitset_words, ga->bitset_words);
+    }
+    ga->fitness[index] = fitness;
+    if (ga->states != NULL) {
+        ga->state_valid[index] = 0;
+    }
+    if (ga->memo != NULL) {
+        memo_insert(ga->memo, memo_key(gene_indices, creature->num_genes), fitness);
+    }
+    return (void)0;
+}
+
+
+/**
+ * Frees a GA and all of its associated memory.
+ *
+ * @param ga The GA to be freed.
+ */
+void ga_free(GA* ga) {
+    population_free(ga->population);
+    evaluator_free(ga->evaluator);
+    for (int t = 0; t < ga->num_threads; t++) {
+        free(ga->threads[t].set);
+        free(ga->threads[t].genes);
+        free(ga->threads[t].positions);
+        free(ga->threads[t].added);
+    }
+    if (ga->states != NULL) {
+        for (int c = 0; c < ga->config.population_size; c++) {
+            fitness_free(ga->states[c]);
+            fitness_free(ga->next_states[c]);
+        }
+    }
+    free(ga->states);
+    free(ga->next_states);
+    free(ga->state_valid);
+    free(ga->next_state_valid);
+    free(ga->threads);
+    free(ga->fitness);
+    free(ga->next_fitness);
+    free(ga->ranking);
+    free(ga->rank_weights);
+    free(ga->bits);
+    free(ga->next_bits);
+    free(ga->duplicate_of);
+    free(ga->memo_keys);
+    if (ga->memo != NULL) {
+        memo_free(ga->memo);
+    }
+    free(ga);
+    return (void)0;
+}
@@ -0,0 +1,166 @@
+#ifndef GM_ROUTINE_H
+#define GM_ROUTINE_H
+
+#include <stdint.h>
+#include "gm_dataset.h"
+#include "gm_vote.h"
+#include "gm_memo.h"
+
+//the genetic algorithm: a population of creatures (subsets of the training genes) is scored by the
+//KNN accuracy they give on the test genes, the best survive as they are and the rest of the next
+//generation is bred by selection, uniform crossover and point mutation. a generation is one fused
+//parallel pass, every child is bred right before it is scored by the thread that scores it
+
+//defined by gm_population.h, gm_evaluator.h and gm_fitness.h
+typedef struct Population Population;
+typedef struct Evaluator Evaluator;
+typedef struct FitnessState FitnessState;
+
+//how parents are picked
+typedef enum ga_selection_t {
+    //the fittest of tournament_size random creatures
+    SELECTION_TOURNAMENT,
+    //linear ranking, the i-th best of p creatures is picked with weight p - i
+    SELECTION_RANK
+} ga_selection_t;
+
+//how the first generation is drawn
+typedef enum ga_initial_t {
+    //every creature is a random subset of the training genes
+    INITIAL_RANDOM,
+    //the training genes are shuffled and dealt out in turn, every one lands in a creature before any
+    //repeats (what PYTHON_SCRIPTS/assign_groups.py did to the csv)
+    INITIAL_GROUPS
+} ga_initial_t;
+
+//settings of a run
+typedef struct ga_config_t {
+    int population_size;
+    int creature_size;
+    int k;
+    int generations;
+    ga_selection_t selection;
+    //chance that a gene of a child is replaced by a random training gene
+    double mutation_rate;
+    int tournament_size;
+    //best creatures copied unchanged into the next generation
+    int elite;
+    //how the k neighbors vote
+    vote_weighting_t vote;
+    //fitnesses remembered across generations, 0 for none
+    int memo_entries;
+    ga_initial_t initial;
+    //1 to score a child that is a few genes away from a parent from the parent's KNN state, 0 to
+    //score every child from scratch
+    int incremental;
+} ga_config_t;
+
+//the population's bitsets (both generations) are only kept up to this many bytes
+#define GA_BITSET_BYTES ((size_t)64 << 20)
+//the KNN states of both generations are only kept up to this many bytes
+#define GA_STATE_BYTES ((size_t)256 << 20)
+//a child is scored from a parent's state when at most 1 / GA_INCREMENTAL_SHARE of its genes differ,
+//past that the updates cost more than scoring it (see bench_incremental)
+#define GA_INCREMENTAL_SHARE 16
+
+//a creature's place in the ranking of a generation
+typedef struct ga_rank_t {
+    double fitness;
+    int index;
+} ga_rank_t;
+
+//where the time of a generation goes, breed and evaluate are summed over the threads
+typedef struct ga_timing_t {
+    double breed;
+    double evaluate;
+    double rank;
+    double wall;
+} ga_timing_t;
+
+//one thread's breeding scratch, a hash set of the genes of the child being bred, and for a child
+//scored from its parent's state the parent's genes as they turn into the child's, the positions that
+//change and the genes they take
+typedef struct ga_thread_t {
+    int* set;
+    int* genes;
+    int* positions;
+    int* added;
+    int set_size;
+    char pad[64 - 4 * sizeof(int*) - sizeof(int)];
+} ga_thread_t;
+
+typedef struct GA {
+    ga_config_t config;
+    Dataset* dataset;
+    const int* train_genes;
+    int num_train_genes;
+
+    Population* population;
+    Evaluator* evaluator;
+    //fitness of the current generation and its ranking, best first
+    double* fitness;
+    ga_rank_t* ranking;
+    //fitness of the generation being bred
+    double* next_fitness;
+    //rank selection: cumulative weight of the first i + 1 ranks
+    double* rank_weights;
+
+    //every creature of both generations as a bitset over the gene space, bitset_words words each,
+    //NULL when that would take more than GA_BITSET_BYTES. they spot creatures that are copies of
+    //scored ones, so those are scored once
+    uint64_t* bits;
+    uint64_t* next_bits;
+    int bitset_words;
+    //ga_evaluate: the first creature each creature is identical to, -1 for none
+    int* duplicate_of;
+    //creatures whose fitness was copied instead of scored, last generation and over the run
+    int num_reused;
+    long long total_reused;
+
+    //every creature's KNN state in both generations, NULL when config.incremental is 0, without
+    //bitsets, for a distance weighted vote or when they would take more than GA_STATE_BYTES. a child
+    //a few genes away from a parent is scored by updating a copy of the parent's state
+    FitnessState** states;
+    FitnessState** next_states;
+    //whether a creature's state is filled (not for one whose fitness came from the memo or another island)
+    uint8_t* state_valid;
+    uint8_t* next_state_valid;
+    //children scored from a parent's state, last generation and over the run
+    int num_incremental;
+    long long total_incremental;
+
+    //the fitness of creatures scored in earlier generations, NULL when config.memo_entries is 0.
+    //children look it up while they are bred (from any thread), the creatures a run scored are
+    //added after it in creature order, so what it holds only depends on the seed
+    FitnessMemo* memo;
+    //the memo key of every child the last run scored, 0 for the ones it didn't
+    uint64_t* memo_keys;
+
+    ga_thread_t* threads;
+    int num_threads;
+
+    //every random choice is drawn from a counter based stream of this seed (see gm_rng)
+    uint64_t seed;
+    int generation;
+
+    //the last generation's times and the sums over every generation
+    ga_timing_t timing;
+    ga_timing_t total_timing;
+} GA;
+
+
+//GA functions
+void ga_default_config(ga_config_t* config);
+GA* ga_init(const ga_config_t* config, Dataset* dataset, const int* train_genes, int num_train_genes, const int* test_genes, int num_test_genes, uint64_t seed);
+void ga_evaluate(GA* ga);
+void ga_rank(GA* ga);
+void ga_step(GA* ga);
+void ga_replace(GA* ga, int index, const int* gene_indices, double fitness);
+void ga_free(GA* ga);
+
+//selection names (tournament, rank)
+int ga_selection_from_name(const char* name, ga_selection_t* selection);
+//first generation names (random, groups)
+int ga_initial_from_name(const char* name, ga_initial_t* initial);
+
+#endif
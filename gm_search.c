@@ -0,0 +1,545 @@
+#include "gm_search.h"
+#include "gm_distance.h"
+#include "gm_topk.h"
+#include "gm_rng.h"
+#include "gm_telemetry.h"
+#include "errors.h"
+
+#include <math.h>
+
+
+static const char* search_names[] = {"exact", "ivf", "kdtree", "auto"};
+#define NUM_SEARCHES ((int)(sizeof(search_names) / sizeof(search_names[0])))
+
+
+//O(1)
+/**
+ * Looks up a search backend by name.
+ *
+ * @param name The name (exact, ivf, kdtree or auto).
+ * @param kind Set to the backend when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int search_kind_from_name(const char* name, search_kind_t* kind) {
+    for (int i = 0; i < NUM_SEARCHES; i++) {
+        if (strcmp(name, search_names[i]) == 0) {
+            *kind = (search_kind_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//O(1)
+/**
+ * Empties a search scratch, nothing is allocated until the first batch.
+ *
+ * @param scratch The scratch to initialize.
+ */
+void search_scratch_init(search_scratch_t* scratch) {
+    memset(scratch, 0, sizeof(search_scratch_t));
+    batch_scratch_init(&scratch->batch);
+    return (void)0;
+}
+
+
+/**
+ * Frees the buffers of a search scratch.
+ *
+ * @param scratch The scratch to release.
+ */
+void search_scratch_free(search_scratch_t* scratch) {
+    batch_scratch_free(&scratch->batch);
+    free(scratch->member_starts);
+    free(scratch->member_genes);
+    free(scratch->query);
+    free(scratch->lists);
+    free(scratch->heap_distance);
+    free(scratch->heap_index);
+    free(scratch->node_counts);
+    memset(scratch, 0, sizeof(search_scratch_t));
+    return (void)0;
+}
+
+
+//O(1) amortized
+//grows a scratch for a batch whose members go in num_buckets buckets, the buffers only grow
+static void scratch_reserve(search_scratch_t* scratch, const NeighborSearch* search, int num_buckets, int num_members, int k) {
+    int failed = 0;
+    if (num_members > scratch->members_capacity) {
+        free(scratch->member_genes);
+        scratch->member_genes = (int*)malloc(num_members * sizeof(int));
+        scratch->members_capacity = num_members;
+        failed |= scratch->member_genes == NULL;
+    }
+    if (num_buckets > scratch->lists_capacity) {
+        free(scratch->member_starts);
+        free(scratch->lists);
+        scratch->member_starts = (int*)malloc((num_buckets + 1) * sizeof(int));
+        scratch->lists = (distance_intex_t*)malloc(num_buckets * sizeof(distance_intex_t));
+        scratch->lists_capacity = num_buckets;
+        failed |= scratch->member_starts == NULL || scratch->lists == NULL;
+    }
+    if (search->dataset->padded_features > scratch->query_capacity) {
+        free(scratch->query);
+        scratch->query = (float*)aligned_alloc(DATASET_ALIGNMENT, search->dataset->padded_features * sizeof(float));
+        scratch->query_capacity = search->dataset->padded_features;
+        failed |= scratch->query == NULL;
+    }
+    if (k > scratch->heap_capacity) {
+        free(scratch->heap_distance);
+        free(scratch->heap_index);
+        scratch->heap_distance = (float*)malloc(k * sizeof(float));
+        scratch->heap_index = (int*)malloc(k * sizeof(int));
+        scratch->heap_capacity = k;
+        failed |= scratch->heap_distance == NULL || scratch->heap_index == NULL;
+    }
+    if (search->tree != NULL && search->tree->num_nodes > scratch->nodes_capacity) {
+        free(scratch->node_counts);
+        scratch->node_counts = (int*)malloc(search->tree->num_nodes * sizeof(int));
+        scratch->nodes_capacity = search->tree->num_nodes;
+        failed |= scratch->node_counts == NULL;
+    }
+    if (failed) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    return (void)0;
+}
+
+
+//O(|members| + buckets)
+//groups a batch's members by bucket (a counting sort), member_starts[b] is where bucket b's members start
+static void bucket_members(search_scratch_t* scratch, const int* bucket_of, int num_buckets, const int* members, int num_members) {
+    int* starts = scratch->member_starts;
+    memset(starts, 0, (num_buckets + 1) * sizeof(int));
+    for (int m = 0; m < num_members; m++) {
+        starts[bucket_of[members[m]] + 1]++;
+    }
+    for (int b = 0; b < num_buckets; b++) {
+        starts[b + 1] += starts[b];
+    }
+    for (int m = 0; m < num_members; m++) {
+        scratch->member_genes[starts[bucket_of[members[m]]]++] = members[m];
+    }
+    for (int b = num_buckets; b > 0; b--) {
+        starts[b] = starts[b - 1];
+    }
+    starts[0] = 0;
+    return (void)0;
+}
+
+
+//O(1)
+//a query's features as floats, decoded into the scratch for compact storage
+static inline const float* query_row(const Dataset* dataset, int query, search_scratch_t* scratch) {
+    if (dataset->storage == STORAGE_F32) {
+        return dataset_row(dataset, query);
+    }
+    dataset_decode_row(dataset, query, scratch->query);
+    return scratch->query;
+}
+
+
+//O(q * |members| * d)
+//the exact backend is the batch engine
+static void exact_knn(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch) {
+    batch_knn_serial(search->dataset, queries, num_queries, members, num_members, k, neighbors, &scratch->batch);
+    return (void)0;
+}
+
+
+static void exact_free(NeighborSearch* search) {
+    free(search);
+    return (void)0;
+}
+
+
+static const search_ops_t exact_ops = {"exact", exact_knn, exact_free};
+
+
+//O(1)
+/**
+ * Allocates the exact search backend (the batch engine).
+ *
+ * @param dataset The dataset holding every gene.
+ * @return A pointer to the newly allocated search.
+ */
+NeighborSearch* search_exact_init(Dataset* dataset) {
+    NeighborSearch* search = (NeighborSearch*)calloc(1, sizeof(NeighborSearch));
+    if (search == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    search->ops = &exact_ops;
+    search->dataset = dataset;
+    return search;
+}
+
+
+//O(lists * d)
+//the list whose centroid is nearest to a decoded row
+static int nearest_list(const NeighborSearch* search, const float* row) {
+    int padded_features = search->dataset->padded_features;
+    int best = 0;
+    float best_distance = INFINITY;
+    for (int l = 0; l < search->num_lists; l++) {
+        float distance = distance_sq(row, search->centroids + (size_t)l * padded_features, padded_features);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = l;
+        }
+    }
+    return best;
+}
+
+
+//orders lists by ascending distance
+static int compare_lists(const void* a, const void* b) {
+    const distance_intex_t* first = (const distance_intex_t*)a;
+    const distance_intex_t* second = (const distance_intex_t*)b;
+    if (first->distance != second->distance) {
+        return first->distance < second->distance ? -1 : 1;
+    }
+    return first->index - second->index;
+}
+
+
+//O(q * (lists * d + probed members * d))
+/**
+ * IVF search over a creature's members.
+ *
+ * The members are bucketed by list once for the batch. Every query ranks the
+ * lists by centroid distance and scans the members of its num_probes nearest
+ * ones, and of further lists while that gives fewer than k members. A batch
+ * with no more members than lists is cheaper to scan whole, it goes to the
+ * batch engine.
+ */
+static void ivf_knn(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch) {
+    Dataset* dataset = search->dataset;
+    int num_lists = search->num_lists;
+    if (num_members <= num_lists) {
+        batch_knn_serial(dataset, queries, num_queries, members, num_members, k, neighbors, &scratch->batch);
+        return (void)0;
+    }
+    scratch_reserve(scratch, search, num_lists, num_members, k);
+    bucket_members(scratch, search->gene_list, num_lists, members, num_members);
+    const int* starts = scratch->member_starts;
+
+    int num_probes = search->num_probes < num_lists ? search->num_probes : num_lists;
+    for (int q = 0; q < num_queries; q++) {
+        int query = queries[q];
+        const float* row = query_row(dataset, query, scratch);
+
+        for (int l = 0; l < num_lists; l++) {
+            scratch->lists[l].distance = distance_sq(row, search->centroids + (size_t)l * dataset->padded_features, dataset->padded_features);
+            scratch->lists[l].index = l;
+        }
+        nth_element(scratch->lists, num_lists, num_probes - 1);
+
+        topk_t topk;
+        topk_init(&topk, k, scratch->heap_distance, scratch->heap_index);
+        int scanned = 0;
+        for (int p = 0; p < num_lists && (p < num_probes || scanned < k); p++) {
+            //too few members in the nearest lists, the rest are taken in order
+            if (p == num_probes) {
+                qsort(scratch->lists + p, num_lists - p, sizeof(distance_intex_t), compare_lists);
+            }
+            int list = scratch->lists[p].index;
+            for (int m = starts[list]; m < starts[list + 1]; m++) {
+                int gene = scratch->member_genes[m];
+                topk_push(&topk, distance_sq_rows(dataset, query, gene), gene);
+            }
+            scanned += starts[list + 1] - starts[list];
+        }
+        TELEMETRY_COUNT(TELEMETRY_DISTANCES, num_lists + scanned);
+        topk_sorted(&topk, neighbors + (size_t)q * k);
+    }
+
+    return (void)0;
+}
+
+
+static void ivf_free(NeighborSearch* search) {
+    free(search->centroids);
+    free(search->gene_list);
+    free(search->list_sizes);
+    free(search);
+    return (void)0;
+}
+
+
+static const search_ops_t ivf_ops = {"ivf", ivf_knn, ivf_free};
+
+
+//O(iterations * sample * lists * d + n * lists * d) / threads
+/**
+ * Builds an IVF index over every gene of a dataset.
+ *
+ * k-means runs SEARCH_IVF_ITERATIONS times over a random sample of
+ * SEARCH_IVF_SAMPLE rows per list (a list that ends up empty takes a sample
+ * row), then every gene is put in the list of its nearest centroid. The
+ * sample is drawn from a fixed seed, so the index only depends on the data.
+ * Compact storage is decoded for the build, the queries decode too.
+ *
+ * @param dataset The dataset holding every gene.
+ * @param num_lists The number of lists, 0 or less for the square root of the number of genes.
+ * @param num_probes The lists scanned per query (the recall/latency knob), 0 or less for SEARCH_IVF_PROBES.
+ * @return A pointer to the newly allocated search.
+ */
+NeighborSearch* search_ivf_init(Dataset* dataset, int num_lists, int num_probes) {
+    int num_genes = dataset->num_genes;
+    int padded_features = dataset->padded_features;
+    if (num_lists <= 0) {
+        num_lists = (int)sqrt((double)num_genes);
+    }
+    if (num_lists > num_genes) {
+        num_lists = num_genes;
+    }
+    if (num_lists < 1) {
+        num_lists = 1;
+    }
+
+    NeighborSearch* search = (NeighborSearch*)calloc(1, sizeof(NeighborSearch));
+    if (search == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    search->ops = &ivf_ops;
+    search->dataset = dataset;
+    search->num_lists = num_lists;
+    search->num_probes = num_probes > 0 ? num_probes : SEARCH_IVF_PROBES;
+
+    //a random sample of the rows, decoded
+    int num_samples = (long long)num_lists * SEARCH_IVF_SAMPLE < num_genes ? num_lists * SEARCH_IVF_SAMPLE : num_genes;
+    int* order = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    float* samples = (float*)aligned_alloc(DATASET_ALIGNMENT, ((size_t)num_samples * padded_features + DATASET_ROW_PAD) * sizeof(float));
+    int* assignment = (int*)malloc((num_samples > 0 ? num_samples : 1) * sizeof(int));
+    int* counts = (int*)malloc(num_lists * sizeof(int));
+    double* sums = (double*)malloc((size_t)num_lists * padded_features * sizeof(double));
+    search->centroids = (float*)aligned_alloc(DATASET_ALIGNMENT, (size_t)num_lists * padded_features * sizeof(float));
+    search->gene_list = (int*)malloc((num_genes > 0 ? num_genes : 1) * sizeof(int));
+    search->list_sizes = (int*)calloc(num_lists, sizeof(int));
+    if (order == NULL || samples == NULL || assignment == NULL || counts == NULL || sums == NULL || search->centroids == NULL || search->gene_list == NULL || search->list_sizes == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    rng_t rng = rng_stream(SEARCH_IVF_SEED, RNG_SEARCH, 0, 0);
+    rng_permutation(order, num_genes, &rng);
+    #pragma omp parallel for schedule(static)
+    for (int s = 0; s < num_samples; s++) {
+        dataset_decode_row(dataset, order[s], samples + (size_t)s * padded_features);
+    }
+
+    //k-means, starting from the first sample rows
+    memcpy(search->centroids, samples, (size_t)num_lists * padded_features * sizeof(float));
+    for (int iteration = 0; iteration < SEARCH_IVF_ITERATIONS; iteration++) {
+        #pragma omp parallel for schedule(static)
+        for (int s = 0; s < num_samples; s++) {
+            assignment[s] = nearest_list(search, samples + (size_t)s * padded_features);
+        }
+
+        memset(counts, 0, num_lists * sizeof(int));
+        memset(sums, 0, (size_t)num_lists * padded_features * sizeof(double));
+        for (int s = 0; s < num_samples; s++) {
+            double* sum = sums + (size_t)assignment[s] * padded_features;
+            const float* row = samples + (size_t)s * padded_features;
+            for (int f = 0; f < padded_features; f++) {
+                sum[f] += row[f];
+            }
+            counts[assignment[s]]++;
+        }
+
+        for (int l = 0; l < num_lists; l++) {
+            float* centroid = search->centroids + (size_t)l * padded_features;
+            if (counts[l] == 0) {
+                //an empty list restarts from a sample row
+                int s = (int)(((long long)iteration * num_lists + l) % num_samples);
+                memcpy(centroid, samples + (size_t)s * padded_features, padded_features * sizeof(float));
+                continue;
+            }
+            for (int f = 0; f < padded_features; f++) {
+                centroid[f] = (float)(sums[(size_t)l * padded_features + f] / counts[l]);
+            }
+        }
+    }
+
+    //every gene goes in its nearest list
+    #pragma omp parallel
+    {
+        float* decoded = (float*)aligned_alloc(DATASET_ALIGNMENT, padded_features * sizeof(float));
+        if (decoded == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < num_genes; i++) {
+            const float* row = decoded;
+            if (dataset->storage == STORAGE_F32) {
+                row = dataset_row(dataset, i);
+            } else {
+                dataset_decode_row(dataset, i, decoded);
+            }
+            search->gene_list[i] = nearest_list(search, row);
+        }
+
+        free(decoded);
+    }
+    for (int i = 0; i < num_genes; i++) {
+        search->list_sizes[search->gene_list[i]]++;
+    }
+
+    free(order);
+    free(samples);
+    free(assignment);
+    free(counts);
+    free(sums);
+
+    return search;
+}
+
+
+//O(q * log |members|) typical
+/**
+ * k-d tree search over a creature's members.
+ *
+ * The members are bucketed by leaf and counted under every node once for the
+ * batch, each query then descends the tree skipping the nodes without
+ * members or too far away. The result is exact. A batch against fewer than
+ * SEARCH_KDTREE_MEMBERS_PER_FEATURE members per feature goes to the batch
+ * engine, which is faster for small creatures.
+ */
+static void kdtree_knn(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch) {
+    Dataset* dataset = search->dataset;
+    KdTree* tree = search->tree;
+    if (num_members < (long long)SEARCH_KDTREE_MEMBERS_PER_FEATURE * dataset->num_features) {
+        batch_knn_serial(dataset, queries, num_queries, members, num_members, k, neighbors, &scratch->batch);
+        return (void)0;
+    }
+    scratch_reserve(scratch, search, tree->num_leaves, num_members, k);
+    bucket_members(scratch, tree->gene_leaf, tree->num_leaves, members, num_members);
+    kdtree_count(tree, scratch->member_starts, scratch->node_counts);
+
+    for (int q = 0; q < num_queries; q++) {
+        topk_t topk;
+        topk_init(&topk, k, scratch->heap_distance, scratch->heap_index);
+        kdtree_query(tree, query_row(dataset, queries[q], scratch), queries[q], scratch->node_counts, scratch->member_starts, scratch->member_genes, &topk);
+        topk_sorted(&topk, neighbors + (size_t)q * k);
+    }
+
+    return (void)0;
+}
+
+
+static void kdtree_search_free(NeighborSearch* search) {
+    kdtree_free(search->tree);
+    free(search);
+    return (void)0;
+}
+
+
+static const search_ops_t kdtree_ops = {"kdtree", kdtree_knn, kdtree_search_free};
+
+
+//O(n log n * d)
+/**
+ * Builds the exact k-d tree search backend over every gene of a dataset.
+ *
+ * @param dataset The dataset holding every gene.
+ * @return A pointer to the newly allocated search.
+ */
+NeighborSearch* search_kdtree_init(Dataset* dataset) {
+    NeighborSearch* search = (NeighborSearch*)calloc(1, sizeof(NeighborSearch));
+    if (search == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    search->ops = &kdtree_ops;
+    search->dataset = dataset;
+    search->tree = kdtree_init(dataset);
+    return search;
+}
+
+
+//O(1) or O(n log n * d)
+/**
+ * Picks the exact backend that suits a dataset: the k-d tree for at most
+ * SEARCH_KDTREE_MAX_FEATURES features and at least SEARCH_KDTREE_MIN_GENES
+ * genes, the batch engine otherwise. Both are exact.
+ *
+ * @param dataset The dataset holding every gene.
+ * @return A pointer to the newly allocated search.
+ */
+NeighborSearch* search_auto_init(Dataset* dataset) {
+    if (dataset->num_features <= SEARCH_KDTREE_MAX_FEATURES && dataset->num_genes >= SEARCH_KDTREE_MIN_GENES) {
+        return search_kdtree_init(dataset);
+    }
+    return search_exact_init(dataset);
+}
+
+
+/**
+ * Makes the search backend a run asked for through the environment.
+ *
+ * GM_SEARCH picks the backend: auto (the default, the k-d tree or the batch
+ * engine, see search_auto_init), exact, kdtree or ivf. For ivf GM_IVF_LISTS
+ * sets the number of lists and GM_IVF_PROBES the lists scanned per query,
+ * more probes give a higher recall and slower queries.
+ *
+ * @param dataset The dataset holding every gene.
+ * @return A pointer to the newly allocated search.
+ */
+NeighborSearch* search_from_env(Dataset* dataset) {
+    search_kind_t kind = SEARCH_AUTO;
+    const char* name = getenv("GM_SEARCH");
+    if (name != NULL && !search_kind_from_name(name, &kind)) {
+        fprintf(stderr, SEARCH_NAME_ERROR);
+        exit(1);
+    }
+    switch (kind) {
+        case SEARCH_EXACT:
+            return search_exact_init(dataset);
+        case SEARCH_KDTREE:
+            return search_kdtree_init(dataset);
+        case SEARCH_IVF: {
+            const char* lists = getenv("GM_IVF_LISTS");
+            const char* probes = getenv("GM_IVF_PROBES");
+            return search_ivf_init(dataset, lists != NULL ? atoi(lists) : 0, probes != NULL ? atoi(probes) : 0);
+        }
+        default:
+            return search_auto_init(dataset);
+    }
+}
+
+
+//O(backend)
+/**
+ * Finds the k nearest members of every query through a search backend.
+ *
+ * @param search The backend.
+ * @param queries The global indices of the query genes.
+ * @param num_queries The number of queries.
+ * @param members The global indices of the genes to search (a creature).
+ * @param num_members The number of members.
+ * @param k The number of neighbors per query.
+ * @param neighbors Output, k (distance, index) pairs per query sorted by ascending distance.
+ * @param scratch The calling thread's scratch.
+ */
+void search_knn(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch) {
+    search->ops->knn(search, queries, num_queries, members, num_members, k, neighbors, scratch);
+    return (void)0;
+}
+
+
+/**
+ * Frees a search backend and its index.
+ *
+ * @param search The search to be freed.
+ */
+void search_free(NeighborSearch* search) {
+    search->ops->free(search);
+    return (void)0;
+}
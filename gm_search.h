@@ -0,0 +1,99 @@
+#ifndef GM_SEARCH_H
+#define GM_SEARCH_H
+
+#include "gm_batch.h"
+#include "gm_kdtree.h"
+
+//pluggable neighbor search. a backend finds, for a batch of query genes, their k nearest genes among
+//a creature's members. the exact backend is the batch engine. the IVF backend (inverted file, flat)
+//clusters the whole gene matrix once with k-means, a query then only scans the members that fall in
+//its nprobe nearest clusters. the members are grouped by cluster once per batch, which is the
+//membership filter: a query never looks at a gene outside the creature. the k-d tree backend
+//(gm_kdtree) is exact and prunes with bounding boxes, it pays off when there are few features, auto
+//picks it or the batch engine from the shape of the dataset
+
+//lists probed per query when the run doesn't say
+#define SEARCH_IVF_PROBES 8
+//k-means iterations of the IVF build and sample points per list it trains on
+#define SEARCH_IVF_ITERATIONS 8
+#define SEARCH_IVF_SAMPLE 32
+//the seed of the IVF build's sample, fixed so the index only depends on the data
+#define SEARCH_IVF_SEED 0x5eed
+//auto uses the k-d tree up to this many features and from this many genes, below the tree's
+//pruning can't make up for its random access and the batch engine is faster
+#define SEARCH_KDTREE_MAX_FEATURES 16
+#define SEARCH_KDTREE_MIN_GENES 4096
+//the k-d tree sends a batch to the batch engine when it has fewer than this many members per feature,
+//a sparse creature leaves most of the boxes loose and the batch engine wins (see bench_kdtree)
+#define SEARCH_KDTREE_MEMBERS_PER_FEATURE 1024
+
+typedef enum search_kind_t {
+    SEARCH_EXACT,
+    SEARCH_IVF,
+    SEARCH_KDTREE,
+    SEARCH_AUTO
+} search_kind_t;
+
+//per thread buffers of a search, they only grow and can be reused across batches
+typedef struct search_scratch_t {
+    batch_scratch_t batch;
+    //the batch's members grouped by list (by leaf for the k-d tree)
+    int* member_starts;
+    int* member_genes;
+    int members_capacity;
+    int lists_capacity;
+    //a query's decoded row and its distance to every list
+    float* query;
+    int query_capacity;
+    distance_intex_t* lists;
+    float* heap_distance;
+    int* heap_index;
+    int heap_capacity;
+    //k-d tree: the batch's members under every node
+    int* node_counts;
+    int nodes_capacity;
+} search_scratch_t;
+
+typedef struct NeighborSearch NeighborSearch;
+
+//what a backend implements
+typedef struct search_ops_t {
+    const char* name;
+    void (*knn)(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch);
+    void (*free)(NeighborSearch* search);
+} search_ops_t;
+
+typedef struct NeighborSearch {
+    const search_ops_t* ops;
+    Dataset* dataset;
+
+    //IVF: num_lists centroids of padded_features floats, the lists probed per query
+    int num_lists;
+    int num_probes;
+    float* centroids;
+    //the list every gene fell in
+    int* gene_list;
+    int* list_sizes;
+
+    //k-d tree
+    KdTree* tree;
+} NeighborSearch;
+
+
+//NeighborSearch functions
+NeighborSearch* search_exact_init(Dataset* dataset);
+NeighborSearch* search_ivf_init(Dataset* dataset, int num_lists, int num_probes);
+NeighborSearch* search_kdtree_init(Dataset* dataset);
+NeighborSearch* search_auto_init(Dataset* dataset);
+NeighborSearch* search_from_env(Dataset* dataset);
+void search_knn(NeighborSearch* search, const int* queries, int num_queries, const int* members, int num_members, int k, distance_intex_t* neighbors, search_scratch_t* scratch);
+void search_free(NeighborSearch* search);
+
+//search_scratch_t functions
+void search_scratch_init(search_scratch_t* scratch);
+void search_scratch_free(search_scratch_t* scratch);
+
+//search names (exact, ivf, kdtree, auto)
+int search_kind_from_name(const char* name, search_kind_t* kind);
+
+#endif
@@ -0,0 +1,301 @@
+#include "gm_stream.h"
+#include "gm_binfile.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+
+
+//O(bytes)
+//reads size bytes at offset, exits on a short read (the file was checked when the stream opened)
+static void read_exactly(int file, void* data, size_t size, uint64_t offset) {
+    char* bytes = (char*)data;
+    while (size > 0) {
+        ssize_t got = pread(file, bytes, size, (off_t)offset);
+        if (got <= 0) {
+            fprintf(stderr, STREAM_READ_ERROR);
+            exit(1);
+        }
+        bytes += got;
+        size -= (size_t)got;
+        offset += (uint64_t)got;
+    }
+    return (void)0;
+}
+
+
+//O(blocks * block_rows * d)
+//the prefetch thread, reads the blocks of every pass into the buffers in order as they free up
+static void* prefetch(void* argument) {
+    GeneStream* stream = (GeneStream*)argument;
+    pthread_mutex_lock(&stream->lock);
+    while (!stream->quit) {
+        //block i goes to buffer i % STREAM_BUFFERS, which is free once the caller took the block after i - STREAM_BUFFERS
+        if (stream->pass_blocks == NULL || stream->num_read >= stream->pass_length
+            || stream->num_read >= stream->num_taken + STREAM_BUFFERS - 1) {
+            pthread_cond_wait(&stream->changed, &stream->lock);
+            continue;
+        }
+
+        int block = stream->pass_blocks[stream->num_read];
+        float* buffer = stream->buffers[stream->num_read % STREAM_BUFFERS];
+        stream->reading = 1;
+        pthread_mutex_unlock(&stream->lock);
+
+        int first = block * stream->block_rows;
+        int rows = stream->dataset->num_genes - first < stream->block_rows ? stream->dataset->num_genes - first : stream->block_rows;
+        size_t size = (size_t)rows * stream->row_bytes;
+        uint64_t offset = stream->features_offset + (uint64_t)first * stream->row_bytes;
+        read_exactly(stream->file, buffer, size, offset);
+        //the rows are in the buffer now, keeping them in the page cache too would only crowd out the rest
+        posix_fadvise(stream->file, (off_t)offset, (off_t)size, POSIX_FADV_DONTNEED);
+
+        pthread_mutex_lock(&stream->lock);
+        stream->reading = 0;
+        stream->num_read++;
+        stream->stats.num_blocks++;
+        stream->stats.bytes_read += (long long)size;
+        pthread_cond_broadcast(&stream->changed);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+
+//O(n + c)
+/**
+ * Opens a dataset out of core.
+ *
+ * The binary dataset file next to the csv (see gm_binfile, convert.out makes
+ * it without running the GA) must exist and match the csv. Its labels and
+ * class names are loaded into the dataset, its features are left in the file
+ * and the dataset's features stay NULL. The stream's buffers are sized so
+ * the labels, the buffers and what the caller reserves (see stream_reserve)
+ * fit in the budget.
+ *
+ * @param dataset The dataset to fill, without any classes yet.
+ * @param source_name The name of the csv file.
+ * @param budget The most bytes the stream may hold.
+ * @return A pointer to the newly allocated stream.
+ */
+GeneStream* stream_open(Dataset* dataset, const char* source_name, size_t budget) {
+    GeneStream* stream = (GeneStream*)calloc(1, sizeof(GeneStream));
+    if (stream == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+
+    binfile_header_t header;
+    char* file_name = binfile_name(source_name);
+    if (!binfile_load_meta(dataset, file_name, source_name, &header)) {
+        fprintf(stderr, STREAM_FILE_ERROR);
+        exit(1);
+    }
+    stream->file = open(file_name, O_RDONLY);
+    free(file_name);
+    if (stream->file < 0) {
+        fprintf(stderr, STREAM_FILE_ERROR);
+        exit(1);
+    }
+    posix_fadvise(stream->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    stream->dataset = dataset;
+    stream->features_offset = header.features_offset;
+    stream->row_bytes = (size_t)dataset->padded_features * sizeof(float);
+    stream->budget = budget;
+    stream_reserve(stream, 0);
+
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    if (pthread_create(&stream->thread, NULL, prefetch, stream) != 0) {
+        fprintf(stderr, STREAM_THREAD_ERROR);
+        exit(1);
+    }
+
+    return stream;
+}
+
+
+//O(1)
+/**
+ * Sizes a stream's blocks for what the caller keeps beside them.
+ *
+ * The blocks get as many rows as fit in the budget once the labels and
+ * resident_bytes are taken out of it, split over STREAM_BUFFERS buffers.
+ * The run exits when not even one row per buffer fits. Must not be called
+ * during a pass.
+ *
+ * @param stream The stream.
+ * @param resident_bytes The bytes the caller holds for as long as it streams.
+ */
+void stream_reserve(GeneStream* stream, size_t resident_bytes) {
+    int num_genes = stream->dataset->num_genes;
+    size_t fixed = (size_t)num_genes * sizeof(int) + resident_bytes;
+    size_t available = stream->budget > fixed ? stream->budget - fixed : 0;
+    size_t rows = available / (STREAM_BUFFERS * stream->row_bytes);
+    if (rows < 1) {
+        fprintf(stderr, MEMORY_BUDGET_ERROR);
+        exit(1);
+    }
+    if (rows > (size_t)num_genes) {
+        rows = num_genes > 0 ? (size_t)num_genes : 1;
+    }
+
+    stream->resident_bytes = resident_bytes;
+    if ((int)rows == stream->block_rows) {
+        return (void)0;
+    }
+    stream->block_rows = (int)rows;
+    stream->num_blocks = (num_genes + stream->block_rows - 1) / stream->block_rows;
+    for (int b = 0; b < STREAM_BUFFERS; b++) {
+        free(stream->buffers[b]);
+        stream->buffers[b] = (float*)aligned_alloc(DATASET_ALIGNMENT, rows * stream->row_bytes);
+        if (stream->buffers[b] == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+    }
+
+    return (void)0;
+}
+
+
+//O(genes * d)
+/**
+ * Reads a few rows straight from the file (the test genes, which stay
+ * resident), outside of any pass.
+ *
+ * @param stream The stream.
+ * @param genes The global indices of the rows.
+ * @param num_genes The number of rows.
+ * @param rows Output, num_genes rows of padded_features floats.
+ */
+void stream_read_rows(GeneStream* stream, const int* genes, int num_genes, float* rows) {
+    size_t floats = stream->row_bytes / sizeof(float);
+    for (int i = 0; i < num_genes; i++) {
+        read_exactly(stream->file, rows + i * floats, stream->row_bytes, stream->features_offset + (uint64_t)genes[i] * stream->row_bytes);
+    }
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Starts a pass over some blocks of a stream, the prefetch thread starts
+ * reading the first one right away.
+ *
+ * @param stream The stream.
+ * @param blocks The blocks to read in order, ascending for sequential reads (borrowed until stream_end).
+ * @param num_blocks The number of blocks.
+ */
+void stream_begin(GeneStream* stream, const int* blocks, int num_blocks) {
+    pthread_mutex_lock(&stream->lock);
+    stream->pass_blocks = blocks;
+    stream->pass_length = num_blocks;
+    stream->num_read = 0;
+    stream->num_taken = 0;
+    stream->stats.num_passes++;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    return (void)0;
+}
+
+
+//O(1), waits for the block to be read
+/**
+ * Hands out the next block of the current pass. The rows of the block before
+ * it are released, so they must no longer be used.
+ *
+ * @param stream The stream.
+ * @return The block's rows, padded_features floats each.
+ */
+const float* stream_next(GeneStream* stream) {
+    double start = omp_get_wtime();
+    pthread_mutex_lock(&stream->lock);
+    while (stream->num_read <= stream->num_taken) {
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+    const float* rows = stream->buffers[stream->num_taken % STREAM_BUFFERS];
+    stream->num_taken++;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    stream->stats.wait_seconds += omp_get_wtime() - start;
+    return rows;
+}
+
+
+//O(1), waits for a read in flight
+/**
+ * Ends the current pass, whether or not every block was taken.
+ *
+ * @param stream The stream.
+ */
+void stream_end(GeneStream* stream) {
+    pthread_mutex_lock(&stream->lock);
+    stream->pass_blocks = NULL;
+    while (stream->reading) {
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return (void)0;
+}
+
+
+/**
+ * Stops a stream's prefetch thread and frees the stream (the dataset stays).
+ *
+ * @param stream The stream to be freed.
+ */
+void stream_close(GeneStream* stream) {
+    pthread_mutex_lock(&stream->lock);
+    stream->quit = 1;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->thread, NULL);
+
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    close(stream->file);
+    for (int b = 0; b < STREAM_BUFFERS; b++) {
+        free(stream->buffers[b]);
+    }
+    free(stream);
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Reads a byte count from the environment, a number with an optional K, M or
+ * G suffix (powers of 1024). The run exits on anything else.
+ *
+ * @param name The variable.
+ * @param fallback The count when the variable is unset.
+ * @return The count.
+ */
+size_t stream_budget_from_env(const char* name, size_t fallback) {
+    const char* value = getenv(name);
+    if (value == NULL) {
+        return fallback;
+    }
+
+    char* end;
+    unsigned long long count = strtoull(value, &end, 10);
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+        default: break;
+    }
+    if (end == value || *end != '\0') {
+        fprintf(stderr, MEMORY_BUDGET_NAME_ERROR);
+        exit(1);
+    }
+    return (size_t)(count << shift);
+}
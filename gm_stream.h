@@ -0,0 +1,73 @@
+#ifndef GM_STREAM_H
+#define GM_STREAM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "gm_dataset.h"
+
+//out of core gene matrix. the dataset keeps its labels and class names but not its features, those
+//stay in the binary dataset file (see gm_binfile) and a pass reads them in large sequential blocks
+//of rows. a prefetch thread reads the next block while the caller works on the current one, so with
+//STREAM_BUFFERS buffers the disk and the distance kernels overlap. the blocks a pass asks for are
+//read once each, in file order, and dropped from the page cache after use
+
+//buffers a pass cycles through, one being worked on while the next one is read
+#define STREAM_BUFFERS 2
+//budget when GM_MEMORY_BUDGET is unset
+#define STREAM_DEFAULT_BUDGET (1ull << 30)
+
+//counts since the stream was opened
+typedef struct stream_stats_t {
+    long long num_passes;
+    long long num_blocks;
+    long long bytes_read;
+    //time the caller spent waiting for a block that wasn't read yet
+    double wait_seconds;
+} stream_stats_t;
+
+typedef struct GeneStream {
+    Dataset* dataset;
+    int file;
+    //where row 0 starts in the file and the bytes of a row (padded_features floats)
+    uint64_t features_offset;
+    size_t row_bytes;
+
+    //the most bytes the stream and what the caller keeps beside it (see stream_reserve) may hold
+    size_t budget;
+    //bytes the caller holds beside the buffers
+    size_t resident_bytes;
+    //rows per block, every buffer holds one block
+    int block_rows;
+    int num_blocks;
+    float* buffers[STREAM_BUFFERS];
+
+    //the blocks of the current pass in the order they are read, and how far the prefetch thread
+    //and the caller got (a buffer is free again once the caller asked for the block after it)
+    const int* pass_blocks;
+    int pass_length;
+    int num_read;
+    int num_taken;
+    //set while the prefetch thread reads a block without holding the lock
+    int reading;
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    stream_stats_t stats;
+} GeneStream;
+
+
+//GeneStream functions
+GeneStream* stream_open(Dataset* dataset, const char* source_name, size_t budget);
+void stream_reserve(GeneStream* stream, size_t resident_bytes);
+void stream_read_rows(GeneStream* stream, const int* genes, int num_genes, float* rows);
+void stream_begin(GeneStream* stream, const int* blocks, int num_blocks);
+const float* stream_next(GeneStream* stream);
+void stream_end(GeneStream* stream);
+void stream_close(GeneStream* stream);
+
+//a byte count from the environment (GM_MEMORY_BUDGET style, with an optional K, M or G suffix)
+size_t stream_budget_from_env(const char* name, size_t fallback);
+
+#endif
@@ -0,0 +1,289 @@
+#include "gm_telemetry.h"
+
+#ifdef GM_TELEMETRY
+
+#include "errors.h"
+
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* counter_names[TELEMETRY_NUM_COUNTERS] = {"distances", "bytes_parsed", "selections", "partitioned", "cache_hits", "cache_misses", "memo_hits", "memo_misses", "checkpoint_bytes"};
+static const char* timer_names[TELEMETRY_NUM_TIMERS] = {"load", "fill", "breed", "knn", "vote", "nth_element", "snapshot", "checkpoint"};
+static const char* event_names[TELEMETRY_NUM_EVENTS] = {"cycles", "instructions", "llc_misses"};
+
+_Thread_local telemetry_thread_t* telemetry_local = NULL;
+
+//every thread's block, newest first, they live until the process exits
+static telemetry_thread_t* threads = NULL;
+static int num_threads = 0;
+//-1 until the first registration reads GM_PERF
+static int perf_wanted = -1;
+static int perf_warned = 0;
+
+//where reports go, and what the blocks summed to at the last report
+static FILE* stream = NULL;
+static int report_rank = -1;
+static uint64_t last_report = 0;
+static telemetry_thread_t previous;
+
+
+//O(1)
+/**
+ * @return Nanoseconds of a monotonic clock.
+ */
+uint64_t telemetry_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+
+//O(1)
+//opens one hardware counter of the calling thread in group leader (-1 to start a group)
+static int perf_open(uint64_t config, int leader) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+
+//O(1)
+/**
+ * Allocates the calling thread's block and adds it to the ones reports sum,
+ * with its hardware counters when GM_PERF=1.
+ *
+ * @return The calling thread's block.
+ */
+telemetry_thread_t* telemetry_register() {
+    telemetry_thread_t* thread = (telemetry_thread_t*)aligned_alloc(64, sizeof(telemetry_thread_t));
+    if (thread == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    memset(thread, 0, sizeof(telemetry_thread_t));
+    for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+        thread->perf_fds[e] = -1;
+    }
+
+    #pragma omp critical(telemetry)
+    {
+        if (perf_wanted < 0) {
+            const char* setting = getenv("GM_PERF");
+            perf_wanted = setting != NULL && strcmp(setting, "0") != 0;
+        }
+        if (perf_wanted) {
+            //in telemetry_event_t order, the cache misses event is the last level's
+            static const uint64_t configs[TELEMETRY_NUM_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+            int opened = 1;
+            for (int e = 0; e < TELEMETRY_NUM_EVENTS && opened; e++) {
+                thread->perf_fds[e] = perf_open(configs[e], e > 0 ? thread->perf_fds[0] : -1);
+                opened = thread->perf_fds[e] >= 0;
+            }
+            if (!opened) {
+                for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+                    if (thread->perf_fds[e] >= 0) {
+                        close(thread->perf_fds[e]);
+                    }
+                    thread->perf_fds[e] = -1;
+                }
+                if (!perf_warned) {
+                    fprintf(stderr, PERF_OPEN_WARNING);
+                    perf_warned = 1;
+                }
+            }
+        }
+
+        thread->next = threads;
+        threads = thread;
+        num_threads++;
+    }
+
+    telemetry_local = thread;
+    return thread;
+}
+
+
+//O(1)
+/**
+ * Adds the time since a scope began to its timer (the cleanup of TELEMETRY_SCOPE).
+ *
+ * @param scope The scope that ends.
+ */
+void telemetry_scope_end(telemetry_scope_t* scope) {
+    telemetry_thread_t* thread = telemetry_thread();
+    thread->nanoseconds[scope->timer] += telemetry_now() - scope->start;
+    thread->calls[scope->timer]++;
+    return (void)0;
+}
+
+
+//O(1)
+//reads the calling thread's hardware counters, returns 0 when it has none
+static int perf_read(telemetry_thread_t* thread, uint64_t values[TELEMETRY_NUM_EVENTS]) {
+    uint64_t buffer[1 + TELEMETRY_NUM_EVENTS];
+    if (thread->perf_fds[0] < 0 || read(thread->perf_fds[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer)) {
+        return 0;
+    }
+    memcpy(values, buffer + 1, TELEMETRY_NUM_EVENTS * sizeof(uint64_t));
+    return 1;
+}
+
+
+//O(1)
+/**
+ * Opens a hardware counter scope (see TELEMETRY_PERF_SCOPE).
+ *
+ * @return The scope, not open when the thread has no counters.
+ */
+telemetry_perf_scope_t telemetry_perf_begin() {
+    telemetry_perf_scope_t scope;
+    scope.open = perf_read(telemetry_thread(), scope.start);
+    return scope;
+}
+
+
+//O(1)
+/**
+ * Adds the hardware events since a scope began to the calling thread (the
+ * cleanup of TELEMETRY_PERF_SCOPE).
+ *
+ * @param scope The scope that ends.
+ */
+void telemetry_perf_end(telemetry_perf_scope_t* scope) {
+    telemetry_thread_t* thread = telemetry_thread();
+    uint64_t end[TELEMETRY_NUM_EVENTS];
+    if (scope->open && perf_read(thread, end)) {
+        for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+            thread->events[e] += end[e] - scope->start[e];
+        }
+    }
+    return (void)0;
+}
+
+
+/**
+ * Picks where reports go: the file GM_TELEMETRY_FILE (with ".<rank>"
+ * appended for an MPI rank) or stderr.
+ *
+ * @param rank The MPI rank, -1 without MPI.
+ */
+void telemetry_open(int rank) {
+    report_rank = rank;
+    stream = stderr;
+    const char* file_name = getenv("GM_TELEMETRY_FILE");
+    if (file_name != NULL) {
+        char name[4096];
+        if (rank >= 0) {
+            snprintf(name, sizeof(name), "%s.%d", file_name, rank);
+        } else {
+            snprintf(name, sizeof(name), "%s", file_name);
+        }
+        stream = fopen(name, "w");
+        if (stream == NULL) {
+            fprintf(stderr, FILE_ERROR);
+            exit(1);
+        }
+    }
+    last_report = telemetry_now();
+    return (void)0;
+}
+
+
+//O(threads)
+/**
+ * Writes what every thread counted since the last report as one json line:
+ * the generation, the wall time, every timer (seconds and calls), every
+ * counter and, with GM_PERF=1, the hardware events and instructions per
+ * cycle (null when no thread could open them). Must be called outside parallel regions, the blocks are read
+ * without synchronization.
+ *
+ * @param generation The generation that just finished (0 for the setup).
+ */
+void telemetry_report(int generation) {
+    if (stream == NULL) {
+        telemetry_open(-1);
+    }
+
+    telemetry_thread_t total;
+    memset(&total, 0, sizeof(total));
+    int counted_events = 0;
+    for (telemetry_thread_t* thread = threads; thread != NULL; thread = thread->next) {
+        counted_events |= thread->perf_fds[0] >= 0;
+        for (int c = 0; c < TELEMETRY_NUM_COUNTERS; c++) {
+            total.counts[c] += thread->counts[c];
+        }
+        for (int t = 0; t < TELEMETRY_NUM_TIMERS; t++) {
+            total.nanoseconds[t] += thread->nanoseconds[t];
+            total.calls[t] += thread->calls[t];
+        }
+        for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+            total.events[e] += thread->events[e];
+        }
+    }
+
+    uint64_t now = telemetry_now();
+    fprintf(stream, "{\"generation\":%d", generation);
+    if (report_rank >= 0) {
+        fprintf(stream, ",\"rank\":%d", report_rank);
+    }
+    fprintf(stream, ",\"threads\":%d,\"wall_s\":%.6f,\"timers\":{", num_threads, (now - last_report) * 1e-9);
+    for (int t = 0; t < TELEMETRY_NUM_TIMERS; t++) {
+        fprintf(stream, "%s\"%s\":{\"s\":%.6f,\"calls\":%llu}", t > 0 ? "," : "", timer_names[t], (total.nanoseconds[t] - previous.nanoseconds[t]) * 1e-9, (unsigned long long)(total.calls[t] - previous.calls[t]));
+    }
+    fprintf(stream, "},\"counters\":{");
+    for (int c = 0; c < TELEMETRY_NUM_COUNTERS; c++) {
+        fprintf(stream, "%s\"%s\":%llu", c > 0 ? "," : "", counter_names[c], (unsigned long long)(total.counts[c] - previous.counts[c]));
+    }
+    fprintf(stream, "}");
+    if (perf_wanted > 0 && !counted_events) {
+        fprintf(stream, ",\"perf\":null");
+    } else if (perf_wanted > 0) {
+        uint64_t events[TELEMETRY_NUM_EVENTS];
+        fprintf(stream, ",\"perf\":{");
+        for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+            events[e] = total.events[e] - previous.events[e];
+            fprintf(stream, "%s\"%s\":%llu", e > 0 ? "," : "", event_names[e], (unsigned long long)events[e]);
+        }
+        fprintf(stream, ",\"ipc\":%.3f}", events[TELEMETRY_CYCLES] > 0 ? (double)events[TELEMETRY_INSTRUCTIONS] / events[TELEMETRY_CYCLES] : 0);
+    }
+    fprintf(stream, "}\n");
+    fflush(stream);
+
+    previous = total;
+    last_report = now;
+    return (void)0;
+}
+
+
+/**
+ * Closes the report stream and every thread's hardware counters. The blocks
+ * stay (other threads still point at theirs), so counting after this is
+ * harmless.
+ */
+void telemetry_close() {
+    if (stream != NULL && stream != stderr) {
+        fclose(stream);
+    }
+    stream = NULL;
+    for (telemetry_thread_t* thread = threads; thread != NULL; thread = thread->next) {
+        for (int e = 0; e < TELEMETRY_NUM_EVENTS; e++) {
+            if (thread->perf_fds[e] >= 0) {
+                close(thread->perf_fds[e]);
+            }
+            thread->perf_fds[e] = -1;
+        }
+    }
+    return (void)0;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef GM_TELEMETRY_H
+#define GM_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//hot path instrumentation, built only with -DGM_TELEMETRY (make TELEMETRY=1). every thread counts
+//into its own cache line aligned block with plain adds (no atomics, no sharing), scoped timers add
+//the nanoseconds of a block to the thread's timer when it leaves scope. telemetry_report sums the
+//blocks between two parallel regions and writes what changed since the last report as one json line.
+//GM_PERF=1 also opens cycles, instructions and last level cache miss counters (perf_event_open) on
+//every thread, read around the distance kernels. without GM_TELEMETRY every macro is empty
+
+//what is counted
+typedef enum telemetry_counter_t {
+    //squared distances computed by the kernels
+    TELEMETRY_DISTANCES,
+    //csv bytes parsed
+    TELEMETRY_BYTES_PARSED,
+    //parents selected
+    TELEMETRY_SELECTIONS,
+    //elements partitioned by nth_element
+    TELEMETRY_PARTITIONED,
+    //distance cache lookups that found the distance, and that didn't
+    TELEMETRY_CACHE_HITS,
+    TELEMETRY_CACHE_MISSES,
+    //fitness memo lookups that found the fitness, and that didn't
+    TELEMETRY_MEMO_HITS,
+    TELEMETRY_MEMO_MISSES,
+    //bytes of the checkpoints written
+    TELEMETRY_CHECKPOINT_BYTES,
+    TELEMETRY_NUM_COUNTERS
+} telemetry_counter_t;
+
+//what is timed
+typedef enum telemetry_timer_t {
+    //gene_fill
+    TELEMETRY_LOAD,
+    //creature_fill and ga_init drawing the first generation
+    TELEMETRY_FILL,
+    //breeding one child
+    TELEMETRY_BREED,
+    //KNN calls and the neighbor searches of one evaluator task (the distance kernels)
+    TELEMETRY_KNN,
+    //the label votes of one evaluator task
+    TELEMETRY_VOTE,
+    //nth_element
+    TELEMETRY_NTH_ELEMENT,
+    //copying the state for a checkpoint, on the generation loop
+    TELEMETRY_SNAPSHOT,
+    //encoding and writing a checkpoint on its writer thread, added by the generation loop once written
+    TELEMETRY_CHECKPOINT,
+    TELEMETRY_NUM_TIMERS
+} telemetry_timer_t;
+
+//hardware counters read around the distance kernels
+typedef enum telemetry_event_t {
+    TELEMETRY_CYCLES,
+    TELEMETRY_INSTRUCTIONS,
+    TELEMETRY_LLC_MISSES,
+    TELEMETRY_NUM_EVENTS
+} telemetry_event_t;
+
+#ifdef GM_TELEMETRY
+
+//one thread's counts, only ever written by its thread
+typedef struct telemetry_thread_t {
+    uint64_t counts[TELEMETRY_NUM_COUNTERS];
+    uint64_t nanoseconds[TELEMETRY_NUM_TIMERS];
+    uint64_t calls[TELEMETRY_NUM_TIMERS];
+    uint64_t events[TELEMETRY_NUM_EVENTS];
+    //the perf_event group (the leader first), -1 without GM_PERF
+    int perf_fds[TELEMETRY_NUM_EVENTS];
+    struct telemetry_thread_t* next;
+} __attribute__((aligned(64))) telemetry_thread_t;
+
+//an open timer scope
+typedef struct telemetry_scope_t {
+    telemetry_timer_t timer;
+    uint64_t start;
+} telemetry_scope_t;
+
+//an open hardware counter scope
+typedef struct telemetry_perf_scope_t {
+    uint64_t start[TELEMETRY_NUM_EVENTS];
+    int open;
+} telemetry_perf_scope_t;
+
+//the calling thread's block, NULL until its first count
+extern _Thread_local telemetry_thread_t* telemetry_local;
+
+
+//telemetry functions
+telemetry_thread_t* telemetry_register();
+uint64_t telemetry_now();
+void telemetry_scope_end(telemetry_scope_t* scope);
+telemetry_perf_scope_t telemetry_perf_begin();
+void telemetry_perf_end(telemetry_perf_scope_t* scope);
+void telemetry_open(int rank);
+void telemetry_report(int generation);
+void telemetry_close();
+
+
+//O(1)
+//the calling thread's block, registered on first use
+static inline telemetry_thread_t* telemetry_thread() {
+    telemetry_thread_t* thread = telemetry_local;
+    return thread != NULL ? thread : telemetry_register();
+}
+
+//O(1)
+static inline telemetry_scope_t telemetry_scope_begin(telemetry_timer_t timer) {
+    telemetry_scope_t scope = {timer, telemetry_now()};
+    return scope;
+}
+
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+
+//adds n to a counter of the calling thread
+#define TELEMETRY_COUNT(counter, n) (telemetry_thread()->counts[(counter)] += (uint64_t)(n))
+//adds ns nanoseconds over n calls, timed elsewhere (by a thread that can't count), to a timer
+#define TELEMETRY_TIME(timer, ns, n) (telemetry_thread()->nanoseconds[(timer)] += (uint64_t)(ns), telemetry_thread()->calls[(timer)] += (uint64_t)(n))
+//times the rest of the enclosing block
+#define TELEMETRY_SCOPE(timer) telemetry_scope_t TELEMETRY_CONCAT(telemetry_scope_, __LINE__) __attribute__((cleanup(telemetry_scope_end))) = telemetry_scope_begin(timer)
+//reads the hardware counters over the rest of the enclosing block (GM_PERF=1)
+#define TELEMETRY_PERF_SCOPE() telemetry_perf_scope_t TELEMETRY_CONCAT(telemetry_perf_, __LINE__) __attribute__((cleanup(telemetry_perf_end))) = telemetry_perf_begin()
+#define TELEMETRY_OPEN(rank) telemetry_open(rank)
+#define TELEMETRY_REPORT(generation) telemetry_report(generation)
+#define TELEMETRY_CLOSE() telemetry_close()
+
+#else
+
+#define TELEMETRY_COUNT(counter, n) ((void)0)
+#define TELEMETRY_TIME(timer, ns, n) ((void)0)
+#define TELEMETRY_SCOPE(timer) ((void)0)
+#define TELEMETRY_PERF_SCOPE() ((void)0)
+#define TELEMETRY_OPEN(rank) ((void)0)
+#define TELEMETRY_REPORT(generation) ((void)0)
+#define TELEMETRY_CLOSE() ((void)0)
+
+#endif
+
+#endif
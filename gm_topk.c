@@ -0,0 +1,155 @@
+#include "gm_topk.h"
+
+//streaming top k selection, candidates are consumed as they are produced and only the k best
+//are kept. small k use a sorted register sized buffer, bigger k a bounded max heap
+
+
+//O(TOPK_SMALL)
+/**
+ * Empties a small top k buffer.
+ *
+ * @param topk The buffer to initialize.
+ * @param k The number of neighbors to keep, 1 <= k <= TOPK_SMALL.
+ */
+void topk_small_init(topk_small_t* topk, int k) {
+    for (int i = 0; i < TOPK_SMALL; i++) {
+        topk->distance[i] = INFINITY;
+        topk->index[i] = -1;
+    }
+    topk->k = k;
+    return (void)0;
+}
+
+
+//O(k)
+/**
+ * Copies the k best of a small top k buffer out, ascending by distance.
+ *
+ * @param topk The buffer.
+ * @param out k entries, unfilled ones are (INFINITY, -1).
+ */
+void topk_small_sorted(const topk_small_t* topk, distance_intex_t* out) {
+    for (int i = 0; i < topk->k; i++) {
+        out[i].distance = topk->distance[i];
+        out[i].index = topk->index[i];
+    }
+    return (void)0;
+}
+
+
+//O(1)
+/**
+ * Empties a heap top k over caller owned storage.
+ *
+ * @param topk The heap to initialize.
+ * @param k The number of neighbors to keep.
+ * @param distance Storage for k distances.
+ * @param index Storage for k indices.
+ */
+void topk_heap_init(topk_heap_t* topk, int k, float* distance, int* index) {
+    topk->distance = distance;
+    topk->index = index;
+    topk->k = k;
+    topk->size = 0;
+    return (void)0;
+}
+
+
+//O(log k)
+/**
+ * Adds a candidate to a heap that is not full yet (sift up).
+ *
+ * @param topk The heap, size < k.
+ * @param distance The distance of the candidate.
+ * @param index The index of the candidate.
+ */
+void topk_heap_push_grow(topk_heap_t* topk, float distance, int index) {
+    int i = topk->size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (topk->distance[parent] >= distance) {
+            break;
+        }
+        topk->distance[i] = topk->distance[parent];
+        topk->index[i] = topk->index[parent];
+        i = parent;
+    }
+    topk->distance[i] = distance;
+    topk->index[i] = index;
+    return (void)0;
+}
+
+
+//O(log k)
+/**
+ * Replaces the worst of the k kept candidates (the root) and sifts down.
+ *
+ * @param topk The full heap.
+ * @param distance The distance of the candidate, smaller than the root.
+ * @param index The index of the candidate.
+ */
+void topk_heap_replace_top(topk_heap_t* topk, float distance, int index) {
+    int size = topk->size;
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= size) {
+            break;
+        }
+        //pick the larger child
+        if (child + 1 < size && topk->distance[child + 1] > topk->distance[child]) {
+            child++;
+        }
+        if (topk->distance[child] <= distance) {
+            break;
+        }
+        topk->distance[i] = topk->distance[child];
+        topk->index[i] = topk->index[child];
+        i = child;
+    }
+    topk->distance[i] = distance;
+    topk->index[i] = index;
+    return (void)0;
+}
+
+
+//O(k log k)
+/**
+ * Drains a heap into a list sorted ascending by distance (ties by index).
+ *
+ * The heap is empty afterwards.
+ *
+ * @param topk The heap.
+ * @param out k entries, unfilled ones are (INFINITY, -1).
+ */
+void topk_heap_sorted(topk_heap_t* topk, distance_intex_t* out) {
+    for (int i = topk->size; i < topk->k; i++) {
+        out[i].distance = INFINITY;
+        out[i].index = -1;
+    }
+
+    //pop the root (the largest) into the back of the filled part
+    while (topk->size > 0) {
+        int last = --topk->size;
+        out[last].distance = topk->distance[0];
+        out[last].index = topk->index[0];
+        if (last > 0) {
+            float distance = topk->distance[last];
+            int index = topk->index[last];
+            topk_heap_replace_top(topk, distance, index);
+        }
+    }
+
+    //equal distances come out of the heap in no particular order, order them by index
+    for (int i = 1; i < topk->k && out[i].index >= 0; i++) {
+        distance_intex_t entry = out[i];
+        int j = i;
+        while (j > 0 && out[j - 1].distance == entry.distance && out[j - 1].index > entry.index) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = entry;
+    }
+
+    return (void)0;
+}
@@ -0,0 +1,152 @@
+#ifndef GM_TOPK_H
+#define GM_TOPK_H
+
+#include <math.h>
+#include "gm_helper.h"
+
+//largest k handled by the fixed size sorted buffer, bigger k use the heap
+#define TOPK_SMALL 16
+
+//the k best (smallest) distances seen so far, kept sorted ascending in a fixed size buffer
+//slots past k are scratch, the struct is small enough for the compiler to keep a local copy in registers
+typedef struct topk_small_t {
+    float distance[TOPK_SMALL];
+    int index[TOPK_SMALL];
+    int k;
+} topk_small_t;
+
+//the k best distances seen so far as a bounded max heap (root is the current k-th best)
+//the storage is owned by the caller so a query costs O(k) memory
+typedef struct topk_heap_t {
+    float* distance;
+    int* index;
+    int k;
+    int size;
+} topk_heap_t;
+
+
+//a top k that uses the small buffer when k <= TOPK_SMALL and the heap otherwise
+typedef struct topk_t {
+    topk_small_t small;
+    topk_heap_t heap;
+    int k;
+} topk_t;
+
+
+//topk_small functions
+void topk_small_init(topk_small_t* topk, int k);
+void topk_small_sorted(const topk_small_t* topk, distance_intex_t* out);
+
+//topk_heap functions
+void topk_heap_init(topk_heap_t* topk, int k, float* distance, int* index);
+void topk_heap_replace_top(topk_heap_t* topk, float distance, int index);
+void topk_heap_push_grow(topk_heap_t* topk, float distance, int index);
+void topk_heap_sorted(topk_heap_t* topk, distance_intex_t* out);
+
+
+//O(1)
+/**
+ * @return The distance a candidate has to beat to enter the small top k.
+ */
+static inline float topk_small_threshold(const topk_small_t* topk) {
+    return topk->distance[topk->k - 1];
+}
+
+
+//O(TOPK_SMALL), branch free
+/**
+ * Offers a candidate to a small top k buffer.
+ *
+ * The insertion is a fixed width compare and shift over all TOPK_SMALL slots
+ * with no data dependent branches, so after inlining it vectorizes and a local
+ * copy of the buffer never leaves registers. Ties keep the earlier candidate.
+ *
+ * @param topk The buffer.
+ * @param distance The distance of the candidate.
+ * @param index The index of the candidate.
+ */
+static inline void topk_small_push(topk_small_t* topk, float distance, int index) {
+    float old_distance[TOPK_SMALL];
+    int old_index[TOPK_SMALL];
+    for (int i = 0; i < TOPK_SMALL; i++) {
+        old_distance[i] = topk->distance[i];
+        old_index[i] = topk->index[i];
+    }
+
+    //slot i takes the previous slot if the candidate lands before it, the candidate if it lands exactly here
+    topk->distance[0] = distance < old_distance[0] ? distance : old_distance[0];
+    topk->index[0] = distance < old_distance[0] ? index : old_index[0];
+    for (int i = 1; i < TOPK_SMALL; i++) {
+        int shift = distance < old_distance[i - 1];
+        int place = distance < old_distance[i];
+        topk->distance[i] = shift ? old_distance[i - 1] : (place ? distance : old_distance[i]);
+        topk->index[i] = shift ? old_index[i - 1] : (place ? index : old_index[i]);
+    }
+}
+
+
+//O(1) or O(log k)
+/**
+ * Offers a candidate to a heap top k, only the k best are kept.
+ *
+ * @param topk The heap.
+ * @param distance The distance of the candidate.
+ * @param index The index of the candidate.
+ */
+static inline void topk_heap_push(topk_heap_t* topk, float distance, int index) {
+    if (topk->size < topk->k) {
+        topk_heap_push_grow(topk, distance, index);
+    } else if (distance < topk->distance[0]) {
+        topk_heap_replace_top(topk, distance, index);
+    }
+}
+
+
+//O(TOPK_SMALL)
+/**
+ * Empties a top k, picking the small buffer or the heap from k.
+ *
+ * @param topk The top k to initialize.
+ * @param k The number of neighbors to keep.
+ * @param heap_distance Storage for k distances (only used when k > TOPK_SMALL).
+ * @param heap_index Storage for k indices (only used when k > TOPK_SMALL).
+ */
+static inline void topk_init(topk_t* topk, int k, float* heap_distance, int* heap_index) {
+    topk->k = k;
+    if (k <= TOPK_SMALL) {
+        topk_small_init(&topk->small, k);
+    } else {
+        topk_heap_init(&topk->heap, k, heap_distance, heap_index);
+    }
+}
+
+//O(TOPK_SMALL) or O(log k)
+static inline void topk_push(topk_t* topk, float distance, int index) {
+    if (topk->k <= TOPK_SMALL) {
+        if (distance < topk_small_threshold(&topk->small)) {
+            topk_small_push(&topk->small, distance, index);
+        }
+    } else {
+        topk_heap_push(&topk->heap, distance, index);
+    }
+}
+
+//O(1)
+//the distance a candidate has to beat to enter the top k, INFINITY until it holds k
+static inline float topk_threshold(const topk_t* topk) {
+    if (topk->k <= TOPK_SMALL) {
+        return topk_small_threshold(&topk->small);
+    }
+    return topk->heap.size < topk->heap.k ? INFINITY : topk->heap.distance[0];
+}
+
+//O(k log k)
+static inline void topk_sorted(topk_t* topk, distance_intex_t* out) {
+    if (topk->k <= TOPK_SMALL) {
+        topk_small_sorted(&topk->small, out);
+    } else {
+        topk_heap_sorted(&topk->heap, out);
+    }
+}
+
+#endif
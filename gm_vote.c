@@ -0,0 +1,87 @@
+#include "gm_vote.h"
+#include "errors.h"
+
+
+static const char* weighting_names[] = {"majority", "distance"};
+#define NUM_WEIGHTINGS ((int)(sizeof(weighting_names) / sizeof(weighting_names[0])))
+
+
+//O(1)
+/**
+ * Looks up a vote weighting by name.
+ *
+ * @param name The name (majority or distance).
+ * @param weighting Set to the weighting when the name is known.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int vote_weighting_from_name(const char* name, vote_weighting_t* weighting) {
+    for (int i = 0; i < NUM_WEIGHTINGS; i++) {
+        if (strcmp(name, weighting_names[i]) == 0) {
+            *weighting = (vote_weighting_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//O(classes) or O(k)
+/**
+ * Allocates an empty tally, dense for at most VOTE_DENSE_CLASSES classes and
+ * an open addressing table of at least 2k slots otherwise.
+ *
+ * @param vote The tally to initialize.
+ * @param num_classes The number of class ids.
+ * @param k The longest neighbor list it will count.
+ * @param weighting How the neighbors are weighed.
+ */
+void vote_init(vote_t* vote, int num_classes, int k, vote_weighting_t weighting) {
+    memset(vote, 0, sizeof(vote_t));
+    vote->weighting = weighting;
+    vote->num_classes = num_classes;
+    vote->k = k;
+
+    if (num_classes <= VOTE_DENSE_CLASSES) {
+        int size = num_classes > 0 ? num_classes : 1;
+        vote->counts = (int*)calloc(size, sizeof(int));
+        vote->weights = (float*)calloc(size, sizeof(float));
+        if (vote->counts == NULL || vote->weights == NULL) {
+            fprintf(stderr, MALLOC_ERROR);
+            exit(1);
+        }
+        return (void)0;
+    }
+
+    vote->table_size = 2;
+    while (vote->table_size < 2 * k) {
+        vote->table_size *= 2;
+    }
+    vote->keys = (int*)malloc(vote->table_size * sizeof(int));
+    vote->key_counts = (int*)calloc(vote->table_size, sizeof(int));
+    vote->key_weights = (float*)calloc(vote->table_size, sizeof(float));
+    if (vote->keys == NULL || vote->key_counts == NULL || vote->key_weights == NULL) {
+        fprintf(stderr, MALLOC_ERROR);
+        exit(1);
+    }
+    for (int s = 0; s < vote->table_size; s++) {
+        vote->keys[s] = -1;
+    }
+
+    return (void)0;
+}
+
+
+/**
+ * Frees the buffers of a tally.
+ *
+ * @param vote The tally to release.
+ */
+void vote_free(vote_t* vote) {
+    free(vote->counts);
+    free(vote->weights);
+    free(vote->keys);
+    free(vote->key_counts);
+    free(vote->key_weights);
+    memset(vote, 0, sizeof(vote_t));
+    return (void)0;
+}
@@ -0,0 +1,139 @@
+#ifndef GM_VOTE_H
+#define GM_VOTE_H
+
+//the label vote that ends every KNN classification. labels are dense class ids (the dataset interns
+//them at load time), so a vote is a few integer (or float) adds per neighbor into a tally owned by
+//the caller. few classes use a dense tally indexed by class id, many classes a small open addressing
+//table sized from k. a vote leaves its tally empty again by clearing only what it touched (the dense
+//slots of its neighbors, or the whole O(k) table), so it costs O(k) whatever the number of classes
+//and never allocates
+
+//up to this many classes the tally is dense
+#define VOTE_DENSE_CLASSES 1024
+//distance weighted votes weigh a neighbor 1 / (squared distance + VOTE_EPSILON)
+#define VOTE_EPSILON 1e-6f
+
+typedef enum vote_weighting_t {
+    //one vote per neighbor
+    VOTE_MAJORITY,
+    //nearer neighbors weigh more
+    VOTE_DISTANCE
+} vote_weighting_t;
+
+//the rest uses the neighbor lists, gm_helper.h pulls in gm_routine.h which needs the weighting
+#include "gm_helper.h"
+
+//one thread's tally
+typedef struct vote_t {
+    vote_weighting_t weighting;
+    int num_classes;
+    int k;
+    //dense: num_classes tallies, every one 0 between votes
+    int* counts;
+    float* weights;
+    //open addressing: table_size slots (a power of two >= 2k) of class id (-1 empty) and tally
+    int* keys;
+    int* key_counts;
+    float* key_weights;
+    int table_size;
+} vote_t;
+
+
+//vote_t functions
+void vote_init(vote_t* vote, int num_classes, int k, vote_weighting_t weighting);
+void vote_free(vote_t* vote);
+
+//weighting names (majority, distance)
+int vote_weighting_from_name(const char* name, vote_weighting_t* weighting);
+
+
+//O(1)
+//the table slot of a class, found by linear probing
+static inline int vote_slot(vote_t* vote, int label) {
+    int mask = vote->table_size - 1;
+    int slot = (int)(((unsigned int)label * 2654435761u) >> 16) & mask;
+    while (vote->keys[slot] != label && vote->keys[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    vote->keys[slot] = label;
+    return slot;
+}
+
+
+//O(k)
+/**
+ * Classifies a gene by the vote of its nearest neighbors.
+ *
+ * Every neighbor adds one (majority) or its weight (distance) to its class.
+ * Ties are broken deterministically: the class that reached the winning tally
+ * first wins, with the list sorted by ascending distance that is the class
+ * with the nearer neighbors.
+ *
+ * @param vote The calling thread's tally.
+ * @param labels The class id of every gene.
+ * @param list The nearest neighbors sorted by ascending distance (index -1 ends the list early).
+ * @param k The length of the list, at most the k the tally was made for.
+ * @return The predicted class id, -1 if the list is empty.
+ */
+static inline int vote_classify(vote_t* vote, const int* labels, const distance_intex_t* list, int k) {
+    int best = -1;
+    int length = 0;
+    while (length < k && list[length].index >= 0) {
+        length++;
+    }
+
+    if (vote->counts != NULL) {
+        if (vote->weighting == VOTE_MAJORITY) {
+            int* counts = vote->counts;
+            for (int j = 0; j < length; j++) {
+                int label = labels[list[j].index];
+                counts[label]++;
+                if (best < 0 || counts[label] > counts[best]) {
+                    best = label;
+                }
+            }
+            for (int j = 0; j < length; j++) {
+                counts[labels[list[j].index]] = 0;
+            }
+        } else {
+            float* weights = vote->weights;
+            for (int j = 0; j < length; j++) {
+                int label = labels[list[j].index];
+                weights[label] += (float)(1.0 / (list[j].distance + VOTE_EPSILON));
+                if (best < 0 || weights[label] > weights[best]) {
+                    best = label;
+                }
+            }
+            for (int j = 0; j < length; j++) {
+                weights[labels[list[j].index]] = 0;
+            }
+        }
+        return best;
+    }
+
+    int best_slot = -1;
+    for (int j = 0; j < length; j++) {
+        int label = labels[list[j].index];
+        int slot = vote_slot(vote, label);
+        int better;
+        if (vote->weighting == VOTE_MAJORITY) {
+            vote->key_counts[slot]++;
+            better = best_slot < 0 || vote->key_counts[slot] > vote->key_counts[best_slot];
+        } else {
+            vote->key_weights[slot] += (float)(1.0 / (list[j].distance + VOTE_EPSILON));
+            better = best_slot < 0 || vote->key_weights[slot] > vote->key_weights[best_slot];
+        }
+        if (better) {
+            best_slot = slot;
+            best = label;
+        }
+    }
+    for (int s = 0; s < vote->table_size; s++) {
+        vote->keys[s] = -1;
+        vote->key_counts[s] = 0;
+        vote->key_weights[s] = 0;
+    }
+    return best;
+}
+
+#endif
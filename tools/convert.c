@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../gm_loader.h"
+#include "../gm_binfile.h"
+
+//converts a csv dataset into the binary dataset file gene_fill maps on startup (see gm_binfile.h)
+//usage: convert.out file.csv [file.csv.gmb]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.csv [output]\n", argv[0]);
+        return 1;
+    }
+    char* output = argc > 2 ? strdup(argv[2]) : binfile_name(argv[1]);
+
+    Dataset* dataset = dataset_init();
+    double start = omp_get_wtime();
+    dataset_load_csv(dataset, argv[1], 0);
+    dataset_compute_norms(dataset);
+    double parse_seconds = omp_get_wtime() - start;
+
+    //the csv is only recorded as the source when the output sits where gene_fill looks for it
+    char* default_output = binfile_name(argv[1]);
+    const char* source = strcmp(output, default_output) == 0 ? argv[1] : NULL;
+    if (!binfile_write(dataset, output, source)) {
+        fprintf(stderr, "Failed to write %s\n", output);
+        return 1;
+    }
+    dataset_free(dataset);
+
+    //time the load the next run would do
+    dataset = dataset_init();
+    start = omp_get_wtime();
+    if (!binfile_load(dataset, output, source)) {
+        fprintf(stderr, "Failed to read back %s\n", output);
+        return 1;
+    }
+    double map_seconds = omp_get_wtime() - start;
+
+    printf("%s: %d genes, %d features, %d classes\n", output, dataset->num_genes, dataset->num_features, dataset->num_classes);
+    printf("csv parse %.4fs, binary map %.4fs\n", parse_seconds, map_seconds);
+
+    dataset_free(dataset);
+    free(default_output);
+    free(output);
+    return 0;
+}
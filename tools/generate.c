@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../gm_generate.h"
+
+//writes a synthetic csv dataset of gaussian class clusters (see gm_generate.h), row by row
+//usage: generate.out output.csv rows features classes [separation] [duplicate_rate] [seed]
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s output.csv rows features classes [separation] [duplicate_rate] [seed]\n", argv[0]);
+        return 1;
+    }
+    int num_rows = atoi(argv[2]);
+    int num_features = atoi(argv[3]);
+    int num_classes = atoi(argv[4]);
+    double separation = argc > 5 ? atof(argv[5]) : 2.0;
+    double duplicate_rate = argc > 6 ? atof(argv[6]) : 0.0;
+    uint64_t seed = argc > 7 ? strtoull(argv[7], NULL, 10) : 1;
+    if (num_rows <= 0 || num_features <= 0 || num_classes <= 0 || duplicate_rate < 0 || duplicate_rate >= 1) {
+        fprintf(stderr, "rows, features and classes must be positive and duplicate_rate in [0, 1)\n");
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    Generator* generator = generator_init(num_features, num_classes, separation, duplicate_rate, seed);
+    double* values = (double*)malloc(num_features * sizeof(double));
+    //a row is at most a label and num_features numbers of a few dozen characters
+    size_t line_capacity = 32 + (size_t)num_features * 32;
+    char* line = (char*)malloc(line_capacity);
+    if (values == NULL || line == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+
+    size_t length = (size_t)snprintf(line, line_capacity, "label");
+    for (int f = 0; f < num_features; f++) {
+        length += (size_t)snprintf(line + length, line_capacity - length, ",f%d", f);
+    }
+    fprintf(file, "%s\n", line);
+
+    long long num_duplicates = 0;
+    for (int row = 0; row < num_rows; row++) {
+        int source = generator_source(generator, row);
+        num_duplicates += source != row;
+        int label = generator_values(generator, source, values);
+
+        length = (size_t)snprintf(line, line_capacity, "class%d", label);
+        for (int f = 0; f < num_features; f++) {
+            length += (size_t)snprintf(line + length, line_capacity - length, ",%.5g", values[f]);
+        }
+        line[length++] = '\n';
+        fwrite(line, 1, length, file);
+    }
+
+    fclose(file);
+    printf("%s: %d rows (%lld duplicates), %d features, %d classes, separation %g, seed %llu\n", argv[1], num_rows, num_duplicates, num_features, num_classes, separation, (unsigned long long)seed);
+    generator_free(generator);
+    free(values);
+    free(line);
+    return 0;
+}